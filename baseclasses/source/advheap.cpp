@@ -0,0 +1,181 @@
+//------------------------------------------------------------------------------
+// File: AdvHeap.cpp
+//
+// Desc: DirectShow base classes - binary heap of advise packets used by
+//       CAMSchedule.
+//------------------------------------------------------------------------------
+
+
+#include "advheap.h"
+#include <stdlib.h>
+
+// Low cookie bits hold the slot index plus one, the rest the reuse count.
+// 32-bit cookies still allow a million outstanding advises.
+#define COOKIE_INDEX_BITS   (sizeof(uintptr_t) >= 8 ? 32 : 20)
+#define COOKIE_INDEX_MASK   ((((uintptr_t)1) << COOKIE_INDEX_BITS) - 1)
+#define MAX_SLOTS           ((uint32_t)COOKIE_INDEX_MASK - 1)
+#define NO_SLOT             0xFFFFFFFF
+#define INITIAL_SLOTS       16
+
+CAdviseHeap::CAdviseHeap()
+: m_pHeap(0), m_pPool(0)
+, m_cHeap(0), m_cCapacity(0), m_cUsed(0)
+, m_iFree(NO_SLOT), m_llAddOrder(0), m_llRepeatOrder(0)
+{
+}
+
+CAdviseHeap::~CAdviseHeap()
+{
+    free(m_pHeap);
+    free(m_pPool);
+}
+
+uintptr_t CAdviseHeap::Cookie( uint32_t iSlot ) const
+{
+    // Keep the reuse count within the cookie so it wraps instead of overflowing
+    const uintptr_t dwReuse = (uintptr_t)m_pPool[iSlot].dwReuse & (~(uintptr_t)0 >> COOKIE_INDEX_BITS);
+    return (dwReuse << COOKIE_INDEX_BITS) | (uintptr_t)(iSlot + 1);
+}
+
+bool CAdviseHeap::Grow()
+{
+    if (m_cCapacity >= MAX_SLOTS) return false;
+
+    uint32_t cNew = m_cCapacity ? m_cCapacity * 2 : INITIAL_SLOTS;
+    if (cNew > MAX_SLOTS || cNew < m_cCapacity) cNew = MAX_SLOTS;
+
+    ENTRY * pHeap = (ENTRY *) realloc(m_pHeap, cNew * sizeof(ENTRY));
+    if (!pHeap) return false;
+    m_pHeap = pHeap;
+
+    PACKET * pPool = (PACKET *) realloc(m_pPool, cNew * sizeof(PACKET));
+    if (!pPool) return false;
+    m_pPool = pPool;
+
+    m_cCapacity = cNew;
+    return true;
+}
+
+/* Heap maintenance, every move keeps the packet's back pointer current */
+
+void CAdviseHeap::Place( uint32_t iHeap, const ENTRY & e )
+{
+    m_pHeap[iHeap] = e;
+    m_pPool[e.iSlot].iHeap = iHeap;
+}
+
+void CAdviseHeap::SiftUp( uint32_t iHeap, ENTRY e )
+{
+    while (iHeap > 0)
+    {
+        const uint32_t iParent = (iHeap - 1) / 2;
+        if (!Before(e, m_pHeap[iParent])) break;
+        Place(iHeap, m_pHeap[iParent]);
+        iHeap = iParent;
+    }
+    Place(iHeap, e);
+}
+
+void CAdviseHeap::SiftDown( uint32_t iHeap, ENTRY e )
+{
+    for (;;)
+    {
+        uint32_t iChild = 2 * iHeap + 1;
+        if (iChild >= m_cHeap) break;
+        if (iChild + 1 < m_cHeap && Before(m_pHeap[iChild + 1], m_pHeap[iChild])) ++iChild;
+        if (!Before(m_pHeap[iChild], e)) break;
+        Place(iHeap, m_pHeap[iChild]);
+        iHeap = iChild;
+    }
+    Place(iHeap, e);
+}
+
+// Takes the entry out of the heap and returns its slot to the free list
+void CAdviseHeap::RemoveAt( uint32_t iHeap )
+{
+    const uint32_t iSlot = m_pHeap[iHeap].iSlot;
+
+    --m_cHeap;
+    if (iHeap < m_cHeap)
+    {
+        const ENTRY eLast = m_pHeap[m_cHeap];
+        if (iHeap > 0 && Before(eLast, m_pHeap[(iHeap - 1) / 2])) SiftUp(iHeap, eLast);
+        else SiftDown(iHeap, eLast);
+    }
+
+    PACKET & p = m_pPool[iSlot];
+    ++p.dwReuse;
+    p.bFree = true;
+    p.iHeap = m_iFree;
+    m_iFree = iSlot;
+}
+
+/* Public methods */
+
+uintptr_t CAdviseHeap::Add( int64_t rtTime, int64_t rtPeriod, void * hNotify, bool bPeriodic, bool * pbFirst )
+{
+    *pbFirst = false;
+
+    uint32_t iSlot;
+    if (m_iFree != NO_SLOT)
+    {
+        iSlot = m_iFree;
+        m_iFree = m_pPool[iSlot].iHeap;
+    }
+    else
+    {
+        if (m_cUsed == m_cCapacity && !Grow()) return 0;
+        iSlot = m_cUsed++;
+        m_pPool[iSlot].dwReuse = 0;
+    }
+
+    PACKET & p = m_pPool[iSlot];
+    p.rtPeriod = rtPeriod;
+    p.hNotify = hNotify;
+    p.bPeriodic = bPeriodic;
+    p.bFree = false;
+
+    ENTRY e;
+    e.rtTime = rtTime;
+    e.llOrder = --m_llAddOrder;
+    e.iSlot = iSlot;
+    SiftUp(m_cHeap++, e);
+
+    *pbFirst = (p.iHeap == 0);
+    return Cookie(iSlot);
+}
+
+bool CAdviseHeap::Remove( uintptr_t dwCookie )
+{
+    const uintptr_t dwIndex = dwCookie & COOKIE_INDEX_MASK;
+    if (dwIndex == 0 || dwIndex > m_cUsed) return false;
+
+    const uint32_t iSlot = (uint32_t)(dwIndex - 1);
+    if (m_pPool[iSlot].bFree || Cookie(iSlot) != dwCookie) return false;
+
+    RemoveAt(m_pPool[iSlot].iHeap);
+    return true;
+}
+
+bool CAdviseHeap::PopDue( int64_t rtNow, void ** phNotify, bool * pbPeriodic, uintptr_t * pdwCookie )
+{
+    if (!m_cHeap || m_pHeap[0].rtTime > rtNow) return false;
+
+    ENTRY e = m_pHeap[0];
+    PACKET & p = m_pPool[e.iSlot];
+    *phNotify = p.hNotify;
+    *pbPeriodic = p.bPeriodic;
+    *pdwCookie = Cookie(e.iSlot);
+
+    if (p.bPeriodic)
+    {
+        e.rtTime += p.rtPeriod;
+        e.llOrder = ++m_llRepeatOrder;
+        SiftDown(0, e);
+    }
+    else
+    {
+        RemoveAt(0);
+    }
+    return true;
+}
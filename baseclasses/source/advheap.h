@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// File: AdvHeap.h
+//
+// Desc: DirectShow base classes - binary heap of advise packets used by
+//       CAMSchedule.
+//------------------------------------------------------------------------------
+
+
+#ifndef __CAdviseHeap__
+#define __CAdviseHeap__
+
+#include <stdint.h>
+
+// Packets live in a pool that only grows, freed slots are reused, and the
+// heap orders small entries that carry the sort key next to the pool index,
+// so sifting never touches the packets themselves. Ties are ordered like
+// the old sorted list: a new advise goes in front of those already due at
+// the same time, a periodic one that fired goes behind them.
+//
+// A cookie is the pool index plus one in the low bits and the slot's reuse
+// count in the high bits, so Unadvise finds its packet directly and a stale
+// cookie for a slot that has since been reused doesn't match.
+//
+// Adding, firing and cancelling are O(log n). Nothing here is thread safe
+// or Windows specific: CAMSchedule does the locking and the notifying.
+
+class CAdviseHeap
+{
+public:
+    CAdviseHeap();
+    ~CAdviseHeap();
+
+    // Returns the cookie, 0 if out of memory. *pbFirst is set if the
+    // packet went to the front, so the wait time needs re-evaluating
+    uintptr_t Add( int64_t rtTime, int64_t rtPeriod, void * hNotify, bool bPeriodic, bool * pbFirst );
+
+    // Returns false if the cookie isn't (or is no longer) scheduled
+    bool Remove( uintptr_t dwCookie );
+
+    // Time of the first packet, or rtEmpty if there is none
+    int64_t NextTime( int64_t rtEmpty ) const
+    { return m_cHeap ? m_pHeap[0].rtTime : rtEmpty; }
+
+    // If the first packet is due at rtNow, hands out its handle and
+    // removes it, or for a periodic packet moves it on by one period.
+    // Returns false once nothing more is due
+    bool PopDue( int64_t rtNow, void ** phNotify, bool * pbPeriodic, uintptr_t * pdwCookie );
+
+    uint32_t Count() const { return m_cHeap; }
+
+private:
+    struct ENTRY
+    {
+        int64_t  rtTime;
+        int64_t  llOrder;       // Breaks ties, see above
+        uint32_t iSlot;
+    };
+
+    struct PACKET
+    {
+        int64_t  rtPeriod;
+        void *   hNotify;
+        uint32_t iHeap;         // Position in m_pHeap, or the next free slot
+        uint32_t dwReuse;       // Bumped whenever the slot is freed
+        bool     bPeriodic;
+        bool     bFree;
+    };
+
+    static bool Before( const ENTRY & a, const ENTRY & b )
+    { return a.rtTime < b.rtTime || (a.rtTime == b.rtTime && a.llOrder < b.llOrder); }
+
+    void Place( uint32_t iHeap, const ENTRY & e );
+    void SiftUp( uint32_t iHeap, ENTRY e );
+    void SiftDown( uint32_t iHeap, ENTRY e );
+    void RemoveAt( uint32_t iHeap );
+    uintptr_t Cookie( uint32_t iSlot ) const;
+    bool Grow();
+
+    ENTRY *   m_pHeap;
+    PACKET *  m_pPool;          // Same capacity as m_pHeap
+    uint32_t  m_cHeap;
+    uint32_t  m_cCapacity;
+    uint32_t  m_cUsed;          // Pool slots ever handed out
+    uint32_t  m_iFree;          // Head of the free slot list, NO_SLOT if empty
+    int64_t   m_llAddOrder;     // Counts down for new advises...
+    int64_t   m_llRepeatOrder;  // ...and up for periodic ones moved on
+};
+
+#endif // __CAdviseHeap__
@@ -4568,11 +4568,16 @@ CBaseAllocator::CBaseAllocator(__in_opt LPCTSTR pName,
     m_lWaiting(0),
     m_fEnableReleaseCallback(fEnableReleaseCallback),
     m_pNotify(NULL)
+#ifdef ALLOCATOR_LOCKFREE
+    , m_lGetting(0)
+#endif
 {
 #ifdef DXMPERF
     PERFLOG_CTOR( pName ? pName : L"CBaseAllocator", (IMemAllocator *) this );
 #endif // DXMPERF
 
+    CritSetName(this, "CBaseAllocator");
+
     if (bEvent) {
         m_hSem = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
         if (m_hSem == NULL) {
@@ -4601,11 +4606,16 @@ CBaseAllocator::CBaseAllocator(__in_opt LPCSTR pName,
     m_lWaiting(0),
     m_fEnableReleaseCallback(fEnableReleaseCallback),
     m_pNotify(NULL)
+#ifdef ALLOCATOR_LOCKFREE
+    , m_lGetting(0)
+#endif
 {
 #ifdef DXMPERF
     PERFLOG_CTOR( L"CBaseAllocator", (IMemAllocator *) this );
 #endif // DXMPERF
 
+    CritSetName(this, "CBaseAllocator");
+
     if (bEvent) {
         m_hSem = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
         if (m_hSem == NULL) {
@@ -4728,6 +4738,78 @@ CBaseAllocator::GetProperties(
 // on return, the time etc properties will be invalid, but the buffer
 // pointer and size will be correct.
 
+#ifdef ALLOCATOR_LOCKFREE
+
+// As below, but while there are free samples without the lock. See the
+// note on waiting for samples in amfilter.h
+
+HRESULT CBaseAllocator::GetBuffer(__deref_out IMediaSample **ppBuffer,
+                                  __in_opt REFERENCE_TIME *pStartTime,
+                                  __in_opt REFERENCE_TIME *pEndTime,
+                                  DWORD dwFlags
+                                  )
+{
+    UNREFERENCED_PARAMETER(pStartTime);
+    UNREFERENCED_PARAMETER(pEndTime);
+    CMediaSample *pSample;
+
+    *ppBuffer = NULL;
+    for (;;)
+    {
+        /* Decommit waits for us between checking we are committed and
+           taking the sample, so it can't free the samples under us */
+
+        InterlockedIncrement(&m_lGetting);
+        BOOL bCommitted = *(volatile BOOL *) &m_bCommitted;
+        pSample = bCommitted ? m_lFree.RemoveHead() : NULL;
+        InterlockedDecrement(&m_lGetting);
+
+        if (pSample) {
+            break;
+        }
+        if (!bCommitted) {
+            return VFW_E_NOT_COMMITTED;
+        }
+        if (dwFlags & AM_GBF_NOWAIT) {
+            return VFW_E_TIMEOUT;
+        }
+
+        {  // scope for lock
+            CAutoLock cObjectLock(this);
+
+            if (!m_bCommitted) {
+                return VFW_E_NOT_COMMITTED;
+            }
+
+            /* Counted as waiting before looking once more, a sample added
+               since is either found here or its adder wakes us */
+            SetWaiting();
+            pSample = (CMediaSample *) m_lFree.RemoveHead();
+            if (pSample != NULL) {
+                InterlockedDecrement(&m_lWaiting);
+            }
+        }
+
+        if (pSample) {
+            break;
+        }
+        ASSERT(m_hSem != NULL);
+        WaitForSingleObject(m_hSem, INFINITE);
+    }
+
+    ASSERT(pSample->m_cRef == 0);
+    pSample->m_cRef = 1;
+    *ppBuffer = pSample;
+
+#ifdef DXMPERF
+    PERFLOG_GETBUFFER( (IMemAllocator *) this, pSample );
+#endif // DXMPERF
+
+    return NOERROR;
+}
+
+#else
+
 HRESULT CBaseAllocator::GetBuffer(__deref_out IMediaSample **ppBuffer,
                                   __in_opt REFERENCE_TIME *pStartTime,
                                   __in_opt REFERENCE_TIME *pEndTime,
@@ -4784,6 +4866,55 @@ HRESULT CBaseAllocator::GetBuffer(__deref_out IMediaSample **ppBuffer,
     return NOERROR;
 }
 
+#endif // ALLOCATOR_LOCKFREE
+
+
+#ifdef ALLOCATOR_LOCKFREE
+
+STDMETHODIMP
+CBaseAllocator::ReleaseBuffer(IMediaSample * pSample)
+{
+    CheckPointer(pSample,E_POINTER);
+    ValidateReadPtr(pSample,sizeof(IMediaSample));
+
+#ifdef DXMPERF
+    PERFLOG_RELBUFFER( (IMemAllocator *) this, pSample );
+#endif // DXMPERF
+
+
+    BOOL bRelease = FALSE;
+
+    /* Put back on the free list, and only then look whether anyone waits
+       or a decommit is pending, see the note in amfilter.h */
+
+    m_lFree.Add((CMediaSample *)pSample);
+    if (*(volatile long *) &m_lWaiting != 0 ||
+        *(volatile BOOL *) &m_bDecommitInProgress) {
+
+        CAutoLock cal(this);
+        NotifySample();
+
+        LONG l1 = m_lFree.GetCount();
+        if (m_bDecommitInProgress && (l1 == m_lAllocated)) {
+            Free();
+            m_bDecommitInProgress = FALSE;
+            bRelease = TRUE;
+        }
+    }
+
+    if (m_pNotify) {
+
+        ASSERT(m_fEnableReleaseCallback);
+        m_pNotify->NotifyRelease();
+    }
+
+    if (bRelease) {
+        Release();
+    }
+    return NOERROR;
+}
+
+#else
 
 /* Final release of a CMediaSample will call this */
 
@@ -4840,6 +4971,8 @@ CBaseAllocator::ReleaseBuffer(IMediaSample * pSample)
     return NOERROR;
 }
 
+#endif // ALLOCATOR_LOCKFREE
+
 STDMETHODIMP
 CBaseAllocator::SetNotify(
     IMemAllocatorNotifyCallbackTemp* pNotify
@@ -4933,10 +5066,27 @@ CBaseAllocator::Decommit()
         /* No more GetBuffer calls will succeed */
         m_bCommitted = FALSE;
 
+#ifdef ALLOCATOR_LOCKFREE
+        // let those that still saw us committed take their sample
+        MemoryBarrier();
+        while (m_lGetting != 0) {
+            SwitchToThread();
+        }
+#endif
+
         // are any buffers outstanding?
         if (m_lFree.GetCount() < m_lAllocated) {
             // please complete the decommit when last buffer is freed
             m_bDecommitInProgress = TRUE;
+#ifdef ALLOCATOR_LOCKFREE
+            // unless it was added before its ReleaseBuffer could see that
+            MemoryBarrier();
+            if (m_lFree.GetCount() == m_lAllocated) {
+                m_bDecommitInProgress = FALSE;
+                Free();
+                bRelease = TRUE;
+            }
+#endif
         } else {
             m_bDecommitInProgress = FALSE;
 
@@ -4991,6 +5141,38 @@ CBaseAllocator::Alloc(void)
 /*  Implement CBaseAllocator::CSampleList::Remove(pSample)
     Removes pSample from the list
 */
+#ifdef ALLOCATOR_LOCKFREE
+
+// Only while nobody else uses the list: takes everything off and puts
+// back all but pSample, in the same order
+void
+CBaseAllocator::CSampleList::Remove(__inout CMediaSample * pSample)
+{
+    CMediaSample *pKeep = NULL;
+    CMediaSample *pNext;
+    BOOL bFound = FALSE;
+    while ((pNext = RemoveHead()) != NULL) {
+        if (pNext == pSample) {
+            bFound = TRUE;
+        } else {
+            CBaseAllocator::NextSample(pNext) = pKeep;
+            pKeep = pNext;
+        }
+    }
+    while (pKeep != NULL) {
+        pNext = CBaseAllocator::NextSample(pKeep);
+        Add(pKeep);
+        pKeep = pNext;
+    }
+    if (bFound) {
+        CBaseAllocator::NextSample(pSample) = NULL;
+    } else {
+        DbgBreak("Couldn't find sample in list");
+    }
+}
+
+#else
+
 void
 CBaseAllocator::CSampleList::Remove(__inout CMediaSample * pSample)
 {
@@ -5008,6 +5190,8 @@ CBaseAllocator::CSampleList::Remove(__inout CMediaSample * pSample)
     DbgBreak("Couldn't find sample in list");
 }
 
+#endif // ALLOCATOR_LOCKFREE
+
 //=====================================================================
 //=====================================================================
 // Implements CMemAllocator
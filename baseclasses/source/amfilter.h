@@ -1333,9 +1333,17 @@ public:
 // Derive from this class and override the Alloc and Free functions to
 // allocate your CMediaSample (or derived) objects and add them to the
 // free list, preparing them as necessary.
+//
+// Built with ALLOCATOR_LOCKFREE the free list is a lock-free stack and
+// GetBuffer and ReleaseBuffer only take the allocator's lock when someone
+// has to wait or be woken, or a decommit has to be completed.
 //=====================================================================
 //=====================================================================
 
+#ifdef ALLOCATOR_LOCKFREE
+#include <freelist.h>
+#endif
+
 class AM_NOVTABLE CBaseAllocator : public CUnknown,// A non delegating IUnknown
                        public IMemAllocatorCallbackTemp, // The interface we support
                        public CCritSec             // Provides object locking
@@ -1349,6 +1357,45 @@ class AM_NOVTABLE CBaseAllocator : public CUnknown,// A non delegating IUnknown
         return pSample->m_pNext;
     };
 
+#ifdef ALLOCATOR_LOCKFREE
+    struct CSampleLink
+    {
+        static CMediaSample * &Next(__in CMediaSample *pSample)
+        {
+            return CBaseAllocator::NextSample(pSample);
+        };
+    };
+
+    /*  The free list as a lock-free stack. Add and RemoveHead may be called
+        without the allocator's lock, Head, Next and Remove only while
+        nothing else uses the list, for example in Alloc and Free */
+    class CSampleList
+    {
+    public:
+#ifdef DEBUG
+        ~CSampleList()
+        {
+            ASSERT(m_Stack.GetCount() == 0);
+        };
+#endif
+        CMediaSample *Head() const { return m_Stack.Head(); };
+        CMediaSample *Next(__in CMediaSample *pSample) const { return CBaseAllocator::NextSample(pSample); };
+        int GetCount() const { return m_Stack.GetCount(); };
+        void Add(__inout CMediaSample *pSample)
+        {
+            ASSERT(pSample != NULL);
+            m_Stack.Push(pSample);
+        };
+        CMediaSample *RemoveHead()
+        {
+            return m_Stack.Pop();
+        };
+        void Remove(__inout CMediaSample *pSample);
+
+    private:
+        CLockFreeStack<CMediaSample, CSampleLink> m_Stack;
+    };
+#else
     /*  Mini list class for the free list */
     class CSampleList
     {
@@ -1385,6 +1432,7 @@ class AM_NOVTABLE CBaseAllocator : public CUnknown,// A non delegating IUnknown
         CMediaSample *m_List;
         int           m_nOnList;
     };
+#endif
 protected:
 
     CSampleList m_lFree;        // Free list
@@ -1423,6 +1471,15 @@ protected:
            But from (1) if m_lFree.GetCount() != 0 then m_lWaiting == 0 so
            from (2) Semaphore count == nWaiting (which is non-0) so the
            deadlock can't happen.
+
+        With ALLOCATOR_LOCKFREE samples are added without the lock, so (1)
+        only holds once the adder has looked at m_lWaiting: it adds, then
+        reads m_lWaiting and takes the lock to call NotifySample() if it
+        isn't 0. SetWaiting() is interlocked and a waiter tries the list
+        once more after it, still holding the lock, and takes itself off
+        m_lWaiting if that found a sample. One of the two always sees the
+        other, so a sample can't be added unseen while someone goes to
+        sleep.
     */
 
     HANDLE m_hSem;              // For signalling
@@ -1445,6 +1502,12 @@ protected:
 
     BOOL m_fEnableReleaseCallback;
 
+#ifdef ALLOCATOR_LOCKFREE
+    // GetBuffer calls between checking m_bCommitted and taking a sample
+    // without the lock, Decommit waits for them before counting free ones
+    volatile LONG m_lGetting;
+#endif
+
     // called to decommit the memory when the last buffer is freed
     // pure virtual - need to override this
     virtual void Free(void) PURE;
@@ -1511,7 +1574,11 @@ public:
     void NotifySample();
 
     // Notify that we're waiting for a sample
+#ifdef ALLOCATOR_LOCKFREE
+    void SetWaiting() { InterlockedIncrement(&m_lWaiting); };
+#else
     void SetWaiting() { m_lWaiting++; };
+#endif
 };
 
 
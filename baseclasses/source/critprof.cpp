@@ -0,0 +1,287 @@
+//------------------------------------------------------------------------------
+// File: CritProf.cpp
+//
+// Desc: DirectShow base classes - slim recursive lock with contention
+//       accounting, used by CCritSec when CRITSEC_PROFILE is defined.
+//------------------------------------------------------------------------------
+
+
+#include "critprof.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+/* Platform layer: thread ids, ticks and the raw lock */
+
+#ifdef _WIN32
+
+static uint32_t CurrentThread()
+{
+    return GetCurrentThreadId();
+}
+
+static int64_t Ticks()
+{
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return li.QuadPart;
+}
+
+static int64_t TicksPerSecond()
+{
+    LARGE_INTEGER li;
+    QueryPerformanceFrequency(&li);
+    return li.QuadPart;
+}
+
+typedef SRWLOCK RAWLOCK;
+#define RAWLOCK_INIT SRWLOCK_INIT
+
+static bool RawTryAcquire( RAWLOCK * p ) { return TryAcquireSRWLockExclusive(p) != 0; }
+static void RawAcquire( RAWLOCK * p ) { AcquireSRWLockExclusive(p); }
+static void RawRelease( RAWLOCK * p ) { ReleaseSRWLockExclusive(p); }
+
+#else
+
+static uint32_t CurrentThread()
+{
+#ifdef __linux__
+    static __thread uint32_t s_dwThread;
+    if (!s_dwThread) s_dwThread = (uint32_t)syscall(SYS_gettid);
+    return s_dwThread;
+#else
+    // Any non-zero number unique to the thread will do
+    static __thread char s_cThread;
+    return (uint32_t)(uintptr_t)&s_cThread | 1;
+#endif
+}
+
+static int64_t Ticks()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t TicksPerSecond()
+{
+    return 1000000000;
+}
+
+// Three state futex lock: 0 free, 1 held, 2 held and someone may sleep
+typedef volatile uint32_t RAWLOCK;
+#define RAWLOCK_INIT 0
+
+static uint32_t RawExchange( RAWLOCK * p, uint32_t v ) { return __atomic_exchange_n(p, v, __ATOMIC_ACQUIRE); }
+
+static bool RawTryAcquire( RAWLOCK * p )
+{
+    uint32_t dwExpected = 0;
+    return __atomic_compare_exchange_n(p, &dwExpected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static void RawAcquire( RAWLOCK * p )
+{
+    if (RawTryAcquire(p)) return;
+    while (RawExchange(p, 2) != 0)
+    {
+#ifdef __linux__
+        syscall(SYS_futex, (uint32_t *)p, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+#else
+        sched_yield();
+#endif
+    }
+}
+
+static void RawRelease( RAWLOCK * p )
+{
+    if (__atomic_exchange_n(p, 0, __ATOMIC_RELEASE) == 2)
+    {
+#ifdef __linux__
+        syscall(SYS_futex, (uint32_t *)p, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+    }
+}
+
+#endif
+
+static int64_t TicksToMicroseconds( int64_t llTicks )
+{
+    static const int64_t s_llFrequency = TicksPerSecond();
+    return (int64_t)((double)llTicks * 1000000.0 / s_llFrequency);
+}
+
+/* Named locks, a plain static so it works before any constructor ran */
+
+static RAWLOCK g_NamedLock = RAWLOCK_INIT;
+static CProfiledLock * g_pNamed = NULL;
+
+/* CProfiledLock */
+
+CProfiledLock::CProfiledLock()
+: m_currentOwner(0), m_lockCount(0)
+, m_llHoldStart(0)
+, m_pNext(NULL), m_pPrev(NULL)
+{
+#ifdef _WIN32
+    InitializeSRWLock(&m_Lock);
+#else
+    m_Lock = 0;
+#endif
+    memset(&m_Stats, 0, sizeof(m_Stats));
+    m_szName[0] = '\0';
+}
+
+CProfiledLock::~CProfiledLock()
+{
+    if (m_szName[0])
+    {
+        RawAcquire(&g_NamedLock);
+        if (m_pPrev) m_pPrev->m_pNext = m_pNext;
+        else g_pNamed = m_pNext;
+        if (m_pNext) m_pNext->m_pPrev = m_pPrev;
+        RawRelease(&g_NamedLock);
+    }
+}
+
+void CProfiledLock::Lock()
+{
+    const uint32_t dwSelf = CurrentThread();
+
+    // Only we can have set it to our own id
+    if (m_currentOwner == dwSelf)
+    {
+        ++m_lockCount;
+        return;
+    }
+
+    int64_t llWait = -1;
+    if (!RawTryAcquire(&m_Lock))
+    {
+        const int64_t llStart = Ticks();
+        RawAcquire(&m_Lock);
+        llWait = Ticks() - llStart;
+    }
+
+    m_currentOwner = dwSelf;
+    m_lockCount = 1;
+    m_llHoldStart = Ticks();
+
+    ++m_Stats.llAcquisitions;
+    if (llWait >= 0)
+    {
+        ++m_Stats.llContended;
+        m_Stats.llWaitTotal += llWait;
+        if (llWait > m_Stats.llWaitMax) m_Stats.llWaitMax = llWait;
+    }
+}
+
+void CProfiledLock::Unlock()
+{
+    if (--m_lockCount) return;
+
+    const int64_t llHold = Ticks() - m_llHoldStart;
+    m_Stats.llHoldTotal += llHold;
+    if (llHold > m_Stats.llHoldMax) m_Stats.llHoldMax = llHold;
+
+    m_currentOwner = 0;
+    RawRelease(&m_Lock);
+}
+
+void CProfiledLock::SetName( const char * pName )
+{
+    RawAcquire(&g_NamedLock);
+    const bool bListed = (m_szName[0] != '\0');
+    snprintf(m_szName, sizeof(m_szName), "%s", (pName && pName[0]) ? pName : "(unnamed)");
+    if (!bListed)
+    {
+        m_pPrev = NULL;
+        m_pNext = g_pNamed;
+        if (g_pNamed) g_pNamed->m_pPrev = this;
+        g_pNamed = this;
+    }
+    RawRelease(&g_NamedLock);
+}
+
+void CProfiledLock::GetStats( CRITPROF_STATS * pStats ) const
+{
+    pStats->llAcquisitions = m_Stats.llAcquisitions;
+    pStats->llContended = m_Stats.llContended;
+    pStats->llWaitTotal = TicksToMicroseconds(m_Stats.llWaitTotal);
+    pStats->llWaitMax = TicksToMicroseconds(m_Stats.llWaitMax);
+    pStats->llHoldTotal = TicksToMicroseconds(m_Stats.llHoldTotal);
+    pStats->llHoldMax = TicksToMicroseconds(m_Stats.llHoldMax);
+}
+
+// Only safe from the owner or while nobody uses the lock
+void CProfiledLock::ResetStats()
+{
+    memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+void CProfiledLock::Dump( CRITPROF_DUMP_CALLBACK pfnLine, void * pContext )
+{
+    // Copy the busiest locks out first: the lines are written without
+    // holding the list, and locks may be destroyed once we let go of it
+    struct ENTRY
+    {
+        const void *   pLock;
+        CRITPROF_STATS Stats;
+        char           szName[CRITPROF_NAME_LENGTH];
+    };
+    ENTRY Entries[CRITPROF_DUMP_MAX];
+    int cEntries = 0;
+    int cOmitted = 0;
+
+    RawAcquire(&g_NamedLock);
+    for (const CProfiledLock * p = g_pNamed; p; p = p->m_pNext)
+    {
+        CRITPROF_STATS Stats;
+        p->GetStats(&Stats);
+
+        // Insertion by total wait, the least waited on falls off the end
+        int i = cEntries;
+        while (i > 0 && Entries[i - 1].Stats.llWaitTotal < Stats.llWaitTotal) --i;
+        if (i == CRITPROF_DUMP_MAX)
+        {
+            ++cOmitted;
+            continue;
+        }
+        if (cEntries == CRITPROF_DUMP_MAX) ++cOmitted;
+        else ++cEntries;
+        memmove(&Entries[i + 1], &Entries[i], (cEntries - 1 - i) * sizeof(ENTRY));
+
+        Entries[i].pLock = p;
+        Entries[i].Stats = Stats;
+        memcpy(Entries[i].szName, p->m_szName, sizeof(Entries[i].szName));
+    }
+    RawRelease(&g_NamedLock);
+
+    char szLine[256];
+    for (int i = 0; i < cEntries; i++)
+    {
+        const CRITPROF_STATS & s = Entries[i].Stats;
+        snprintf(szLine, sizeof(szLine),
+            "%-32s %p: %lld locks, %lld contended (%.1f%%), wait %lld us (max %lld), hold max %lld us, mean %.1f us\n",
+            Entries[i].szName, Entries[i].pLock,
+            (long long)s.llAcquisitions, (long long)s.llContended,
+            s.llAcquisitions ? 100.0 * s.llContended / s.llAcquisitions : 0.0,
+            (long long)s.llWaitTotal, (long long)s.llWaitMax, (long long)s.llHoldMax,
+            s.llAcquisitions ? (double)s.llHoldTotal / s.llAcquisitions : 0.0);
+        pfnLine(pContext, szLine);
+    }
+    if (cOmitted)
+    {
+        snprintf(szLine, sizeof(szLine), "%d less contended locks not shown\n", cOmitted);
+        pfnLine(pContext, szLine);
+    }
+}
@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// File: CritProf.h
+//
+// Desc: DirectShow base classes - slim recursive lock with contention
+//       accounting, used by CCritSec when CRITSEC_PROFILE is defined.
+//------------------------------------------------------------------------------
+
+
+#ifndef __CRITPROF__
+#define __CRITPROF__
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// CProfiledLock replaces the CRITICAL_SECTION with an SRW lock (Windows)
+// or a futex word (Linux, other systems spin and yield) and keeps the
+// recursion CCritSec callers rely on by tracking the owning thread.
+//
+// Every outermost acquisition first tries the lock; if that fails it counts
+// as contended and the time until the lock is ours is the wait time. The
+// time from acquiring to the final release is the hold time. All counters
+// are updated while the lock is held, so they need no atomics of their own.
+//
+// Locks given a name are listed process wide and can be dumped at any time.
+// The dump reads the counters without taking the locks, so a line may mix
+// values from just before and just after an acquisition.
+//
+// Both the base classes and the filter must be built with CRITSEC_PROFILE,
+// it changes the layout of CCritSec.
+
+#define CRITPROF_NAME_LENGTH    48
+#define CRITPROF_DUMP_MAX       64      // Locks listed by Dump, the most waited on
+
+struct CRITPROF_STATS
+{
+    int64_t llAcquisitions;     // Outermost Lock calls, recursive ones aren't counted
+    int64_t llContended;        // Of those, ones that had to wait
+    int64_t llWaitTotal;        // In microseconds
+    int64_t llWaitMax;
+    int64_t llHoldTotal;
+    int64_t llHoldMax;
+};
+
+// Receives one formatted line per named lock
+typedef void (*CRITPROF_DUMP_CALLBACK)(void *pContext, const char *pLine);
+
+class CProfiledLock
+{
+public:
+    CProfiledLock();
+    ~CProfiledLock();
+
+    void Lock();
+    void Unlock();
+
+    // Names the lock and lists it for Dump, the name is copied
+    void SetName( const char * pName );
+    void GetStats( CRITPROF_STATS * pStats ) const;
+    void ResetStats();
+
+    // One line per named lock, most total wait first
+    static void Dump( CRITPROF_DUMP_CALLBACK pfnLine, void * pContext );
+
+    // Same names and meaning as the DEBUG build's CCritSec, so the
+    // CritCheckIn/CritCheckOut helpers work on either
+    volatile uint32_t m_currentOwner;   // Thread id, 0 if not owned
+    uint32_t          m_lockCount;      // Recursion depth, owner only
+
+private:
+    CProfiledLock( const CProfiledLock & );
+    CProfiledLock & operator=( const CProfiledLock & );
+
+#ifdef _WIN32
+    SRWLOCK           m_Lock;
+#else
+    volatile uint32_t m_Lock;           // 0 free, 1 held, 2 held with sleepers
+#endif
+    int64_t           m_llHoldStart;    // Ticks when the owner got it
+    CRITPROF_STATS    m_Stats;          // In ticks until GetStats converts them
+
+    char              m_szName[CRITPROF_NAME_LENGTH];
+    CProfiledLock *   m_pNext;          // Named locks list
+    CProfiledLock *   m_pPrev;
+};
+
+#endif // __CRITPROF__
@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// File: FreeList.h
+//
+// Desc: DirectShow base classes - lock-free stack of intrusively linked
+//       objects, used for the allocator's free list in ALLOCATOR_LOCKFREE
+//       builds.
+//------------------------------------------------------------------------------
+
+
+#ifndef __FREELIST__
+#define __FREELIST__
+
+#include <ringq.h>      // Atomics
+
+// A Treiber stack: the head pointer and a tag share one 64-bit word that
+// is swapped with a compare-exchange. Every successful swap bumps the tag,
+// so a pop that read the head, was preempted while the same object was
+// popped and pushed back, and then compares against it fails instead of
+// installing a stale next pointer (the ABA problem). 64-bit pointers keep
+// 48 bits (all user mode addresses on Windows, Linux and macOS fit) and
+// leave 16 bits of tag, 32-bit pointers leave 32.
+//
+// The count is kept apart from the head. A pop first reserves an object
+// by taking one off the count and only then unlinks one, and a push links
+// the object before adding it to the count, so the count never says more
+// objects are on the stack than really are: a count equal to the number
+// of objects there are means all of them are free, which is what the
+// allocator's decommit relies on.
+//
+// A pop may read the next pointer of an object another pop has just
+// taken, so the caller has to make sure no object is deleted while pops
+// may still be running. Link supplies the next pointer:
+//
+//      struct LINK { static T *&Next(T *p); };
+
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#define FREELIST_POINTER_BITS   48
+#else
+#define FREELIST_POINTER_BITS   32
+#endif
+#define FREELIST_POINTER_MASK   ((((uint64_t)1) << FREELIST_POINTER_BITS) - 1)
+
+template <class T, class Link> class CLockFreeStack {
+private:
+    volatile int64_t m_llHead;          // Tag above FREELIST_POINTER_BITS, pointer below
+    volatile int64_t m_llCount;         // Objects that can be reserved
+
+    static T *Pointer(int64_t llHead) {
+        return (T *)(uintptr_t)((uint64_t)llHead & FREELIST_POINTER_MASK);
+    }
+    static int64_t Pack(int64_t llOld, T *p) {
+        const uint64_t qwTag = ((uint64_t)llOld >> FREELIST_POINTER_BITS) + 1;
+        return (int64_t)((qwTag << FREELIST_POINTER_BITS) | ((uint64_t)(uintptr_t)p & FREELIST_POINTER_MASK));
+    }
+
+    // Takes one off the count unless it is 0
+    bool Reserve() {
+        int64_t llCount = RingLoadAcquire(&m_llCount);
+        while (llCount > 0) {
+            if (RingCompareExchange(&m_llCount, llCount, llCount - 1)) {
+                return true;
+            }
+            llCount = RingLoadAcquire(&m_llCount);
+        }
+        return false;
+    }
+
+    void AddCount(int64_t llAdd) {
+        int64_t llCount = RingLoadAcquire(&m_llCount);
+        while (!RingCompareExchange(&m_llCount, llCount, llCount + llAdd)) {
+            llCount = RingLoadAcquire(&m_llCount);
+        }
+    }
+
+    // make copy constructor and assignment operator inaccessible
+    CLockFreeStack(const CLockFreeStack &);
+    CLockFreeStack &operator=(const CLockFreeStack &);
+
+public:
+    CLockFreeStack() : m_llHead(0), m_llCount(0) {}
+
+    // Objects on the stack, may be low while pushes are completing
+    int GetCount() const {
+        return (int)RingLoadAcquire(const_cast<volatile int64_t *>(&m_llCount));
+    }
+
+    // Top of the stack, only meaningful while nobody pushes or pops
+    T *Head() const {
+        return Pointer(RingLoadAcquire(const_cast<volatile int64_t *>(&m_llHead)));
+    }
+
+    // A full barrier, as is a pop that finds an object
+    void Push(T *p) {
+        int64_t llHead = RingLoadAcquire(&m_llHead);
+        for (;;) {
+            Link::Next(p) = Pointer(llHead);
+            if (RingCompareExchange(&m_llHead, llHead, Pack(llHead, p))) {
+                break;
+            }
+            llHead = RingLoadAcquire(&m_llHead);
+        }
+        AddCount(1);
+    }
+
+    // NULL if the stack is empty
+    T *Pop() {
+        if (!Reserve()) {
+            return NULL;
+        }
+
+        // There is one for us, though another pop may unlink it first
+        int64_t llHead = RingLoadAcquire(&m_llHead);
+        for (;;) {
+            T *p = Pointer(llHead);
+            if (p != NULL) {
+                if (RingCompareExchange(&m_llHead, llHead, Pack(llHead, Link::Next(p)))) {
+                    return p;
+                }
+            }
+            else {
+                RingPause();            // Stale, our reservation means one is linked
+            }
+            llHead = RingLoadAcquire(&m_llHead);
+        }
+    }
+};
+
+#endif // __FREELIST__
@@ -84,6 +84,8 @@ CBaseReferenceClock::CBaseReferenceClock( __in_opt LPCTSTR pName,
     PERFLOG_CTOR( pName ? pName : L"CBaseReferenceClock", (IReferenceClock *) this );
 #endif // DXMPERF
 
+    CritSetName(this, "CBaseReferenceClock");
+
     ASSERT(m_pSchedule);
     if (!m_pSchedule)
     {
@@ -50,6 +50,10 @@ CBaseRenderer::CBaseRenderer(REFCLSID RenderClass, // CLSID for this renderer
     m_bInReceive(FALSE),
     m_EndOfStreamTimer(0)
 {
+    CritSetName(&m_InterfaceLock, "CBaseRenderer interface");
+    CritSetName(&m_RendererLock, "CBaseRenderer renderer");
+    CritSetName(&m_ObjectCreationLock, "CBaseRenderer object creation");
+
     if (SUCCEEDED(*phr)) {
         Ready();
 #ifdef PERF
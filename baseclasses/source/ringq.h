@@ -0,0 +1,249 @@
+//------------------------------------------------------------------------------
+// File: RingQ.h
+//
+// Desc: DirectShow base classes - lock-free bounded queue with the same
+//       interface and blocking behaviour as CQueue.
+//------------------------------------------------------------------------------
+
+
+#ifndef __RINGQ__
+#define __RINGQ__
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")     // WaitOnAddress, Windows 8 and later
+#else
+#include <sched.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#ifndef DEFAULT_QUEUESIZE
+#define DEFAULT_QUEUESIZE   2
+#endif
+
+// CQueue takes a semaphore, a critical section and releases the other
+// semaphore for every object, three kernel objects per put or get. Here
+// producers and consumers claim cells with one compare-exchange on a
+// position counter, and each cell carries a sequence number that says
+// whether it is ready to be written or read (a bounded MPMC ring as
+// described by Dmitry Vyukov). The put and get counters sit on separate
+// cache lines so producers and consumers don't false-share.
+//
+// Blocking calls spin for a while first (not on a single processor, where
+// the other side can't move while we spin), then sleep on a 32-bit epoch with
+// WaitOnAddress (Windows) or a futex (Linux) until the other side has
+// moved. Sleepers are counted, so as long as nobody sleeps the other side
+// only reads that count and never writes to this side's cache line or
+// makes a system call. Other systems yield instead of sleeping.
+//
+// T must be copyable; as with CQueue it is normally a pointer.
+
+#define RINGQ_CACHE_LINE    64
+#define RINGQ_SPIN          200     // Failed tries before sleeping
+
+// Atomics in the same spirit as the rest of the base classes: interlocked
+// calls on Windows (where volatile accesses are acquire/release), the
+// compiler builtins elsewhere
+#ifdef _WIN32
+
+#ifdef _WIN64
+inline int64_t RingLoadAcquire( volatile int64_t * p ) { return *p; }
+inline void RingStoreRelease( volatile int64_t * p, int64_t v ) { *p = v; }
+#else
+// 64-bit loads and stores aren't atomic on x86
+inline int64_t RingLoadAcquire( volatile int64_t * p ) { return InterlockedCompareExchange64((volatile LONG64 *)p, 0, 0); }
+inline void RingStoreRelease( volatile int64_t * p, int64_t v ) { InterlockedExchange64((volatile LONG64 *)p, v); }
+#endif
+inline bool RingCompareExchange( volatile int64_t * p, int64_t llExpected, int64_t llNew )
+{ return InterlockedCompareExchange64((volatile LONG64 *)p, llNew, llExpected) == llExpected; }
+inline uint32_t RingLoad32( volatile uint32_t * p ) { return *p; }
+inline uint32_t RingIncrement32( volatile uint32_t * p ) { return (uint32_t)InterlockedIncrement((volatile LONG *)p); }
+inline uint32_t RingDecrement32( volatile uint32_t * p ) { return (uint32_t)InterlockedDecrement((volatile LONG *)p); }
+inline void RingFence() { MemoryBarrier(); }
+inline void RingPause() { YieldProcessor(); }
+inline void RingYield() { SwitchToThread(); }
+inline int RingProcessors() { SYSTEM_INFO si; GetSystemInfo(&si); return (int)si.dwNumberOfProcessors; }
+
+inline void RingWait( volatile uint32_t * p, uint32_t dwExpected )
+{ WaitOnAddress(p, &dwExpected, sizeof(dwExpected), INFINITE); }
+inline void RingWakeOne( volatile uint32_t * p ) { WakeByAddressSingle((PVOID)p); }
+
+#else
+
+inline int64_t RingLoadAcquire( volatile int64_t * p ) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+inline void RingStoreRelease( volatile int64_t * p, int64_t v ) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+inline bool RingCompareExchange( volatile int64_t * p, int64_t llExpected, int64_t llNew )
+{ return __atomic_compare_exchange_n(p, &llExpected, llNew, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED); }
+inline uint32_t RingLoad32( volatile uint32_t * p ) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+inline uint32_t RingIncrement32( volatile uint32_t * p ) { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline uint32_t RingDecrement32( volatile uint32_t * p ) { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline void RingFence() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+#if defined(__i386__) || defined(__x86_64__)
+inline void RingPause() { __builtin_ia32_pause(); }
+#else
+inline void RingPause() {}
+#endif
+inline void RingYield() { sched_yield(); }
+inline int RingProcessors() { return (int)sysconf(_SC_NPROCESSORS_ONLN); }
+
+#ifdef __linux__
+inline void RingWait( volatile uint32_t * p, uint32_t dwExpected )
+{ syscall(SYS_futex, (uint32_t *)p, FUTEX_WAIT_PRIVATE, dwExpected, NULL, NULL, 0); }
+inline void RingWakeOne( volatile uint32_t * p )
+{ syscall(SYS_futex, (uint32_t *)p, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0); }
+#else
+inline void RingWait( volatile uint32_t * p, uint32_t dwExpected )
+{ if (RingLoad32(p) == dwExpected) RingYield(); }
+inline void RingWakeOne( volatile uint32_t * ) {}
+#endif
+
+#endif
+
+template <class T> class CRingQueue {
+private:
+    struct CELL {
+        volatile int64_t llSequence;    // Position it can be written at, or that plus one once written
+        T                Object;
+    };
+
+    // Sleepers on one side of the queue, woken when the other side moves
+    struct WAITERS {
+        volatile uint32_t dwEpoch;      // Bumped by moves of the other side while someone sleeps
+        volatile uint32_t cSleeping;
+    };
+
+    // Each on its own cache line
+    struct alignas(RINGQ_CACHE_LINE) POSITION {
+        volatile int64_t llPos;
+        WAITERS          Waiters;       // Waiting for this side's turn
+    };
+
+    POSITION        m_Put;              // Next position to write, producers waiting for room
+    POSITION        m_Get;              // Next position to read, consumers waiting for objects
+    CELL           *m_pCells;
+    int             m_nMax;
+
+    // make copy constructor and assignment operator inaccessible
+    CRingQueue(const CRingQueue &);
+    CRingQueue &operator=(const CRingQueue &);
+
+    void Initialize(int n) {
+        if (n < 1) n = 1;
+        m_nMax = n;
+        m_Put.llPos = m_Get.llPos = 0;
+        m_Put.Waiters.dwEpoch = m_Put.Waiters.cSleeping = 0;
+        m_Get.Waiters.dwEpoch = m_Get.Waiters.cSleeping = 0;
+        m_pCells = new CELL[n];
+        for (int i = 0; i < n; i++) m_pCells[i].llSequence = i;
+    }
+
+    // The fence orders the cell we just published before reading the count,
+    // a sleeper that registered too late to be seen will see the cell
+    static void Signal(WAITERS *pWaiters) {
+        RingFence();
+        if (RingLoad32(&pWaiters->cSleeping)) {
+            RingIncrement32(&pWaiters->dwEpoch);
+            RingWakeOne(&pWaiters->dwEpoch);
+        }
+    }
+
+    // Spins, then sleeps until the other side moved, always ends with a successful Try
+    template <class TRY> void Block(WAITERS *pWaiters, TRY Try) {
+        static const int s_nSpin = RingProcessors() > 1 ? RINGQ_SPIN : 0;
+        for (int i = 0; i < s_nSpin; i++) {
+            if (Try()) return;
+            RingPause();
+        }
+        for (;;) {
+            const uint32_t dwEpoch = RingLoad32(&pWaiters->dwEpoch);
+            RingIncrement32(&pWaiters->cSleeping);
+            if (Try()) {
+                RingDecrement32(&pWaiters->cSleeping);
+                return;
+            }
+            RingWait(&pWaiters->dwEpoch, dwEpoch);
+            RingDecrement32(&pWaiters->cSleeping);
+        }
+    }
+
+public:
+    CRingQueue(int n) {
+        Initialize(n);
+    }
+
+    CRingQueue() {
+        Initialize(DEFAULT_QUEUESIZE);
+    }
+
+    ~CRingQueue() {
+        delete [] m_pCells;
+    }
+
+    // Non-blocking, false if the queue is full
+    bool TryPutQueueObject(const T &Object) {
+        int64_t llPos = RingLoadAcquire(&m_Put.llPos);
+        for (;;) {
+            CELL *pCell = &m_pCells[llPos % m_nMax];
+            const int64_t llDiff = RingLoadAcquire(&pCell->llSequence) - llPos;
+            if (llDiff == 0) {
+                if (RingCompareExchange(&m_Put.llPos, llPos, llPos + 1)) {
+                    pCell->Object = Object;
+                    RingStoreRelease(&pCell->llSequence, llPos + 1);
+                    Signal(&m_Get.Waiters);
+                    return true;
+                }
+                llPos = RingLoadAcquire(&m_Put.llPos);
+            }
+            else if (llDiff < 0) {
+                return false;           // Not read yet a lap ago
+            }
+            else {
+                llPos = RingLoadAcquire(&m_Put.llPos);
+            }
+        }
+    }
+
+    // Non-blocking, false if the queue is empty
+    bool TryGetQueueObject(T *pObject) {
+        int64_t llPos = RingLoadAcquire(&m_Get.llPos);
+        for (;;) {
+            CELL *pCell = &m_pCells[llPos % m_nMax];
+            const int64_t llDiff = RingLoadAcquire(&pCell->llSequence) - (llPos + 1);
+            if (llDiff == 0) {
+                if (RingCompareExchange(&m_Get.llPos, llPos, llPos + 1)) {
+                    *pObject = pCell->Object;
+                    RingStoreRelease(&pCell->llSequence, llPos + m_nMax);
+                    Signal(&m_Put.Waiters);
+                    return true;
+                }
+                llPos = RingLoadAcquire(&m_Get.llPos);
+            }
+            else if (llDiff < 0) {
+                return false;           // Not written yet
+            }
+            else {
+                llPos = RingLoadAcquire(&m_Get.llPos);
+            }
+        }
+    }
+
+    // Blocks until there is an object, like CQueue
+    T GetQueueObject() {
+        T Object;
+        Block(&m_Get.Waiters, [&]() { return TryGetQueueObject(&Object); });
+        return Object;
+    }
+
+    // Blocks until there is room, like CQueue
+    void PutQueueObject(T Object) {
+        Block(&m_Put.Waiters, [&]() { return TryPutQueueObject(Object); });
+    }
+};
+
+#endif // __RINGQ__
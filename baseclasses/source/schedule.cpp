@@ -19,44 +19,23 @@
 
 CAMSchedule::CAMSchedule( HANDLE ev )
 : CBaseObject(TEXT("CAMSchedule"))
-, head(&z, 0), z(0, MAX_TIME)
-, m_dwNextCookie(0), m_dwAdviseCount(0)
-, m_pAdviseCache(0), m_dwCacheCount(0)
+, m_dwAdviseCount(0)
 , m_ev( ev )
 {
-    head.m_dwAdviseCookie = z.m_dwAdviseCookie = 0;
+    CritSetName(&m_Serialize, "CAMSchedule");
 }
 
 CAMSchedule::~CAMSchedule()
 {
     m_Serialize.Lock();
 
-    // Delete cache
-    CAdvisePacket * p = m_pAdviseCache;
-    while (p)
-    {
-        CAdvisePacket *const p_next = p->m_next;
-        delete p;
-        p = p_next;
-    }
-
     ASSERT( m_dwAdviseCount == 0 );
-    // Better to be safe than sorry
+    // Better to be safe than sorry, the heap frees any left over packets
     if ( m_dwAdviseCount > 0 )
     {
         DumpLinkedList();
-        while ( !head.m_next->IsZ() )
-        {
-            head.DeleteNext();
-            --m_dwAdviseCount;
-        }
     }
 
-    // If, in the debug version, we assert twice, it means, not only
-    // did we have left over advises, but we have also let m_dwAdviseCount
-    // get out of sync. with the number of advises actually on the list.
-    ASSERT( m_dwAdviseCount == 0 );
-
     m_Serialize.Unlock();
 }
 
@@ -70,8 +49,8 @@ DWORD CAMSchedule::GetAdviseCount()
 
 REFERENCE_TIME CAMSchedule::GetNextAdviseTime()
 {
-    CAutoLock lck(&m_Serialize); // Need to stop the linked list from changing
-    return head.m_next->m_rtEventTime;
+    CAutoLock lck(&m_Serialize); // Need to stop the heap from changing
+    return m_Heap.NextTime( MAX_TIME );
 }
 
 DWORD_PTR CAMSchedule::AddAdvisePacket
@@ -80,70 +59,49 @@ DWORD_PTR CAMSchedule::AddAdvisePacket
 , HANDLE h, BOOL periodic
 )
 {
-    // Since we use MAX_TIME as a sentry, we can't afford to
+    // MAX_TIME means "nothing scheduled", so we can't afford to
     // schedule a notification at MAX_TIME
-    ASSERT( time1 < MAX_TIME );
-    DWORD_PTR Result;
-    CAdvisePacket * p;
+    ASSERT( time1 >= 0 && time1 < MAX_TIME );
+    BOOL bFirst;
 
     m_Serialize.Lock();
 
-    if (m_pAdviseCache)
+    bool bAtFront;
+    const DWORD_PTR Result = m_Heap.Add( time1, time2, h, periodic != FALSE, &bAtFront );
+    if (Result)
     {
-        p = m_pAdviseCache;
-        m_pAdviseCache = p->m_next;
-        --m_dwCacheCount;
+        m_dwAdviseCount = m_Heap.Count();
+        DbgLog((LOG_TIMING, 2, TEXT("Added advise %lu, for thread 0x%02X, scheduled at %lu"),
+            Result, GetCurrentThreadId(), (time1 / (UNITS / MILLISECONDS)) ));
     }
-    else
-    {
-        p = new CAdvisePacket();
-    }
-    if (p)
-    {
-        p->m_rtEventTime = time1; p->m_rtPeriod = time2;
-        p->m_hNotify = h; p->m_bPeriodic = periodic;
-        Result = AddAdvisePacket( p );
-    }
-    else Result = 0;
+    bFirst = Result && bAtFront;
 
     m_Serialize.Unlock();
 
+    // If packet added at the head, then clock needs to re-evaluate wait time.
+    if ( bFirst ) SetEvent( m_ev );
+
     return Result;
 }
 
 HRESULT CAMSchedule::Unadvise(DWORD_PTR dwAdviseCookie)
 {
     HRESULT hr = S_FALSE;
-    CAdvisePacket * p_prev = &head;
-    CAdvisePacket * p_n;
     m_Serialize.Lock();
-    while ( p_n = p_prev->Next() ) // The Next() method returns NULL when it hits z
+    if ( m_Heap.Remove( dwAdviseCookie ) )
     {
-        if ( p_n->m_dwAdviseCookie == dwAdviseCookie )
-        {
-            Delete( p_prev->RemoveNext() );
-            --m_dwAdviseCount;
-            hr = S_OK;
-	    // Having found one cookie that matches, there should be no more
-            #ifdef DEBUG
-	       while (p_n = p_prev->Next())
-               {
-                   ASSERT(p_n->m_dwAdviseCookie != dwAdviseCookie);
-                   p_prev = p_n;
-               }
-            #endif
-            break;
-        }
-        p_prev = p_n;
-    };
+        m_dwAdviseCount = m_Heap.Count();
+        hr = S_OK;
+    }
     m_Serialize.Unlock();
     return hr;
 }
 
 REFERENCE_TIME CAMSchedule::Advise( const REFERENCE_TIME & rtTime )
 {
-    REFERENCE_TIME  rtNextTime;
-    CAdvisePacket * pAdvise;
+    void *    hNotify;
+    bool      bPeriodic;
+    uintptr_t dwCookie;
 
     DbgLog((LOG_TIMING, 2,
         TEXT("CAMSchedule::Advise( %lu ms )"), ULONG(rtTime / (UNITS / MILLISECONDS))));
@@ -154,131 +112,40 @@ REFERENCE_TIME CAMSchedule::Advise( const REFERENCE_TIME & rtTime )
         if (DbgCheckModuleLevel(LOG_TIMING, 4)) DumpLinkedList();
     #endif
 
-    //  Note - DON'T cache the difference, it might overflow 
-    while ( rtTime >= (rtNextTime = (pAdvise=head.m_next)->m_rtEventTime) &&
-            !pAdvise->IsZ() )
+    // Periodic packets are moved on by one period and stay in the heap
+    while ( m_Heap.PopDue( rtTime, &hNotify, &bPeriodic, &dwCookie ) )
     {
-        ASSERT(pAdvise->m_dwAdviseCookie); // If this is zero, its the head or the tail!!
+        ASSERT(hNotify != INVALID_HANDLE_VALUE);
 
-        ASSERT(pAdvise->m_hNotify != INVALID_HANDLE_VALUE);
-
-        if (pAdvise->m_bPeriodic == TRUE)
+        if (bPeriodic)
         {
-            ReleaseSemaphore(pAdvise->m_hNotify,1,NULL);
-            pAdvise->m_rtEventTime += pAdvise->m_rtPeriod;
-            ShuntHead();
+            ReleaseSemaphore(hNotify,1,NULL);
+            DbgLog((LOG_TIMING, 2, TEXT("Periodic advise %lu, shunted to %lu"),
+                dwCookie, (m_Heap.NextTime( MAX_TIME ) / (UNITS / MILLISECONDS)) ));
         }
         else
         {
-            ASSERT( pAdvise->m_bPeriodic == FALSE );
-            EXECUTE_ASSERT(SetEvent(pAdvise->m_hNotify));
-            --m_dwAdviseCount;
-            Delete( head.RemoveNext() );
+            EXECUTE_ASSERT(SetEvent(hNotify));
         }
-
     }
+    m_dwAdviseCount = m_Heap.Count();
+
+    const REFERENCE_TIME rtNextTime = m_Heap.NextTime( MAX_TIME );
 
     DbgLog((LOG_TIMING, 3,
-            TEXT("CAMSchedule::Advise() Next time stamp: %lu ms, for advise %lu."),
-            DWORD(rtNextTime / (UNITS / MILLISECONDS)), pAdvise->m_dwAdviseCookie ));
+            TEXT("CAMSchedule::Advise() Next time stamp: %lu ms."),
+            DWORD(rtNextTime / (UNITS / MILLISECONDS)) ));
 
     return rtNextTime;
 }
 
-/* Private methods */
-
-DWORD_PTR CAMSchedule::AddAdvisePacket( __inout CAdvisePacket * pPacket )
-{
-    ASSERT(pPacket->m_rtEventTime >= 0 && pPacket->m_rtEventTime < MAX_TIME);
-    ASSERT(CritCheckIn(&m_Serialize));
-
-    CAdvisePacket * p_prev = &head;
-    CAdvisePacket * p_n;
-
-    const DWORD_PTR Result = pPacket->m_dwAdviseCookie = ++m_dwNextCookie;
-    // This relies on the fact that z is a sentry with a maximal m_rtEventTime
-    for(;;p_prev = p_n)
-    {
-        p_n = p_prev->m_next;
-        if ( p_n->m_rtEventTime >= pPacket->m_rtEventTime ) break;
-    }
-    p_prev->InsertAfter( pPacket );
-    ++m_dwAdviseCount;
-
-    DbgLog((LOG_TIMING, 2, TEXT("Added advise %lu, for thread 0x%02X, scheduled at %lu"),
-    	pPacket->m_dwAdviseCookie, GetCurrentThreadId(), (pPacket->m_rtEventTime / (UNITS / MILLISECONDS)) ));
-
-    // If packet added at the head, then clock needs to re-evaluate wait time.
-    if ( p_prev == &head ) SetEvent( m_ev );
-
-    return Result;
-}
-
-void CAMSchedule::Delete( __inout CAdvisePacket * pPacket )
-{
-    if ( m_dwCacheCount >= dwCacheMax ) delete pPacket;
-    else
-    {
-        m_Serialize.Lock();
-        pPacket->m_next = m_pAdviseCache;
-        m_pAdviseCache = pPacket;
-        ++m_dwCacheCount;
-        m_Serialize.Unlock();
-    }
-}
-
-
-// Takes the head of the list & repositions it
-void CAMSchedule::ShuntHead()
-{
-    CAdvisePacket * p_prev = &head;
-    CAdvisePacket * p_n;
-
-    m_Serialize.Lock();
-    CAdvisePacket *const pPacket = head.m_next;
-
-    // This will catch both an empty list,
-    // and if somehow a MAX_TIME time gets into the list
-    // (which would also break this method).
-    ASSERT( pPacket->m_rtEventTime < MAX_TIME );
-
-    // This relies on the fact that z is a sentry with a maximal m_rtEventTime
-    for(;;p_prev = p_n)
-    {
-        p_n = p_prev->m_next;
-        if ( p_n->m_rtEventTime > pPacket->m_rtEventTime ) break;
-    }
-    // If p_prev == pPacket then we're already in the right place
-    if (p_prev != pPacket)
-    {
-        head.m_next = pPacket->m_next;
-        (p_prev->m_next = pPacket)->m_next = p_n;
-    }
-    #ifdef DEBUG
-        DbgLog((LOG_TIMING, 2, TEXT("Periodic advise %lu, shunted to %lu"),
-    	    pPacket->m_dwAdviseCookie, (pPacket->m_rtEventTime / (UNITS / MILLISECONDS)) ));
-    #endif
-    m_Serialize.Unlock();
-}
-
 
 #ifdef DEBUG
 void CAMSchedule::DumpLinkedList()
 {
     m_Serialize.Lock();
-    int i=0;
-    DbgLog((LOG_TIMING, 1, TEXT("CAMSchedule::DumpLinkedList() this = 0x%p"), this));
-    for ( CAdvisePacket * p = &head
-        ; p
-        ; p = p->m_next         , i++
-        )	
-    {
-        DbgLog((LOG_TIMING, 1, TEXT("Advise List # %lu, Cookie %d,  RefTime %lu"),
-            i,
-	    p->m_dwAdviseCookie,
-	    p->m_rtEventTime / (UNITS / MILLISECONDS)
-            ));
-    }
+    DbgLog((LOG_TIMING, 1, TEXT("CAMSchedule::DumpLinkedList() this = 0x%p, %lu advises, next at %lu"),
+        this, m_Heap.Count(), DWORD(m_Heap.NextTime( MAX_TIME ) / (UNITS / MILLISECONDS)) ));
     m_Serialize.Unlock();
 }
 #endif
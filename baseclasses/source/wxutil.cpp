@@ -463,12 +463,14 @@ HRESULT AMSafeMemMoveOffset(
 *
 * We provide debug versions of the Constructor, destructor, Lock and Unlock
 * routines.  The debug code tracks who owns each critical section by
-* maintaining a depth count.
+* maintaining a depth count. The profiling lock tracks its owner anyway.
 *
 * History:
 *
 \**************************************************************************/
 
+#ifndef CRITSEC_PROFILE
+
 CCritSec::CCritSec()
 {
     InitializeCriticalSection(&m_CritSec);
@@ -520,6 +522,8 @@ void CCritSec::Unlock() {
     LeaveCriticalSection(&m_CritSec);
 }
 
+#endif // CRITSEC_PROFILE
+
 void WINAPI DbgLockTrace(CCritSec * pcCrit, BOOL fTrace)
 {
     pcCrit->m_fTrace = fTrace;
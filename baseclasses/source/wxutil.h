@@ -14,6 +14,30 @@
 // eliminate spurious "statement has no effect" warnings.
 #pragma warning(disable: 4705)
 
+#ifdef CRITSEC_PROFILE
+
+#include <critprof.h>
+
+// profiling builds use a slim lock that counts contention, see critprof.h
+class CCritSec : public CProfiledLock {
+
+    // make copy constructor and assignment operator inaccessible
+
+    CCritSec(const CCritSec &refCritSec);
+    CCritSec &operator=(const CCritSec &refCritSec);
+
+public:
+#ifdef DEBUG
+    BOOL    m_fTrace;        // Only kept for DbgLockTrace
+
+    CCritSec() : m_fTrace(FALSE) {};
+#else
+    CCritSec() {};
+#endif
+};
+
+#else
+
 // wrapper for whatever critical section we have
 class CCritSec {
 
@@ -55,6 +79,8 @@ public:
 #endif
 };
 
+#endif // CRITSEC_PROFILE
+
 //
 // To make deadlocks easier to track it is useful to insert in the
 // code an assertion that says whether we own a critical section or
@@ -77,6 +103,17 @@ public:
     #define DbgLockTrace(pc, fT)
 #endif
 
+// Names a lock for the contention dump, and writes the dump line by line
+// to a CRITPROF_DUMP_CALLBACK. Both do nothing unless CRITSEC_PROFILE is
+// defined.
+#ifdef CRITSEC_PROFILE
+    #define CritSetName(pc, name) (pc)->SetName(name)
+    #define CritDumpStats(pfn, pContext) CProfiledLock::Dump(pfn, pContext)
+#else
+    #define CritSetName(pc, name)
+    #define CritDumpStats(pfn, pContext)
+#endif
+
 
 // locks a critical section, and unlocks it automatically
 // when the lock goes out of scope
@@ -337,6 +374,10 @@ public:
     }
 };
 
+// CRingQueue in ringq.h is a drop-in alternative without kernel objects
+// in the uncontended case, which also offers non-blocking Try calls.
+// Include ringq.h where it is used, it links Synchronization.lib
+
 // Ensures that memory is not read past the length source buffer
 // and that memory is not written past the length of the dst buffer
 //   dst - buffer to copy to
@@ -0,0 +1,339 @@
+#include "capture.h"
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static inline uint64_t AlignUp (uint64_t qw, uint64_t qwAlign) {
+	return (qw + qwAlign - 1) & ~(qwAlign - 1);
+}
+
+//######################################
+// GetCaptureClock
+//######################################
+uint64_t GetCaptureClock () {
+#ifdef _WIN32
+	static LONGLONG s_llFrequency = 0;
+	LARGE_INTEGER li;
+	if (s_llFrequency == 0) {
+		QueryPerformanceFrequency(&li);
+		s_llFrequency = li.QuadPart;
+	}
+	QueryPerformanceCounter(&li);
+	return (uint64_t)(li.QuadPart / s_llFrequency * 1000000 + li.QuadPart % s_llFrequency * 1000000 / s_llFrequency);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+#ifdef _WIN32
+//######################################
+// OpenPath
+// UTF-8 path to a file handle, INVALID_HANDLE_VALUE on failure
+//######################################
+static HANDLE OpenPath (const char *pszPath, bool bWrite) {
+	WCHAR wszPath[MAX_PATH];
+	if (MultiByteToWideChar(CP_UTF8, 0, pszPath, -1, wszPath, MAX_PATH) == 0) return INVALID_HANDLE_VALUE;
+	return CreateFileW(wszPath, bWrite ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ,
+		NULL, bWrite ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+#endif
+
+//######################################
+// CCaptureWriter
+//######################################
+CCaptureWriter::CCaptureWriter () :
+#ifdef _WIN32
+	m_hFile(INVALID_HANDLE_VALUE),
+	m_hMapping(0),
+#else
+	m_fd(-1),
+#endif
+	m_pView(0),
+	m_qwViewOffset(0),
+	m_qwFileSize(0),
+	m_qwLength(0),
+	m_cRecords(0),
+	m_qwCreated(0)
+{
+}
+
+CCaptureWriter::~CCaptureWriter () {
+	Close();
+}
+
+//######################################
+// Open
+//######################################
+bool CCaptureWriter::Open (const char *pszPath) {
+	Close();
+
+#ifdef _WIN32
+	m_hFile = OpenPath(pszPath, true);
+	if (m_hFile == INVALID_HANDLE_VALUE) return false;
+#else
+	m_fd = open(pszPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_fd < 0) return false;
+#endif
+
+	m_qwFileSize = 0;
+	m_qwLength = 0;
+	m_cRecords = 0;
+	m_qwCreated = (uint64_t)time(NULL) * 1000;
+	if (!Map(sizeof(CAPTURE_HEADER))) {
+		Close();
+		return false;
+	}
+
+	CAPTURE_HEADER *pHeader = (CAPTURE_HEADER *)m_pView;
+	pHeader->dwMagic = CAPTURE_MAGIC;
+	pHeader->dwVersion = CAPTURE_VERSION;
+	pHeader->cbHeader = sizeof(CAPTURE_HEADER);
+	pHeader->cbRecordHeader = sizeof(CAPTURE_RECORD);
+	pHeader->qwCreated = m_qwCreated;
+	m_qwLength = sizeof(CAPTURE_HEADER);
+	return true;
+}
+
+//######################################
+// Map
+// Makes sure cbNeeded bytes past the end of what was written are mapped.
+// The file grows CAPTURE_GROW at a time and only its unwritten tail, from
+// the last record on, is mapped, so the address space used stays about
+// one growth step whatever the length of the capture
+//######################################
+bool CCaptureWriter::Map (uint64_t cbNeeded) {
+	const uint64_t qwEnd = m_qwLength + cbNeeded;
+	if (m_pView && qwEnd <= m_qwFileSize) return true;
+
+	const uint64_t qwFileSize = qwEnd <= m_qwFileSize ? m_qwFileSize : AlignUp(qwEnd, CAPTURE_GROW);
+	const uint64_t qwViewOffset = m_qwLength & ~(uint64_t)(CAPTURE_WINDOW_ALIGN - 1);
+	const uint64_t cbView = qwFileSize - qwViewOffset;
+	if (cbView > (uint64_t)(size_t)-1) return false;
+
+#ifdef _WIN32
+	if (m_pView) UnmapViewOfFile(m_pView);
+	if (m_hMapping) CloseHandle((HANDLE)m_hMapping);
+	m_pView = 0;
+
+	// A mapping larger than the file grows it
+	m_hMapping = CreateFileMappingW((HANDLE)m_hFile, NULL, PAGE_READWRITE, (DWORD)(qwFileSize >> 32), (DWORD)qwFileSize, NULL);
+	if (!m_hMapping) return false;
+	m_pView = (uint8_t *)MapViewOfFile((HANDLE)m_hMapping, FILE_MAP_READ | FILE_MAP_WRITE,
+		(DWORD)(qwViewOffset >> 32), (DWORD)qwViewOffset, (SIZE_T)cbView);
+	if (!m_pView) return false;
+#else
+	if (m_pView) munmap(m_pView, (size_t)(m_qwFileSize - m_qwViewOffset));
+	m_pView = 0;
+
+	if (qwFileSize != m_qwFileSize && ftruncate(m_fd, (off_t)qwFileSize) != 0) return false;
+	void *pView = mmap(0, (size_t)cbView, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, (off_t)qwViewOffset);
+	if (pView == MAP_FAILED) return false;
+	m_pView = (uint8_t *)pView;
+#endif
+
+	m_qwFileSize = qwFileSize;
+	m_qwViewOffset = qwViewOffset;
+	return true;
+}
+
+//######################################
+// Close
+// The header is written through the file rather than the mapping, which
+// may no longer cover it
+//######################################
+void CCaptureWriter::Close () {
+	CAPTURE_HEADER Header;
+	memset(&Header, 0, sizeof(Header));
+	Header.dwMagic = CAPTURE_MAGIC;
+	Header.dwVersion = CAPTURE_VERSION;
+	Header.cbHeader = sizeof(CAPTURE_HEADER);
+	Header.cbRecordHeader = sizeof(CAPTURE_RECORD);
+	Header.qwLength = m_qwLength;
+	Header.cRecords = m_cRecords;
+	Header.qwCreated = m_qwCreated;
+
+#ifdef _WIN32
+	if (m_pView) UnmapViewOfFile(m_pView);
+	if (m_hMapping) CloseHandle((HANDLE)m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE) {
+		if (m_qwLength) {
+			LARGE_INTEGER liPos;
+			DWORD cbWritten;
+			liPos.QuadPart = (LONGLONG)m_qwLength;
+			if (SetFilePointerEx((HANDLE)m_hFile, liPos, NULL, FILE_BEGIN)) SetEndOfFile((HANDLE)m_hFile);
+			liPos.QuadPart = 0;
+			if (SetFilePointerEx((HANDLE)m_hFile, liPos, NULL, FILE_BEGIN)) WriteFile((HANDLE)m_hFile, &Header, sizeof(Header), &cbWritten, NULL);
+		}
+		CloseHandle((HANDLE)m_hFile);
+	}
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = 0;
+#else
+	if (m_pView) munmap(m_pView, (size_t)(m_qwFileSize - m_qwViewOffset));
+	if (m_fd >= 0) {
+		if (m_qwLength) {
+			if (ftruncate(m_fd, (off_t)m_qwLength) != 0 || pwrite(m_fd, &Header, sizeof(Header), 0) != (ssize_t)sizeof(Header)) {
+				// Left as if the process had died, readers still find every record
+			}
+		}
+		close(m_fd);
+	}
+	m_fd = -1;
+#endif
+
+	m_pView = 0;
+	m_qwViewOffset = 0;
+	m_qwFileSize = 0;
+	m_qwLength = 0;
+	m_cRecords = 0;
+}
+
+//######################################
+// Append
+// The record header goes in after the data, so a record is only there
+// for a reader once it is complete
+//######################################
+bool CCaptureWriter::Append (const CAPTURE_RECORD *pRecord, const void *pData) {
+	if (!m_pView) return false;
+
+	const uint64_t cbRecord = AlignUp(sizeof(CAPTURE_RECORD) + pRecord->cbData, CAPTURE_ALIGN);
+	if (!Map(cbRecord)) {
+		Close();
+		return false;
+	}
+
+	uint8_t *p = m_pView + (m_qwLength - m_qwViewOffset);
+	if (pRecord->cbData) memcpy(p + sizeof(CAPTURE_RECORD), pData, (size_t)pRecord->cbData);
+
+	CAPTURE_RECORD Record = *pRecord;
+	Record.dwMagic = CAPTURE_RECORD_MAGIC;
+	Record.cbRecord = cbRecord;
+	Record.qwSequence = m_cRecords;
+	memcpy(p, &Record, sizeof(Record));
+
+	m_qwLength += cbRecord;
+	m_cRecords++;
+	return true;
+}
+
+//######################################
+// CCaptureReader
+//######################################
+CCaptureReader::CCaptureReader () :
+#ifdef _WIN32
+	m_hFile(INVALID_HANDLE_VALUE),
+	m_hMapping(0),
+#endif
+	m_pView(0),
+	m_cbView(0),
+	m_qwLength(0)
+{
+}
+
+CCaptureReader::~CCaptureReader () {
+	Close();
+}
+
+//######################################
+// Open
+// The whole file is mapped, a capture too large for the address space
+// can't be read by a 32-bit build
+//######################################
+bool CCaptureReader::Open (const char *pszPath) {
+	Close();
+
+	uint64_t qwFileSize;
+#ifdef _WIN32
+	m_hFile = OpenPath(pszPath, false);
+	if (m_hFile == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER liSize;
+	if (!GetFileSizeEx((HANDLE)m_hFile, &liSize) || (uint64_t)liSize.QuadPart < sizeof(CAPTURE_HEADER)
+		|| (uint64_t)liSize.QuadPart > (uint64_t)(size_t)-1) {
+		Close();
+		return false;
+	}
+	qwFileSize = (uint64_t)liSize.QuadPart;
+
+	m_hMapping = CreateFileMappingW((HANDLE)m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_hMapping) m_pView = (const uint8_t *)MapViewOfFile((HANDLE)m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_pView) {
+		Close();
+		return false;
+	}
+#else
+	int fd = open(pszPath, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(CAPTURE_HEADER) || (uint64_t)st.st_size > (uint64_t)(size_t)-1) {
+		close(fd);
+		return false;
+	}
+	qwFileSize = (uint64_t)st.st_size;
+
+	void *pView = mmap(0, (size_t)qwFileSize, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pView == MAP_FAILED) return false;
+	m_pView = (const uint8_t *)pView;
+#endif
+
+	m_cbView = qwFileSize;
+
+	const CAPTURE_HEADER *pHeader = Header();
+	if (pHeader->dwMagic != CAPTURE_MAGIC || pHeader->dwVersion != CAPTURE_VERSION
+		|| pHeader->cbHeader != sizeof(CAPTURE_HEADER) || pHeader->cbRecordHeader != sizeof(CAPTURE_RECORD)) {
+		Close();
+		return false;
+	}
+
+	// Unless it was closed, records may go all the way to the end
+	m_qwLength = (pHeader->qwLength && pHeader->qwLength < qwFileSize) ? pHeader->qwLength : qwFileSize;
+	return true;
+}
+
+//######################################
+// Close
+//######################################
+void CCaptureReader::Close () {
+#ifdef _WIN32
+	if (m_pView) UnmapViewOfFile(m_pView);
+	if (m_hMapping) CloseHandle((HANDLE)m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE) CloseHandle((HANDLE)m_hFile);
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = 0;
+#else
+	if (m_pView) munmap((void *)m_pView, (size_t)m_cbView);
+#endif
+	m_pView = 0;
+	m_cbView = 0;
+	m_qwLength = 0;
+}
+
+//######################################
+// Next
+// Stops at the first space that doesn't hold a complete record
+//######################################
+const CAPTURE_RECORD *CCaptureReader::Next (const CAPTURE_RECORD *pRecord) const {
+	if (!m_pView) return 0;
+
+	uint64_t qwOffset = pRecord ? (uint64_t)((const uint8_t *)pRecord - m_pView) + pRecord->cbRecord : sizeof(CAPTURE_HEADER);
+	if (qwOffset + sizeof(CAPTURE_RECORD) > m_qwLength) return 0;
+
+	const CAPTURE_RECORD *pNext = (const CAPTURE_RECORD *)(m_pView + qwOffset);
+	if (pNext->dwMagic != CAPTURE_RECORD_MAGIC || pNext->cbRecord < sizeof(CAPTURE_RECORD) + pNext->cbData
+		|| pNext->cbRecord > m_qwLength - qwOffset) {
+		return 0;
+	}
+	return pNext;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//######################################
+// Raw capture of the samples reaching the renderer, for replaying the exact
+// input of a production run
+//
+// A capture file is a CAPTURE_HEADER followed by records, each a
+// CAPTURE_RECORD and the sample data, padded to CAPTURE_ALIGN. Records are
+// only ever appended, through a memory mapping that grows with the file, and
+// the header learns the final length when the file is closed. A file that
+// was never closed (the process died) still reads up to the last complete
+// record, as the space beyond it is zero filled. Only fixed width types are
+// used, so files move between Windows and POSIX systems
+//######################################
+
+#define CAPTURE_MAGIC          0x5041434E      // 'NCAP'
+#define CAPTURE_RECORD_MAGIC   0x4345524E      // 'NREC'
+#define CAPTURE_VERSION        1
+#define CAPTURE_ALIGN          64
+#define CAPTURE_GROW           (64 * 1024 * 1024)  // File growth step
+#define CAPTURE_WINDOW_ALIGN   (64 * 1024)     // Mapping offsets, Windows' allocation granularity
+
+// Values for CAPTURE_RECORD::dwFlags, the IMediaSample properties
+#define CAPTURE_TIME_VALID     0x01            // rtStart is set
+#define CAPTURE_STOP_VALID     0x02            // rtStop is set
+#define CAPTURE_SYNCPOINT      0x04
+#define CAPTURE_DISCONTINUITY  0x08
+#define CAPTURE_PREROLL        0x10
+#define CAPTURE_FORMAT_CHANGE  0x20            // The sample carried a new media type, Format is it
+
+//######################################
+// The media type a sample arrived with, the VIDEOINFOHEADER fields that
+// matter for sending it
+//######################################
+struct CAPTURE_FORMAT
+{
+	uint8_t Subtype[16];            // Media subtype GUID as laid out in memory
+	int32_t lWidth;
+	int32_t lHeight;                // Positive for bottom-up RGB, as in the BITMAPINFOHEADER
+	uint32_t dwBitCount;
+	uint32_t dwCompression;         // FourCC, BI_RGB = 0
+	int64_t llAvgTimePerFrame;      // 100 ns units, 0 if unknown
+	uint32_t dwReserved[2];
+};
+
+struct CAPTURE_RECORD
+{
+	uint32_t dwMagic;               // CAPTURE_RECORD_MAGIC
+	uint32_t dwFlags;               // CAPTURE_*
+	uint64_t cbRecord;              // This header, the data and the padding
+	uint64_t cbData;                // Actual data length of the sample
+	uint64_t qwSequence;            // Record number, from 0
+	int64_t rtStart;                // Sample times in 100 ns units
+	int64_t rtStop;
+	int64_t rtArrival;              // Stream time the sample arrived at, -1 without a clock
+	uint64_t qwArrivalTime;         // GetCaptureClock() when it arrived
+	CAPTURE_FORMAT Format;
+	uint32_t dwReserved[4];
+};
+
+struct CAPTURE_HEADER
+{
+	uint32_t dwMagic;               // CAPTURE_MAGIC
+	uint32_t dwVersion;             // CAPTURE_VERSION
+	uint32_t cbHeader;              // sizeof(CAPTURE_HEADER)
+	uint32_t cbRecordHeader;        // sizeof(CAPTURE_RECORD)
+	uint64_t qwLength;              // Bytes up to the end of the last record, 0 until closed
+	uint64_t cRecords;              // Records, 0 until closed
+	uint64_t qwCreated;             // Milliseconds since 1970 (UTC)
+	uint32_t dwReserved[6];
+};
+
+static_assert(sizeof(CAPTURE_FORMAT) == 48, "CAPTURE_FORMAT layout changed");
+static_assert(sizeof(CAPTURE_RECORD) == 128, "CAPTURE_RECORD layout changed");
+static_assert(sizeof(CAPTURE_HEADER) == 64, "CAPTURE_HEADER layout changed");
+
+//######################################
+// Microseconds on a monotonic clock, for qwArrivalTime
+//######################################
+uint64_t GetCaptureClock();
+
+//######################################
+// Appends records to a capture file. Paths are UTF-8
+//######################################
+class CCaptureWriter
+{
+public:
+	CCaptureWriter();
+	~CCaptureWriter();
+
+	bool Open(const char *pszPath);     // Creates or truncates the file
+	void Close();                       // Completes the header and trims the file
+	bool IsOpen() const { return m_pView != 0; }
+
+	// Copies the record and its data to the end of the file. cbRecord and
+	// qwSequence are filled in, cbData says how much of pData to copy
+	bool Append(const CAPTURE_RECORD *pRecord, const void *pData);
+
+	uint64_t Length() const { return m_qwLength; }
+	uint64_t Records() const { return m_cRecords; }
+
+private:
+	bool Map(uint64_t cbNeeded);
+
+#ifdef _WIN32
+	void *m_hFile;
+	void *m_hMapping;
+#else
+	int m_fd;
+#endif
+	uint8_t *m_pView;               // Mapped from m_qwViewOffset to m_qwFileSize
+	uint64_t m_qwViewOffset;
+	uint64_t m_qwFileSize;
+	uint64_t m_qwLength;            // Bytes written
+	uint64_t m_cRecords;
+	uint64_t m_qwCreated;
+};
+
+//######################################
+// Maps a capture file read only and walks its records
+//######################################
+class CCaptureReader
+{
+public:
+	CCaptureReader();
+	~CCaptureReader();
+
+	bool Open(const char *pszPath);
+	void Close();
+
+	const CAPTURE_HEADER *Header() const { return (const CAPTURE_HEADER *)m_pView; }
+	bool WasClosed() const { return m_pView && Header()->qwLength != 0; }
+
+	// The record after pRecord, the first one for NULL. NULL at the end
+	const CAPTURE_RECORD *Next(const CAPTURE_RECORD *pRecord) const;
+	static const uint8_t *Data(const CAPTURE_RECORD *pRecord) { return (const uint8_t *)(pRecord + 1); }
+
+private:
+#ifdef _WIN32
+	void *m_hFile;
+	void *m_hMapping;
+#endif
+	const uint8_t *m_pView;
+	uint64_t m_cbView;              // The whole file
+	uint64_t m_qwLength;            // Bytes that may hold records
+};
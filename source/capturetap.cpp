@@ -0,0 +1,172 @@
+#include "capturetap.h"
+
+//######################################
+// Constructor
+//######################################
+CCaptureTap::CCaptureTap () :
+	m_hThread(NULL),
+	m_hWake(NULL),
+	m_bExit(FALSE),
+	m_iHead(0),
+	m_cQueued(0),
+	m_cDepth(CAPTURE_QUEUE)
+{
+	ZeroMemory(m_Queue, sizeof(m_Queue));
+	ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+//######################################
+// Destructor
+//######################################
+CCaptureTap::~CCaptureTap () {
+	Stop();
+}
+
+//######################################
+// Start
+//######################################
+HRESULT CCaptureTap::Start (const char *pszPath) {
+	Stop();
+
+	if (!m_Writer.Open(pszPath)) return HRESULT_FROM_WIN32(GetLastError());
+
+	m_hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (!m_hWake) {
+		m_Writer.Close();
+		return E_OUTOFMEMORY;
+	}
+
+	ZeroMemory(&m_Stats, sizeof(m_Stats));
+	m_bExit = FALSE;
+	m_hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+	if (!m_hThread) {
+		CloseHandle(m_hWake);
+		m_hWake = NULL;
+		m_Writer.Close();
+		return E_OUTOFMEMORY;
+	}
+
+	return NOERROR;
+}
+
+//######################################
+// Stop
+// The thread writes whatever is still queued before it leaves
+//######################################
+void CCaptureTap::Stop () {
+	if (m_hThread) {
+		m_bExit = TRUE;
+		SetEvent(m_hWake);
+		WaitForSingleObject(m_hThread, INFINITE);
+		CloseHandle(m_hThread);
+		m_hThread = NULL;
+	}
+	if (m_hWake) {
+		CloseHandle(m_hWake);
+		m_hWake = NULL;
+	}
+	m_Writer.Close();
+}
+
+//######################################
+// Add
+// Streaming thread, never waits for the file
+//######################################
+void CCaptureTap::Add (IMediaSample *pSample, const CAPTURE_FORMAT *pFormat, REFERENCE_TIME rtArrival, BOOL bFormatChange) {
+	if (!m_hThread) return;
+
+	CAPTURE_RECORD Record;
+	ZeroMemory(&Record, sizeof(Record));
+	Record.qwArrivalTime = GetCaptureClock();
+	Record.rtArrival = rtArrival;
+	Record.Format = *pFormat;
+
+	REFERENCE_TIME rtStart, rtStop;
+	HRESULT hr = pSample->GetTime(&rtStart, &rtStop);
+	if (SUCCEEDED(hr)) {
+		Record.dwFlags |= CAPTURE_TIME_VALID;
+		Record.rtStart = rtStart;
+		if (hr == S_OK) {
+			Record.dwFlags |= CAPTURE_STOP_VALID;
+			Record.rtStop = rtStop;
+		}
+	}
+	if (pSample->IsSyncPoint() == S_OK) Record.dwFlags |= CAPTURE_SYNCPOINT;
+	if (pSample->IsDiscontinuity() == S_OK) Record.dwFlags |= CAPTURE_DISCONTINUITY;
+	if (pSample->IsPreroll() == S_OK) Record.dwFlags |= CAPTURE_PREROLL;
+	if (bFormatChange) Record.dwFlags |= CAPTURE_FORMAT_CHANGE;
+
+	CAutoLock cLock(&m_Lock);
+	if (m_cQueued >= m_cDepth) {
+		m_Stats.llMissed++;
+		return;
+	}
+
+	ENTRY *pEntry = &m_Queue[(m_iHead + m_cQueued) % CAPTURE_QUEUE];
+	pEntry->pSample = pSample;
+	pEntry->Record = Record;
+	pSample->AddRef();
+	m_cQueued++;
+	SetEvent(m_hWake);
+}
+
+//######################################
+// WriteQueued
+// Capture thread. The copy runs outside the lock, the entry stays queued
+// until it is done so Add never reuses it early
+//######################################
+void CCaptureTap::WriteQueued () {
+	for (;;) {
+		ENTRY *pEntry;
+		{
+			CAutoLock cLock(&m_Lock);
+			if (m_cQueued == 0) return;
+			pEntry = &m_Queue[m_iHead];
+		}
+
+		BYTE *pData = NULL;
+		if (SUCCEEDED(pEntry->pSample->GetPointer(&pData))) {
+			pEntry->Record.cbData = (uint64_t)pEntry->pSample->GetActualDataLength();
+		}
+		BOOL bWritten = m_Writer.Append(&pEntry->Record, pData);
+		pEntry->pSample->Release();
+		pEntry->pSample = NULL;
+
+		CAutoLock cLock(&m_Lock);
+		if (bWritten) m_Stats.llCaptured++;
+		else m_Stats.llMissed++;
+		m_Stats.qwBytes = m_Writer.Length();
+		m_iHead = (m_iHead + 1) % CAPTURE_QUEUE;
+		m_cQueued--;
+	}
+}
+
+//######################################
+// ThreadProc
+//######################################
+DWORD WINAPI CCaptureTap::ThreadProc (LPVOID pParam) {
+	CCaptureTap *pThis = (CCaptureTap *)pParam;
+	for (;;) {
+		WaitForSingleObject(pThis->m_hWake, INFINITE);
+		pThis->WriteQueued();
+		if (pThis->m_bExit) break;
+	}
+	return 0;
+}
+
+//######################################
+// SetDepth
+// Samples already queued stay, the new depth holds for the next ones
+//######################################
+void CCaptureTap::SetDepth (int cDepth) {
+	CAutoLock cLock(&m_Lock);
+	m_cDepth = (cDepth < 0) ? 0 : (cDepth > CAPTURE_QUEUE) ? CAPTURE_QUEUE : cDepth;
+}
+
+//######################################
+// GetStats
+//######################################
+void CCaptureTap::GetStats (CAPTURE_TAP_STATS *pStats) {
+	CAutoLock cLock(&m_Lock);
+	*pStats = m_Stats;
+}
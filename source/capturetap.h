@@ -0,0 +1,68 @@
+#pragma once
+
+#include <streams.h>
+
+#include "capture.h"
+
+#define CAPTURE_QUEUE 4         // Samples held for the capture thread at most, see SetDepth
+
+//######################################
+// Counters of a capture tap
+//######################################
+struct CAPTURE_TAP_STATS
+{
+	LONGLONG llCaptured;        // Records written
+	LONGLONG llMissed;          // Samples not captured, the queue was full
+	ULONGLONG qwBytes;          // Capture file length
+};
+
+//######################################
+// Writes every sample handed to it to a capture file from a thread of its
+// own. The streaming thread only notes the sample's properties and keeps a
+// reference on it, the copy into the file happens on the capture thread.
+// The samples held come out of upstream's allocator, so when the thread
+// falls behind by the depth set for that allocator further ones are
+// counted as missed rather than starving upstream
+//######################################
+class CCaptureTap
+{
+public:
+	CCaptureTap();
+	~CCaptureTap();
+
+	HRESULT Start(const char *pszPath);     // UTF-8 path, the file is truncated
+	void Stop();                            // Writes what is queued, closes the file
+	BOOL IsStarted() const { return m_hThread != NULL; }
+
+	// rtArrival is the stream time now, -1 without a clock. bFormatChange
+	// if the sample carries the media type pFormat describes
+	void Add(IMediaSample *pSample, const CAPTURE_FORMAT *pFormat, REFERENCE_TIME rtArrival, BOOL bFormatChange);
+
+	// Samples the tap may hold, what the allocator has to spare once the
+	// renderer and upstream have theirs. 0 misses every sample
+	void SetDepth(int cDepth);
+
+	void GetStats(CAPTURE_TAP_STATS *pStats);
+
+private:
+	struct ENTRY
+	{
+		IMediaSample *pSample;
+		CAPTURE_RECORD Record;
+	};
+
+	static DWORD WINAPI ThreadProc(LPVOID pParam);
+	void WriteQueued();
+
+	CCaptureWriter m_Writer;
+	HANDLE m_hThread;
+	HANDLE m_hWake;                 // Auto reset, set for every sample queued
+	volatile BOOL m_bExit;
+
+	CCritSec m_Lock;                // Guards the queue and the counters
+	ENTRY m_Queue[CAPTURE_QUEUE];
+	int m_iHead;                    // Oldest entry
+	int m_cQueued;
+	int m_cDepth;                   // Queued at most, up to CAPTURE_QUEUE
+	CAPTURE_TAP_STATS m_Stats;
+};
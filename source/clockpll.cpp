@@ -0,0 +1,71 @@
+#include "clockpll.h"
+
+// Loop gains per tick, for a damped response settling within ~100 frames
+// while a ms of scheduling jitter moves the rate by no more than 500 ppm
+#define PLL_KP  0.02
+#define PLL_KI  0.0002
+
+//######################################
+// CPacingPll
+//######################################
+CPacingPll::CPacingPll () :
+	m_dFreq(0)
+{
+	Reset(0, true);
+}
+
+void CPacingPll::Reset (int64_t rtSystem, bool bForget) {
+	m_rtSystemBase = rtSystem;
+	m_rtClockBase = rtSystem;
+	if (bForget) m_dFreq = 0;
+	m_dRate = 1.0 + m_dFreq;
+	m_rtLastUpdate = 0;
+	m_bUpdated = false;
+	m_rtError = 0;
+	m_nGood = 0;
+}
+
+//######################################
+// Time
+//######################################
+int64_t CPacingPll::Time (int64_t rtSystem) const {
+	return m_rtClockBase + (int64_t)((double)(rtSystem - m_rtSystemBase) * m_dRate);
+}
+
+//######################################
+// Update
+// Blocking longer than the target means frames reach NDI early, so our
+// clock runs ahead of NDI's and is slowed down, and the other way round.
+// A send that didn't block at all only says we are late by some unknown
+// amount, the error saturates at -target then, which still pulls the
+// right way. Ticks after a gap are skipped, NDI restarts its pacing then
+//######################################
+void CPacingPll::Update (int64_t rtSystem, int64_t rtBlocked, int64_t rtPeriod) {
+	// Rebase first so the new rate doesn't step the time already handed out
+	m_rtClockBase = Time(rtSystem);
+	m_rtSystemBase = rtSystem;
+
+	bool bConsecutive = m_bUpdated && rtSystem - m_rtLastUpdate < rtPeriod + rtPeriod / 2;
+	m_rtLastUpdate = rtSystem;
+	m_bUpdated = true;
+	if (!bConsecutive || rtPeriod <= 0) return;
+
+	int64_t rtError = rtBlocked - PLL_TARGET_BLOCK;
+	if (rtError > rtPeriod / 2) rtError = rtPeriod / 2;
+	if (rtError < -rtPeriod / 2) rtError = -rtPeriod / 2;
+	m_rtError = rtError;
+
+	double dError = (double)rtError / rtPeriod;
+
+	m_dFreq -= PLL_KI * dError;
+	if (m_dFreq > PLL_MAX_FREQ) m_dFreq = PLL_MAX_FREQ;
+	if (m_dFreq < -PLL_MAX_FREQ) m_dFreq = -PLL_MAX_FREQ;
+
+	double dOffset = m_dFreq - PLL_KP * dError;
+	if (dOffset > PLL_MAX_SLEW) dOffset = PLL_MAX_SLEW;
+	if (dOffset < -PLL_MAX_SLEW) dOffset = -PLL_MAX_SLEW;
+	m_dRate = 1.0 + dOffset;
+
+	bool bGood = rtBlocked > 0 && (rtError < 0 ? -rtError : rtError) < rtPeriod / 8;
+	m_nGood = bGood ? m_nGood + 1 : 0;
+}
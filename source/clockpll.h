@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+//######################################
+// Phase locked loop that disciplines a clock to NDI's send pacing
+//
+// With clock_video NDI lets at most one frame through per frame duration,
+// timed by its own clock, and a send call blocks until the frame's slot.
+// When the graph runs on a clock that is slightly fast, frames arrive
+// early and the send blocks longer and longer; slightly slow and they
+// arrive after their slot, so NDI stops blocking and frames go out in
+// bursts. The loop watches how long each send blocks and steers the clock
+// rate so that sends block for a small, steady target time. All times are
+// in 100 ns units. Nothing here depends on Windows, so tools/pllsim.cpp
+// can replay synthetic drift profiles through the same code
+//######################################
+
+#define PLL_UNITS          10000000        // 100 ns units per second
+#define PLL_TARGET_BLOCK   20000           // Aim for sends that block 2 ms
+#define PLL_MAX_FREQ       0.0005          // Largest drift corrected, 500 ppm
+#define PLL_MAX_SLEW       0.001           // Largest rate offset at any time, 1000 ppm
+#define PLL_LOCK_COUNT     50              // Consecutive good ticks before we call it locked
+
+class CPacingPll
+{
+public:
+	CPacingPll();
+
+	// Start over with the clock at the system time rtSystem, running at
+	// the nominal rate. The frequency estimate is kept unless bForget
+	void Reset(int64_t rtSystem, bool bForget);
+
+	// Disciplined time at system time rtSystem. Continuous and increasing
+	// whatever the loop does, rate changes only apply from the last update
+	int64_t Time(int64_t rtSystem) const;
+
+	// A send returned at system time rtSystem after blocking for rtBlocked,
+	// rtPeriod is the frame duration NDI paces at
+	void Update(int64_t rtSystem, int64_t rtBlocked, int64_t rtPeriod);
+
+	double Rate() const { return m_dRate; }             // Clock rate relative to the system clock
+	double Frequency() const { return m_dFreq; }        // Drift estimate, without the phase term
+	int64_t PhaseError() const { return m_rtError; }    // Last block time minus the target
+	bool IsLocked() const { return m_nGood >= PLL_LOCK_COUNT; }
+
+private:
+	int64_t m_rtSystemBase;     // System time of the last update
+	int64_t m_rtClockBase;      // Our time at that point
+	double m_dFreq;             // Integral term, the drift between NDI and the system clock
+	double m_dRate;             // Rate used until the next update
+	int64_t m_rtLastUpdate;
+	bool m_bUpdated;            // m_rtLastUpdate is valid
+	int64_t m_rtError;
+	int m_nGood;
+};
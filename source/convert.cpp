@@ -0,0 +1,299 @@
+#include "convert.h"
+#include <emmintrin.h>
+#include <string.h>
+
+//######################################
+// Helpers
+//######################################
+static inline BYTE Clamp255 (int v) {
+	return (BYTE)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static inline short Fix (double d, double scale) {
+	return (short)(d * scale + (d < 0 ? -0.5 : 0.5));
+}
+
+//######################################
+// Init
+// Builds the integer coefficients from the matrix constants Kr and Kb.
+// Limited range squeezes luma into 16-235 and chroma into 16-240
+//######################################
+void CColorCoefficients::Init (ColorMatrix matrix, BOOL bFullRange) {
+	double kr = (matrix == ColorMatrix_BT601) ? 0.299 : 0.2126;
+	double kb = (matrix == ColorMatrix_BT601) ? 0.114 : 0.0722;
+	double kg = 1.0 - kr - kb;
+
+	double ys = bFullRange ? 1.0 : 219.0 / 255.0;
+	double cs = bFullRange ? 1.0 : 224.0 / 255.0;
+
+	// Luma per pixel in Q14
+	yr = Fix(kr * ys, 16384.0);
+	yg = Fix(kg * ys, 16384.0);
+	yb = Fix(kb * ys, 16384.0);
+	yOffset = ((bFullRange ? 0 : 16) << 14) + (1 << 13);
+
+	// Chroma from pixel pair sums, so Q14 coefficients give a Q15 result
+	double ud = 2.0 * (1.0 - kb);
+	double vd = 2.0 * (1.0 - kr);
+	ur = Fix(-kr / ud * cs, 16384.0);
+	ug = Fix(-kg / ud * cs, 16384.0);
+	ub = Fix(0.5 * cs, 16384.0);
+	vr = Fix(0.5 * cs, 16384.0);
+	vg = Fix(-kg / vd * cs, 16384.0);
+	vb = Fix(-kb / vd * cs, 16384.0);
+	cOffset = (128 << 15) + (1 << 14);
+}
+
+//######################################
+// ConvertPairs
+// Scalar conversion of pixels [x, width) of one row, also handles an odd
+// trailing pixel by pairing it with itself
+//######################################
+static void ConvertPairs (const CColorCoefficients *c, const BYTE *s, BYTE *d, BYTE *a, int x, int width) {
+	for (; x < width; x += 2) {
+		const BYTE *p0 = s + x * 4;
+		const BYTE *p1 = (x + 1 < width) ? p0 + 4 : p0;
+
+		int y0 = (c->yr * p0[2] + c->yg * p0[1] + c->yb * p0[0] + c->yOffset) >> 14;
+		int y1 = (c->yr * p1[2] + c->yg * p1[1] + c->yb * p1[0] + c->yOffset) >> 14;
+
+		int rs = p0[2] + p1[2];
+		int gs = p0[1] + p1[1];
+		int bs = p0[0] + p1[0];
+		int u = (c->ur * rs + c->ug * gs + c->ub * bs + c->cOffset) >> 15;
+		int v = (c->vr * rs + c->vg * gs + c->vb * bs + c->cOffset) >> 15;
+
+		BYTE *q = d + x * 2;
+		q[0] = Clamp255(u);
+		q[1] = Clamp255(y0);
+		if (x + 1 < width) {
+			q[2] = Clamp255(v);
+			q[3] = Clamp255(y1);
+		}
+
+		if (a) {
+			a[x] = p0[3];
+			if (x + 1 < width) a[x + 1] = p1[3];
+		}
+	}
+}
+
+//######################################
+// ConvertBGRAToUYVY
+// SSE2 path does 8 pixels (16 output bytes) per iteration, the scalar
+// path finishes the row
+//######################################
+void ConvertBGRAToUYVY (
+	const CColorCoefficients *pCoeffs,
+	const BYTE *pSrc, LONG lSrcStride,
+	BYTE *pDst, LONG lDstStride,
+	BYTE *pAlpha, LONG lAlphaStride,
+	int width, int yStart, int yEnd)
+{
+	const CColorCoefficients *c = pCoeffs;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi16(1);
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i yBG  = _mm_set_epi16(c->yg, c->yb, c->yg, c->yb, c->yg, c->yb, c->yg, c->yb);
+	const __m128i yR   = _mm_set_epi16(0, c->yr, 0, c->yr, 0, c->yr, 0, c->yr);
+	const __m128i uBG  = _mm_set_epi16(c->ug, c->ub, c->ug, c->ub, c->ug, c->ub, c->ug, c->ub);
+	const __m128i uR   = _mm_set_epi16(0, c->ur, 0, c->ur, 0, c->ur, 0, c->ur);
+	const __m128i vBG  = _mm_set_epi16(c->vg, c->vb, c->vg, c->vb, c->vg, c->vb, c->vg, c->vb);
+	const __m128i vR   = _mm_set_epi16(0, c->vr, 0, c->vr, 0, c->vr, 0, c->vr);
+	const __m128i yOff = _mm_set1_epi32(c->yOffset);
+	const __m128i cOff = _mm_set1_epi32(c->cOffset);
+
+	const int width8 = width & ~7;
+
+	for (int y = yStart; y < yEnd; y++) {
+		const BYTE *s = pSrc + (LONG_PTR)y * lSrcStride;
+		BYTE *d = pDst + (LONG_PTR)y * lDstStride;
+		BYTE *a = pAlpha ? pAlpha + (LONG_PTR)y * lAlphaStride : NULL;
+
+		int x = 0;
+		for (; x < width8; x += 8) {
+			__m128i p0 = _mm_loadu_si128((const __m128i *)(s + x * 4));
+			__m128i p1 = _mm_loadu_si128((const __m128i *)(s + x * 4 + 16));
+
+			// Split into 8 x 16 bit B, G and R
+			__m128i b = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+			__m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+			__m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+
+			// Luma for all 8 pixels
+			__m128i yLo = _mm_add_epi32(
+				_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(b, g), yBG), _mm_madd_epi16(_mm_unpacklo_epi16(r, zero), yR)),
+				yOff);
+			__m128i yHi = _mm_add_epi32(
+				_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(b, g), yBG), _mm_madd_epi16(_mm_unpackhi_epi16(r, zero), yR)),
+				yOff);
+			__m128i yy = _mm_packs_epi32(_mm_srai_epi32(yLo, 14), _mm_srai_epi32(yHi, 14));
+
+			// Chroma for the 4 pixel pairs
+			__m128i bs = _mm_madd_epi16(b, ones);
+			__m128i gs = _mm_madd_epi16(g, ones);
+			__m128i rs = _mm_madd_epi16(r, ones);
+			__m128i bgs = _mm_unpacklo_epi16(_mm_packs_epi32(bs, bs), _mm_packs_epi32(gs, gs));
+			__m128i rzs = _mm_unpacklo_epi16(_mm_packs_epi32(rs, rs), zero);
+
+			__m128i u = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(bgs, uBG), _mm_madd_epi16(rzs, uR)), cOff), 15);
+			__m128i v = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(bgs, vBG), _mm_madd_epi16(rzs, vR)), cOff), 15);
+
+			// U0 V0 U1 V1 ... interleaved with Y0 Y1 Y2 ... gives U0 Y0 V0 Y1
+			__m128i uv = _mm_unpacklo_epi16(_mm_packs_epi32(u, u), _mm_packs_epi32(v, v));
+			__m128i lo = _mm_unpacklo_epi16(uv, yy);
+			__m128i hi = _mm_unpackhi_epi16(uv, yy);
+			_mm_storeu_si128((__m128i *)(d + x * 2), _mm_packus_epi16(lo, hi));
+
+			if (a) {
+				__m128i aa = _mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24));
+				_mm_storel_epi64((__m128i *)(a + x), _mm_packus_epi16(aa, aa));
+			}
+		}
+
+		ConvertPairs(c, s, d, a, x, width);
+	}
+}
+
+//######################################
+// ConvertStripe
+// Worker pool callback, job iJob of nJobs converts its share of the rows
+//######################################
+void ConvertStripe (void *pContext, int iJob, int nJobs) {
+	CONVERT_JOB *pJob = (CONVERT_JOB *)pContext;
+	int yStart = pJob->height * iJob / nJobs;
+	int yEnd = pJob->height * (iJob + 1) / nJobs;
+
+	ConvertBGRAToUYVY(pJob->pCoeffs,
+		pJob->pSrc, pJob->lSrcStride,
+		pJob->pDst, pJob->lDstStride,
+		pJob->pAlpha, pJob->lAlphaStride,
+		pJob->width, yStart, yEnd);
+}
+
+//######################################
+// CopyRows
+// Unaligned loads, the destination rows are the ones we lay out
+//######################################
+void CopyRows (const BYTE *pSrc, LONG lSrcStride, BYTE *pDst, LONG lDstStride, int cbRow, int rows) {
+	for (int y = 0; y < rows; y++) {
+		const BYTE *s = pSrc + (LONG_PTR)y * lSrcStride;
+		BYTE *d = pDst + (LONG_PTR)y * lDstStride;
+
+		int x = 0;
+		for (; x + 64 <= cbRow; x += 64) {
+			__m128i p0 = _mm_loadu_si128((const __m128i *)(s + x));
+			__m128i p1 = _mm_loadu_si128((const __m128i *)(s + x + 16));
+			__m128i p2 = _mm_loadu_si128((const __m128i *)(s + x + 32));
+			__m128i p3 = _mm_loadu_si128((const __m128i *)(s + x + 48));
+			_mm_storeu_si128((__m128i *)(d + x), p0);
+			_mm_storeu_si128((__m128i *)(d + x + 16), p1);
+			_mm_storeu_si128((__m128i *)(d + x + 32), p2);
+			_mm_storeu_si128((__m128i *)(d + x + 48), p3);
+		}
+		for (; x + 16 <= cbRow; x += 16) {
+			_mm_storeu_si128((__m128i *)(d + x), _mm_loadu_si128((const __m128i *)(s + x)));
+		}
+		if (x < cbRow) memcpy(d + x, s + x, cbRow - x);
+	}
+}
+
+//######################################
+// HalveUnit
+// Scalar fallback for one output unit, from the two input rows at x * 2
+//######################################
+static inline void HalveUnit (HalveLayout layout, const BYTE *s0, const BYTE *s1, BYTE *d) {
+	switch (layout) {
+	case Halve_Bytes:
+		d[0] = (BYTE)((s0[0] + s0[1] + s1[0] + s1[1] + 2) >> 2);
+		break;
+	case Halve_Pairs:
+		for (int c = 0; c < 2; c++) d[c] = (BYTE)((s0[c] + s0[c + 2] + s1[c] + s1[c + 2] + 2) >> 2);
+		break;
+	case Halve_Pixels:
+		for (int c = 0; c < 4; c++) d[c] = (BYTE)((s0[c] + s0[c + 4] + s1[c] + s1[c + 4] + 2) >> 2);
+		break;
+	case Halve_UYVY:
+		// Two pixel pairs in, one out: chroma of both, luma of each pair
+		d[0] = (BYTE)((s0[0] + s0[4] + s1[0] + s1[4] + 2) >> 2);
+		d[1] = (BYTE)((s0[1] + s0[3] + s1[1] + s1[3] + 2) >> 2);
+		d[2] = (BYTE)((s0[2] + s0[6] + s1[2] + s1[6] + 2) >> 2);
+		d[3] = (BYTE)((s0[5] + s0[7] + s1[5] + s1[7] + 2) >> 2);
+		break;
+	}
+}
+
+//######################################
+// Halve16
+// 32 input bytes of two rows to 16 output bytes. The rows are averaged
+// first, then neighbouring units: even and odd units are separated into
+// lanes of their own, averaged, and packed back together
+//######################################
+static inline __m128i Halve16 (HalveLayout layout, const BYTE *s0, const BYTE *s1) {
+	__m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)s0), _mm_loadu_si128((const __m128i *)s1));
+	__m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(s0 + 16)), _mm_loadu_si128((const __m128i *)(s1 + 16)));
+
+	switch (layout) {
+	case Halve_Bytes: {
+		const __m128i mask = _mm_set1_epi16(0x00FF);
+		__m128i ha = _mm_avg_epu8(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8));
+		__m128i hb = _mm_avg_epu8(_mm_and_si128(b, mask), _mm_srli_epi16(b, 8));
+		return _mm_packus_epi16(ha, hb);
+	}
+	case Halve_Pairs: {
+		const __m128i mask = _mm_set1_epi32(0x0000FFFF);
+		__m128i ha = _mm_avg_epu8(_mm_and_si128(a, mask), _mm_srli_epi32(a, 16));
+		__m128i hb = _mm_avg_epu8(_mm_and_si128(b, mask), _mm_srli_epi32(b, 16));
+		// 16 bit values in 32 bit lanes, packed without signed saturation
+		ha = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(ha, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+		hb = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(hb, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+		return _mm_unpacklo_epi64(ha, hb);
+	}
+	case Halve_Pixels: {
+		__m128 fa = _mm_castsi128_ps(a), fb = _mm_castsi128_ps(b);
+		__m128i even = _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i odd = _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+		return _mm_avg_epu8(even, odd);
+	}
+	default: {
+		// Luma of each pair lands in byte 1 of its 32 bit lane
+		__m128i la = _mm_avg_epu8(a, _mm_srli_epi32(a, 16));
+		__m128i lb = _mm_avg_epu8(b, _mm_srli_epi32(b, 16));
+		__m128 fa = _mm_castsi128_ps(a), fb = _mm_castsi128_ps(b);
+		__m128 fla = _mm_castsi128_ps(la), flb = _mm_castsi128_ps(lb);
+		__m128i chroma = _mm_avg_epu8(
+			_mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0))),
+			_mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1))));
+		__m128i lumaEven = _mm_castps_si128(_mm_shuffle_ps(fla, flb, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i lumaOdd = _mm_castps_si128(_mm_shuffle_ps(fla, flb, _MM_SHUFFLE(3, 1, 3, 1)));
+		const __m128i maskC = _mm_set1_epi32(0x00FF00FF);
+		const __m128i maskY = _mm_set1_epi32(0x0000FF00);
+		return _mm_or_si128(_mm_or_si128(_mm_and_si128(chroma, maskC), _mm_and_si128(lumaEven, maskY)),
+			_mm_slli_epi32(_mm_and_si128(lumaOdd, maskY), 16));
+	}
+	}
+}
+
+//######################################
+// HalveRows
+// The vector path rounds twice, up to one level brighter than the exact
+// average, which no one watching a preview will see
+//######################################
+void HalveRows (HalveLayout layout, const BYTE *pSrc, LONG lSrcStride, BYTE *pDst, LONG lDstStride, int cbRow, int rows) {
+	const int cbUnit = layout == Halve_Bytes ? 1 : (layout == Halve_Pairs ? 2 : 4);
+
+	for (int y = 0; y < rows; y++) {
+		const BYTE *s0 = pSrc + (LONG_PTR)(2 * y) * lSrcStride;
+		const BYTE *s1 = s0 + lSrcStride;
+		BYTE *d = pDst + (LONG_PTR)y * lDstStride;
+
+		int x = 0;
+		for (; x + 16 <= cbRow; x += 16) {
+			_mm_storeu_si128((__m128i *)(d + x), Halve16(layout, s0 + 2 * x, s1 + 2 * x));
+		}
+		for (; x + cbUnit <= cbRow; x += cbUnit) {
+			HalveUnit(layout, s0 + 2 * x, s1 + 2 * x, d + x);
+		}
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <windows.h>
+
+//######################################
+// BGRX/BGRA to UYVY/UYVA conversion
+// Done in the renderer so the NDI SDK doesn't have to convert RGB itself,
+// single-threaded, inside the send call
+//######################################
+
+enum ColorMatrix {
+	ColorMatrix_BT601,
+	ColorMatrix_BT709
+};
+
+//######################################
+// Fixed point RGB->YCbCr coefficients for one matrix and range. Luma
+// is computed per pixel in Q14, chroma from the sum of a horizontal pixel
+// pair so the result comes out in Q15
+//######################################
+struct CColorCoefficients
+{
+	short yr, yg, yb;
+	short ur, ug, ub;
+	short vr, vg, vb;
+	int yOffset;                // Black level plus rounding, Q14
+	int cOffset;                // 128 plus rounding, Q15
+
+	void Init(ColorMatrix matrix, BOOL bFullRange);
+};
+
+//######################################
+// Converts output rows [yStart, yEnd) of a width x height BGRX/BGRA image
+// pSrc is the source row that ends up as output row 0, lSrcStride may be
+// negative which flips a bottom-up DIB in the same pass. pAlpha is NULL
+// for UYVY, otherwise the alpha plane of a UYVA frame is written there
+//######################################
+void ConvertBGRAToUYVY(
+	const CColorCoefficients *pCoeffs,
+	const BYTE *pSrc, LONG lSrcStride,
+	BYTE *pDst, LONG lDstStride,
+	BYTE *pAlpha, LONG lAlphaStride,
+	int width, int yStart, int yEnd);
+
+//######################################
+// One frame worth of conversion, split into horizontal stripes by
+// ConvertStripe so it can be handed to a CWorkerPool
+//######################################
+struct CONVERT_JOB
+{
+	const CColorCoefficients *pCoeffs;
+	const BYTE *pSrc;
+	LONG lSrcStride;
+	BYTE *pDst;
+	LONG lDstStride;
+	BYTE *pAlpha;
+	LONG lAlphaStride;
+	int width;
+	int height;
+};
+
+void ConvertStripe(void *pContext, int iJob, int nJobs);
+
+//######################################
+// Copies rows of cbRow bytes between strided images, used to cut a region
+// out of a frame whose rows don't start aligned for NDI
+//######################################
+void CopyRows(
+	const BYTE *pSrc, LONG lSrcStride,
+	BYTE *pDst, LONG lDstStride,
+	int cbRow, int rows);
+
+//######################################
+// Halves an image in both directions, each output unit the average of a
+// 2x2 block of input units. cbRow and rows are those of the output, the
+// input is read from 2 * rows rows of 2 * cbRow bytes
+//######################################
+enum HalveLayout {
+	Halve_Bytes,                // One byte per unit: NV12 luma, alpha planes
+	Halve_Pairs,                // Two bytes per unit: NV12's interleaved UV
+	Halve_Pixels,               // Four bytes per unit: BGRX, BGRA
+	Halve_UYVY                  // UYVY, chroma shared by each pixel pair
+};
+
+void HalveRows(
+	HalveLayout layout,
+	const BYTE *pSrc, LONG lSrcStride,
+	BYTE *pDst, LONG lDstStride,
+	int cbRow, int rows);
@@ -0,0 +1,681 @@
+#include "fanout.h"
+#include "convert.h"
+#include <malloc.h>
+
+//######################################
+// Constructor
+//######################################
+CSenderFanout::CSenderFanout () :
+	m_cSenders(0),
+	m_bPrepared(FALSE),
+	m_pPrepared(NULL),
+	m_dwTallyPolicy(0),
+	m_hTallyThread(NULL),
+	m_hTallyExit(NULL)
+{
+	ZeroMemory(m_Senders, sizeof(m_Senders));
+	ZeroMemory(m_Frames, sizeof(m_Frames));
+
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	m_llQpcFrequency = liFrequency.QuadPart;
+}
+
+//######################################
+// Destructor
+//######################################
+CSenderFanout::~CSenderFanout () {
+	Destroy();
+}
+
+//######################################
+// Create
+// Senders that NDI refuses (a name already taken, say) are left out. They
+// count as on program until the tally thread has seen their tally
+//######################################
+int CSenderFanout::Create (const SENDER_DESC *pDescs, int cDescs, DWORD dwTallyPolicy) {
+	Destroy();
+
+	for (int i = 0; i < cDescs && m_cSenders < MAX_SENDERS; i++) {
+		NDIlib_send_create_t params;
+		params.p_ndi_name = pDescs[i].szName;
+		params.p_groups = pDescs[i].szGroups[0] ? pDescs[i].szGroups : NULL;
+		params.clock_video = pDescs[i].bClockVideo ? true : false;
+		params.clock_audio = false;
+
+		NDIlib_send_instance_t pSend = NDIlib_send_create(&params);
+		if (!pSend) continue;
+
+		SENDER *pSender = &m_Senders[m_cSenders++];
+		ZeroMemory(pSender, sizeof(*pSender));
+		pSender->pSend = pSend;
+		pSender->Desc = pDescs[i];
+		pSender->lTally = TALLY_PROGRAM;
+	}
+
+	// The calling thread sends to the first
+	if (m_cSenders > 1) m_Workers.Start(m_cSenders - 1);
+
+	if (dwTallyPolicy && m_cSenders) {
+		m_hTallyExit = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (m_hTallyExit) m_hTallyThread = CreateThread(NULL, 0, TallyProc, this, 0, NULL);
+		if (m_hTallyThread) m_dwTallyPolicy = dwTallyPolicy;
+		else StopTally();
+	}
+
+	return m_cSenders;
+}
+
+//######################################
+// Destroy
+//######################################
+void CSenderFanout::Destroy () {
+	StopTally();
+	Flush();
+	for (int i = 0; i < m_cSenders; i++) {
+		NDIlib_send_destroy(m_Senders[i].pSend);
+		m_Senders[i].pSend = NULL;
+	}
+	FreeRegions();
+	m_Workers.Stop();
+	m_cSenders = 0;
+}
+
+//######################################
+// SetFormat
+// Regions are clipped to the frame and kept to even coordinates so they
+// never split a chroma sample. One that ends up empty, or covers the
+// whole frame, sends the whole frame
+//######################################
+HRESULT CSenderFanout::SetFormat (int xres, int yres) {
+	Flush();
+	FreeRegions();
+
+	for (int i = 0; i < m_cSenders; i++) {
+		SENDER *pSender = &m_Senders[i];
+		const SENDER_DESC *pDesc = &pSender->Desc;
+
+		int x = min(pDesc->lRegionX, xres) & ~1;
+		int y = min(pDesc->lRegionY, yres) & ~1;
+		int width = (pDesc->lRegionWidth ? min(pDesc->lRegionWidth, xres - x) : xres - x) & ~1;
+		int height = (pDesc->lRegionHeight ? min(pDesc->lRegionHeight, yres - y) : yres - y) & ~1;
+		if (width <= 0 || height <= 0) continue;
+		if (x == 0 && y == 0 && width == (xres & ~1) && height == (yres & ~1)) continue;
+
+		// Room for a cut of any format we send, BGRA being the largest
+		pSender->cbCopy = (size_t)width * height * 4;
+		pSender->pCopy = (PBYTE)_aligned_malloc(2 * pSender->cbCopy, 64);
+		if (!pSender->pCopy) {
+			FreeRegions();
+			return E_OUTOFMEMORY;
+		}
+		pSender->x = x;
+		pSender->y = y;
+		pSender->width = width;
+		pSender->height = height;
+	}
+
+	// Half of whatever the sender is sent, BGRA being the largest again
+	if (m_dwTallyPolicy & TALLY_HALF_SIZE) {
+		for (int i = 0; i < m_cSenders; i++) {
+			SENDER *pSender = &m_Senders[i];
+			int width = ((pSender->width ? pSender->width : xres) / 2) & ~1;
+			int height = ((pSender->height ? pSender->height : yres) / 2) & ~1;
+			if (width <= 0 || height <= 0) continue;
+
+			pSender->cbHalf = (size_t)width * height * 4;
+			pSender->pHalf = (PBYTE)_aligned_malloc(2 * pSender->cbHalf, 64);
+			if (!pSender->pHalf) {
+				FreeRegions();
+				return E_OUTOFMEMORY;
+			}
+		}
+	}
+
+	return S_OK;
+}
+
+//######################################
+// FreeRegions
+// Back to sending whole frames, no sender may still read a cut or a
+// half size frame. A prepared frame may point into them, it is dropped
+//######################################
+void CSenderFanout::FreeRegions () {
+	m_bPrepared = FALSE;
+	m_pPrepared = NULL;
+	for (int i = 0; i < m_cSenders; i++) {
+		SENDER *pSender = &m_Senders[i];
+		ASSERT(pSender->pInFlight == NULL || (pSender->pCopy == NULL && pSender->pHalf == NULL));
+		if (pSender->pCopy) _aligned_free(pSender->pCopy);
+		pSender->pCopy = NULL;
+		pSender->cbCopy = 0;
+		if (pSender->pHalf) _aligned_free(pSender->pHalf);
+		pSender->pHalf = NULL;
+		pSender->cbHalf = 0;
+		pSender->pSent = NULL;
+		pSender->x = pSender->y = pSender->width = pSender->height = 0;
+	}
+}
+
+//######################################
+// HasRegions
+//######################################
+BOOL CSenderFanout::HasRegions () const {
+	for (int i = 0; i < m_cSenders; i++) {
+		if (m_Senders[i].width) return TRUE;
+	}
+	return FALSE;
+}
+
+//######################################
+// GetSenderStats
+//######################################
+void CSenderFanout::GetSenderStats (int i, SENDER_STATS *pStats) const {
+	const SENDER *pSender = &m_Senders[i];
+	*pStats = pSender->Stats;
+	pStats->lTally = pSender->lTally;
+	pStats->lTallyChanges = pSender->lTallyChanges;
+}
+
+//######################################
+// PixelBytes
+// Of the first plane, *pbPlanar if another plane follows it
+//######################################
+static int PixelBytes (NDIlib_FourCC_type_e FourCC, BOOL *pbPlanar) {
+	*pbPlanar = FALSE;
+	switch (FourCC) {
+	case NDIlib_FourCC_type_BGRX:
+	case NDIlib_FourCC_type_BGRA:
+		return 4;
+	case NDIlib_FourCC_type_UYVA:
+		*pbPlanar = TRUE;
+		return 2;
+	case NDIlib_FourCC_type_UYVY:
+		return 2;
+	default: // NV12
+		*pbPlanar = TRUE;
+		return 1;
+	}
+}
+
+//######################################
+// FrameBytes
+// All planes of a width x height frame
+//######################################
+static LONGLONG FrameBytes (NDIlib_FourCC_type_e FourCC, int width, int height) {
+	LONGLONG llPixels = (LONGLONG)width * height;
+	switch (FourCC) {
+	case NDIlib_FourCC_type_BGRX:
+	case NDIlib_FourCC_type_BGRA:
+		return llPixels * 4;
+	case NDIlib_FourCC_type_UYVA:
+		return llPixels * 3;
+	case NDIlib_FourCC_type_UYVY:
+		return llPixels * 2;
+	default: // NV12
+		return llPixels * 3 / 2;
+	}
+}
+
+//######################################
+// GetRegion
+// FALSE if the sender is sent whole frames
+//######################################
+BOOL CSenderFanout::GetRegion (int i, RECT *prcRegion) const {
+	const SENDER *pSender = &m_Senders[i];
+	if (pSender->width == 0) return FALSE;
+	SetRect(prcRegion, pSender->x, pSender->y, pSender->x + pSender->width, pSender->y + pSender->height);
+	return TRUE;
+}
+
+//######################################
+// PrepareRegion
+// Fills in the frame description the sender is sent. Packed rows that
+// start 16 byte aligned are read by NDI in place, using the frame's
+// stride. Planar formats keep their second plane after the first, so a
+// region of them is always cut out, as is anything unaligned
+//######################################
+void CSenderFanout::PrepareRegion (SENDER *pSender, const NDIlib_video_frame_v2_t *pFrame) {
+	NDIlib_video_frame_v2_t *pOut = &pSender->Frame;
+	*pOut = *pFrame;
+	if (pSender->width == 0) return;
+
+	const int xres = pFrame->xres;
+	const int yres = pFrame->yres;
+	const int width = pSender->width;
+	const int height = pSender->height;
+
+	pOut->xres = width;
+	pOut->yres = height;
+	if (pFrame->picture_aspect_ratio > 0) {
+		pOut->picture_aspect_ratio = pFrame->picture_aspect_ratio * ((float)width * yres) / ((float)height * xres);
+	}
+
+	BOOL bPlanar;
+	const int cbPixel = PixelBytes(pFrame->FourCC, &bPlanar);
+	const LONG lStride = pFrame->line_stride_in_bytes ? pFrame->line_stride_in_bytes : xres * cbPixel;
+	const BYTE *pSrc = pFrame->p_data + (LONG_PTR)pSender->y * lStride + pSender->x * cbPixel;
+
+	if (!bPlanar && ((ULONG_PTR)pSrc & 15) == 0 && (lStride & 15) == 0) {
+		pOut->p_data = (uint8_t *)pSrc;
+		pOut->line_stride_in_bytes = lStride;
+		return;
+	}
+
+	PBYTE pDst = (pSender->pSent == pSender->pCopy) ? pSender->pCopy + pSender->cbCopy : pSender->pCopy;
+
+	const int cbRow = width * cbPixel;
+	CopyRows(pSrc, lStride, pDst, cbRow, cbRow, height);
+
+	const BYTE *pPlane = pFrame->p_data + (LONG_PTR)yres * lStride;
+	if (pFrame->FourCC == NDIlib_FourCC_type_UYVA) {
+		// Alpha plane, one byte per pixel
+		CopyRows(pPlane + (LONG_PTR)pSender->y * xres + pSender->x, xres, pDst + (LONG_PTR)cbRow * height, width, width, height);
+	}
+	else if (bPlanar) {
+		// Interleaved UV at half the height, one byte pair per two pixels
+		CopyRows(pPlane + (LONG_PTR)(pSender->y / 2) * lStride + pSender->x, lStride, pDst + (LONG_PTR)cbRow * height, cbRow, cbRow, height / 2);
+	}
+
+	pOut->p_data = pDst;
+	pOut->line_stride_in_bytes = cbRow;
+	pSender->Stats.llCopied++;
+}
+
+//######################################
+// PrepareHalf
+// The sender's region, or the whole frame, halved in both directions into
+// the half of pHalf it wasn't last sent. Sizes stay even for the chroma
+//######################################
+void CSenderFanout::PrepareHalf (SENDER *pSender, const NDIlib_video_frame_v2_t *pFrame) {
+	NDIlib_video_frame_v2_t *pOut = &pSender->Frame;
+	*pOut = *pFrame;
+
+	const int xres = pFrame->xres;
+	const int yres = pFrame->yres;
+	const int x = pSender->width ? pSender->x : 0;
+	const int y = pSender->width ? pSender->y : 0;
+	const int width = pSender->width ? pSender->width : xres;
+	const int height = pSender->width ? pSender->height : yres;
+	const int halfWidth = (width / 2) & ~1;
+	const int halfHeight = (height / 2) & ~1;
+
+	pOut->xres = halfWidth;
+	pOut->yres = halfHeight;
+	if (pFrame->picture_aspect_ratio > 0) {
+		pOut->picture_aspect_ratio = pFrame->picture_aspect_ratio * ((float)halfWidth * yres) / ((float)halfHeight * xres);
+	}
+
+	BOOL bPlanar;
+	const int cbPixel = PixelBytes(pFrame->FourCC, &bPlanar);
+	const LONG lStride = pFrame->line_stride_in_bytes ? pFrame->line_stride_in_bytes : xres * cbPixel;
+	const BYTE *pSrc = pFrame->p_data + (LONG_PTR)y * lStride + x * cbPixel;
+	const BYTE *pPlane = pFrame->p_data + (LONG_PTR)yres * lStride;
+
+	PBYTE pDst = (pSender->pSent == pSender->pHalf) ? pSender->pHalf + pSender->cbHalf : pSender->pHalf;
+
+	const int cbRow = halfWidth * cbPixel;
+	switch (pFrame->FourCC) {
+	case NDIlib_FourCC_type_BGRX:
+	case NDIlib_FourCC_type_BGRA:
+		HalveRows(Halve_Pixels, pSrc, lStride, pDst, cbRow, cbRow, halfHeight);
+		break;
+	case NDIlib_FourCC_type_UYVA:
+		HalveRows(Halve_UYVY, pSrc, lStride, pDst, cbRow, cbRow, halfHeight);
+		HalveRows(Halve_Bytes, pPlane + (LONG_PTR)y * xres + x, xres, pDst + (LONG_PTR)cbRow * halfHeight, halfWidth, halfWidth, halfHeight);
+		break;
+	case NDIlib_FourCC_type_UYVY:
+		HalveRows(Halve_UYVY, pSrc, lStride, pDst, cbRow, cbRow, halfHeight);
+		break;
+	default: // NV12
+		HalveRows(Halve_Bytes, pSrc, lStride, pDst, cbRow, cbRow, halfHeight);
+		HalveRows(Halve_Pairs, pPlane + (LONG_PTR)(y / 2) * lStride + x, lStride, pDst + (LONG_PTR)cbRow * halfHeight, cbRow, cbRow, halfHeight / 2);
+		break;
+	}
+
+	pOut->p_data = pDst;
+	pOut->line_stride_in_bytes = cbRow;
+}
+
+//######################################
+// PrepareJob
+// Worker pool callback, job iJob prepares sender iJob's frame
+//######################################
+void CSenderFanout::PrepareJob (void *pContext, int iJob, int nJobs) {
+	SEND_JOB *pJob = (SEND_JOB *)pContext;
+	SENDER *pSender = &pJob->pThis->m_Senders[iJob];
+	pSender->llPrepareCost = 0;
+	if (pSender->Mode == Send_Skip) return;
+
+	LARGE_INTEGER liStart, liEnd;
+	QueryPerformanceCounter(&liStart);
+
+	if (pSender->Mode == Send_Half) pJob->pThis->PrepareHalf(pSender, pJob->pFrame);
+	else pJob->pThis->PrepareRegion(pSender, pJob->pFrame);
+
+	QueryPerformanceCounter(&liEnd);
+	pSender->llPrepareCost = liEnd.QuadPart - liStart.QuadPart;
+}
+
+//######################################
+// SendJob
+// Worker pool callback, job iJob sends to sender iJob. The time taken,
+// preparation included, tells the tally policy what it saves
+//######################################
+void CSenderFanout::SendJob (void *pContext, int iJob, int nJobs) {
+	SEND_JOB *pJob = (SEND_JOB *)pContext;
+	SENDER *pSender = &pJob->pThis->m_Senders[iJob];
+	if (pSender->Mode == Send_Skip) return;
+
+	LARGE_INTEGER liStart, liEnd;
+	QueryPerformanceCounter(&liStart);
+
+	if (pJob->bAsync) {
+		NDIlib_send_send_video_async_v2(pSender->pSend, &pSender->Frame);
+	}
+	else {
+		NDIlib_send_send_video_v2(pSender->pSend, &pSender->Frame);
+	}
+
+	QueryPerformanceCounter(&liEnd);
+	pSender->llCost = liEnd.QuadPart - liStart.QuadPart + pSender->llPrepareCost;
+	pSender->pSent = pSender->Frame.p_data;
+}
+
+//######################################
+// Prepare
+// Modes are chosen from the tally as it is now, which for a frame prepared
+// ahead is at most its wait older than at the send. Only cuts and halves
+// are worth the worker pool, whole frames are a description to fill in
+//######################################
+void CSenderFanout::Prepare (const NDIlib_video_frame_v2_t *pFrame, BOOL bRepeat) {
+	ChooseModes(pFrame, bRepeat);
+
+	BOOL bCuts = FALSE;
+	for (int i = 0; i < m_cSenders; i++) {
+		if (m_Senders[i].Mode == Send_Half || (m_Senders[i].Mode == Send_Full && m_Senders[i].width)) bCuts = TRUE;
+	}
+
+	SEND_JOB Job = { this, pFrame, FALSE };
+	if (bCuts && m_cSenders > 1) {
+		m_Workers.Run(PrepareJob, &Job, m_cSenders);
+	}
+	else {
+		for (int i = 0; i < m_cSenders; i++) PrepareJob(&Job, i, m_cSenders);
+	}
+
+	m_bPrepared = TRUE;
+	m_pPrepared = pFrame->p_data;
+}
+
+//######################################
+// ChooseModes
+// Per sender, from the last tally seen. Half rate sends the first frame
+// after leaving program and every other one after that
+//######################################
+void CSenderFanout::ChooseModes (const NDIlib_video_frame_v2_t *pFrame, BOOL bRepeat) {
+	for (int i = 0; i < m_cSenders; i++) {
+		SENDER *pSender = &m_Senders[i];
+		pSender->Mode = Send_Full;
+		if (!m_dwTallyPolicy || (pSender->lTally & TALLY_PROGRAM)) {
+			pSender->lOffProgram = 0;
+			continue;
+		}
+
+		LONG lOffProgram = pSender->lOffProgram++;
+		if ((m_dwTallyPolicy & TALLY_SKIP_REPEATS) && bRepeat) pSender->Mode = Send_Skip;
+		else if ((m_dwTallyPolicy & TALLY_HALF_RATE) && (lOffProgram & 1)) pSender->Mode = Send_Skip;
+		else if ((m_dwTallyPolicy & TALLY_HALF_SIZE) && pSender->pHalf) pSender->Mode = Send_Half;
+	}
+}
+
+//######################################
+// CountModes
+// What the tally policy saved on the frame just sent. The CPU saved is the
+// average full send less what the reduced send took, so the halving itself
+// is accounted for
+//######################################
+void CSenderFanout::CountModes (const NDIlib_video_frame_v2_t *pFrame) {
+	for (int i = 0; i < m_cSenders; i++) {
+		SENDER *pSender = &m_Senders[i];
+		int width = pSender->width ? pSender->width : pFrame->xres;
+		int height = pSender->width ? pSender->height : pFrame->yres;
+		LONGLONG llSaved = 0;
+
+		switch (pSender->Mode) {
+		case Send_Full:
+			if (pSender->llFullCost == 0) pSender->llFullCost = pSender->llCost;
+			else pSender->llFullCost += (pSender->llCost - pSender->llFullCost) / 8;
+			break;
+		case Send_Half:
+			pSender->Stats.llHalved++;
+			pSender->Stats.llBytesSaved += FrameBytes(pFrame->FourCC, width, height)
+				- FrameBytes(pFrame->FourCC, pSender->Frame.xres, pSender->Frame.yres);
+			llSaved = max(pSender->llFullCost - pSender->llCost, (LONGLONG)0);
+			break;
+		case Send_Skip:
+			pSender->Stats.llSkipped++;
+			pSender->Stats.llBytesSaved += FrameBytes(pFrame->FourCC, width, height);
+			llSaved = pSender->llFullCost;
+			break;
+		}
+		pSender->Stats.llCpuSaved += llSaved * 1000000 / m_llQpcFrequency;
+	}
+}
+
+//######################################
+// NewFrame
+// A free slot for the frame about to be sent, with no references yet
+//######################################
+SHARED_FRAME *CSenderFanout::NewFrame (IMediaSample *pSample, const BYTE *pData) {
+	for (int i = 0; i < MAX_SENDERS + 1; i++) {
+		SHARED_FRAME *pFrame = &m_Frames[i];
+		if (pFrame->cRef == 0) {
+			pFrame->pSample = pSample;
+			pFrame->pData = pData;
+			if (pSample) pSample->AddRef();
+			return pFrame;
+		}
+	}
+
+	// Can't happen, every sender holds at most one other frame
+	ASSERT(FALSE);
+	return NULL;
+}
+
+//######################################
+// Unref
+// The last reference gives the sample back and frees the slot
+//######################################
+void CSenderFanout::Unref (SHARED_FRAME *pFrame) {
+	ASSERT(pFrame->cRef > 0);
+	if (--pFrame->cRef == 0) {
+		if (pFrame->pSample) pFrame->pSample->Release();
+		pFrame->pSample = NULL;
+		pFrame->pData = NULL;
+	}
+}
+
+//######################################
+// ReleaseFrame
+// NDI let go of the sender's frame
+//######################################
+void CSenderFanout::ReleaseFrame (SENDER *pSender) {
+	if (pSender->pInFlight == NULL) return;
+
+	Unref(pSender->pInFlight);
+	pSender->pInFlight = NULL;
+	pSender->Stats.llReleased++;
+}
+
+//######################################
+// SendAsync
+// Every sender gets the same data, or its region of it. A send returns
+// once NDI is done with the sender's previous frame, so once all sends
+// are back the previous frames are released. A region cut into a buffer
+// doesn't need the frame any more, but holding it keeps the books simple.
+// A skipped sender would go on reading its previous frame, which the
+// renderer writes the next frame over unless it is a held sample, so it
+// is made to let go of that with a NULL send, long done by now
+//######################################
+DWORD CSenderFanout::SendAsync (const NDIlib_video_frame_v2_t *pFrame, IMediaSample *pSample, BOOL bRepeat) {
+	SHARED_FRAME *pShared = NewFrame(pSample, pFrame->p_data);
+	if (pShared == NULL) return 0;
+
+	// Held across the sends, so a sample can't go back before the last one
+	pShared->cRef = 1;
+
+	if (!m_bPrepared || m_pPrepared != pFrame->p_data) Prepare(pFrame, bRepeat);
+	m_bPrepared = FALSE;
+	SEND_JOB Job = { this, pFrame, TRUE };
+	m_Workers.Run(SendJob, &Job, m_cSenders);
+
+	DWORD dwSent = 0;
+	for (int i = 0; i < m_cSenders; i++) {
+		SENDER *pSender = &m_Senders[i];
+		if (pSender->Mode == Send_Skip) {
+			SHARED_FRAME *pOld = pSender->pInFlight;
+			if (pOld && pOld->pSample == NULL && pOld->pData != pFrame->p_data) {
+				NDIlib_send_send_video_async_v2(pSender->pSend, NULL);
+				ReleaseFrame(pSender);
+			}
+			continue;
+		}
+		pShared->cRef++;
+		ReleaseFrame(pSender);
+		pSender->pInFlight = pShared;
+		pSender->Stats.llSent++;
+		dwSent |= pSender->Desc.bClockVideo ? (SENT_ANY | SENT_CLOCKED) : SENT_ANY;
+	}
+	CountModes(pFrame);
+
+	Unref(pShared);
+	return dwSent;
+}
+
+//######################################
+// Send
+// Synchronous, NDI is done with the frame when this returns
+//######################################
+DWORD CSenderFanout::Send (const NDIlib_video_frame_v2_t *pFrame, BOOL bRepeat) {
+	if (!m_bPrepared || m_pPrepared != pFrame->p_data) Prepare(pFrame, bRepeat);
+	m_bPrepared = FALSE;
+	SEND_JOB Job = { this, pFrame, FALSE };
+	m_Workers.Run(SendJob, &Job, m_cSenders);
+
+	DWORD dwSent = 0;
+	for (int i = 0; i < m_cSenders; i++) {
+		if (m_Senders[i].Mode == Send_Skip) continue;
+		m_Senders[i].Stats.llSent++;
+		m_Senders[i].Stats.llReleased++;
+		dwSent |= m_Senders[i].Desc.bClockVideo ? (SENT_ANY | SENT_CLOCKED) : SENT_ANY;
+	}
+	CountModes(pFrame);
+	return dwSent;
+}
+
+//######################################
+// Flush
+// A NULL frame makes NDI finish with the sender's last async frame
+//######################################
+void CSenderFanout::Flush () {
+	for (int i = 0; i < m_cSenders; i++) {
+		SENDER *pSender = &m_Senders[i];
+		if (pSender->pInFlight) {
+			NDIlib_send_send_video_async_v2(pSender->pSend, NULL);
+			ReleaseFrame(pSender);
+		}
+	}
+}
+
+//######################################
+// IsClocked
+//######################################
+BOOL CSenderFanout::IsClocked () const {
+	for (int i = 0; i < m_cSenders; i++) {
+		if (m_Senders[i].Desc.bClockVideo) return TRUE;
+	}
+	return FALSE;
+}
+
+//######################################
+// IsReading
+//######################################
+BOOL CSenderFanout::IsReading (const BYTE *pData) const {
+	for (int i = 0; i < MAX_SENDERS + 1; i++) {
+		if (m_Frames[i].cRef && m_Frames[i].pData == pData) return TRUE;
+	}
+	return FALSE;
+}
+
+//######################################
+// FramesInFlight
+//######################################
+int CSenderFanout::FramesInFlight () const {
+	int cFrames = 0;
+	for (int i = 0; i < MAX_SENDERS + 1; i++) {
+		if (m_Frames[i].cRef) cFrames++;
+	}
+	return cFrames;
+}
+
+//######################################
+// GetConnections
+//######################################
+int CSenderFanout::GetConnections () {
+	int cConnections = 0;
+	for (int i = 0; i < m_cSenders; i++) {
+		cConnections += NDIlib_send_get_no_connections(m_Senders[i].pSend, 0);
+	}
+	return cConnections;
+}
+
+//######################################
+// TallyProc
+// A single sender's tally is waited on, NDI returns as soon as it changes.
+// Several are looked at in turn every TALLY_POLL_MS. Either way a change
+// is seen well within a frame
+//######################################
+DWORD WINAPI CSenderFanout::TallyProc (LPVOID pParam) {
+	CSenderFanout *pThis = (CSenderFanout *)pParam;
+	const BOOL bSingle = pThis->m_cSenders == 1;
+	BOOL bFirst = TRUE;
+
+	for (;;) {
+		for (int i = 0; i < pThis->m_cSenders; i++) {
+			SENDER *pSender = &pThis->m_Senders[i];
+			NDIlib_tally_t Tally;
+			Tally.on_program = false;
+			Tally.on_preview = false;
+			NDIlib_send_get_tally(pSender->pSend, &Tally, bSingle && !bFirst ? TALLY_WAIT_MS : 0);
+
+			LONG lTally = (Tally.on_program ? TALLY_PROGRAM : 0) | (Tally.on_preview ? TALLY_PREVIEW : 0);
+			if (InterlockedExchange(&pSender->lTally, lTally) != lTally && !bFirst) {
+				InterlockedIncrement(&pSender->lTallyChanges);
+			}
+		}
+		bFirst = FALSE;
+
+		if (WaitForSingleObject(pThis->m_hTallyExit, bSingle ? 0 : TALLY_POLL_MS) == WAIT_OBJECT_0) break;
+	}
+	return 0;
+}
+
+//######################################
+// StopTally
+// Senders count as on program again
+//######################################
+void CSenderFanout::StopTally () {
+	if (m_hTallyThread) {
+		SetEvent(m_hTallyExit);
+		WaitForSingleObject(m_hTallyThread, INFINITE);
+		CloseHandle(m_hTallyThread);
+		m_hTallyThread = NULL;
+	}
+	if (m_hTallyExit) {
+		CloseHandle(m_hTallyExit);
+		m_hTallyExit = NULL;
+	}
+	m_dwTallyPolicy = 0;
+	for (int i = 0; i < m_cSenders; i++) m_Senders[i].lTally = TALLY_PROGRAM;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <streams.h>
+#include <Processing.NDI.Lib.h>
+
+#include "settings.h"
+#include "workers.h"
+
+//######################################
+// A frame handed to several senders. In async mode NDI reads a frame until
+// the next send on the same sender (or a flush), so every sender holds a
+// reference from its send until then, and a sample held for zero copy goes
+// back to its allocator once the last of them lets go
+//######################################
+struct SHARED_FRAME
+{
+	LONG cRef;                  // Senders that may still read it, 0 = slot unused
+	IMediaSample *pSample;      // Held for them, NULL if the data is the renderer's
+	const BYTE *pData;          // What they read
+};
+
+// Tally of a sender, as NDI last reported it
+#define TALLY_PROGRAM      0x01
+#define TALLY_PREVIEW      0x02
+
+// What Send and SendAsync did with a frame
+#define SENT_ANY           0x01    // At least one sender was sent it
+#define SENT_CLOCKED       0x02    // At least one with clock_video was
+
+// How often the tally of several senders is looked at, and how long a
+// single sender's tally is waited on at a time
+#define TALLY_POLL_MS      4
+#define TALLY_WAIT_MS      50
+
+//######################################
+// Counters of one sender
+//######################################
+struct SENDER_STATS
+{
+	LONGLONG llSent;            // Frames handed to it
+	LONGLONG llReleased;        // Of those, let go of again
+	LONGLONG llCopied;          // Of those, region cut into a buffer of its own
+	LONGLONG llHalved;          // Of those, sent at half size for the tally policy
+	LONGLONG llSkipped;         // Frames not sent for the tally policy
+	LONGLONG llBytesSaved;      // Frame data not handed to NDI for the tally policy
+	LONGLONG llCpuSaved;        // Send time saved for the tally policy, us (estimated)
+	LONG lTallyChanges;         // Tally transitions seen
+	LONG lTally;                // TALLY_PROGRAM, TALLY_PREVIEW
+};
+
+//######################################
+// The NDI senders of a renderer
+//
+// Every frame goes to all senders by reference: it is copied or converted
+// once, if at all, whatever the number of senders, and each sender only
+// costs its send call. The senders release the frames they were sent
+// independently, and data is only reused once none of them may read it
+//
+// A sender with a region publishes only that part of the frame. Packed
+// formats point NDI into the frame with its stride where the region's rows
+// start aligned, anything else is cut out into the sender's own buffer.
+// With several senders the sends run on a worker pool, one sender per job,
+// so an 8K frame split into four UHD tiles is encoded on four cores
+//
+// With a tally policy a thread follows every sender's tally, and a sender
+// that isn't on program is sent less: every other frame, frames at half
+// size, or no repaints. The decision is made per frame from the last
+// tally seen, so a sender going to program gets the next frame in full
+//
+// Prepare does the cutting and halving for the next send ahead of it, so
+// the renderer can get it done while it waits for the frame's due time
+//######################################
+class CSenderFanout
+{
+public:
+	CSenderFanout();
+	~CSenderFanout();
+
+	int Create(const SENDER_DESC *pDescs, int cDescs, DWORD dwTallyPolicy);  // Senders created
+	void Destroy();
+
+	// Fits the regions to a new frame size and sizes their buffers
+	HRESULT SetFormat(int xres, int yres);
+
+	int Count() const { return m_cSenders; }
+	BOOL IsClocked() const;                         // Any sender paced by clock_video
+	BOOL HasRegions() const;
+	BOOL GetRegion(int i, RECT *prcRegion) const;   // Fitted region, FALSE if whole frames
+	const SENDER_DESC *Desc(int i) const { return &m_Senders[i].Desc; }
+	void GetSenderStats(int i, SENDER_STATS *pStats) const;
+
+	// What every sender is sent of pFrame, cut or halved into its own
+	// buffer. bRepeat if the frame is a repaint of the one sent last. The
+	// next send of the same data sends this, another Prepare replaces it
+	void Prepare(const NDIlib_video_frame_v2_t *pFrame, BOOL bRepeat);
+
+	// Async sends keep a reference on the frame per sender, pSample (NULL if
+	// NDI reads the renderer's data) is held until the last one is released.
+	// A frame that wasn't prepared is prepared here, with bRepeat. Both
+	// return SENT_ flags, the tally policy may have skipped every sender
+	DWORD SendAsync(const NDIlib_video_frame_v2_t *pFrame, IMediaSample *pSample, BOOL bRepeat);
+	DWORD Send(const NDIlib_video_frame_v2_t *pFrame, BOOL bRepeat);
+
+	// Waits for NDI to finish with all async frames and releases them
+	void Flush();
+
+	BOOL IsReading(const BYTE *pData) const;    // Any sender may still read pData
+	int FramesInFlight() const;                 // Distinct frames held by senders
+	int GetConnections();                       // Receivers over all senders
+
+private:
+	enum SendMode {
+		Send_Full,
+		Send_Half,              // Half size, off program
+		Send_Skip               // Not sent, off program
+	};
+
+	struct SENDER
+	{
+		NDIlib_send_instance_t pSend;
+		SHARED_FRAME *pInFlight;    // Frame NDI may still read, NULL if none
+		const BYTE *pSent;          // Data it was last sent, a cut or half there isn't overwritten
+		SENDER_DESC Desc;
+		SENDER_STATS Stats;
+
+		// Region fitted to the frame, all 0 = the whole frame
+		int x, y, width, height;
+		PBYTE pCopy;                // Two region sized halves, NULL if none fits
+		size_t cbCopy;              // Size of one half
+		NDIlib_video_frame_v2_t Frame;  // What the sender is sent, once prepared
+
+		// Tally policy, the tally written by the tally thread
+		volatile LONG lTally;
+		volatile LONG lTallyChanges;
+		SendMode Mode;              // For the frame being sent
+		LONG lOffProgram;           // Frames offered since it left program
+		PBYTE pHalf;                // Two halves of half size frames, NULL without TALLY_HALF_SIZE
+		size_t cbHalf;              // Size of one half
+		LONGLONG llPrepareCost;     // QPC ticks cutting or halving the last frame took
+		LONGLONG llCost;            // QPC ticks the last send took, preparation included
+		LONGLONG llFullCost;        // Average of full sends, QPC ticks
+	};
+
+	// Shared by the jobs of one send
+	struct SEND_JOB
+	{
+		CSenderFanout *pThis;
+		const NDIlib_video_frame_v2_t *pFrame;
+		BOOL bAsync;
+	};
+
+	static void PrepareJob(void *pContext, int iJob, int nJobs);
+	static void SendJob(void *pContext, int iJob, int nJobs);
+	void PrepareRegion(SENDER *pSender, const NDIlib_video_frame_v2_t *pFrame);
+	void PrepareHalf(SENDER *pSender, const NDIlib_video_frame_v2_t *pFrame);
+	void FreeRegions();
+
+	void ChooseModes(const NDIlib_video_frame_v2_t *pFrame, BOOL bRepeat);
+	void CountModes(const NDIlib_video_frame_v2_t *pFrame);
+	static DWORD WINAPI TallyProc(LPVOID pParam);
+	void StopTally();
+
+	SHARED_FRAME *NewFrame(IMediaSample *pSample, const BYTE *pData);
+	void Unref(SHARED_FRAME *pFrame);
+	void ReleaseFrame(SENDER *pSender);
+
+	SENDER m_Senders[MAX_SENDERS];
+	int m_cSenders;
+
+	// Each sender holds at most one, plus the one being sent
+	SHARED_FRAME m_Frames[MAX_SENDERS + 1];
+
+	BOOL m_bPrepared;               // The senders' Frame are ready for the next send
+	const BYTE *m_pPrepared;        // Data they were prepared from
+
+	CWorkerPool m_Workers;          // One thread per sender but the first
+
+	DWORD m_dwTallyPolicy;          // TALLY_HALF_RATE, TALLY_HALF_SIZE, TALLY_SKIP_REPEATS
+	HANDLE m_hTallyThread;
+	HANDLE m_hTallyExit;            // Manual reset
+	LONGLONG m_llQpcFrequency;
+};
@@ -0,0 +1,99 @@
+#include "framelease.h"
+
+//######################################
+// The pool shared by every renderer instance of the process
+//######################################
+static CCritSec g_FramePoolLock;                // Guards everything below
+static CFramePool g_FramePool;
+static HANDLE g_hLowMemory = NULL;              // Memory resource notification, created on first use
+
+//######################################
+// PoolNow
+// Lock held. Ms for the pool's keep time, and a chance to give all idle
+// memory back when the system runs low
+//######################################
+static uint64_t PoolNow () {
+	if (g_hLowMemory == NULL) {
+		g_hLowMemory = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+		CritSetName(&g_FramePoolLock, "FramePool");
+	}
+
+	uint64_t qwNow = GetTickCount64();
+	BOOL bLow = FALSE;
+	if (g_hLowMemory && QueryMemoryResourceNotification(g_hLowMemory, &bLow) && bLow) {
+		g_FramePool.Trim(qwNow, true);
+	}
+	return qwNow;
+}
+
+//######################################
+// CFrameLease
+//######################################
+CFrameLease::CFrameLease () :
+	m_pBuffer(NULL),
+	m_cbBuffer(0)
+{
+	ZeroMemory(&m_Account, sizeof(m_Account));
+}
+
+CFrameLease::~CFrameLease () {
+	Return();
+}
+
+//######################################
+// Configure
+//######################################
+void CFrameLease::Configure (DWORD dwLimitMB, DWORD dwKeepSeconds) {
+	CAutoLock cLock(&g_FramePoolLock);
+	g_FramePool.SetLimit((uint64_t)dwLimitMB * 1024 * 1024);
+	g_FramePool.SetKeep((uint64_t)dwKeepSeconds * 1000);
+}
+
+//######################################
+// Borrow
+//######################################
+PBYTE CFrameLease::Borrow (size_t cb) {
+	if (m_pBuffer && CFramePool::ClassSize(cb) == CFramePool::ClassSize(m_cbBuffer)) return m_pBuffer;
+	Return();
+
+	CAutoLock cLock(&g_FramePoolLock);
+	m_pBuffer = g_FramePool.Borrow(cb, PoolNow(), &m_Account);
+	m_cbBuffer = m_pBuffer ? cb : 0;
+	return m_pBuffer;
+}
+
+//######################################
+// Return
+//######################################
+void CFrameLease::Return () {
+	if (m_pBuffer == NULL) return;
+
+	CAutoLock cLock(&g_FramePoolLock);
+	g_FramePool.Return(m_pBuffer, PoolNow(), &m_Account);
+	m_pBuffer = NULL;
+	m_cbBuffer = 0;
+}
+
+//######################################
+// Trim
+//######################################
+void CFrameLease::Trim () {
+	CAutoLock cLock(&g_FramePoolLock);
+	g_FramePool.Trim(PoolNow(), false);
+}
+
+//######################################
+// GetAccount
+//######################################
+void CFrameLease::GetAccount (FRAME_POOL_ACCOUNT *pAccount) {
+	CAutoLock cLock(&g_FramePoolLock);
+	*pAccount = m_Account;
+}
+
+//######################################
+// GetStats
+//######################################
+void CFrameLease::GetStats (FRAME_POOL_STATS *pStats) {
+	CAutoLock cLock(&g_FramePoolLock);
+	*pStats = *g_FramePool.Stats();
+}
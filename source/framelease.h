@@ -0,0 +1,41 @@
+#pragma once
+
+#include <streams.h>
+
+#include "framepool.h"
+
+//######################################
+// A renderer instance's buffer from the process wide CFramePool
+//
+// Holds at most one buffer at a time and the instance's account. The pool
+// is locked around every call and trims everything idle when Windows
+// signals low memory
+//######################################
+class CFrameLease
+{
+public:
+	CFrameLease();
+	~CFrameLease();             // Returns the buffer
+
+	// Limit in MB, 0 = none, and seconds idle buffers are kept. All
+	// instances read the same settings, the last call wins
+	static void Configure(DWORD dwLimitMB, DWORD dwKeepSeconds);
+
+	// The buffer held if it is of cb's size class, otherwise the held one
+	// goes back and one of cb bytes is borrowed. NULL if the pool refused
+	PBYTE Borrow(size_t cb);
+	void Return();
+
+	PBYTE Get() const { return m_pBuffer; }
+
+	// Ages out idle buffers without borrowing, for instances that keep theirs
+	static void Trim();
+
+	void GetAccount(FRAME_POOL_ACCOUNT *pAccount);
+	static void GetStats(FRAME_POOL_STATS *pStats);
+
+private:
+	PBYTE m_pBuffer;
+	size_t m_cbBuffer;          // Asked for, its class may be larger
+	FRAME_POOL_ACCOUNT m_Account;
+};
@@ -0,0 +1,145 @@
+#include "framepool.h"
+#include <string.h>
+
+#define FRAME_POOL_PAGE 4096
+
+//######################################
+// CFramePool
+//######################################
+CFramePool::CFramePool () :
+	m_pIdle(NULL),
+	m_pLent(NULL),
+	m_qwKeepMs(0)
+{
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+CFramePool::~CFramePool () {
+	Trim(0, true);
+}
+
+//######################################
+// ClassSize
+// Multiples of a quarter of the power of two below cb
+//######################################
+size_t CFramePool::ClassSize (size_t cb) {
+	if (cb <= FRAME_POOL_MIN_CLASS) return FRAME_POOL_MIN_CLASS;
+	size_t cbPower = FRAME_POOL_MIN_CLASS;
+	while (cbPower <= (cb - 1) / 2) cbPower *= 2;
+	size_t cbStep = cbPower / FRAME_POOL_CLASS_STEPS;
+	return (cb + cbStep - 1) / cbStep * cbStep;
+}
+
+//######################################
+// Borrow
+// The idle buffer of the class returned last is the likeliest to still be
+// in the cache and the TLB. New buffers get every page touched, so the
+// first frame written to them doesn't fault
+//######################################
+uint8_t *CFramePool::Borrow (size_t cb, uint64_t qwNow, FRAME_POOL_ACCOUNT *pAccount) {
+	Trim(qwNow, false);
+
+	size_t cbClass = ClassSize(cb);
+	POOL_BUFFER *pBuffer = NULL;
+	for (POOL_BUFFER **ppBuffer = &m_pIdle; *ppBuffer; ppBuffer = &(*ppBuffer)->pNext) {
+		if ((*ppBuffer)->cbClass != cbClass) continue;
+		pBuffer = *ppBuffer;
+		*ppBuffer = pBuffer->pNext;
+		m_Stats.llReused++;
+		pAccount->llReused++;
+		break;
+	}
+
+	if (pBuffer == NULL) {
+		while (m_Stats.cbLimit && m_Stats.cbAllocated + cbClass > m_Stats.cbLimit) {
+			if (!FreeOldestIdle()) break;
+		}
+		if (m_Stats.cbLimit && m_Stats.cbAllocated + cbClass > m_Stats.cbLimit) {
+			m_Stats.llRefused++;
+			pAccount->llRefused++;
+			return NULL;
+		}
+
+		pBuffer = new POOL_BUFFER;
+		if (pBuffer == NULL) return NULL;
+		if (!SampleBlockAlloc(&pBuffer->Block, cbClass, FRAME_POOL_ALIGN, false)) {
+			delete pBuffer;
+			return NULL;
+		}
+		pBuffer->cbClass = cbClass;
+		for (size_t cbOffset = 0; cbOffset < cbClass; cbOffset += FRAME_POOL_PAGE) {
+			((volatile uint8_t *)pBuffer->Block.pData)[cbOffset] = 0;
+		}
+
+		m_Stats.llAllocated++;
+		m_Stats.llPagesFaulted += (cbClass + FRAME_POOL_PAGE - 1) / FRAME_POOL_PAGE;
+		m_Stats.cbAllocated += cbClass;
+		if (m_Stats.cbAllocated > m_Stats.cbPeak) m_Stats.cbPeak = m_Stats.cbAllocated;
+	}
+
+	pBuffer->pNext = m_pLent;
+	m_pLent = pBuffer;
+	m_Stats.cbLent += cbClass;
+	pAccount->cbLent += cbClass;
+	if (pAccount->cbLent > pAccount->cbPeak) pAccount->cbPeak = pAccount->cbLent;
+	pAccount->llBorrowed++;
+	return pBuffer->Block.pData;
+}
+
+//######################################
+// Return
+//######################################
+void CFramePool::Return (uint8_t *pData, uint64_t qwNow, FRAME_POOL_ACCOUNT *pAccount) {
+	for (POOL_BUFFER **ppBuffer = &m_pLent; *ppBuffer; ppBuffer = &(*ppBuffer)->pNext) {
+		if ((*ppBuffer)->Block.pData != pData) continue;
+		POOL_BUFFER *pBuffer = *ppBuffer;
+		*ppBuffer = pBuffer->pNext;
+
+		m_Stats.cbLent -= pBuffer->cbClass;
+		pAccount->cbLent -= pBuffer->cbClass;
+		pBuffer->qwIdleSince = qwNow;
+		pBuffer->pNext = m_pIdle;
+		m_pIdle = pBuffer;
+		break;
+	}
+
+	Trim(qwNow, false);
+}
+
+//######################################
+// Trim
+//######################################
+void CFramePool::Trim (uint64_t qwNow, bool bAll) {
+	POOL_BUFFER **ppBuffer = &m_pIdle;
+	while (*ppBuffer) {
+		POOL_BUFFER *pBuffer = *ppBuffer;
+		if (bAll || qwNow - pBuffer->qwIdleSince >= m_qwKeepMs) {
+			*ppBuffer = pBuffer->pNext;
+			FreeBuffer(pBuffer);
+		}
+		else {
+			ppBuffer = &pBuffer->pNext;
+		}
+	}
+}
+
+//######################################
+// FreeOldestIdle
+// The idle list is in the order buffers were returned, the oldest is last
+//######################################
+bool CFramePool::FreeOldestIdle () {
+	if (m_pIdle == NULL) return false;
+
+	POOL_BUFFER **ppBuffer = &m_pIdle;
+	while ((*ppBuffer)->pNext) ppBuffer = &(*ppBuffer)->pNext;
+	FreeBuffer(*ppBuffer);
+	*ppBuffer = NULL;
+	return true;
+}
+
+void CFramePool::FreeBuffer (POOL_BUFFER *pBuffer) {
+	m_Stats.cbAllocated -= pBuffer->cbClass;
+	m_Stats.llTrimmed++;
+	SampleBlockFree(&pBuffer->Block);
+	delete pBuffer;
+}
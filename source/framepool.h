@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sampleblock.h"
+
+//######################################
+// Frame buffers shared by all renderer instances of a process
+//
+// Each instance used to keep its own copy buffer from its first connection
+// until it was deleted, whether it was streaming or not. Here buffers are
+// borrowed when an instance starts and returned when it stops, and another
+// instance needing the same size class gets the same memory, already
+// faulted in. Sizes are rounded up to FRAME_POOL_CLASS_STEPS classes per
+// power of two, so a buffer is less than a quarter larger than asked for.
+// The pool can be held to a limit: idle buffers are freed oldest first to
+// make room, once idle for the keep time, or all at once under memory
+// pressure, and a borrow that still doesn't fit is refused. Each borrower
+// has an account of what it holds. Nothing here locks, framelease.h does,
+// and the times are passed in, so tools/poolbench.cpp runs the same code
+//######################################
+
+#define FRAME_POOL_ALIGN        4096                // Buffers start on a page
+#define FRAME_POOL_MIN_CLASS    (64 * 1024)
+#define FRAME_POOL_CLASS_STEPS  4                   // Size classes per power of two
+
+struct FRAME_POOL_ACCOUNT
+{
+	uint64_t cbLent;            // Held now
+	uint64_t cbPeak;
+	uint64_t llBorrowed;
+	uint64_t llReused;          // Borrows served by an idle buffer
+	uint64_t llRefused;         // Borrows over the limit
+};
+
+struct FRAME_POOL_STATS
+{
+	uint64_t cbLimit;           // 0 = none
+	uint64_t cbAllocated;       // Lent and idle
+	uint64_t cbLent;
+	uint64_t cbPeak;            // Most ever allocated at once
+	uint64_t llAllocated;       // Buffers allocated
+	uint64_t llReused;
+	uint64_t llRefused;
+	uint64_t llTrimmed;         // Idle buffers freed, to make room, aged or under pressure
+	uint64_t llPagesFaulted;    // Pages touched when allocating
+};
+
+class CFramePool
+{
+public:
+	CFramePool();
+	~CFramePool();              // Frees the idle buffers, all must have been returned
+
+	void SetLimit(uint64_t cbLimit) { m_Stats.cbLimit = cbLimit; }
+	void SetKeep(uint64_t qwKeepMs) { m_qwKeepMs = qwKeepMs; }
+
+	// Size of the class that holds cb bytes
+	static size_t ClassSize(size_t cb);
+
+	// A buffer of at least cb bytes, NULL if that would go over the limit
+	// even with every idle buffer freed. qwNow is in ms of any clock
+	uint8_t *Borrow(size_t cb, uint64_t qwNow, FRAME_POOL_ACCOUNT *pAccount);
+	void Return(uint8_t *pBuffer, uint64_t qwNow, FRAME_POOL_ACCOUNT *pAccount);
+
+	// Frees idle buffers kept longer than the keep time, all of them with bAll
+	void Trim(uint64_t qwNow, bool bAll);
+
+	const FRAME_POOL_STATS *Stats() const { return &m_Stats; }
+
+private:
+	struct POOL_BUFFER
+	{
+		SAMPLE_BLOCK Block;
+		size_t cbClass;
+		uint64_t qwIdleSince;
+		POOL_BUFFER *pNext;
+	};
+
+	void FreeBuffer(POOL_BUFFER *pBuffer);
+	bool FreeOldestIdle();
+
+	POOL_BUFFER *m_pIdle;       // Most recently returned first
+	POOL_BUFFER *m_pLent;
+	uint64_t m_qwKeepMs;
+	FRAME_POOL_STATS m_Stats;
+};
@@ -0,0 +1,440 @@
+#include "frameshm.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+//######################################
+// Helpers
+// Full barriers, as for the statistics segment. The writer pays for four
+// per frame, a reader for two per slot looked at
+//######################################
+#ifdef _WIN32
+
+static inline void Barrier () {
+	MemoryBarrier();
+}
+
+static inline uint32_t CurrentProcessId () {
+	return (uint32_t)GetCurrentProcessId();
+}
+
+static bool IsProcessAlive (uint32_t dwProcessId) {
+	HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, dwProcessId);
+	if (!hProcess) return GetLastError() == ERROR_ACCESS_DENIED;
+	bool bAlive = WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+	CloseHandle(hProcess);
+	return bAlive;
+}
+
+#else
+
+static inline void Barrier () {
+	__sync_synchronize();
+}
+
+static inline uint32_t CurrentProcessId () {
+	return (uint32_t)getpid();
+}
+
+static bool IsProcessAlive (uint32_t dwProcessId) {
+	return kill((pid_t)dwProcessId, 0) == 0 || errno == EPERM;
+}
+
+#endif
+
+static inline uint64_t AlignUp (uint64_t qw, uint64_t qwAlign) {
+	return (qw + qwAlign - 1) & ~(qwAlign - 1);
+}
+
+//######################################
+// GetFramesClock
+//######################################
+uint64_t GetFramesClock () {
+#ifdef _WIN32
+	static LONGLONG s_llFrequency = 0;
+	LARGE_INTEGER li;
+	if (s_llFrequency == 0) {
+		QueryPerformanceFrequency(&li);
+		s_llFrequency = li.QuadPart;
+	}
+	QueryPerformanceCounter(&li);
+	return (uint64_t)(li.QuadPart / s_llFrequency * 1000000 + li.QuadPart % s_llFrequency * 1000000 / s_llFrequency);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+//######################################
+// GetFramesSegmentName
+//######################################
+void GetFramesSegmentName (const char *pszSource, char *pszSegment) {
+	size_t cch = strlen(FRAMES_SEGMENT_PREFIX);
+	memcpy(pszSegment, FRAMES_SEGMENT_PREFIX, cch);
+	for (; *pszSource && cch < FRAMES_MAX_NAME - 1; pszSource++) {
+		pszSegment[cch++] = (*pszSource == '\\' || *pszSource == '/') ? '_' : *pszSource;
+	}
+	pszSegment[cch] = '\0';
+}
+
+//######################################
+// CFrameWriter
+//######################################
+CFrameWriter::CFrameWriter () :
+#ifdef _WIN32
+	m_hMapping(0),
+#endif
+	m_pHeader(0),
+	m_cbSegment(0),
+	m_qwFrame(0),
+	m_pWriting(0)
+{
+	m_szName[0] = '\0';
+}
+
+CFrameWriter::~CFrameWriter () {
+	Close();
+}
+
+//######################################
+// Open
+// Slot data is page aligned and a whole number of pages, so a reader can
+// hand it on to anything that wants aligned buffers
+//######################################
+bool CFrameWriter::Open (const char *pszSource, uint32_t cSlots, uint64_t cbMaxFrame) {
+	Close();
+
+	if (cSlots < 2) cSlots = 2;
+	if (cSlots > FRAMES_MAX_SLOTS) cSlots = FRAMES_MAX_SLOTS;
+
+	const uint64_t cbSlotData = AlignUp(cbMaxFrame ? cbMaxFrame : 1, FRAMES_DATA_ALIGN);
+	const uint64_t qwDataOffset = AlignUp(sizeof(FRAMES_HEADER) + cSlots * sizeof(FRAMES_SLOT), FRAMES_DATA_ALIGN);
+	const uint64_t qwSegment = qwDataOffset + cSlots * cbSlotData;
+	if (qwSegment > (uint64_t)(size_t)-1) return false;
+	const size_t cbSegment = (size_t)qwSegment;
+
+	GetFramesSegmentName(pszSource, m_szName);
+	const uint32_t dwProcessId = CurrentProcessId();
+	void *pView = 0;
+
+#ifdef _WIN32
+	// An existing mapping keeps its size, too small a one fails to map
+	// until the readers still holding it saw dwWriter go to 0 and let go
+	HANDLE hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)(qwSegment >> 32), (DWORD)qwSegment, m_szName);
+	if (!hMapping) return false;
+
+	pView = MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, cbSegment);
+	if (!pView) {
+		CloseHandle(hMapping);
+		return false;
+	}
+
+	FRAMES_HEADER *pOld = (FRAMES_HEADER *)pView;
+	if (pOld->dwMagic == FRAMES_MAGIC && pOld->dwWriter && pOld->dwWriter != dwProcessId && IsProcessAlive(pOld->dwWriter)) {
+		UnmapViewOfFile(pView);
+		CloseHandle(hMapping);
+		return false;
+	}
+	m_hMapping = hMapping;
+#else
+	// A segment left behind is replaced by a new one of the right size,
+	// readers still mapping it see its writer gone
+	int fd = shm_open(m_szName, O_RDONLY, 0);
+	if (fd >= 0) {
+		FRAMES_HEADER Old;
+		bool bAlive = pread(fd, &Old, sizeof(Old), 0) == (ssize_t)sizeof(Old)
+			&& Old.dwMagic == FRAMES_MAGIC && Old.dwWriter && Old.dwWriter != dwProcessId && IsProcessAlive(Old.dwWriter);
+		close(fd);
+		if (bAlive) return false;
+		shm_unlink(m_szName);
+	}
+
+	fd = shm_open(m_szName, O_RDWR | O_CREAT | O_EXCL, 0666);
+	if (fd < 0) return false;
+	if (ftruncate(fd, (off_t)cbSegment) != 0) {
+		close(fd);
+		shm_unlink(m_szName);
+		return false;
+	}
+
+	pView = mmap(0, cbSegment, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pView == MAP_FAILED) {
+		shm_unlink(m_szName);
+		return false;
+	}
+#endif
+
+	m_pHeader = (FRAMES_HEADER *)pView;
+	m_cbSegment = cbSegment;
+	m_qwFrame = 0;
+
+	// Readers of a segment taken over see every slot change
+	m_pHeader->dwMagic = 0;
+	Barrier();
+	FRAMES_SLOT *pSlots = (FRAMES_SLOT *)(m_pHeader + 1);
+	for (uint32_t i = 0; i < cSlots; i++) {
+		pSlots[i].dwSequence = (pSlots[i].dwSequence | 1) + 1;
+		memset(&pSlots[i].Info, 0, sizeof(pSlots[i].Info));
+	}
+	m_pHeader->dwVersion = FRAMES_VERSION;
+	m_pHeader->cbHeader = sizeof(FRAMES_HEADER);
+	m_pHeader->cbSlot = sizeof(FRAMES_SLOT);
+	m_pHeader->cSlots = cSlots;
+	m_pHeader->qwDataOffset = qwDataOffset;
+	m_pHeader->cbSlotData = cbSlotData;
+	m_pHeader->dwWriter = dwProcessId;
+	Barrier();
+	m_pHeader->dwMagic = FRAMES_MAGIC;
+
+	return true;
+}
+
+//######################################
+// Close
+// Readers see the writer gone, the segment itself lives on until the last
+// of them unmaps it
+//######################################
+void CFrameWriter::Close () {
+	if (!m_pHeader) return;
+
+	Barrier();
+	m_pHeader->dwWriter = 0;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_pHeader);
+	if (m_hMapping) CloseHandle((HANDLE)m_hMapping);
+	m_hMapping = 0;
+#else
+	munmap(m_pHeader, m_cbSegment);
+	shm_unlink(m_szName);
+#endif
+	m_pHeader = 0;
+	m_cbSegment = 0;
+	m_pWriting = 0;
+}
+
+//######################################
+// BeginFrame
+// From here on a reader of the slot's previous frame fails IsCurrent
+//######################################
+uint8_t *CFrameWriter::BeginFrame () {
+	if (!m_pHeader) return 0;
+
+	const uint32_t iSlot = (uint32_t)(m_qwFrame % m_pHeader->cSlots);
+	m_pWriting = (FRAMES_SLOT *)(m_pHeader + 1) + iSlot;
+	m_pWriting->dwSequence = m_pWriting->dwSequence + 1;
+	Barrier();
+
+	return (uint8_t *)m_pHeader + m_pHeader->qwDataOffset + iSlot * m_pHeader->cbSlotData;
+}
+
+//######################################
+// EndFrame
+// Numbers the frame and makes it visible
+//######################################
+void CFrameWriter::EndFrame (const FRAMES_INFO *pInfo) {
+	if (!m_pWriting) return;
+
+	FRAMES_INFO *pSlotInfo = &m_pWriting->Info;
+	*pSlotInfo = *pInfo;
+	pSlotInfo->qwFrame = ++m_qwFrame;
+	pSlotInfo->qwWriteTime = GetFramesClock();
+	if (pSlotInfo->cbData > m_pHeader->cbSlotData) pSlotInfo->cbData = m_pHeader->cbSlotData;
+
+	Barrier();
+	m_pWriting->dwSequence = m_pWriting->dwSequence + 1;
+	m_pWriting = 0;
+}
+
+//######################################
+// CancelFrame
+// The slot's previous frame is gone already, so it is left without one
+//######################################
+void CFrameWriter::CancelFrame () {
+	if (!m_pWriting) return;
+
+	memset(&m_pWriting->Info, 0, sizeof(m_pWriting->Info));
+
+	Barrier();
+	m_pWriting->dwSequence = m_pWriting->dwSequence + 1;
+	m_pWriting = 0;
+}
+
+//######################################
+// Write
+//######################################
+bool CFrameWriter::Write (const FRAMES_INFO *pInfo, const void *pData) {
+	if (!m_pHeader || pInfo->cbData > m_pHeader->cbSlotData) return false;
+
+	uint8_t *pSlotData = BeginFrame();
+	memcpy(pSlotData, pData, (size_t)pInfo->cbData);
+	EndFrame(pInfo);
+	return true;
+}
+
+//######################################
+// CFrameReader
+//######################################
+CFrameReader::CFrameReader () :
+#ifdef _WIN32
+	m_hMapping(0),
+#endif
+	m_pHeader(0),
+	m_cbSegment(0)
+{
+}
+
+CFrameReader::~CFrameReader () {
+	Close();
+}
+
+//######################################
+// Open
+// Maps the header to learn the size, then the whole segment
+//######################################
+bool CFrameReader::Open (const char *pszSource) {
+	Close();
+
+	char szName[FRAMES_MAX_NAME];
+	GetFramesSegmentName(pszSource, szName);
+
+	FRAMES_HEADER Header;
+	const void *pView = 0;
+
+#ifdef _WIN32
+	HANDLE hMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, szName);
+	if (!hMapping) return false;
+
+	pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, sizeof(FRAMES_HEADER));
+	if (!pView) {
+		CloseHandle(hMapping);
+		return false;
+	}
+	memcpy(&Header, pView, sizeof(Header));
+	UnmapViewOfFile(pView);
+#else
+	int fd = shm_open(szName, O_RDONLY, 0);
+	if (fd < 0) return false;
+	if (pread(fd, &Header, sizeof(Header), 0) != (ssize_t)sizeof(Header)) {
+		close(fd);
+		return false;
+	}
+#endif
+
+	// A segment whose writer has gone isn't held on to, on Windows that
+	// would keep the writer from creating it again at another size
+	Barrier();
+	bool bValid = Header.dwMagic == FRAMES_MAGIC && Header.dwWriter != 0 && Header.dwVersion == FRAMES_VERSION
+		&& Header.cbHeader == sizeof(FRAMES_HEADER) && Header.cbSlot == sizeof(FRAMES_SLOT)
+		&& Header.cSlots >= 2 && Header.cSlots <= FRAMES_MAX_SLOTS
+		&& Header.qwDataOffset >= sizeof(FRAMES_HEADER) + Header.cSlots * sizeof(FRAMES_SLOT);
+	const uint64_t qwSegment = Header.qwDataOffset + Header.cSlots * Header.cbSlotData;
+	if (qwSegment > (uint64_t)(size_t)-1) bValid = false;
+
+#ifdef _WIN32
+	if (bValid) pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, (size_t)qwSegment);
+	if (!bValid || !pView) {
+		CloseHandle(hMapping);
+		return false;
+	}
+	m_hMapping = hMapping;
+#else
+	struct stat st;
+	if (bValid && (fstat(fd, &st) != 0 || (uint64_t)st.st_size < qwSegment)) bValid = false;
+	pView = bValid ? mmap(0, (size_t)qwSegment, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (pView == MAP_FAILED) return false;
+#endif
+
+	m_pHeader = (const FRAMES_HEADER *)pView;
+	m_cbSegment = (size_t)qwSegment;
+	return true;
+}
+
+//######################################
+// Close
+//######################################
+void CFrameReader::Close () {
+#ifdef _WIN32
+	if (m_pHeader) UnmapViewOfFile(m_pHeader);
+	if (m_hMapping) CloseHandle((HANDLE)m_hMapping);
+	m_hMapping = 0;
+#else
+	if (m_pHeader) munmap((void *)m_pHeader, m_cbSegment);
+#endif
+	m_pHeader = 0;
+	m_cbSegment = 0;
+}
+
+//######################################
+// ReadSlot
+// Sequence lock read of the slot header. A slot being written has no
+// frame to offer yet, only a sequence that moved under us is retried
+//######################################
+bool CFrameReader::ReadSlot (uint32_t iSlot, FRAMES_VIEW *pView) const {
+	const FRAMES_SLOT *pSlot = (const FRAMES_SLOT *)(m_pHeader + 1) + iSlot;
+
+	for (int nTries = 0; nTries < 100; nTries++) {
+		uint32_t dwBefore = pSlot->dwSequence;
+		if (dwBefore & 1) return false;
+		Barrier();
+
+		memcpy(&pView->Info, (const void *)&pSlot->Info, sizeof(pView->Info));
+
+		Barrier();
+		if (pSlot->dwSequence == dwBefore) {
+			pView->pData = (const uint8_t *)m_pHeader + m_pHeader->qwDataOffset + iSlot * m_pHeader->cbSlotData;
+			pView->pSlot = pSlot;
+			pView->dwSequence = dwBefore;
+			return pView->Info.qwFrame != 0;
+		}
+	}
+	return false;
+}
+
+//######################################
+// Latest
+//######################################
+bool CFrameReader::Latest (FRAMES_VIEW *pView) const {
+	if (!m_pHeader) return false;
+
+	bool bFound = false;
+	for (uint32_t i = 0; i < m_pHeader->cSlots; i++) {
+		FRAMES_VIEW View;
+		if (ReadSlot(i, &View) && (!bFound || View.Info.qwFrame > pView->Info.qwFrame)) {
+			*pView = View;
+			bFound = true;
+		}
+	}
+	return bFound;
+}
+
+//######################################
+// Get
+//######################################
+bool CFrameReader::Get (uint64_t qwFrame, FRAMES_VIEW *pView) const {
+	if (!m_pHeader || qwFrame == 0) return false;
+
+	return ReadSlot((uint32_t)((qwFrame - 1) % m_pHeader->cSlots), pView) && pView->Info.qwFrame == qwFrame;
+}
+
+//######################################
+// IsCurrent
+//######################################
+bool CFrameReader::IsCurrent (const FRAMES_VIEW *pView) const {
+	Barrier();
+	return pView->pSlot->dwSequence == pView->dwSequence;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//######################################
+// Frames published to shared memory for consumers on the same machine
+//
+// A renderer can write every frame it sends into a named ring of slots, so
+// a local consumer maps the segment and reads frames in place, without NDI
+// encoding, decoding and the loopback network in between. Each slot has a
+// sequence lock: odd while the writer fills it, and a reader that finds it
+// unchanged after using the data knows the data was not overwritten in the
+// meantime. Frame n always goes to slot (n - 1) % cSlots, so a reader has
+// cSlots - 1 frame periods to use a frame in place, less however early the
+// writer starts on a frame (the renderer does while the frame waits for
+// its due time, so up to a frame period). The layout only uses
+// fixed width types and is the same on Windows and POSIX systems
+//######################################
+
+#ifdef _WIN32
+#define FRAMES_SEGMENT_PREFIX "Local\\NDIRendererFrames."
+#else
+#define FRAMES_SEGMENT_PREFIX "/NDIRendererFrames."
+#endif
+
+#define FRAMES_MAGIC       0x4D52464E      // 'NFRM'
+#define FRAMES_VERSION     1
+#define FRAMES_MAX_SLOTS   16
+#define FRAMES_DATA_ALIGN  4096            // Slot data starts on a page
+#define FRAMES_MAX_NAME    256
+
+//######################################
+// One frame, the format fields are NDI's
+//######################################
+struct FRAMES_INFO
+{
+	uint64_t qwFrame;               // Frame counter, 1 for the first frame written
+	int64_t llTimestamp;            // Sample start time in 100 ns units, -1 if it had none
+	uint64_t qwWriteTime;           // GetFramesClock() when the frame was complete
+	uint64_t cbData;                // Bytes of frame data in the slot
+	uint32_t dwFourCC;              // NDI FourCC
+	uint32_t dwWidth;
+	uint32_t dwHeight;
+	uint32_t dwStride;              // Bytes per row of the first plane, the others follow it as NDI expects
+	uint32_t dwFrameRateN;          // Frame rate as a fraction, 0/0 if unknown
+	uint32_t dwFrameRateD;
+	uint32_t dwReserved[2];
+};
+
+//######################################
+// Slot header, two cache lines. dwSequence is odd while the writer fills
+// the slot or its data
+//######################################
+struct FRAMES_SLOT
+{
+	volatile uint32_t dwSequence;
+	uint32_t dwReserved0;
+	FRAMES_INFO Info;
+	uint32_t dwReserved[14];
+};
+
+struct FRAMES_HEADER
+{
+	volatile uint32_t dwMagic;      // FRAMES_MAGIC once the fields below are valid
+	uint32_t dwVersion;             // FRAMES_VERSION
+	uint32_t cbHeader;              // sizeof(FRAMES_HEADER)
+	uint32_t cbSlot;                // sizeof(FRAMES_SLOT)
+	uint32_t cSlots;
+	volatile uint32_t dwWriter;     // Process id of the writer, 0 once it has gone
+	uint64_t qwDataOffset;          // Offset of slot 0's data from the header
+	uint64_t cbSlotData;            // Bytes of data per slot, a multiple of FRAMES_DATA_ALIGN
+	uint32_t dwReserved[22];
+};
+
+// Segment layout: FRAMES_HEADER, cSlots FRAMES_SLOTs, then at qwDataOffset
+// the data of slot 0, slot 1 and so on, cbSlotData bytes apart
+
+static_assert(sizeof(FRAMES_INFO) == 64, "FRAMES_INFO layout changed");
+static_assert(sizeof(FRAMES_SLOT) == 128, "FRAMES_SLOT layout changed");
+static_assert(sizeof(FRAMES_HEADER) == 128, "FRAMES_HEADER layout changed");
+
+//######################################
+// Microseconds on a clock all processes of the machine share, for
+// qwWriteTime
+//######################################
+uint64_t GetFramesClock();
+
+//######################################
+// Builds the segment name for a source name, into pszSegment of
+// FRAMES_MAX_NAME bytes. Path separators become underscores
+//######################################
+void GetFramesSegmentName(const char *pszSource, char *pszSegment);
+
+//######################################
+// Writer side, one per segment
+//######################################
+class CFrameWriter
+{
+public:
+	CFrameWriter();
+	~CFrameWriter();
+
+	// Creates the segment, or takes over one whose writer has gone. Fails
+	// if another writer is alive
+	bool Open(const char *pszSource, uint32_t cSlots, uint64_t cbMaxFrame);
+	void Close();
+	bool IsOpen() { return m_pHeader != 0; }
+	uint64_t MaxFrame() const { return m_pHeader ? m_pHeader->cbSlotData : 0; }
+
+	// Marks the next slot as being written and returns its data, then
+	// EndFrame publishes it or CancelFrame leaves the slot empty. Frames
+	// larger than MaxFrame() are refused
+	uint8_t *BeginFrame();
+	void EndFrame(const FRAMES_INFO *pInfo);
+	void CancelFrame();
+	bool IsWriting() const { return m_pWriting != 0; }
+
+	// BeginFrame, a copy of pData and EndFrame
+	bool Write(const FRAMES_INFO *pInfo, const void *pData);
+
+private:
+	char m_szName[FRAMES_MAX_NAME];
+#ifdef _WIN32
+	void *m_hMapping;
+#endif
+	FRAMES_HEADER *m_pHeader;
+	size_t m_cbSegment;
+	uint64_t m_qwFrame;             // Frames written
+	FRAMES_SLOT *m_pWriting;        // Slot between BeginFrame and EndFrame
+};
+
+//######################################
+// A frame read in place. pData points into the segment and stays valid as
+// long as CFrameReader::IsCurrent says so
+//######################################
+struct FRAMES_VIEW
+{
+	FRAMES_INFO Info;
+	const uint8_t *pData;
+	const FRAMES_SLOT *pSlot;
+	uint32_t dwSequence;
+};
+
+//######################################
+// Reader side, the reference for consumers. Maps the segment read only
+//######################################
+class CFrameReader
+{
+public:
+	CFrameReader();
+	~CFrameReader();
+
+	bool Open(const char *pszSource);       // Fails if the writer has gone
+	void Close();
+	bool IsOpen() { return m_pHeader != 0; }
+
+	// The writer closed the segment. Close and Open again: a new one may be
+	// opened under the name, and on Windows the writer can't create it at
+	// another size while this one is still mapped
+	bool IsClosed() const { return m_pHeader && m_pHeader->dwWriter == 0; }
+	uint32_t Slots() const { return m_pHeader ? m_pHeader->cSlots : 0; }
+
+	// The newest complete frame, false if none has been written yet
+	bool Latest(FRAMES_VIEW *pView) const;
+
+	// Frame qwFrame, false if it hasn't been written yet or was overwritten
+	bool Get(uint64_t qwFrame, FRAMES_VIEW *pView) const;
+
+	// The view's data hasn't been touched since the view was taken. Check
+	// after using the data, a false means the use has to be thrown away
+	bool IsCurrent(const FRAMES_VIEW *pView) const;
+
+private:
+	bool ReadSlot(uint32_t iSlot, FRAMES_VIEW *pView) const;
+
+#ifdef _WIN32
+	void *m_hMapping;
+#endif
+	const FRAMES_HEADER *m_pHeader;
+	size_t m_cbSegment;
+};
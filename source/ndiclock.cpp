@@ -0,0 +1,65 @@
+#include "ndiclock.h"
+
+//######################################
+// Constructor
+//######################################
+CNdiClock::CNdiClock (LPUNKNOWN pUnk, HRESULT *phr) :
+	CBaseReferenceClock(NAME("NDI pacing clock"), pUnk, phr)
+{
+	LARGE_INTEGER liFrequency, liNow;
+	QueryPerformanceFrequency(&liFrequency);
+	QueryPerformanceCounter(&liNow);
+	m_llQpcFrequency = liFrequency.QuadPart;
+	m_Pll.Reset(QpcToTime(liNow.QuadPart), true);
+	CritSetName(this, "CNdiClock");
+}
+
+//######################################
+// Destructor
+//######################################
+CNdiClock::~CNdiClock () {
+}
+
+//######################################
+// QpcToTime
+// Split so the multiplication can't overflow after a long uptime
+//######################################
+REFERENCE_TIME CNdiClock::QpcToTime (LONGLONG llCount) const {
+	return (llCount / m_llQpcFrequency) * UNITS + (llCount % m_llQpcFrequency) * UNITS / m_llQpcFrequency;
+}
+
+//######################################
+// GetPrivateTime
+// Replaces the base class' timeGetTime based time, GetTime and the advise
+// thread both go through here
+//######################################
+REFERENCE_TIME CNdiClock::GetPrivateTime () {
+	CAutoLock cObjectLock(this);
+
+	LARGE_INTEGER liNow;
+	QueryPerformanceCounter(&liNow);
+	return m_Pll.Time(QpcToTime(liNow.QuadPart));
+}
+
+//######################################
+// OnSend
+// Pending advises aren't rescheduled, at most 1000 ppm off they would move
+// by a few us
+//######################################
+void CNdiClock::OnSend (LONGLONG llSendStart, LONGLONG llSendEnd, REFERENCE_TIME rtPeriod) {
+	CAutoLock cObjectLock(this);
+	m_Pll.Update(QpcToTime(llSendEnd), QpcToTime(llSendEnd - llSendStart), rtPeriod);
+}
+
+//######################################
+// GetDrift
+//######################################
+double CNdiClock::GetDrift () {
+	CAutoLock cObjectLock(this);
+	return -m_Pll.Frequency() * 1e6;
+}
+
+BOOL CNdiClock::IsLocked () {
+	CAutoLock cObjectLock(this);
+	return m_Pll.IsLocked();
+}
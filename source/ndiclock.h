@@ -0,0 +1,35 @@
+#pragma once
+
+#include <streams.h>
+
+#include "clockpll.h"
+
+//######################################
+// Reference clock slaved to NDI's send pacing
+//
+// Runs off QueryPerformanceCounter at a rate CPacingPll keeps adjusting, so
+// a graph using it follows the timebase NDI sends at instead of drifting
+// against it. The renderer aggregates it and feeds it every send while the
+// graph runs on it; on any other clock the loop would have nothing to steer
+//######################################
+class CNdiClock : public CBaseReferenceClock
+{
+public:
+	CNdiClock(LPUNKNOWN pUnk, HRESULT *phr);
+	~CNdiClock();       // Public, the owning renderer deletes it
+
+	REFERENCE_TIME GetPrivateTime();
+
+	// A send started at QPC time llSendStart and returned at llSendEnd,
+	// NDI paces frames rtPeriod apart
+	void OnSend(LONGLONG llSendStart, LONGLONG llSendEnd, REFERENCE_TIME rtPeriod);
+
+	double GetDrift();  // ppm between NDI's clock and QPC, positive if NDI runs slow
+	BOOL IsLocked();
+
+private:
+	REFERENCE_TIME QpcToTime(LONGLONG llCount) const;
+
+	CPacingPll m_Pll;
+	LONGLONG m_llQpcFrequency;
+};
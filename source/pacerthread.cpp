@@ -0,0 +1,226 @@
+#include "pacerthread.h"
+
+//######################################
+// The pacer shared by every renderer instance of the process. A stopping
+// thread is waited for outside the lock, so it gets handles of its own
+// and a thread started meanwhile doesn't have to wait for it
+//######################################
+struct PACER_THREAD
+{
+	HANDLE hThread;
+	HANDLE hWake;               // Auto reset, a post may need an earlier tick
+	HANDLE hExit;               // Manual reset
+};
+
+static CCritSec g_PacerLock;                    // Guards everything below
+static CSendPacer g_Pacer;
+static PACER_THREAD *g_pPacerThread = NULL;     // NULL while no channel is joined
+static HANDLE g_hReleased[PACER_MAX_CHANNELS];  // Joined channels' events
+static DWORD g_dwTolerance[PACER_MAX_CHANNELS]; // ...and tolerances in ms
+static LONGLONG g_llQpcFrequency = 0;
+
+static REFERENCE_TIME PacerNow () {
+	LARGE_INTEGER liNow;
+	QueryPerformanceCounter(&liNow);
+	return liNow.QuadPart / g_llQpcFrequency * PACER_UNITS
+		+ liNow.QuadPart % g_llQpcFrequency * PACER_UNITS / g_llQpcFrequency;
+}
+
+//######################################
+// UpdateTolerance
+// Lock held. The smallest any joined channel asked for
+//######################################
+static void UpdateTolerance () {
+	DWORD dwTolerance = MAXDWORD;
+	for (int i = 0; i < PACER_MAX_CHANNELS; i++) {
+		if (g_hReleased[i] && g_dwTolerance[i] < dwTolerance) dwTolerance = g_dwTolerance[i];
+	}
+	if (dwTolerance != MAXDWORD) g_Pacer.SetTolerance((int64_t)dwTolerance * (PACER_UNITS / 1000));
+}
+
+//######################################
+// PacerProc
+// Releases whatever is due, then sleeps until the next tick or a post that
+// needs an earlier one. Waits come in whole ms: with a tolerance of at
+// least that the wait is rounded down and the tick picks up the frame up to
+// a ms early, otherwise rounded up. The events are set under the lock, so a
+// channel can't leave and close its event in between
+//######################################
+static DWORD WINAPI PacerProc (LPVOID pParam) {
+	PACER_THREAD *pThread = (PACER_THREAD *)pParam;
+	int iReleased[PACER_MAX_CHANNELS];
+
+	for (;;) {
+		DWORD dwTimeout = INFINITE;
+		{
+			CAutoLock cLock(&g_PacerLock);
+			int cReleased = g_Pacer.Release(PacerNow(), iReleased);
+			for (int i = 0; i < cReleased; i++) SetEvent(g_hReleased[iReleased[i]]);
+
+			int64_t rtNext = g_Pacer.NextTick();
+			if (rtNext != PACER_NEVER) {
+				int64_t rtWait = rtNext - PacerNow();
+				if (rtWait <= 0) dwTimeout = 0;
+				else if (g_Pacer.Tolerance() >= PACER_UNITS / 1000) dwTimeout = (DWORD)(rtWait / (PACER_UNITS / 1000));
+				else dwTimeout = (DWORD)((rtWait + PACER_UNITS / 1000 - 1) / (PACER_UNITS / 1000));
+			}
+		}
+
+		HANDLE hWait[2] = { pThread->hExit, pThread->hWake };
+		if (WaitForMultipleObjects(2, hWait, FALSE, dwTimeout) == WAIT_OBJECT_0) break;
+	}
+	return 0;
+}
+
+//######################################
+// StopPacer
+// Lock not held, the thread was unhooked from g_pPacerThread under it
+//######################################
+static void StopPacer (PACER_THREAD *pThread) {
+	if (pThread->hThread) {
+		SetEvent(pThread->hExit);
+		WaitForSingleObject(pThread->hThread, INFINITE);
+		CloseHandle(pThread->hThread);
+	}
+	if (pThread->hWake) CloseHandle(pThread->hWake);
+	if (pThread->hExit) CloseHandle(pThread->hExit);
+	delete pThread;
+}
+
+//######################################
+// CPacerChannel
+//######################################
+CPacerChannel::CPacerChannel () :
+	m_iChannel(-1),
+	m_hReleased(NULL),
+	m_llReleased(0),
+	m_llMissed(0)
+{
+}
+
+CPacerChannel::~CPacerChannel () {
+	Leave();
+	if (m_hReleased) CloseHandle(m_hReleased);
+}
+
+//######################################
+// Join
+// The event stays until we are deleted, a streaming thread may still be
+// waiting on it when the renderer leaves on its way to stopping
+//######################################
+BOOL CPacerChannel::Join (DWORD dwToleranceMs) {
+	if (m_iChannel >= 0) return TRUE;
+
+	if (m_hReleased == NULL) m_hReleased = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (m_hReleased == NULL) return FALSE;
+	ResetEvent(m_hReleased);
+
+	CAutoLock cLock(&g_PacerLock);
+
+	if (g_pPacerThread == NULL) {
+		LARGE_INTEGER liFrequency;
+		QueryPerformanceFrequency(&liFrequency);
+		g_llQpcFrequency = liFrequency.QuadPart;
+		CritSetName(&g_PacerLock, "Pacer");
+
+		PACER_THREAD *pThread = new PACER_THREAD;
+		if (pThread == NULL) return FALSE;
+		pThread->hThread = NULL;
+		pThread->hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+		pThread->hExit = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (pThread->hWake && pThread->hExit) {
+			pThread->hThread = CreateThread(NULL, 0, PacerProc, pThread, 0, NULL);
+		}
+		if (pThread->hThread == NULL) {
+			StopPacer(pThread);
+			return FALSE;
+		}
+
+		// It only ever sets events, and late ticks are late sends
+		SetThreadPriority(pThread->hThread, THREAD_PRIORITY_TIME_CRITICAL);
+		g_Pacer.ResetStats();
+		g_pPacerThread = pThread;
+	}
+
+	// All taken, then this instance waits on its own. The thread runs for
+	// the others, there is at least one
+	m_iChannel = g_Pacer.Register();
+	if (m_iChannel < 0) return FALSE;
+
+	m_llReleased = 0;
+	m_llMissed = 0;
+	g_hReleased[m_iChannel] = m_hReleased;
+	g_dwTolerance[m_iChannel] = dwToleranceMs;
+	UpdateTolerance();
+	return TRUE;
+}
+
+//######################################
+// Leave
+// The last channel out stops the thread. A wait still in progress is never
+// released now and ends on its signal or timeout
+//######################################
+void CPacerChannel::Leave () {
+	PACER_THREAD *pStop = NULL;
+	{
+		CAutoLock cLock(&g_PacerLock);
+		if (m_iChannel < 0) return;
+		g_Pacer.Unregister(m_iChannel);
+		g_hReleased[m_iChannel] = NULL;
+		m_iChannel = -1;
+		UpdateTolerance();
+		if (g_Pacer.Channels() == 0) {
+			pStop = g_pPacerThread;
+			g_pPacerThread = NULL;
+		}
+	}
+
+	if (pStop) StopPacer(pStop);
+}
+
+//######################################
+// Wait
+// A post due before the tick the pacer is sleeping for wakes it up to
+// reschedule. A release that raced with hSignal is taken off the event,
+// otherwise it would end the next wait straight away. The channel number
+// is only looked at under the lock, Leave may be called meanwhile
+//######################################
+DWORD CPacerChannel::Wait (HANDLE hSignal, REFERENCE_TIME rtWait) {
+	DWORD dwTimeout = (DWORD)(rtWait / (UNITS / MILLISECONDS));
+	int iChannel;
+	{
+		CAutoLock cLock(&g_PacerLock);
+		iChannel = m_iChannel;
+		if (iChannel >= 0) {
+			REFERENCE_TIME rtDue = PacerNow() + rtWait;
+			BOOL bEarlier = rtDue < g_Pacer.NextTick();
+			g_Pacer.Post(iChannel, rtDue);
+			if (bEarlier && g_pPacerThread) SetEvent(g_pPacerThread->hWake);
+		}
+	}
+	if (iChannel < 0) return WaitForSingleObject(hSignal, dwTimeout);
+
+	HANDLE hWait[2] = { hSignal, m_hReleased };
+	DWORD dwResult = WaitForMultipleObjects(2, hWait, FALSE, dwTimeout + PACER_WAIT_SLACK_MS);
+	REFERENCE_TIME rtWoken = PacerNow();
+
+	CAutoLock cLock(&g_PacerLock);
+	if (dwResult == WAIT_OBJECT_0 + 1) {
+		if (iChannel == m_iChannel) g_Pacer.OnWoken(iChannel, rtWoken);
+		m_llReleased++;
+		return WAIT_TIMEOUT;
+	}
+
+	if (iChannel != m_iChannel || !g_Pacer.Cancel(iChannel)) WaitForSingleObject(m_hReleased, 0);
+	if (dwResult == WAIT_TIMEOUT) m_llMissed++;
+	return dwResult;
+}
+
+//######################################
+// GetStats
+//######################################
+void CPacerChannel::GetStats (PACER_STATS *pStats, int *pcChannels) {
+	CAutoLock cLock(&g_PacerLock);
+	*pStats = *g_Pacer.Stats();
+	*pcChannels = g_Pacer.Channels();
+}
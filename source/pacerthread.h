@@ -0,0 +1,44 @@
+#pragma once
+
+#include <streams.h>
+
+#include "sendpacer.h"
+
+#define PACER_WAIT_SLACK_MS 100     // How long past its due time a channel waits for the pacer before going itself
+
+//######################################
+// A renderer instance's place in the process wide send schedule
+//
+// The first channel to join starts the pacer thread, which runs CSendPacer
+// off QueryPerformanceCounter and wakes once per tick instead of once per
+// channel and frame. The last one to leave stops it again. The tolerance
+// used is the smallest any joined channel asked for
+//######################################
+class CPacerChannel
+{
+public:
+	CPacerChannel();
+	~CPacerChannel();
+
+	BOOL Join(DWORD dwToleranceMs);
+	void Leave();
+	BOOL IsJoined() const { return m_iChannel >= 0; }
+
+	// Instead of a timed wait on hSignal: blocks until the pacer releases
+	// the frame due in rtWait or hSignal is set. Returns WAIT_OBJECT_0 for
+	// hSignal and WAIT_TIMEOUT once the frame may go, which may be up to the
+	// tolerance before rtWait is over
+	DWORD Wait(HANDLE hSignal, REFERENCE_TIME rtWait);
+
+	LONGLONG Released() const { return m_llReleased; }
+	LONGLONG Missed() const { return m_llMissed; }
+
+	// Process wide counters of the pacer since it was last started
+	static void GetStats(PACER_STATS *pStats, int *pcChannels);
+
+private:
+	int m_iChannel;             // In CSendPacer, -1 unless joined
+	HANDLE m_hReleased;         // Auto reset, set by the pacer thread
+	LONGLONG m_llReleased;      // Waits the pacer ended
+	LONGLONG m_llMissed;        // Waits that ran into PACER_WAIT_SLACK_MS
+};
@@ -1,25 +1,48 @@
 #include "renderer.h"
 #include <initguid.h>
-#include <Processing.NDI.Lib.h>
+#include "testsource.h"
+#include <stdarg.h>
+#include <stdio.h>
 
 //######################################
 // Defines
 //######################################
 
 // Define ASYNC_MODE to activate asynchronous mode. In async mode sample data is sent asynchronously,
-// which unfortunately requires to copy it in memory, but performance is still better.
+// which requires it to stay valid until the next send. If upstream granted enough buffers the sample
+// itself is held until then, otherwise it is copied. Performance is better either way.
 
 #define ASYNC_MODE
 
+// Buffers the allocator needs before samples are held instead of copied in
+// async mode: one held for NDI, one waiting in the renderer, one being filled
+#define ZERO_COPY_MIN_BUFFERS 3
+
+// Largest alignment asked of upstream, CMemAllocator refuses anything over
+// the allocation granularity. Our own allocator goes up to AllocatorAlign
+#define ALLOCATOR_MAX_ASKED_ALIGN 65536
+
+// Most samples of a ReceiveMultiple batch rendered under one acquisition of
+// the filter locks, a state change waits for at most this many sends
+#define RECEIVE_BATCH_LOCKED 8
+
+// Samples due within this are sent right away instead of waiting for them,
+// less than the wait granularity and NDI's clock_video evens it out anyway
+#define RECEIVE_EARLY_TOLERANCE 10000
+
+// Number of frames sent with each RGB path when ConvertRGB is set to auto
+#define CALIBRATION_FRAMES 120
+#define CALIBRATION_DONE   (2 * CALIBRATION_FRAMES + 1)
+
+// How often a shared memory segment that couldn't be opened is tried again
+#define FRAME_OUTPUT_RETRY_MS 1000
+
 //######################################
 // Globals
 //######################################
-NDIlib_send_instance_t g_pNDI_send = NULL;
-NDIlib_video_frame_v2_t g_NDI_video_frame;
 
-#ifdef ASYNC_MODE
-PBYTE g_data = NULL;
-#endif
+// Renderer instances created so far, numbers the published stats
+LONG g_cInstances = 0;
 
 //######################################
 // GUIDs
@@ -58,6 +81,36 @@ const AMOVIESETUP_FILTER sudSpoutRenderer = {
 	&sudPins                   // Pin details
 };
 
+//######################################
+// Input formats in order of preference, cheapest to send first. The input
+// pin offers them in this order and holds out for the best one upstream
+// can deliver while a connection is being made
+//######################################
+struct FORMAT_PREFERENCE {
+	const GUID *pSubtype;
+	DWORD dwCompression;         // biCompression
+	WORD wBitCount;              // biBitCount
+	const char *pName;
+};
+
+const FORMAT_PREFERENCE g_FormatPreferences[] = {
+	{ &MEDIASUBTYPE_NV12,   MAKEFOURCC('N','V','1','2'), 12, "NV12" },
+	{ &MEDIASUBTYPE_UYVY,   MAKEFOURCC('U','Y','V','Y'), 16, "UYVY" },
+	{ &MEDIASUBTYPE_RGB32,  BI_RGB,                      32, "RGB32" },
+	{ &MEDIASUBTYPE_ARGB32, BI_RGB,                      32, "ARGB32" }
+};
+const int g_cFormatPreferences = sizeof(g_FormatPreferences) / sizeof(g_FormatPreferences[0]);
+
+//######################################
+// Position of a subtype in g_FormatPreferences, or -1 if we don't take it
+//######################################
+static int GetFormatRank (const GUID *pSubtype) {
+	for (int i = 0; i < g_cFormatPreferences; i++) {
+		if (*g_FormatPreferences[i].pSubtype == *pSubtype) return i;
+	}
+	return -1;
+}
+
 //######################################
 // Notify about errors
 //######################################
@@ -69,6 +122,33 @@ void ErrorMessage (const char * msg) {
 	MessageBoxA(NULL, msg, "Error", MB_OK);
 }
 
+//######################################
+// Write a formatted line to the debug log
+//######################################
+void LogMessage (const char * fmt, ...) {
+	char buf[512];
+	va_list args;
+	va_start(args, fmt);
+	_vsnprintf_s(buf, sizeof(buf), _TRUNCATE, fmt, args);
+	va_end(args);
+	OutputDebugStringA(buf);
+}
+
+//######################################
+// Total CPU time used by this process so far, in 100 ns units
+//######################################
+static LONGLONG GetProcessCpuTime () {
+	FILETIME ftCreation, ftExit, ftKernel, ftUser;
+	if (!GetProcessTimes(GetCurrentProcess(), &ftCreation, &ftExit, &ftKernel, &ftUser)) return 0;
+
+	ULARGE_INTEGER uliKernel, uliUser;
+	uliKernel.LowPart = ftKernel.dwLowDateTime;
+	uliKernel.HighPart = ftKernel.dwHighDateTime;
+	uliUser.LowPart = ftUser.dwLowDateTime;
+	uliUser.HighPart = ftUser.dwHighDateTime;
+	return (LONGLONG)(uliKernel.QuadPart + uliUser.QuadPart);
+}
+
 //######################################
 // List of class IDs and creator functions for the class factory. This
 // provides the link between the OLE entry point in the DLL and an object
@@ -79,7 +159,12 @@ CFactoryTemplate g_Templates[] = {
 	, &CLSID_NDIRenderer
 	, CVideoRenderer::CreateInstance
 	, NULL
-	, &sudSpoutRenderer }
+	, &sudSpoutRenderer },
+	{ L"NDIRenderer Test Pattern"
+	, &CLSID_NDITestPattern
+	, CTestPatternSource::CreateInstance
+	, NULL
+	, &sudTestPattern }
 };
 int g_cTemplates = sizeof(g_Templates) / sizeof(g_Templates[0]);
 
@@ -96,27 +181,83 @@ CUnknown * WINAPI CVideoRenderer::CreateInstance (LPUNKNOWN pUnk, HRESULT *phr)
 //######################################
 CVideoRenderer::CVideoRenderer (TCHAR *pName, LPUNKNOWN pUnk, HRESULT *phr) :
 	CBaseVideoRenderer(CLSID_NDIRenderer, pName, pUnk, phr),
-	m_InputPin(NAME("Video Pin"), this, &m_InterfaceLock, phr, L"Input")
+	m_InputPin(NAME("Video Pin"), this, &m_InterfaceLock, phr, L"Input"),
+	m_dwFrameOutputRetry(0),
+	m_pData(NULL),
+	m_lLoggedProportion(-1),
+	m_rtQualityLogged(0),
+	m_pNdiClock(NULL),
+	m_llNextStatsWindow(0),
+	m_rtLastSent(-1),
+	m_llPacerWindow(0),
+	m_llPacerWakeups(0),
+	m_llPacerSkewed(0),
+	m_rtPacerSkewSum(0),
+	m_pSentData(NULL),
+	m_pPrepared(NULL),
+	m_bPreparedHold(FALSE),
+	m_FourCC(NDIlib_FourCC_type_UYVY),
+	m_bRGBSource(FALSE),
+	m_bBottomUp(FALSE),
+	m_bConvertRGB(FALSE),
+	m_cbData(0),
+	m_nCalibrationFrames(CALIBRATION_DONE),
+	m_llCalibrationStart(0),
+	m_llNativeTime(0)
 {
 	// Store the video input pin
 	m_pInputPin = &m_InputPin;
 
+	ZeroMemory(&m_Stats, sizeof(m_Stats));
+	m_Settings.Load();
+	m_Coeffs.Init(m_Settings.dwColorMatrix == 601 ? ColorMatrix_BT601 : ColorMatrix_BT709, m_Settings.dwFullRange);
+
+	CFrameLease::Configure(m_Settings.dwFramePoolLimit, m_Settings.dwFramePoolKeep);
+
+	m_SchedulePolicy.SetLatenessBudget((int64_t)m_Settings.dwLatenessBudget * 10000);
+	m_SchedulePolicy.SetClocked(false);
+
+	if (m_Settings.dwSlaveClock) {
+		m_pNdiClock = new CNdiClock(GetOwner(), phr);
+		if (m_pNdiClock == NULL) *phr = E_OUTOFMEMORY;
+	}
+
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	m_llQpcFrequency = liFrequency.QuadPart;
+
+	ZeroMemory(&m_SharedInfo, sizeof(m_SharedInfo));
+	ZeroMemory(&m_Snapshot, sizeof(m_Snapshot));
+	strcpy_s(m_Snapshot.szName, sizeof(m_Snapshot.szName), m_Settings.Senders[0].szName);
+	if (m_Settings.dwPublishStats && !m_Publisher.Open((uint32_t)InterlockedIncrement(&g_cInstances))) {
+		LogMessage("NDIRenderer: statistics not published, shared memory unavailable or full\n");
+	}
+
+	if (m_Settings.szCaptureFile[0] && FAILED(m_Capture.Start(m_Settings.szCaptureFile))) {
+		LogMessage("NDIRenderer: can't capture to '%s'\n", m_Settings.szCaptureFile);
+	}
+
+	// Local consumers only, frames never go through NDI
+	if (m_Settings.dwSharedMemory == SHARED_MEMORY_ONLY) {
+		LogMessage("NDIRenderer: writing frames to shared memory only, no NDI senders\n");
+		return;
+	}
+
 	// Not required, but "correct" (see the SDK documentation.
 	if (!NDIlib_initialize()){
 		ErrorMessage("Initializing NDILib failed");
 	}
 
-	// We create the NDI sender
-	NDIlib_send_create_t params;
-	params.p_ndi_name = "NDIRenderer";
-	params.p_groups = NULL;
-	params.clock_video = TRUE;
-	params.clock_audio = FALSE;
-	g_pNDI_send = NDIlib_send_create(&params);
-
-	if (!g_pNDI_send) {
+	// We create the NDI senders
+	if (m_Senders.Create(m_Settings.Senders, m_Settings.cSenders, m_Settings.dwTallyPolicy) == 0) {
 		ErrorMessage("Creating NDI sender failed");
 	}
+	else if (m_Settings.cSenders > 1 || m_Senders.Count() < m_Settings.cSenders || m_Settings.dwTallyPolicy) {
+		LogSenders();
+	}
+
+	// NDI's pacing is only modelled if some sender actually has it
+	m_SchedulePolicy.SetClocked(m_Senders.IsClocked() ? true : false);
 }
 
 //######################################
@@ -124,26 +265,44 @@ CVideoRenderer::CVideoRenderer (TCHAR *pName, LPUNKNOWN pUnk, HRESULT *phr) :
 //######################################
 CVideoRenderer::~CVideoRenderer () {
 
-	if (g_pNDI_send) {
+	DiscardPrepared();
+	m_Capture.Stop();
+	m_Workers.Stop();
+	ReleaseSentSample();
+	m_Publisher.Close();
+	m_FrameOutput.Close();
 
-		// Destroy the NDI sender
-		NDIlib_send_destroy(g_pNDI_send);
-		g_pNDI_send = NULL;
+	if (m_Senders.Count()) {
+
+		// Destroy the NDI senders
+		m_Senders.Destroy();
 
 		// Not required, but nice
 		NDIlib_destroy();
 	}
 
-#ifdef ASYNC_MODE
-	if (g_data) {
-		free(g_data);
-		g_data = NULL;
-	}
-#endif
+	m_DataLease.Return();
+	m_pData = NULL;
+
+	delete m_pNdiClock;
+	m_pNdiClock = NULL;
 
 	m_pInputPin = NULL;
 }
 
+//######################################
+// NonDelegatingQueryInterface
+// Renderers get asked first when the graph picks its clock, so offering
+// one here makes the whole graph follow NDI's pacing
+//######################################
+STDMETHODIMP CVideoRenderer::NonDelegatingQueryInterface (REFIID riid, void **ppv) {
+	CheckPointer(ppv, E_POINTER);
+	if (riid == IID_IReferenceClock && m_pNdiClock) {
+		return m_pNdiClock->NonDelegatingQueryInterface(riid, ppv);
+	}
+	return CBaseVideoRenderer::NonDelegatingQueryInterface(riid, ppv);
+}
+
  //######################################
 // CheckMediaType
 // Check the proposed video media type
@@ -210,29 +369,956 @@ HRESULT CVideoRenderer::DoRenderSample (IMediaSample *pMediaSample) {
 
 	CheckPointer(pMediaSample, E_POINTER);
 
-	if (g_pNDI_send) {
+	if (m_dwFrameOutputRetry && GetTickCount() - m_dwFrameOutputRetry >= FRAME_OUTPUT_RETRY_MS) {
+		CAutoLock cInterfaceLock(&m_InterfaceLock);
+		if (m_dwFrameOutputRetry) OpenFrameOutput();
+	}
+
+	if (m_Senders.Count() || m_FrameOutput.IsOpen()) {
 
 		CAutoLock cInterfaceLock(&m_InterfaceLock);
 
-		PBYTE pbData;
-		HRESULT hr = pMediaSample->GetPointer(&pbData);
-		if (FAILED(hr)) return hr;
+		// Usually done while the sample waited for now
+		if (pMediaSample != m_pPrepared) {
+			HRESULT hr = PrerenderSample(pMediaSample, FALSE);
+			if (hr == E_OUTOFMEMORY) {
+				if (m_Stats.llFramesNoBuffer++ == 0) {
+					LogMessage("NDIRenderer: frame pool at its limit of %lu MB, frames aren't sent until it has room\n", m_Settings.dwFramePoolLimit);
+				}
+				return S_OK;
+			}
+			if (FAILED(hr)) return hr;
+		}
+		BOOL bHold = m_bPreparedHold;
+
+		// The same start time twice in a row is a repaint
+		REFERENCE_TIME rtStart, rtStop;
+		REFERENCE_TIME rtPeriod = 0;
+		BOOL bRepeat = FALSE;
+		BOOL bTimed = SUCCEEDED(pMediaSample->GetTime(&rtStart, &rtStop));
+		if (bTimed) {
+			bRepeat = (rtStart == m_rtLastSent);
+			if (bRepeat) m_Stats.llFramesDuplicated++;
+			m_rtLastSent = rtStart;
+			rtPeriod = rtStop - rtStart;
+		}
+		else {
+			rtStart = -1;
+		}
 
-		//send the frame via NDI
+		// Local consumers first, they don't wait for NDI's pacing. The copy
+		// was made with the rest of the processing unless the segment only
+		// opened since
+		if (m_FrameOutput.IsOpen() && !m_FrameOutput.IsWriting()) WriteSharedFrame(rtStart);
+		PublishSharedFrame();
+
+		REFERENCE_TIME rtSendStart = 0;
+		if (m_pClock) {
+			m_pClock->GetTime(&rtSendStart);
+			rtSendStart -= m_tStart;
+		}
+
+		LARGE_INTEGER liSendStart, liSendEnd;
+		QueryPerformanceCounter(&liSendStart);
+
+		//send the frame via NDI, the same frame to every sender
 #ifdef ASYNC_MODE
-		memcpy(g_data, pbData, pMediaSample->GetActualDataLength());
-		g_NDI_video_frame.p_data = g_data;
-		NDIlib_send_send_video_async_v2(g_pNDI_send, &g_NDI_video_frame);
+		DWORD dwSent = m_Senders.SendAsync(&m_NDI_video_frame, bHold ? pMediaSample : NULL, bRepeat);
 #else
-		g_NDI_video_frame.p_data = pbData;
-		NDIlib_send_send_video_v2(g_pNDI_send, &g_NDI_video_frame);
+		DWORD dwSent = m_Senders.Send(&m_NDI_video_frame, bRepeat);
 #endif
 
+		QueryPerformanceCounter(&liSendEnd);
+		LONGLONG llSendTicks = liSendEnd.QuadPart - liSendStart.QuadPart;
+		m_SendLatency.Add((uint32_t)(llSendTicks * 1000000 / m_llQpcFrequency));
+
+		// A frame the tally policy kept from every clocked sender didn't
+		// wait for NDI's pacing, so its send time says nothing about it.
+		// Without clock_video the policy only wants what sends cost
+		BOOL bPaced = (dwSent & SENT_CLOCKED) != 0;
+		BOOL bMeasured = (dwSent & (m_Senders.IsClocked() ? SENT_CLOCKED : SENT_ANY)) != 0;
+		if (bMeasured && m_pClock && m_Settings.dwSchedulePolicy == SCHEDULE_POLICY_NETWORK) {
+			m_SchedulePolicy.OnSent(rtSendStart, llSendTicks * UNITS / m_llQpcFrequency);
+		}
+		// Only close the loop if the graph actually runs on our clock
+		if (bPaced && m_pNdiClock && m_pClock == static_cast<IReferenceClock *>(m_pNdiClock)) {
+			m_pNdiClock->OnSend(liSendStart.QuadPart, liSendEnd.QuadPart, rtPeriod);
+		}
+		m_Stats.llFramesSent++;
+
+		// How long after its due time the send went out, processing aside
+		if (bTimed && m_pClock && m_State == State_Running) {
+			LONGLONG llLate = max(rtSendStart - rtStart, (LONGLONG)0) / 10;
+			m_DueLatency.Add((uint32_t)min(llLate, (LONGLONG)MAXLONG));
+			m_Stats.llDueTimed++;
+			m_Stats.llDueLateSum += llLate;
+			if (llLate > m_Stats.llDueLateMax) m_Stats.llDueLateMax = llLate;
+		}
+
+		m_pSentData = (PBYTE)m_NDI_video_frame.p_data;
+		m_pPrepared->Release();
+		m_pPrepared = NULL;
+
+		PublishStats();
+	}
+
+	return S_OK;
+}
+
+//######################################
+// PrerenderSample
+// Everything DoRenderSample does to a sample before the send calls: the
+// copy or conversion into m_pData, the senders' cuts and halves and the
+// copy into the shared memory ring, which is published with the send. With
+// bAhead the sample is still waiting for its due time (see OnWaitStart and
+// Receive) so none of this lands after the deadline, otherwise it is due
+// now. The sample is held until it is sent, or discarded when another one
+// is prepared, on a flush or a stop. S_FALSE if there was nothing to do,
+// E_OUTOFMEMORY if the frame pool had no buffer
+//######################################
+HRESULT CVideoRenderer::PrerenderSample (IMediaSample *pSample, BOOL bAhead) {
+	CAutoLock cInterfaceLock(&m_InterfaceLock);
+
+	if (pSample == m_pPrepared) return S_OK;
+	if (bAhead && (m_State == State_Stopped || m_pInputPin->IsFlushing() || (m_Senders.Count() == 0 && !m_FrameOutput.IsOpen()))) {
+		return S_FALSE;
+	}
+	DiscardPrepared();
+
+	PBYTE pbData;
+	HRESULT hr = pSample->GetPointer(&pbData);
+	if (FAILED(hr)) return hr;
+
+	if (m_Stats.lAlignRequested > 1 && ((ULONG_PTR)pbData & (m_Stats.lAlignRequested - 1))) {
+		m_Stats.cUnalignedSamples++;
 	}
 
+	BOOL bConvert = m_bConvertRGB;
+	if (m_nCalibrationFrames < CALIBRATION_DONE) bConvert = CalibrateRGB();
+
+	if (!BorrowData(bConvert)) return E_OUTOFMEMORY;
+
+	LARGE_INTEGER liStart, liEnd;
+	QueryPerformanceCounter(&liStart);
+
+	m_bPreparedHold = PrepareFrame(pbData, pSample->GetActualDataLength(), bConvert);
+
+	REFERENCE_TIME rtStart, rtStop;
+	BOOL bTimed = SUCCEEDED(pSample->GetTime(&rtStart, &rtStop));
+	BOOL bRepeat = bTimed && rtStart == m_rtLastSent;
+	m_Senders.Prepare(&m_NDI_video_frame, bRepeat);
+	if (m_FrameOutput.IsOpen()) WriteSharedFrame(bTimed ? rtStart : -1);
+
+	QueryPerformanceCounter(&liEnd);
+	LONGLONG llMicroseconds = (liEnd.QuadPart - liStart.QuadPart) * 1000000 / m_llQpcFrequency;
+	m_PrepareLatency.Add((uint32_t)llMicroseconds);
+	m_Stats.llPrepareTime += llMicroseconds;
+	if (bAhead) m_Stats.llPreparedAhead++;
+	else m_Stats.llPreparedAtDue++;
+
+	m_pPrepared = pSample;
+	m_pPrepared->AddRef();
 	return S_OK;
 }
 
+//######################################
+// DiscardPrepared
+// Lets go of a sample that was prepared but won't be sent. What it left in
+// m_pData and the senders' buffers is written over by the next one
+//######################################
+void CVideoRenderer::DiscardPrepared () {
+	if (m_pPrepared == NULL) return;
+
+	m_pPrepared->Release();
+	m_pPrepared = NULL;
+	m_Stats.llPreparedDiscarded++;
+	m_FrameOutput.CancelFrame();
+}
+
+//######################################
+// ShouldDrawSampleNow
+// The base class schedules for a display: an 8 ms refresh bias, early
+// draws while catching up and drops based on blt time. We have no display,
+// so unless the registry asks for the old behaviour CNetworkSinkPolicy
+// decides, from NDI's pacing and the measured send cost
+//######################################
+HRESULT CVideoRenderer::ShouldDrawSampleNow (IMediaSample *pMediaSample, REFERENCE_TIME *ptrStart, REFERENCE_TIME *ptrEnd) {
+	if (m_Settings.dwSchedulePolicy != SCHEDULE_POLICY_NETWORK) {
+		return CBaseVideoRenderer::ShouldDrawSampleNow(pMediaSample, ptrStart, ptrEnd);
+	}
+
+	REFERENCE_TIME rtNow;
+	m_pClock->GetTime(&rtNow);
+	rtNow -= m_tStart;
+
+	// Upstream still hears how late we are
+	SendQuality(rtNow - *ptrStart, rtNow);
+
+	ScheduleDecision Decision = m_SchedulePolicy.Decide(rtNow, ptrStart, ptrEnd, pMediaSample->IsDiscontinuity() == S_OK);
+	if (Decision == Schedule_Drop) return E_FAIL;
+	return (Decision == Schedule_Send) ? S_OK : S_FALSE;
+}
+
+//######################################
+// OnWaitStart
+// The base class's Receive is about to wait for m_pMediaSample's due time,
+// with no lock held, so the frame is prepared now. As in its pause handling
+// m_bInReceive is clear while we take the interface lock, a state change
+// holding it would wait for us otherwise. A sample that is due already is
+// left to DoRenderSample
+//######################################
+void CVideoRenderer::OnWaitStart () {
+	CBaseVideoRenderer::OnWaitStart();
+
+	m_bInReceive = FALSE;
+	CAutoLock cInterfaceLock(&m_InterfaceLock);
+	if (m_State == State_Stopped) return;
+	m_bInReceive = TRUE;
+
+	IMediaSample *pSample;
+	{
+		CAutoLock cSampleLock(&m_RendererLock);
+		pSample = m_pMediaSample;
+		if (pSample == NULL) return;
+		pSample->AddRef();
+	}
+
+	REFERENCE_TIME tStart, tStop, rtNow;
+	if (m_State != State_Running || m_pClock == NULL || FAILED(pSample->GetTime(&tStart, &tStop))
+		|| FAILED(m_pClock->GetTime(&rtNow)) || rtNow - m_tStart < tStart) {
+		PrerenderSample(pSample, TRUE);
+	}
+	pSample->Release();
+}
+
+//######################################
+// BeginFlush
+// A sample prepared ahead won't be sent, upstream may be waiting for it
+//######################################
+HRESULT CVideoRenderer::BeginFlush () {
+	DiscardPrepared();
+	return CBaseVideoRenderer::BeginFlush();
+}
+
+//######################################
+// ResetStreamingTimes
+// The base class counts dropped frames from zero on every run, keep the
+// total for the published stats
+//######################################
+HRESULT CVideoRenderer::ResetStreamingTimes () {
+	m_Stats.llFramesDropped += m_cFramesDropped;
+	m_SchedulePolicy.Reset();
+	m_lLoggedProportion = -1;
+	return CBaseVideoRenderer::ResetStreamingTimes();
+}
+
+//######################################
+// SendQuality
+// With the network policy the message describes NDI's backpressure rather
+// than a display: lateness when the frame actually leaves, and a proportion
+// that asks the decoder to skip frames before we have to drop them
+//######################################
+HRESULT CVideoRenderer::SendQuality (REFERENCE_TIME trLate, REFERENCE_TIME trRealStream) {
+	if (m_Settings.dwSchedulePolicy != SCHEDULE_POLICY_NETWORK) {
+		return CBaseVideoRenderer::SendQuality(trLate, trRealStream);
+	}
+
+	QUALITY_MSG Msg;
+	m_SchedulePolicy.MakeQuality(trLate, trRealStream, &Msg);
+	if (m_Settings.dwLogQuality) LogQuality(&Msg);
+
+	Quality q;
+	q.Type = Msg.Type ? Flood : Famine;
+	q.Proportion = Msg.Proportion;
+	q.Late = Msg.Late;
+	q.TimeStamp = Msg.TimeStamp;
+
+	// Same sink as the base class: the one set through IQualityControl, else
+	// upstream's, kept until the pin disconnects
+	if (m_pQSink == NULL) {
+		IPin *pOutputPin = m_pInputPin->GetConnected();
+		IQualityControl *pQC = NULL;
+		if (pOutputPin && SUCCEEDED(pOutputPin->QueryInterface(IID_IQualityControl, (void **)&pQC))) {
+			m_pQSink = pQC;
+		}
+	}
+	return m_pQSink ? m_pQSink->Notify(this, q) : S_FALSE;
+}
+
+//######################################
+// LogQuality
+// One line per notable change, so the debug log gives a time series of how
+// upstream was asked to adapt and why
+//######################################
+void CVideoRenderer::LogQuality (const QUALITY_MSG *pQuality) {
+	long lChange = pQuality->Proportion - m_lLoggedProportion;
+	if (m_lLoggedProportion >= 0 && lChange < 50 && lChange > -50
+		&& pQuality->TimeStamp - m_rtQualityLogged < UNITS) return;
+
+	m_lLoggedProportion = pQuality->Proportion;
+	m_rtQualityLogged = pQuality->TimeStamp;
+
+	LogMessage("NDIRenderer: quality %.3f s %s proportion %ld late %.1f ms, NDI queue %d, send %.2f ms, sent %lld dropped %lld\n",
+		pQuality->TimeStamp / (double)UNITS, pQuality->Type ? "Flood" : "Famine", pQuality->Proportion,
+		pQuality->Late / 10000.0, m_SchedulePolicy.QueueOccupancy(pQuality->TimeStamp),
+		m_SchedulePolicy.SendCost() / 10000.0, (long long)m_Stats.llFramesSent,
+		(long long)(m_Stats.llFramesDropped + m_cFramesDropped));
+}
+
+//######################################
+// PublishStats
+// Refreshes our slot in the shared statistics segment. Latency percentiles
+// and the connection count are only worked out once per STATS_WINDOW_MS
+//######################################
+void CVideoRenderer::PublishStats () {
+	if (!m_Publisher.IsOpen()) return;
+
+	STATS_SNAPSHOT *pSnapshot = &m_Snapshot;
+
+	LARGE_INTEGER liNow;
+	QueryPerformanceCounter(&liNow);
+	if (liNow.QuadPart >= m_llNextStatsWindow) {
+		pSnapshot->dwLatencyP50 = m_SendLatency.Percentile(50);
+		pSnapshot->dwLatencyP90 = m_SendLatency.Percentile(90);
+		pSnapshot->dwLatencyP99 = m_SendLatency.Percentile(99);
+		pSnapshot->dwLatencyMax = m_SendLatency.Max();
+		m_SendLatency.Reset();
+		pSnapshot->dwPrepareP50 = m_PrepareLatency.Percentile(50);
+		pSnapshot->dwPrepareP99 = m_PrepareLatency.Percentile(99);
+		m_PrepareLatency.Reset();
+		pSnapshot->dwDueLatencyP50 = m_DueLatency.Percentile(50);
+		pSnapshot->dwDueLatencyP99 = m_DueLatency.Percentile(99);
+		pSnapshot->dwDueLatencyMax = m_DueLatency.Max();
+		m_DueLatency.Reset();
+
+		pSnapshot->dwConnections = (uint32_t)m_Senders.GetConnections();
+		if (m_Settings.dwTallyPolicy) PublishTallyStats(pSnapshot);
+		if (m_Pacer.IsJoined()) PublishPacerStats(pSnapshot, liNow.QuadPart);
+		CFrameLease::Trim();
+		m_llNextStatsWindow = liNow.QuadPart + m_llQpcFrequency * STATS_WINDOW_MS / 1000;
+	}
+
+	pSnapshot->qwFramesSent = m_Stats.llFramesSent;
+	pSnapshot->qwFramesDropped = m_Stats.llFramesDropped + m_cFramesDropped;
+	pSnapshot->qwFramesDuplicated = m_Stats.llFramesDuplicated;
+	pSnapshot->qwFramesIn = pSnapshot->qwFramesSent - pSnapshot->qwFramesDuplicated + pSnapshot->qwFramesDropped;
+	pSnapshot->qwBytesCopied = m_Stats.llBytesCopied;
+	pSnapshot->dwQueueDepth = (uint32_t)m_Senders.FramesInFlight();
+	pSnapshot->dwFourCC = m_InputPin.IsConnected() ? (uint32_t)m_NDI_video_frame.FourCC : 0;
+	pSnapshot->qwUpdateTime = GetStatsTime();
+
+	m_Publisher.Publish(pSnapshot);
+}
+
+//######################################
+// PublishTallyStats
+// Sums of the senders' tally counters, refreshed with the connections
+//######################################
+void CVideoRenderer::PublishTallyStats (STATS_SNAPSHOT *pSnapshot) {
+	pSnapshot->dwTally = 0;
+	pSnapshot->dwTallyChanges = 0;
+	pSnapshot->qwTallyReduced = 0;
+	pSnapshot->qwTallyBytesSaved = 0;
+	pSnapshot->qwTallyCpuSaved = 0;
+
+	for (int i = 0; i < m_Senders.Count(); i++) {
+		SENDER_STATS Sender;
+		m_Senders.GetSenderStats(i, &Sender);
+		if (Sender.lTally & TALLY_PROGRAM) pSnapshot->dwTally |= STATS_TALLY_PROGRAM;
+		if (Sender.lTally & TALLY_PREVIEW) pSnapshot->dwTally |= STATS_TALLY_PREVIEW;
+		pSnapshot->dwTallyChanges += (uint32_t)Sender.lTallyChanges;
+		pSnapshot->qwTallyReduced += Sender.llSkipped + Sender.llHalved;
+		pSnapshot->qwTallyBytesSaved += Sender.llBytesSaved;
+		pSnapshot->qwTallyCpuSaved += Sender.llCpuSaved;
+	}
+}
+
+//######################################
+// PublishPacerStats
+// Wakeups per second and the average skew of the process's pacer since the
+// last window. Its counters start over when the last instance leaves it,
+// then the window counts from zero
+//######################################
+void CVideoRenderer::PublishPacerStats (STATS_SNAPSHOT *pSnapshot, LONGLONG llNow) {
+	PACER_STATS Pacer;
+	int cChannels;
+	CPacerChannel::GetStats(&Pacer, &cChannels);
+
+	LONGLONG llWakeups = Pacer.llTicks + Pacer.llIdleTicks;
+	if (llWakeups < m_llPacerWakeups || Pacer.llSkewed < m_llPacerSkewed) {
+		m_llPacerWakeups = 0;
+		m_llPacerSkewed = 0;
+		m_rtPacerSkewSum = 0;
+	}
+
+	if (m_llPacerWindow && llNow > m_llPacerWindow) {
+		pSnapshot->dwPacerWakeups = (uint32_t)((llWakeups - m_llPacerWakeups) * m_llQpcFrequency / (llNow - m_llPacerWindow));
+	}
+	if (Pacer.llSkewed > m_llPacerSkewed) {
+		pSnapshot->dwPacerSkew = (uint32_t)((Pacer.rtSkewSum - m_rtPacerSkewSum) / (Pacer.llSkewed - m_llPacerSkewed) / 10);
+	}
+
+	m_llPacerWindow = llNow;
+	m_llPacerWakeups = llWakeups;
+	m_llPacerSkewed = Pacer.llSkewed;
+	m_rtPacerSkewSum = Pacer.rtSkewSum;
+}
+
+//######################################
+// ReceiveBatch
+// ReceiveMultiple for our input pin. Runs of samples that are already due
+// (always the case without a clock, and for feeds that are behind) are
+// rendered by RenderDueSamples, anything else goes through the regular
+// Receive one sample at a time
+//######################################
+HRESULT CVideoRenderer::ReceiveBatch (IMediaSample **ppSamples, long nSamples, long *pcProcessed) {
+	HRESULT hr = S_OK;
+	*pcProcessed = 0;
+
+	while (*pcProcessed < nSamples) {
+		long nRun = min(nSamples - *pcProcessed, RECEIVE_BATCH_LOCKED);
+		long cRendered = RenderDueSamples(ppSamples + *pcProcessed, nRun, RECEIVE_EARLY_TOLERANCE, NULL);
+		*pcProcessed += cRendered;
+		if (cRendered == nRun) continue;
+
+		// Past the pin's Receive, the batch was captured already
+		hr = m_InputPin.CRendererInputPin::Receive(ppSamples[*pcProcessed]);
+
+		// S_FALSE means don't send any more
+		if (hr != S_OK) break;
+		(*pcProcessed)++;
+	}
+
+	return hr;
+}
+
+//######################################
+// CaptureSample
+// Hands a sample to the capture tap as it arrives, with the media type it
+// is to be rendered with
+//######################################
+void CVideoRenderer::CaptureSample (IMediaSample *pSample) {
+	if (!m_Capture.IsStarted()) return;
+
+	CAPTURE_FORMAT Format;
+	ZeroMemory(&Format, sizeof(Format));
+	const AM_MEDIA_TYPE *pmt = &m_mtIn;
+	AM_MEDIA_TYPE *pmtSample = NULL;
+	if (pSample->GetMediaType(&pmtSample) == S_OK && pmtSample) pmt = pmtSample;
+
+	CopyMemory(Format.Subtype, &pmt->subtype, sizeof(Format.Subtype));
+	if (pmt->formattype == FORMAT_VideoInfo && pmt->cbFormat >= sizeof(VIDEOINFOHEADER) && pmt->pbFormat) {
+		const VIDEOINFOHEADER *pVideoInfo = (const VIDEOINFOHEADER *)pmt->pbFormat;
+		Format.lWidth = pVideoInfo->bmiHeader.biWidth;
+		Format.lHeight = pVideoInfo->bmiHeader.biHeight;
+		Format.dwBitCount = pVideoInfo->bmiHeader.biBitCount;
+		Format.dwCompression = pVideoInfo->bmiHeader.biCompression;
+		Format.llAvgTimePerFrame = pVideoInfo->AvgTimePerFrame;
+	}
+	if (pmtSample) DeleteMediaType(pmtSample);
+
+	REFERENCE_TIME rtArrival = -1;
+	if (m_pClock && m_State == State_Running) {
+		m_pClock->GetTime(&rtArrival);
+		rtArrival -= m_tStart;
+	}
+
+	m_Capture.Add(pSample, &Format, rtArrival, pmtSample != NULL);
+}
+
+//######################################
+// Receive
+// The base class schedules every sample that isn't due with an advise on
+// the clock, and its advise thread then sets an event the streaming thread
+// waits on: an advise, a reset, a set, a wait and a switch to and from the
+// advise thread per frame, on top of taking the filter locks twice. Here a
+// sample that is due is rendered straight away under one acquisition of
+// the locks, and one that isn't is waited for right here with a single
+// timed wait on the thread signal, which a stop or flush sets. Anything
+// else (paused, a format change, end of stream) goes to the base class, as
+// does everything with the display policy, which schedules 8 ms early.
+// With SendPacer the wait ends on the process wide pacer's tick instead,
+// which may come up to PacerTolerance before the sample is due
+//######################################
+HRESULT CVideoRenderer::Receive (IMediaSample *pSample) {
+	if (!m_Settings.dwFastReceive || m_Settings.dwSchedulePolicy != SCHEDULE_POLICY_NETWORK) {
+		return CBaseVideoRenderer::Receive(pSample);
+	}
+
+	BOOL bWaited = FALSE;
+	BOOL bPrepared = FALSE;
+	REFERENCE_TIME rtEarly = RECEIVE_EARLY_TOLERANCE;
+	for (;;) {
+		REFERENCE_TIME rtWait = 0;
+		if (RenderDueSamples(&pSample, 1, rtEarly, &rtWait) == 1) {
+			if (bWaited) m_Stats.llReceiveWaited++;
+			else m_Stats.llReceiveDue++;
+			return NOERROR;
+		}
+		if (rtWait <= 0) break;
+
+		// Process the frame first and wait for what is left of the time
+		if (!bPrepared) {
+			bPrepared = TRUE;
+			if (PrerenderSample(pSample, TRUE) == S_OK) continue;
+		}
+
+		// As in WaitForRenderTime, a state change waits for us to leave and
+		// the sample is discarded if we were woken up for it
+		m_bInReceive = TRUE;
+		DWORD dwResult = m_Pacer.Wait(m_ThreadSignal, rtWait);
+		m_bInReceive = FALSE;
+		if (dwResult != WAIT_TIMEOUT) {
+			CAutoLock cInterfaceLock(&m_InterfaceLock);
+			if (pSample == m_pPrepared) DiscardPrepared();
+			return NOERROR;
+		}
+
+		m_Stats.llReceiveWaits++;
+		bWaited = TRUE;
+		if (m_Pacer.IsJoined()) rtEarly = RECEIVE_EARLY_TOLERANCE + (REFERENCE_TIME)m_Settings.dwPacerTolerance * (UNITS / MILLISECONDS);
+	}
+
+	m_Stats.llReceiveBase++;
+	return CBaseVideoRenderer::Receive(pSample);
+}
+
+//######################################
+// RenderDueSamples
+// Does what Receive does for each sample but checks the filter state, takes
+// the locks and reads the clock once for the lot, and never waits. Stops at
+// the first sample that needs more than that: a format change, a sample
+// that isn't due yet, or anything CBaseInputPin::Receive objects to. Returns
+// how many samples were consumed, including those quality control dropped.
+// Samples count as due rtEarly before their start time. If it stopped at a
+// sample that isn't due yet, *prtWait says for how long
+//######################################
+long CVideoRenderer::RenderDueSamples (IMediaSample **ppSamples, long nSamples, REFERENCE_TIME rtEarly, REFERENCE_TIME *prtWait) {
+	CAutoLock cInterfaceLock(&m_InterfaceLock);
+
+	if (m_State != State_Running || m_bStreaming == FALSE || m_bEOS || m_bAbort
+		|| m_pMediaSample || m_pInputPin->IsFlushing()) {
+		return 0;
+	}
+
+	REFERENCE_TIME rtNow = 0;
+	if (m_pClock) {
+		m_pClock->GetTime(&rtNow);
+		rtNow -= m_tStart;
+	}
+
+	m_bInReceive = TRUE;
+	CAutoLock cSampleLock(&m_RendererLock);
+
+	long i = 0;
+	for (; i < nSamples; i++) {
+		IMediaSample *pSample = ppSamples[i];
+
+		AM_MEDIA_TYPE *pmt = NULL;
+		if (pSample->GetMediaType(&pmt) == S_OK) {
+			DeleteMediaType(pmt);
+			break;
+		}
+
+		REFERENCE_TIME tStart, tStop;
+		if (m_pClock && SUCCEEDED(pSample->GetTime(&tStart, &tStop)) && tStart > rtNow + rtEarly) {
+			// Rendering the previous ones took time, look again before giving up
+			if (i > 0) {
+				m_pClock->GetTime(&rtNow);
+				rtNow -= m_tStart;
+			}
+			if (tStart > rtNow + rtEarly) {
+				if (prtWait) *prtWait = tStart - rtNow;
+				break;
+			}
+		}
+
+		if (m_pInputPin->CBaseInputPin::Receive(pSample) != NOERROR) break;
+
+		if (m_pPosition) m_pPosition->RegisterMediaTime(pSample);
+
+		// Quality control may still drop it, which Receive reports as success.
+		// S_FALSE only asks to wait for a time that has already come
+		if (FAILED(GetSampleTimes(pSample, &tStart, &tStop))) {
+			if (pSample == m_pPrepared) DiscardPrepared();
+			m_cFramesDropped++;
+			continue;
+		}
+
+		m_SignalTime = m_pInputPin->SampleProps()->tStop;
+		m_pMediaSample = pSample;
+		m_pMediaSample->AddRef();
+
+		Render(m_pMediaSample);
+		ClearPendingSample();
+	}
+
+	m_bInReceive = FALSE;
+	return i;
+}
+
+//######################################
+// PrepareFrame
+// Points the NDI frame at the sample data, a copy of it or a UYVY/UYVA
+// conversion of it. Returns TRUE if NDI reads the sample data directly
+//######################################
+BOOL CVideoRenderer::PrepareFrame (PBYTE pbData, long lActual, BOOL bConvert) {
+
+	if (bConvert) {
+		PBYTE pDst = NextDataBuffer();
+		ConvertFrame(pbData, pDst);
+		m_NDI_video_frame.FourCC = (m_FourCC == NDIlib_FourCC_type_BGRA) ? NDIlib_FourCC_type_UYVA : NDIlib_FourCC_type_UYVY;
+		m_NDI_video_frame.p_data = pDst;
+		m_Stats.llBytesCopied += (LONGLONG)m_NDI_video_frame.xres * m_NDI_video_frame.yres * (m_FourCC == NDIlib_FourCC_type_BGRA ? 3 : 2);
+		return FALSE;
+	}
+
+	m_NDI_video_frame.FourCC = m_FourCC;
+#ifdef ASYNC_MODE
+	if (!m_Stats.bZeroCopy) {
+		PBYTE pDst = NextDataBuffer();
+		if (lActual > m_cbData) lActual = m_cbData;
+		memcpy(pDst, pbData, lActual);
+		m_NDI_video_frame.p_data = pDst;
+		m_Stats.llBytesCopied += lActual;
+		return FALSE;
+	}
+#endif
+	m_NDI_video_frame.p_data = pbData;
+	return TRUE;
+}
+
+//######################################
+// WriteSharedFrame
+// Copies the frame NDI is about to be sent into the next slot of the
+// shared memory ring, planes laid out as NDI expects them. Consumers get
+// it with PublishSharedFrame once it is sent
+//######################################
+void CVideoRenderer::WriteSharedFrame (REFERENCE_TIME rtStart) {
+	const int xres = m_NDI_video_frame.xres;
+	const int yres = m_NDI_video_frame.yres;
+
+	FRAMES_INFO Info;
+	ZeroMemory(&Info, sizeof(Info));
+	switch (m_NDI_video_frame.FourCC) {
+	case NDIlib_FourCC_type_BGRX:
+	case NDIlib_FourCC_type_BGRA:
+		Info.dwStride = xres * 4;
+		Info.cbData = (uint64_t)Info.dwStride * yres;
+		break;
+	case NDIlib_FourCC_type_UYVA:
+		Info.dwStride = xres * 2;
+		Info.cbData = (uint64_t)xres * yres * 3;
+		break;
+	case NDIlib_FourCC_type_NV12:
+		Info.dwStride = xres;
+		Info.cbData = (uint64_t)xres * yres * 3 / 2;
+		break;
+	default:
+		Info.dwStride = xres * 2;
+		Info.cbData = (uint64_t)Info.dwStride * yres;
+		break;
+	}
+	Info.llTimestamp = rtStart;
+	Info.dwFourCC = (uint32_t)m_NDI_video_frame.FourCC;
+	Info.dwWidth = xres;
+	Info.dwHeight = yres;
+	Info.dwFrameRateN = m_Snapshot.dwFrameRateN;
+	Info.dwFrameRateD = m_Snapshot.dwFrameRateD;
+
+	if (Info.cbData > m_FrameOutput.MaxFrame()) return;
+
+	memcpy(m_FrameOutput.BeginFrame(), m_NDI_video_frame.p_data, (size_t)Info.cbData);
+	m_SharedInfo = Info;
+	m_Stats.llBytesCopied += Info.cbData;
+}
+
+//######################################
+// PublishSharedFrame
+//######################################
+void CVideoRenderer::PublishSharedFrame () {
+	if (m_FrameOutput.IsWriting()) m_FrameOutput.EndFrame(&m_SharedInfo);
+}
+
+//######################################
+// BorrowData
+// Conversions always need m_pData, copies only in async mode when samples
+// can't be held instead. It is lent from the frame pool on the first frame
+// that needs it, or in Active before the first frame, and goes back when
+// we stop
+//######################################
+BOOL CVideoRenderer::BorrowData (BOOL bConvert) {
+#ifdef ASYNC_MODE
+	if (!bConvert && m_Stats.bZeroCopy) return TRUE;
+	const long cFrames = 2;
+#else
+	if (!bConvert) return TRUE;
+	const long cFrames = 1;
+#endif
+	if (m_pData) return TRUE;
+	if (m_cbData <= 0) return FALSE;
+
+	m_pData = m_DataLease.Borrow((size_t)cFrames * m_cbData);
+	m_pSentData = NULL;
+	return m_pData != NULL;
+}
+
+//######################################
+// NextDataBuffer
+// In async mode the two halves of m_pData take turns so we never write to
+// the frame NDI may still be reading, the one sent last. A sender the
+// tally policy skipped was made to let go of the other half by then, see
+// CSenderFanout::SendAsync. A frame prepared and discarded leaves the turn
+// where it was
+//######################################
+PBYTE CVideoRenderer::NextDataBuffer () {
+#ifdef ASYNC_MODE
+	PBYTE pData = (m_pSentData == m_pData) ? m_pData + m_cbData : m_pData;
+	ASSERT(!m_Senders.IsReading(pData));
+	return pData;
+#else
+	return m_pData;
+#endif
+}
+
+//######################################
+// ReleaseSentSample
+// Waits for NDI to finish with the last async frame on every sender and
+// hands a sample we were holding for them back to its allocator
+//######################################
+void CVideoRenderer::ReleaseSentSample () {
+	m_Senders.Flush();
+}
+
+//######################################
+// LogSenders
+// Which names and groups the feed goes out under
+//######################################
+void CVideoRenderer::LogSenders () {
+	LogMessage("NDIRenderer: sending to %d of %d senders\n", m_Senders.Count(), m_Settings.cSenders);
+	for (int i = 0; i < m_Senders.Count(); i++) {
+		const SENDER_DESC *pDesc = m_Senders.Desc(i);
+		char szRegion[64] = "";
+		RECT rcRegion;
+		if (m_Senders.GetRegion(i, &rcRegion)) {
+			sprintf_s(szRegion, sizeof(szRegion), ", region %ldx%ld at %ld,%ld",
+				rcRegion.right - rcRegion.left, rcRegion.bottom - rcRegion.top, rcRegion.left, rcRegion.top);
+		}
+		LogMessage("NDIRenderer: sender '%s', groups '%s'%s%s\n", pDesc->szName,
+			pDesc->szGroups[0] ? pDesc->szGroups : "default", pDesc->bClockVideo ? ", clocked" : "", szRegion);
+	}
+	DWORD dwTally = m_Settings.dwTallyPolicy;
+	if (dwTally) {
+		LogMessage("NDIRenderer: off program senders get%s%s%s\n", (dwTally & TALLY_HALF_RATE) ? " half the frames" : "",
+			(dwTally & TALLY_HALF_SIZE) ? " at half size" : "", (dwTally & TALLY_SKIP_REPEATS) ? " without repaints" : "");
+	}
+}
+
+//######################################
+// OpenFrameOutput
+// Room for the largest format we may write, BGRA. A segment still mapped
+// by readers keeps its size on Windows, so after a reconnect at a larger
+// size it can only be created once they saw the writer gone and let go of
+// it. Until then this is tried again every FRAME_OUTPUT_RETRY_MS
+//######################################
+void CVideoRenderer::OpenFrameOutput () {
+	if (m_FrameOutput.Open(m_Settings.Senders[0].szName, m_Settings.dwSharedMemorySlots,
+		(uint64_t)m_NDI_video_frame.xres * m_NDI_video_frame.yres * 4)) {
+		if (m_dwFrameOutputRetry) LogMessage("NDIRenderer: shared memory frames available again\n");
+		m_dwFrameOutputRetry = 0;
+		return;
+	}
+
+	if (m_dwFrameOutputRetry == 0) {
+		LogMessage("NDIRenderer: shared memory frames unavailable, '%s' taken, still mapped at a smaller size or out of memory, retrying\n", m_Settings.Senders[0].szName);
+	}
+	m_dwFrameOutputRetry = GetTickCount() | 1;
+}
+
+#ifdef CRITSEC_PROFILE
+//######################################
+// LogLockStats
+// Receives the lock contention dump line by line
+//######################################
+static void LogLockStats (void *pContext, const char *pLine) {
+	LogMessage("NDIRenderer: lock %s", pLine);
+}
+#endif
+
+//######################################
+// Active
+// Called when we leave the stopped state. Only Receive's own wait can be
+// left to the pacer, the base class path schedules with clock advises.
+// The copy buffer is borrowed now if we may need it, so the first frame
+// after a cue is written to memory that is already faulted in. The
+// allocator is settled by now, so this is where the frame path is logged,
+// unless calibration still has to pick it
+//######################################
+HRESULT CVideoRenderer::Active () {
+	BorrowData(m_bRGBSource && m_Settings.dwConvertRGB != CONVERT_RGB_OFF);
+	if (m_nCalibrationFrames >= CALIBRATION_DONE) LogFramePath(m_bConvertRGB);
+
+	if (m_Settings.dwSendPacer && m_Settings.dwFastReceive && m_Settings.dwSchedulePolicy == SCHEDULE_POLICY_NETWORK) {
+		if (!m_Pacer.Join(m_Settings.dwPacerTolerance)) {
+			LogMessage("NDIRenderer: send pacer unavailable, waiting for samples on our own\n");
+		}
+		m_llPacerWindow = 0;
+	}
+	return CBaseVideoRenderer::Active();
+}
+
+//######################################
+// Inactive
+// Called when we are stopped. A held sample must go back before upstream
+// decommits its allocator
+//######################################
+HRESULT CVideoRenderer::Inactive () {
+	DiscardPrepared();
+	ReleaseSentSample();
+	PublishStats();
+	if (m_Pacer.IsJoined()) {
+		PACER_STATS Pacer;
+		int cChannels;
+		CPacerChannel::GetStats(&Pacer, &cChannels);
+		LogMessage("NDIRenderer: send pacer released %lld of our samples, %lld waits ran over; for %d channels %lld ticks and %lld idle wakeups released %lld samples, "
+			"%.1f per tick, skew avg %.0f max %.0f us, early avg %.0f max %.0f us, late max %.0f us\n",
+			m_Pacer.Released(), m_Pacer.Missed(), cChannels, Pacer.llTicks, Pacer.llIdleTicks, Pacer.llReleased,
+			Pacer.llTicks ? (double)Pacer.llReleased / Pacer.llTicks : 0.0,
+			Pacer.llSkewed ? Pacer.rtSkewSum / 10.0 / Pacer.llSkewed : 0.0, Pacer.rtSkewMax / 10.0,
+			Pacer.llReleased ? Pacer.rtEarlySum / 10.0 / Pacer.llReleased : 0.0, Pacer.rtEarlyMax / 10.0, Pacer.rtLateMax / 10.0);
+		m_Pacer.Leave();
+	}
+	if (m_pData || m_Stats.llFramesNoBuffer) {
+		FRAME_POOL_ACCOUNT Account;
+		FRAME_POOL_STATS Pool;
+		m_DataLease.GetAccount(&Account);
+		CFrameLease::GetStats(&Pool);
+		LogMessage("NDIRenderer: frame pool lent us %llu KB, %llu borrows, %llu reused and %llu refused (%lld frames not sent); "
+			"pool %llu of %llu MB in use, %llu MB allocated, peak %llu MB, %llu buffers reused, %llu trimmed\n",
+			Account.cbLent / 1024, Account.llBorrowed, Account.llReused, Account.llRefused, (long long)m_Stats.llFramesNoBuffer,
+			Pool.cbLent / (1024 * 1024), Pool.cbLimit / (1024 * 1024), Pool.cbAllocated / (1024 * 1024), Pool.cbPeak / (1024 * 1024),
+			Pool.llReused, Pool.llTrimmed);
+	}
+	m_DataLease.Return();
+	m_pData = NULL;
+	if (m_Settings.dwFastReceive) {
+		LogMessage("NDIRenderer: receive path, %lld samples due on arrival, %lld after %lld waits, %lld through the base class\n",
+			(long long)m_Stats.llReceiveDue, (long long)m_Stats.llReceiveWaited,
+			(long long)m_Stats.llReceiveWaits, (long long)m_Stats.llReceiveBase);
+	}
+	if (m_Stats.llPreparedAhead || m_Stats.llPreparedAtDue) {
+		LogMessage("NDIRenderer: %lld frames processed while waiting for their due time, %lld when due and %lld discarded, "
+			"avg %.0f us; sent avg %.0f max %lld us after their due time\n",
+			(long long)m_Stats.llPreparedAhead, (long long)m_Stats.llPreparedAtDue, (long long)m_Stats.llPreparedDiscarded,
+			(double)m_Stats.llPrepareTime / (m_Stats.llPreparedAhead + m_Stats.llPreparedAtDue),
+			m_Stats.llDueTimed ? (double)m_Stats.llDueLateSum / m_Stats.llDueTimed : 0.0, (long long)m_Stats.llDueLateMax);
+	}
+	if (m_pNdiClock && m_pClock == static_cast<IReferenceClock *>(m_pNdiClock)) {
+		LogMessage("NDIRenderer: graph clock slaved to NDI, drift %+.1f ppm, %s\n",
+			m_pNdiClock->GetDrift(), m_pNdiClock->IsLocked() ? "locked" : "not locked");
+	}
+	if (m_Stats.bWarmAllocator) {
+		WARM_ALLOCATOR_STATS Warm;
+		m_InputPin.WarmAllocator()->GetWarmStats(&Warm);
+		LogMessage("NDIRenderer: allocator reused its memory for %ld of %ld commits, about %lld page faults avoided, %ld trims, %lld KB committed%s\n",
+			Warm.cReused, Warm.cCommits, Warm.llFaultsAvoided, Warm.cTrims, Warm.cbCommitted / 1024,
+			Warm.bLargePages ? " in large pages" : "");
+	}
+	if (m_Senders.Count() > 1 || m_Senders.HasRegions()) {
+		for (int i = 0; i < m_Senders.Count(); i++) {
+			SENDER_STATS Sender;
+			m_Senders.GetSenderStats(i, &Sender);
+			LogMessage("NDIRenderer: sender '%s' was sent %lld frames and released %lld, %lld cut out of the frame\n",
+				m_Senders.Desc(i)->szName, (long long)Sender.llSent, (long long)Sender.llReleased, (long long)Sender.llCopied);
+		}
+	}
+	if (m_Settings.dwTallyPolicy) {
+		for (int i = 0; i < m_Senders.Count(); i++) {
+			SENDER_STATS Sender;
+			m_Senders.GetSenderStats(i, &Sender);
+			LogMessage("NDIRenderer: sender '%s' tally changed %ld times, now %s, %lld frames skipped and %lld halved off program, %lld MB and %.1f s of sending saved\n",
+				m_Senders.Desc(i)->szName, Sender.lTallyChanges,
+				(Sender.lTally & TALLY_PROGRAM) ? "program" : ((Sender.lTally & TALLY_PREVIEW) ? "preview" : "off"),
+				(long long)Sender.llSkipped, (long long)Sender.llHalved,
+				(long long)(Sender.llBytesSaved / (1024 * 1024)), Sender.llCpuSaved / 1e6);
+		}
+	}
+	if (m_Capture.IsStarted()) {
+		CAPTURE_TAP_STATS Capture;
+		m_Capture.GetStats(&Capture);
+		LogMessage("NDIRenderer: captured %lld samples, %lld missed, %llu MB written to '%s'\n",
+			Capture.llCaptured, Capture.llMissed, Capture.qwBytes / (1024 * 1024), m_Settings.szCaptureFile);
+	}
+	CritDumpStats(LogLockStats, NULL);
+	return CBaseVideoRenderer::Inactive();
+}
+
+//######################################
+// ConvertFrame
+// Converts a BGRX/BGRA sample into pDst, flipping bottom-up sources in
+// the same pass. UYVA keeps its alpha plane right after the UYVY plane
+//######################################
+void CVideoRenderer::ConvertFrame (PBYTE pbData, PBYTE pDst) {
+	int xres = m_NDI_video_frame.xres;
+	int yres = m_NDI_video_frame.yres;
+	LONG lStride = xres * 4;
+
+	CONVERT_JOB job;
+	job.pCoeffs = &m_Coeffs;
+	if (m_bBottomUp) {
+		job.pSrc = pbData + (LONG_PTR)(yres - 1) * lStride;
+		job.lSrcStride = -lStride;
+	}
+	else {
+		job.pSrc = pbData;
+		job.lSrcStride = lStride;
+	}
+	job.pDst = pDst;
+	job.lDstStride = xres * 2;
+	job.pAlpha = (m_FourCC == NDIlib_FourCC_type_BGRA) ? pDst + (LONG_PTR)xres * 2 * yres : NULL;
+	job.lAlphaStride = xres;
+	job.width = xres;
+	job.height = yres;
+
+	m_Workers.Run(ConvertStripe, &job, m_Workers.JobCount());
+}
+
+//######################################
+// CalibrateRGB
+// With ConvertRGB set to auto the first CALIBRATION_FRAMES frames are sent
+// as BGRX/BGRA and the next CALIBRATION_FRAMES are converted here. The path
+// that cost the process less CPU time (NDI's own conversion runs on its
+// threads, ours on the worker pool) is kept for the rest of the connection.
+// Returns whether the current frame should be converted
+//######################################
+BOOL CVideoRenderer::CalibrateRGB () {
+	LONGLONG llNow = GetProcessCpuTime();
+
+	if (m_nCalibrationFrames == 0) {
+		m_llCalibrationStart = llNow;
+	}
+	else if (m_nCalibrationFrames == CALIBRATION_FRAMES) {
+		m_llNativeTime = llNow - m_llCalibrationStart;
+		m_llCalibrationStart = llNow;
+	}
+	else if (m_nCalibrationFrames == 2 * CALIBRATION_FRAMES) {
+		LONGLONG llConvertTime = llNow - m_llCalibrationStart;
+		m_bConvertRGB = (llConvertTime < m_llNativeTime);
+
+		LogMessage("NDIRenderer: %dx%d RGB calibration, NDI conversion %.2f ms/frame, renderer conversion %.2f ms/frame, using %s\n",
+			m_NDI_video_frame.xres, m_NDI_video_frame.yres,
+			m_llNativeTime / 10000.0 / CALIBRATION_FRAMES,
+			llConvertTime / 10000.0 / CALIBRATION_FRAMES,
+			m_bConvertRGB ? "renderer" : "NDI");
+		LogFramePath(m_bConvertRGB);
+	}
+
+	int n = m_nCalibrationFrames++;
+	if (n < CALIBRATION_FRAMES) return FALSE;
+	if (n < 2 * CALIBRATION_FRAMES) return TRUE;
+	return m_bConvertRGB;
+}
+
 //######################################
 // SetMediaType
 // We store a copy of the media type used for the connection in the renderer
@@ -251,17 +1337,20 @@ HRESULT CVideoRenderer::SetMediaType (const CMediaType *pMediaType) {
 	m_mtIn = *pMediaType;
 
 	const GUID *pSubType = pMediaType->Subtype();
-	if      (*pSubType == MEDIASUBTYPE_UYVY)   g_NDI_video_frame.FourCC = NDIlib_FourCC_type_UYVY;
-	else if (*pSubType == MEDIASUBTYPE_NV12)   g_NDI_video_frame.FourCC = NDIlib_FourCC_type_NV12;
-	else if (*pSubType == MEDIASUBTYPE_RGB32)  g_NDI_video_frame.FourCC = NDIlib_FourCC_type_BGRX; // vertically flipped
-	else if (*pSubType == MEDIASUBTYPE_ARGB32) g_NDI_video_frame.FourCC = NDIlib_FourCC_type_BGRA; // vertically flipped
-	//else if (*pSubType == MEDIASUBTYPE_YV12)  g_NDI_video_frame.FourCC = NDIlib_FourCC_type_YV12; // not working
+	if      (*pSubType == MEDIASUBTYPE_UYVY)   m_FourCC = NDIlib_FourCC_type_UYVY;
+	else if (*pSubType == MEDIASUBTYPE_NV12)   m_FourCC = NDIlib_FourCC_type_NV12;
+	else if (*pSubType == MEDIASUBTYPE_RGB32)  m_FourCC = NDIlib_FourCC_type_BGRX; // vertically flipped unless converted
+	else if (*pSubType == MEDIASUBTYPE_ARGB32) m_FourCC = NDIlib_FourCC_type_BGRA; // vertically flipped unless converted
+	//else if (*pSubType == MEDIASUBTYPE_YV12)  m_FourCC = NDIlib_FourCC_type_YV12; // not working
 
 	else {
 		NOTE("Invalid video media subtype");
 		return E_INVALIDARG;
 	}
 
+	m_NDI_video_frame.FourCC = m_FourCC;
+	m_bRGBSource = (m_FourCC == NDIlib_FourCC_type_BGRX || m_FourCC == NDIlib_FourCC_type_BGRA);
+
 	return NOERROR;
 }
 
@@ -286,6 +1375,20 @@ HRESULT CVideoRenderer::BreakConnect () {
 	IPin *pPin = m_InputPin.GetConnected();
 	if (pPin) SendNotifyWindow(pPin, NULL);
 
+	DiscardPrepared();
+	ReleaseSentSample();
+	m_Workers.Stop();
+	m_DataLease.Return();
+	m_pData = NULL;
+
+	// Consumers see the writer gone until the next connection
+	m_FrameOutput.Close();
+	m_dwFrameOutputRetry = 0;
+
+	m_Snapshot.dwWidth = m_Snapshot.dwHeight = 0;
+	m_Snapshot.dwFrameRateN = m_Snapshot.dwFrameRateD = 0;
+	PublishStats();
+
 	return NOERROR;
 }
 
@@ -308,19 +1411,42 @@ HRESULT CVideoRenderer::CompleteConnect (IPin *pReceivePin) {
 	if ((m_mtIn.formattype == FORMAT_VideoInfo) && (m_mtIn.cbFormat == sizeof(VIDEOINFOHEADER) && (m_mtIn.pbFormat != NULL))) {
 		VIDEOINFOHEADER *pVideoInfo = (VIDEOINFOHEADER *)m_mtIn.Format();
 
-		g_NDI_video_frame.xres = pVideoInfo->bmiHeader.biWidth;
-		g_NDI_video_frame.yres = pVideoInfo->bmiHeader.biHeight;
-		if (g_NDI_video_frame.yres < 0) g_NDI_video_frame.yres = -g_NDI_video_frame.yres; // do we need this?
+		m_NDI_video_frame.xres = pVideoInfo->bmiHeader.biWidth;
+		m_NDI_video_frame.yres = pVideoInfo->bmiHeader.biHeight;
+		if (m_NDI_video_frame.yres < 0) m_NDI_video_frame.yres = -m_NDI_video_frame.yres; // do we need this?
+		m_bBottomUp = (pVideoInfo->bmiHeader.biHeight > 0);
 
-#ifdef ASYNC_MODE
-		if (g_data) {
-			g_data = (PBYTE)realloc(g_data, g_NDI_video_frame.xres * g_NDI_video_frame.yres * pVideoInfo->bmiHeader.biBitCount / 8);
-		}
-		else {
-			g_data = (PBYTE)malloc(g_NDI_video_frame.xres * g_NDI_video_frame.yres * pVideoInfo->bmiHeader.biBitCount / 8);
+		// Converted RGB frames always need a buffer of their own. UYVY/UYVA
+		// is never larger than the 32 bit source so one size fits both paths
+		BOOL bMayConvert = m_bRGBSource && (m_Settings.dwConvertRGB != CONVERT_RGB_OFF);
+		m_bConvertRGB = m_bRGBSource && (m_Settings.dwConvertRGB == CONVERT_RGB_ON);
+		m_nCalibrationFrames = (m_bRGBSource && m_Settings.dwConvertRGB == CONVERT_RGB_AUTO) ? 0 : CALIBRATION_DONE;
+
+		// The copy buffer itself is only lent while we run, see BorrowData
+		DiscardPrepared();
+		m_DataLease.Return();
+		m_pData = NULL;
+		m_cbData = m_NDI_video_frame.xres * m_NDI_video_frame.yres * pVideoInfo->bmiHeader.biBitCount / 8;
+
+		if (bMayConvert) m_Workers.Start(m_Settings.dwConvertThreads);
+
+		HRESULT hr = m_Senders.SetFormat(m_NDI_video_frame.xres, m_NDI_video_frame.yres);
+		if (FAILED(hr)) return hr;
+		if (m_Senders.HasRegions()) LogSenders();
+
+		if (m_Settings.dwSharedMemory != SHARED_MEMORY_OFF) {
+			m_dwFrameOutputRetry = 0;
+			OpenFrameOutput();
 		}
-		if (!g_data) return E_OUTOFMEMORY;
-#endif
+
+		m_Snapshot.dwWidth = m_NDI_video_frame.xres;
+		m_Snapshot.dwHeight = m_NDI_video_frame.yres;
+		m_Snapshot.dwFrameRateN = pVideoInfo->AvgTimePerFrame ? UNITS : 0;
+		m_Snapshot.dwFrameRateD = (uint32_t)pVideoInfo->AvgTimePerFrame;
+		m_rtLastSent = -1;
+		PublishStats();
+
+		LogConnection(pReceivePin);
 
 		return NOERROR;
 	}
@@ -328,6 +1454,70 @@ HRESULT CVideoRenderer::CompleteConnect (IPin *pReceivePin) {
 	return E_INVALIDARG;
 }
 
+//######################################
+// LogConnection
+// Records which format we ended up with, where it came from and which way
+// each frame takes to NDI. What that costs depends on the allocator too,
+// see LogFramePath
+//######################################
+void CVideoRenderer::LogConnection (IPin *pReceivePin) {
+	WCHAR wszUpstream[MAX_FILTER_NAME] = L"?";
+	PIN_INFO PinInfo;
+	if (pReceivePin && SUCCEEDED(pReceivePin->QueryPinInfo(&PinInfo))) {
+		if (PinInfo.pFilter) {
+			FILTER_INFO FilterInfo;
+			if (SUCCEEDED(PinInfo.pFilter->QueryFilterInfo(&FilterInfo))) {
+				lstrcpynW(wszUpstream, FilterInfo.achName, MAX_FILTER_NAME);
+				if (FilterInfo.pGraph) FilterInfo.pGraph->Release();
+			}
+			PinInfo.pFilter->Release();
+		}
+	}
+
+	int iRank = GetFormatRank(m_mtIn.Subtype());
+
+	// What happens to each frame between the sample and the NDI encoder
+	const char *pPath;
+	if (!m_bRGBSource) {
+		pPath = "sent as is";
+	}
+	else if (m_Settings.dwConvertRGB == CONVERT_RGB_OFF) {
+		pPath = "converted to YUV by NDI inside the send call";
+	}
+	else {
+		pPath = (m_Settings.dwConvertRGB == CONVERT_RGB_ON) ? "converted to UYVY by the renderer" : "conversion path chosen by calibration";
+	}
+
+	LogMessage("NDIRenderer: connected to '%ls' with %s %dx%d (preference %d of %d), %s\n",
+		wszUpstream,
+		iRank >= 0 ? g_FormatPreferences[iRank].pName : "?",
+		m_NDI_video_frame.xres, m_NDI_video_frame.yres, iRank + 1, g_cFormatPreferences,
+		pPath);
+}
+
+//######################################
+// LogFramePath
+// What PrepareFrame does to each frame, bConvert as BorrowData is told, and
+// the bytes it reads and writes doing so. Only known once NotifyAllocator
+// has decided whether samples can be held
+//######################################
+void CVideoRenderer::LogFramePath (BOOL bConvert) {
+	const char *pWork = "sent from the allocator's buffers";
+	long cbTouched = 0;
+	if (bConvert) {
+		pWork = "converted into a pool buffer";
+		cbTouched = m_cbData + m_NDI_video_frame.xres * m_NDI_video_frame.yres * ((m_FourCC == NDIlib_FourCC_type_BGRA) ? 3 : 2);
+	}
+#ifdef ASYNC_MODE
+	else if (!m_Stats.bZeroCopy) {
+		pWork = "copied into a pool buffer";
+		cbTouched = 2 * m_cbData;    // copy in and out
+	}
+#endif
+
+	LogMessage("NDIRenderer: frames %s, %ld bytes touched per frame before the send\n", pWork, cbTouched);
+}
+
 //######################################
 // Constructor
 //######################################
@@ -338,10 +1528,249 @@ CVideoInputPin::CVideoInputPin (TCHAR *pObjectName,
 		LPCWSTR pPinName) :
 	CRendererInputPin(pRenderer, phr, pPinName),
 	m_pRenderer(pRenderer),
-	m_pInterfaceLock(pInterfaceLock)
+	m_pInterfaceLock(pInterfaceLock),
+	m_pConnecting(NULL),
+	m_pWarmAllocator(NULL),
+	m_bHaveLast(FALSE)
 {
 	ASSERT(m_pRenderer);
 	ASSERT(pInterfaceLock);
+	ZeroMemory(&m_viLast, sizeof(m_viLast));
+}
+
+//######################################
+// Destructor
+//######################################
+CVideoInputPin::~CVideoInputPin () {
+	if (m_pWarmAllocator) m_pWarmAllocator->Release();
+}
+
+//######################################
+// ReceiveConnection
+// Keep the connecting pin around while the base class checks the type so
+// CheckMediaType can look at what else it could give us
+//######################################
+STDMETHODIMP CVideoInputPin::ReceiveConnection (IPin *pConnector, const AM_MEDIA_TYPE *pmt) {
+	CAutoLock cInterfaceLock(m_pInterfaceLock);
+
+	m_pConnecting = pConnector;
+	HRESULT hr = CRendererInputPin::ReceiveConnection(pConnector, pmt);
+	m_pConnecting = NULL;
+
+	return hr;
+}
+
+//######################################
+// CheckMediaType
+// On top of the renderer's checks we remember the proposed size for
+// GetMediaType and, while connecting, turn down a type if the output pin
+// could also deliver one further up g_FormatPreferences. That way the
+// output pin moves on to the cheaper type instead of us ending up behind
+// a colour space converter
+//######################################
+HRESULT CVideoInputPin::CheckMediaType (const CMediaType *pmt) {
+	HRESULT hr = CRendererInputPin::CheckMediaType(pmt);
+	if (hr != NOERROR) return hr;
+
+	CopyMemory(&m_viLast, pmt->Format(), sizeof(VIDEOINFOHEADER));
+	m_bHaveLast = TRUE;
+
+	if (m_pConnecting && HasCheaperType(pmt)) {
+		NOTE("Holding out for a cheaper media type");
+		return VFW_E_TYPE_NOT_ACCEPTED;
+	}
+
+	return NOERROR;
+}
+
+//######################################
+// HasCheaperType
+// Does the connecting output pin enumerate a type we prefer over pmt and
+// would it actually agree to deliver it
+//######################################
+BOOL CVideoInputPin::HasCheaperType (const CMediaType *pmt) {
+	int iRank = GetFormatRank(pmt->Subtype());
+	if (iRank <= 0) return FALSE;
+
+	IEnumMediaTypes *pEnum = NULL;
+	if (FAILED(m_pConnecting->EnumMediaTypes(&pEnum))) return FALSE;
+
+	BOOL bCheaper = FALSE;
+	AM_MEDIA_TYPE *pType = NULL;
+	while (!bCheaper && pEnum->Next(1, &pType, NULL) == S_OK) {
+		CMediaType *pCandidate = (CMediaType *)pType;
+		int iCandidateRank = GetFormatRank(pCandidate->Subtype());
+		if (iCandidateRank >= 0 && iCandidateRank < iRank
+			&& CRendererInputPin::CheckMediaType(pCandidate) == NOERROR
+			&& m_pConnecting->QueryAccept(pCandidate) == S_OK) {
+			bCheaper = TRUE;
+		}
+		DeleteMediaType(pType);
+	}
+	pEnum->Release();
+
+	return bCheaper;
+}
+
+//######################################
+// GetAllocator
+// Offers a CWarmAllocator instead of the system's memory allocator, kept
+// for the life of the pin so reconnects find their memory still committed
+//######################################
+STDMETHODIMP CVideoInputPin::GetAllocator (IMemAllocator **ppAllocator) {
+	CheckPointer(ppAllocator, E_POINTER);
+	CAutoLock cInterfaceLock(m_pInterfaceLock);
+
+	DWORD dwKeep = m_pRenderer->m_Settings.dwAllocatorKeep;
+	if (dwKeep == 0) return CRendererInputPin::GetAllocator(ppAllocator);
+
+	if (m_pWarmAllocator == NULL) {
+		HRESULT hr = NOERROR;
+		const CRendererSettings *pSettings = &m_pRenderer->m_Settings;
+		m_pWarmAllocator = new CWarmAllocator(NAME("NDIRenderer allocator"), dwKeep * 1000,
+			(LONG)pSettings->dwAllocatorAlign, pSettings->dwAllocatorLargePages != 0, &hr);
+		if (m_pWarmAllocator == NULL) return E_OUTOFMEMORY;
+		m_pWarmAllocator->AddRef();
+		if (FAILED(hr)) {
+			m_pWarmAllocator->Release();
+			m_pWarmAllocator = NULL;
+			return hr;
+		}
+	}
+	if (m_pAllocator == NULL) {
+		m_pAllocator = m_pWarmAllocator;
+		m_pAllocator->AddRef();
+	}
+
+	*ppAllocator = m_pAllocator;
+	m_pAllocator->AddRef();
+	return NOERROR;
+}
+
+//######################################
+// GetAllocatorRequirements
+// Upstream tends to settle for one or two byte aligned buffers, which
+// serialises decoding against sending and makes every SIMD load unaligned.
+// Ask for a few aligned buffers instead so frames can be in flight while
+// the next one is decoded
+//######################################
+STDMETHODIMP CVideoInputPin::GetAllocatorRequirements (ALLOCATOR_PROPERTIES *pProps) {
+	CheckPointer(pProps, E_POINTER);
+	CAutoLock cInterfaceLock(m_pInterfaceLock);
+
+	const CRendererSettings *pSettings = &m_pRenderer->m_Settings;
+	pProps->cBuffers = (long)pSettings->dwAllocatorBuffers;
+	pProps->cbBuffer = (long)m_pRenderer->m_mtIn.GetSampleSize();
+	pProps->cbAlign = (long)min(pSettings->dwAllocatorAlign, ALLOCATOR_MAX_ASKED_ALIGN);
+	pProps->cbPrefix = 0;
+
+	m_pRenderer->m_Stats.lBuffersRequested = pProps->cBuffers;
+	m_pRenderer->m_Stats.lAlignRequested = pProps->cbAlign;
+
+	return NOERROR;
+}
+
+//######################################
+// NotifyAllocator
+// Records what we actually got, which decides whether async sends can
+// hold on to samples instead of copying them
+//######################################
+STDMETHODIMP CVideoInputPin::NotifyAllocator (IMemAllocator *pAllocator, BOOL bReadOnly) {
+	HRESULT hr = CRendererInputPin::NotifyAllocator(pAllocator, bReadOnly);
+	if (FAILED(hr)) return hr;
+
+	CAutoLock cInterfaceLock(m_pInterfaceLock);
+
+	ALLOCATOR_PROPERTIES Props;
+	if (FAILED(pAllocator->GetProperties(&Props))) {
+		ZeroMemory(&Props, sizeof(Props));
+	}
+
+	CRendererStats *pStats = &m_pRenderer->m_Stats;
+	pStats->lBuffersGranted = Props.cBuffers;
+	pStats->lAlignGranted = Props.cbAlign;
+	pStats->lBufferSize = Props.cbBuffer;
+	pStats->cUnalignedSamples = 0;
+	pStats->bZeroCopy = (Props.cBuffers >= ZERO_COPY_MIN_BUFFERS);
+	pStats->bWarmAllocator = (m_pWarmAllocator && pAllocator == static_cast<IMemAllocator *>(m_pWarmAllocator));
+
+	if (Props.cBuffers < pStats->lBuffersRequested || Props.cbAlign < pStats->lAlignRequested) {
+		LogMessage("NDIRenderer: allocator granted %ld buffers of %ld bytes aligned to %ld (asked for %ld aligned to %ld)%s\n",
+			Props.cBuffers, Props.cbBuffer, Props.cbAlign,
+			pStats->lBuffersRequested, pStats->lAlignRequested,
+			pStats->bZeroCopy ? "" : ", samples will be copied");
+	}
+
+	// The capture tap gets what is left after the sample being rendered,
+	// the one held for zero copy sends and one for upstream to fill
+	long cHeld = 2;
+#ifdef ASYNC_MODE
+	if (pStats->bZeroCopy) cHeld++;
+#endif
+	long cDepth = Props.cBuffers - cHeld;
+	m_pRenderer->m_Capture.SetDepth((int)cDepth);
+	if (m_pRenderer->m_Capture.IsStarted() && cDepth <= 0) {
+		LogMessage("NDIRenderer: %ld buffers leave none to capture from, samples won't be captured\n", Props.cBuffers);
+	}
+
+	return NOERROR;
+}
+
+//######################################
+// ReceiveMultiple
+// Handed to the renderer so batches share locks and state checks
+//######################################
+STDMETHODIMP CVideoInputPin::ReceiveMultiple (IMediaSample **pSamples, long nSamples, long *nSamplesProcessed) {
+	CheckPointer(pSamples, E_POINTER);
+	CheckPointer(nSamplesProcessed, E_POINTER);
+	for (long i = 0; i < nSamples; i++) m_pRenderer->CaptureSample(pSamples[i]);
+	return m_pRenderer->ReceiveBatch(pSamples, nSamples, nSamplesProcessed);
+}
+
+//######################################
+// Receive
+// Every sample is seen by the capture tap, if any, before anything else
+//######################################
+STDMETHODIMP CVideoInputPin::Receive (IMediaSample *pSample) {
+	CheckPointer(pSample, E_POINTER);
+	m_pRenderer->CaptureSample(pSample);
+	return CRendererInputPin::Receive(pSample);
+}
+
+//######################################
+// GetMediaType
+// Offers g_FormatPreferences in order, sized like the last acceptable type
+// we have seen. Until then we have nothing complete enough to propose
+//######################################
+HRESULT CVideoInputPin::GetMediaType (int iPosition, CMediaType *pmt) {
+	CheckPointer(pmt, E_POINTER);
+	CAutoLock cInterfaceLock(m_pInterfaceLock);
+
+	if (iPosition < 0) return E_INVALIDARG;
+	if (!m_bHaveLast || iPosition >= g_cFormatPreferences) return VFW_S_NO_MORE_ITEMS;
+
+	const FORMAT_PREFERENCE *pPref = &g_FormatPreferences[iPosition];
+
+	VIDEOINFOHEADER *pVideoInfo = (VIDEOINFOHEADER *)pmt->AllocFormatBuffer(sizeof(VIDEOINFOHEADER));
+	if (pVideoInfo == NULL) return E_OUTOFMEMORY;
+	ZeroMemory(pVideoInfo, sizeof(VIDEOINFOHEADER));
+
+	pVideoInfo->AvgTimePerFrame = m_viLast.AvgTimePerFrame;
+	pVideoInfo->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	pVideoInfo->bmiHeader.biWidth = m_viLast.bmiHeader.biWidth;
+	pVideoInfo->bmiHeader.biHeight = abs(m_viLast.bmiHeader.biHeight);
+	pVideoInfo->bmiHeader.biPlanes = 1;
+	pVideoInfo->bmiHeader.biBitCount = pPref->wBitCount;
+	pVideoInfo->bmiHeader.biCompression = pPref->dwCompression;
+	pVideoInfo->bmiHeader.biSizeImage = GetBitmapSize(&pVideoInfo->bmiHeader);
+
+	pmt->SetType(&MEDIATYPE_Video);
+	pmt->SetSubtype(pPref->pSubtype);
+	pmt->SetFormatType(&FORMAT_VideoInfo);
+	pmt->SetTemporalCompression(FALSE);
+	pmt->SetSampleSize(pVideoInfo->bmiHeader.biSizeImage);
+
+	return NOERROR;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -1,6 +1,21 @@
 #pragma once
 
 #include <streams.h>
+#include <Processing.NDI.Lib.h>
+
+#include "settings.h"
+#include "stats.h"
+#include "convert.h"
+#include "workers.h"
+#include "statsblock.h"
+#include "schedpolicy.h"
+#include "ndiclock.h"
+#include "warmalloc.h"
+#include "fanout.h"
+#include "frameshm.h"
+#include "capturetap.h"
+#include "pacerthread.h"
+#include "framelease.h"
 
 
 // Forward declarations
@@ -21,6 +36,12 @@ class CVideoInputPin : public CRendererInputPin
 {
 	CVideoRenderer *m_pRenderer;        // The renderer that owns us
 	CCritSec *m_pInterfaceLock;         // Main filter critical section
+	IPin *m_pConnecting;                // Output pin inside ReceiveConnection
+	CWarmAllocator *m_pWarmAllocator;   // Ours once offered, NULL with AllocatorKeep 0
+	VIDEOINFOHEADER m_viLast;           // Last acceptable format we were offered
+	BOOL m_bHaveLast;                   // m_viLast is valid
+
+	BOOL HasCheaperType(const CMediaType *pmt);
 
 public:
 	// Constructor
@@ -30,6 +51,23 @@ public:
 		CCritSec *pInterfaceLock,       // Main critical section
 		HRESULT *phr,                   // OLE failure return code
 		LPCWSTR pPinName);              // This pins identification
+	~CVideoInputPin();
+
+	// Offer and prefer the formats that are cheapest to send
+	STDMETHODIMP ReceiveConnection(IPin *pConnector, const AM_MEDIA_TYPE *pmt);
+	HRESULT CheckMediaType(const CMediaType *pmt);
+	HRESULT GetMediaType(int iPosition, CMediaType *pmt);
+
+	// Ask for enough aligned buffers to keep decode and send overlapped,
+	// and offer an allocator that keeps them across stops
+	STDMETHODIMP GetAllocator(IMemAllocator **ppAllocator);
+	STDMETHODIMP GetAllocatorRequirements(ALLOCATOR_PROPERTIES *pProps);
+	STDMETHODIMP NotifyAllocator(IMemAllocator *pAllocator, BOOL bReadOnly);
+	CWarmAllocator *WarmAllocator() { return m_pWarmAllocator; }
+
+	// Render batches without a full Receive cycle per sample
+	STDMETHODIMP ReceiveMultiple(IMediaSample **pSamples, long nSamples, long *nSamplesProcessed);
+	STDMETHODIMP Receive(IMediaSample *pSample);
 };
 
 //######################################
@@ -50,6 +88,7 @@ public:
 	~CVideoRenderer();
 
 	CBasePin *GetPin(int n);
+	STDMETHODIMP NonDelegatingQueryInterface(REFIID riid, void **ppv);
 
 	// Override these from the filter and renderer classes
 	HRESULT BreakConnect();
@@ -57,8 +96,97 @@ public:
 	HRESULT SetMediaType(const CMediaType *pMediaType);
 	HRESULT DoRenderSample(IMediaSample *pMediaSample);
 	HRESULT CheckMediaType(const CMediaType *pMediaType);
+	HRESULT Active();
+	HRESULT Inactive();
+	HRESULT ResetStreamingTimes();
+	HRESULT BeginFlush();
+	void OnWaitStart();
+	HRESULT ShouldDrawSampleNow(IMediaSample *pMediaSample, REFERENCE_TIME *ptrStart, REFERENCE_TIME *ptrEnd);
+	HRESULT SendQuality(REFERENCE_TIME trLate, REFERENCE_TIME trRealStream);
+
+	void ReleaseSentSample();
+	void PublishStats();
+	void PublishTallyStats(STATS_SNAPSHOT *pSnapshot);
+	void PublishPacerStats(STATS_SNAPSHOT *pSnapshot, LONGLONG llNow);
+	void CaptureSample(IMediaSample *pSample);
+	HRESULT ReceiveBatch(IMediaSample **ppSamples, long nSamples, long *pcProcessed);
+	HRESULT Receive(IMediaSample *pSample);
+
+private:
+	long RenderDueSamples(IMediaSample **ppSamples, long nSamples, REFERENCE_TIME rtEarly, REFERENCE_TIME *prtWait);
+	void LogConnection(IPin *pReceivePin);
+	void LogFramePath(BOOL bConvert);
+	void LogQuality(const QUALITY_MSG *pQuality);
+	void LogSenders();
+	void OpenFrameOutput();
+	HRESULT PrerenderSample(IMediaSample *pSample, BOOL bAhead);
+	void DiscardPrepared();
+	BOOL PrepareFrame(PBYTE pbData, long lActual, BOOL bConvert);
+	void WriteSharedFrame(REFERENCE_TIME rtStart);
+	void PublishSharedFrame();
+	void ConvertFrame(PBYTE pbData, PBYTE pDst);
+	BOOL BorrowData(BOOL bConvert);
+	PBYTE NextDataBuffer();
+	BOOL CalibrateRGB();
 
 public:
 	CVideoInputPin  m_InputPin;        // IPin based interfaces
 	CMediaType      m_mtIn;            // Source connection media type
+
+	CSenderFanout   m_Senders;         // Our NDI senders, all sent the same frames
+	NDIlib_video_frame_v2_t m_NDI_video_frame; // Frame description handed to them
+	CFrameWriter    m_FrameOutput;     // Every frame for local consumers, if SharedMemory
+	DWORD           m_dwFrameOutputRetry; // Tick count of a failed open to retry, 0 if none
+	FRAMES_INFO     m_SharedInfo;      // Frame written to m_FrameOutput, published when sent
+	CCaptureTap     m_Capture;         // Raw copy of the input, if CaptureFile
+	PBYTE           m_pData;           // Copies and conversions of samples, NULL while not lent
+	CFrameLease     m_DataLease;       // m_pData's memory, from the process wide frame pool
+
+	CRendererSettings m_Settings;      // Registry settings for this instance
+	CRendererStats  m_Stats;           // Counters for this instance
+
+	CNetworkSinkPolicy m_SchedulePolicy; // Decides when samples are sent
+	long            m_lLoggedProportion; // Proportion in the last logged quality message
+	REFERENCE_TIME  m_rtQualityLogged; // Stream time of that message
+	CNdiClock       *m_pNdiClock;      // Clock offered to the graph, NULL unless SlaveClock
+	CPacerChannel   m_Pacer;           // Waits for due samples, joined while running if SendPacer
+
+	// Published to shared memory for external monitors
+	CStatsPublisher m_Publisher;
+	STATS_SNAPSHOT  m_Snapshot;        // Last values published
+	CLatencyHistogram m_SendLatency;   // Send call durations this window
+	CLatencyHistogram m_PrepareLatency; // Frame processing this window
+	CLatencyHistogram m_DueLatency;    // Due time to the send call this window
+	LONGLONG        m_llQpcFrequency;
+	LONGLONG        m_llNextStatsWindow; // QPC time of the next window
+	REFERENCE_TIME  m_rtLastSent;      // Start time of the last sample sent
+	LONGLONG        m_llPacerWindow;   // QPC time and pacer counters at the last window
+	LONGLONG        m_llPacerWakeups;
+	LONGLONG        m_llPacerSkewed;
+	LONGLONG        m_rtPacerSkewSum;
+
+	// In async mode NDI keeps reading a frame until the next send call, so
+	// either the sample itself is held until then by m_Senders (zero copy,
+	// needs spare allocator buffers) or frames alternate between two halves
+	// of m_pData
+	PBYTE           m_pSentData;       // Data of the frame sent last, its half isn't written
+
+	// m_NDI_video_frame and the senders' frames are prepared from a sample
+	// while it waits for its due time, see PrerenderSample
+	IMediaSample    *m_pPrepared;      // Held until sent or discarded, NULL if none
+	BOOL            m_bPreparedHold;   // NDI reads m_pPrepared's data directly
+
+	// RGB32/ARGB32 sources can be converted to UYVY/UYVA before sending
+	NDIlib_FourCC_type_e m_FourCC;     // FourCC of the incoming samples
+	BOOL            m_bRGBSource;      // Connected with RGB32 or ARGB32
+	BOOL            m_bBottomUp;       // Source rows are stored bottom-up
+	BOOL            m_bConvertRGB;     // Send converted frames
+	CColorCoefficients m_Coeffs;       // Matrix/range used for conversion
+	CWorkerPool     m_Workers;         // Conversion stripes run here
+	long            m_cbData;          // Size of one frame in m_pData
+
+	// CONVERT_RGB_AUTO compares process CPU time spent on both paths
+	int             m_nCalibrationFrames;
+	LONGLONG        m_llCalibrationStart;
+	LONGLONG        m_llNativeTime;
 };
@@ -0,0 +1,180 @@
+#include "sampleblock.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//######################################
+// Helpers
+//######################################
+static size_t RoundUp (size_t cb, size_t cbUnit) {
+	return (cb + cbUnit - 1) & ~(cbUnit - 1);
+}
+
+static bool IsPowerOfTwo (size_t cb) {
+	return cb && !(cb & (cb - 1));
+}
+
+//######################################
+// SampleBlockLayout
+//######################################
+bool SampleBlockLayout (int64_t cBuffers, int64_t cbBuffer, int64_t cbPrefix, int64_t cbAlign,
+	size_t *pcbStride, size_t *pcbTotal)
+{
+	if (cBuffers < 0 || cbBuffer < 0 || cbPrefix < 0 || cbAlign <= 0) return false;
+
+	// Every term stays far below 2^63, so only the size_t range needs checking
+	int64_t llStride = cbBuffer + cbPrefix;
+	if (llStride % cbAlign) llStride += cbAlign - llStride % cbAlign;
+	if ((uint64_t)llStride > SIZE_MAX) return false;
+	if (cBuffers && (uint64_t)llStride > SIZE_MAX / (uint64_t)cBuffers) return false;
+
+	*pcbStride = (size_t)llStride;
+	*pcbTotal = (size_t)llStride * (size_t)cBuffers;
+	return true;
+}
+
+#ifdef _WIN32
+
+//######################################
+// EnableLockMemory
+// Large pages need SeLockMemoryPrivilege enabled in our token. The user or
+// service account must have been granted it, otherwise this fails quietly
+//######################################
+static bool EnableLockMemory () {
+	HANDLE hToken;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken)) return false;
+
+	TOKEN_PRIVILEGES tp;
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool bEnabled = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+		&& AdjustTokenPrivileges(hToken, FALSE, &tp, 0, NULL, NULL)
+		&& GetLastError() == ERROR_SUCCESS;     // Not ERROR_NOT_ALL_ASSIGNED
+
+	CloseHandle(hToken);
+	return bEnabled;
+}
+
+size_t SampleBlockLargePageSize () {
+	static const size_t s_cbLarge = EnableLockMemory() ? GetLargePageMinimum() : 0;
+	return s_cbLarge;
+}
+
+bool SampleBlockAlloc (SAMPLE_BLOCK *pBlock, size_t cbSize, size_t cbAlign, bool bLargePages) {
+	memset(pBlock, 0, sizeof(*pBlock));
+	if (!cbSize || !IsPowerOfTwo(cbAlign) || cbAlign > SAMPLE_BLOCK_MAX_ALIGN) return false;
+
+	// Large pages come committed, locked and aligned to the large page size
+	size_t cbLarge = bLargePages ? SampleBlockLargePageSize() : 0;
+	if (cbLarge && cbAlign <= cbLarge && cbSize <= SIZE_MAX - cbLarge) {
+		size_t cbRounded = RoundUp(cbSize, cbLarge);
+		void *p = VirtualAlloc(NULL, cbRounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (p) {
+			pBlock->pBase = p;
+			pBlock->cbBase = cbRounded;
+			pBlock->pData = (uint8_t *)p;
+			pBlock->cbData = cbRounded;
+			pBlock->bLargePages = true;
+			return true;
+		}
+	}
+
+	// Reservations start on the allocation granularity, reserve enough to
+	// align beyond it and only commit what is used
+	SYSTEM_INFO SysInfo;
+	GetSystemInfo(&SysInfo);
+	size_t cbExtra = cbAlign > SysInfo.dwAllocationGranularity ? cbAlign : 0;
+	if (cbSize > SIZE_MAX - cbExtra) return false;
+
+	void *p = VirtualAlloc(NULL, cbSize + cbExtra, MEM_RESERVE, PAGE_READWRITE);
+	if (!p) return false;
+	uint8_t *pData = (uint8_t *)RoundUp((size_t)p, cbAlign);
+	if (!VirtualAlloc(pData, cbSize, MEM_COMMIT, PAGE_READWRITE)) {
+		VirtualFree(p, 0, MEM_RELEASE);
+		return false;
+	}
+
+	pBlock->pBase = p;
+	pBlock->cbBase = cbSize + cbExtra;
+	pBlock->pData = pData;
+	pBlock->cbData = cbSize;
+	return true;
+}
+
+void SampleBlockFree (SAMPLE_BLOCK *pBlock) {
+	if (pBlock->pBase) VirtualFree(pBlock->pBase, 0, MEM_RELEASE);
+	memset(pBlock, 0, sizeof(*pBlock));
+}
+
+#else
+
+//######################################
+// Transparent huge pages, usable unless switched off altogether
+//######################################
+static size_t ReadHugePageSize () {
+#ifdef MADV_HUGEPAGE
+	char szMode[128] = "";
+	FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+	if (!f) return 0;
+	bool bUsable = fgets(szMode, sizeof(szMode), f) && !strstr(szMode, "[never]");
+	fclose(f);
+	if (!bUsable) return 0;
+
+	unsigned long long cbHuge = 2 * 1024 * 1024;
+	f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+	if (f) {
+		if (fscanf(f, "%llu", &cbHuge) != 1) cbHuge = 2 * 1024 * 1024;
+		fclose(f);
+	}
+	return IsPowerOfTwo((size_t)cbHuge) ? (size_t)cbHuge : 0;
+#else
+	return 0;
+#endif
+}
+
+size_t SampleBlockLargePageSize () {
+	static const size_t s_cbLarge = ReadHugePageSize();
+	return s_cbLarge;
+}
+
+bool SampleBlockAlloc (SAMPLE_BLOCK *pBlock, size_t cbSize, size_t cbAlign, bool bLargePages) {
+	memset(pBlock, 0, sizeof(*pBlock));
+	if (!cbSize || !IsPowerOfTwo(cbAlign) || cbAlign > SAMPLE_BLOCK_MAX_ALIGN) return false;
+
+	// Huge pages only back whole, aligned huge page ranges
+	size_t cbLarge = bLargePages ? SampleBlockLargePageSize() : 0;
+	if (cbLarge) {
+		if (cbSize > SIZE_MAX - cbLarge) return false;
+		cbSize = RoundUp(cbSize, cbLarge);
+		if (cbAlign < cbLarge) cbAlign = cbLarge;
+	}
+
+	size_t cbPage = (size_t)sysconf(_SC_PAGESIZE);
+	size_t cbExtra = cbAlign > cbPage ? cbAlign : 0;
+	if (cbSize > SIZE_MAX - cbExtra) return false;
+
+	void *p = mmap(NULL, cbSize + cbExtra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) return false;
+
+	pBlock->pBase = p;
+	pBlock->cbBase = cbSize + cbExtra;
+	pBlock->pData = (uint8_t *)RoundUp((size_t)p, cbAlign);
+	pBlock->cbData = cbSize;
+#ifdef MADV_HUGEPAGE
+	if (cbLarge) pBlock->bLargePages = (madvise(pBlock->pData, cbSize, MADV_HUGEPAGE) == 0);
+#endif
+	return true;
+}
+
+void SampleBlockFree (SAMPLE_BLOCK *pBlock) {
+	if (pBlock->pBase) munmap(pBlock->pBase, pBlock->cbBase);
+	memset(pBlock, 0, sizeof(*pBlock));
+}
+
+#endif
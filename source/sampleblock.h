@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//######################################
+// Memory block holding all samples of an allocator
+//
+// The base classes' allocator sizes its block with LONG arithmetic and
+// refuses anything over 2 GB, and backs it with 4 KB pages, so every line
+// of a high resolution frame costs a TLB entry. Here sizes are size_t, the
+// samples' start can be aligned to anything up to SAMPLE_BLOCK_MAX_ALIGN,
+// and the block can ask for large pages: MEM_LARGE_PAGES on Windows (needs
+// the "Lock pages in memory" right, falls back to normal pages without),
+// transparent huge pages through madvise elsewhere. Nothing here depends
+// on DirectShow, so tools/allocbench.cpp runs the same code
+//######################################
+
+#define SAMPLE_BLOCK_MAX_ALIGN  (2 * 1024 * 1024)
+
+struct SAMPLE_BLOCK
+{
+	void *pBase;            // As mapped, NULL if nothing is
+	size_t cbBase;
+	uint8_t *pData;         // Aligned start of the samples
+	size_t cbData;          // Usable from pData
+	bool bLargePages;       // Large pages were asked for and granted
+};
+
+// Stride and total size of cBuffers samples of cbBuffer bytes, each
+// following a cbPrefix and starting cbAlign aligned, like CMemAllocator
+// lays them out. False if it doesn't fit into a size_t
+bool SampleBlockLayout(int64_t cBuffers, int64_t cbBuffer, int64_t cbPrefix, int64_t cbAlign,
+	size_t *pcbStride, size_t *pcbTotal);
+
+// cbAlign is a power of two up to SAMPLE_BLOCK_MAX_ALIGN. With bLargePages
+// the block is rounded up to whole large pages and aligned to one, unless
+// the system can't give us any
+bool SampleBlockAlloc(SAMPLE_BLOCK *pBlock, size_t cbSize, size_t cbAlign, bool bLargePages);
+void SampleBlockFree(SAMPLE_BLOCK *pBlock);
+
+// Large page size, 0 if large pages can't be used
+size_t SampleBlockLargePageSize();
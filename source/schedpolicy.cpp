@@ -0,0 +1,286 @@
+#include "schedpolicy.h"
+
+// Same smoothing as the base class renderer
+#define AVGPERIOD 4
+
+// Samples the drop rate reported upstream is averaged over
+#define DROP_RATE_PERIOD 16
+
+//######################################
+// CNetworkSinkPolicy
+//######################################
+CNetworkSinkPolicy::CNetworkSinkPolicy () :
+	m_rtBudget(400000),
+	m_bClocked(true)
+{
+	Reset();
+}
+
+void CNetworkSinkPolicy::Reset () {
+	m_rtCostAvg = 0;
+	m_rtDuration = 0;
+	m_rtNdiFree = 0;
+	m_rtLastSent = 0;
+	m_bSent = false;
+	m_lDropRate = 0;
+}
+
+//######################################
+// QueueOccupancy
+//######################################
+int CNetworkSinkPolicy::QueueOccupancy (int64_t rtNow) const {
+	if (!m_bClocked || !m_bSent || m_rtNdiFree <= rtNow || m_rtDuration <= 0) return 0;
+	return (int)((m_rtNdiFree - rtNow + m_rtDuration - 1) / m_rtDuration);
+}
+
+//######################################
+// OwnCost
+// What a send costs us. A clocked send call mostly blocks until NDI's
+// pacing slot, which m_rtNdiFree stands for already, and counting that
+// again would make a frame on time look a frame late
+//######################################
+int64_t CNetworkSinkPolicy::OwnCost () const {
+	return m_bClocked ? 0 : m_rtCostAvg;
+}
+
+//######################################
+// LateOut
+// How late a sample starting at rtStart will leave if we pick it up at
+// rtNow: it waits for its start time, then for NDI, then for the send
+//######################################
+int64_t CNetworkSinkPolicy::LateOut (int64_t rtNow, int64_t rtStart) const {
+	int64_t rtDue = (rtStart > rtNow) ? rtStart : rtNow;
+	int64_t rtBacklog = (m_bClocked && m_rtNdiFree > rtDue) ? m_rtNdiFree - rtDue : 0;
+	return rtDue - rtStart + rtBacklog + OwnCost();
+}
+
+//######################################
+// Decide
+// Early samples are judged too: once NDI's pacing has fallen behind it
+// stays behind, and only skipping a frame lets it catch up. Upstream
+// skipping samples already made that gap, so the first sample after a
+// discontinuity starts over like the first one after Reset and isn't
+// judged against the backlog of the frames before it
+//######################################
+ScheduleDecision CNetworkSinkPolicy::Decide (int64_t rtNow, int64_t *prtStart, int64_t *prtEnd, bool bDiscontinuity) {
+	int64_t rtDuration = *prtEnd - *prtStart;
+	if (rtDuration > 0) m_rtDuration = rtDuration;
+
+	if (bDiscontinuity) {
+		m_rtNdiFree = 0;
+		m_bSent = false;
+	}
+
+	// Never starve the receivers, and nothing to measure before the first send
+	bool bDrop = m_bSent && rtNow - m_rtLastSent < POLICY_MAX_GAP && LateOut(rtNow, *prtStart) > m_rtBudget;
+
+	m_lDropRate = ((bDrop ? 1000 : 0) + (DROP_RATE_PERIOD - 1) * m_lDropRate) / DROP_RATE_PERIOD;
+	if (bDrop) return Schedule_Drop;
+	return (*prtStart > rtNow) ? Schedule_Wait : Schedule_Send;
+}
+
+//######################################
+// OnSent
+//######################################
+void CNetworkSinkPolicy::OnSent (int64_t rtNow, int64_t rtCost) {
+	m_rtCostAvg = m_bSent ? (rtCost + (AVGPERIOD - 1) * m_rtCostAvg) / AVGPERIOD : rtCost;
+
+	if (m_bClocked) {
+		m_rtNdiFree = (m_rtNdiFree > rtNow ? m_rtNdiFree : rtNow) + m_rtDuration;
+	}
+	m_rtLastSent = rtNow;
+	m_bSent = true;
+}
+
+//######################################
+// MakeQuality
+// Lateness is reported as it will be when the frame leaves, after NDI's
+// backlog and the send cost. The proportion asks upstream to slow down to
+// what the send stage manages, to catch up once frames leave later than
+// half the budget, and to drop what we would otherwise drop here. Type is
+// Flood when sending takes more than half a frame or, with clock_video,
+// when NDI has more than a frame waiting, else Famine
+//######################################
+void CNetworkSinkPolicy::MakeQuality (int64_t rtLate, int64_t rtNow, QUALITY_MSG *pQuality) {
+	int64_t rtLateOut = LateOut(rtNow, rtNow - rtLate);
+
+	pQuality->TimeStamp = rtNow;
+	pQuality->Late = rtLateOut;
+	int64_t rtCost = OwnCost();
+	if (m_bClocked) pQuality->Type = (QueueOccupancy(rtNow) > 1) ? 1 : 0;
+	else pQuality->Type = (m_rtDuration > 0 && 2 * rtCost > m_rtDuration) ? 1 : 0;
+
+	long lProportion = 1000;
+	if (m_rtDuration > 0 && rtCost > m_rtDuration) {
+		lProportion = (long)(1000 * m_rtDuration / rtCost);
+	}
+	if (rtLateOut > m_rtBudget / 2) {
+		long lCatchUp = 1000 - (long)((rtLateOut - m_rtBudget / 2) / (POLICY_UNITS / 1000));
+		if (lCatchUp < lProportion) lProportion = lCatchUp;
+	}
+	if (1000 - m_lDropRate < lProportion) {
+		lProportion = 1000 - m_lDropRate;
+	}
+	if (lProportion < 500) lProportion = 500;
+
+	pQuality->Proportion = lProportion;
+}
+
+//######################################
+// CDisplayPolicy
+// Follows renbase.cpp, names included, so the two are easy to compare. The
+// supplier is assumed not to handle quality itself
+//######################################
+CDisplayPolicy::CDisplayPolicy () {
+	Reset();
+}
+
+void CDisplayPolicy::Reset () {
+	m_trLastDraw = -1000;
+	m_trRenderAvg = 0;
+	m_trRenderLast = 0;
+	m_trFrameAvg = -1;
+	m_trDuration = 0;
+	m_trWaitAvg = 0;
+	m_trEarliness = 0;
+	m_nNormal = 0;
+}
+
+// Like the base class it takes no notice of discontinuities
+ScheduleDecision CDisplayPolicy::Decide (int64_t rtNow, int64_t *ptrStart, int64_t *ptrEnd, bool /* bDiscontinuity */) {
+	// Monitor refresh bias
+	if (*ptrStart >= 80000) {
+		*ptrStart -= 80000;
+		*ptrEnd -= 80000;
+	}
+
+	const int64_t trRealStream = rtNow;
+	const int64_t trLate = trRealStream - *ptrStart;
+	const int64_t trDuration = *ptrEnd - *ptrStart;
+	{
+		int64_t t = m_trDuration / 32;
+		if (trDuration > m_trDuration + t || trDuration < m_trDuration - t) {
+			m_trFrameAvg = trDuration;
+			m_trDuration = trDuration;
+		}
+	}
+
+	bool bJustDroppedFrame = (m_nNormal == -1);
+
+	if (trLate > 0) {
+		m_trEarliness = 0;
+	}
+	else if (trLate >= m_trEarliness || bJustDroppedFrame) {
+		m_trEarliness = trLate;
+	}
+	else {
+		m_trEarliness = m_trEarliness - m_trEarliness / 8;
+	}
+
+	int64_t trWaitAvg;
+	{
+		int64_t trL = trLate < 0 ? -trLate : 0;
+		trWaitAvg = (trL + m_trWaitAvg * (AVGPERIOD - 1)) / AVGPERIOD;
+	}
+
+	int64_t trFrame = trRealStream - m_trLastDraw;
+	if (trFrame > POLICY_UNITS) trFrame = POLICY_UNITS;
+
+	if ((3 * m_trRenderAvg <= m_trFrameAvg)
+		|| (trLate + trLate < trDuration)
+		|| (m_trWaitAvg > 80000)
+		|| ((trRealStream - m_trLastDraw) > POLICY_UNITS)) {
+
+		bool bPlayASAP = false;
+		if (bJustDroppedFrame) {
+			bPlayASAP = true;
+		}
+		else if (m_trFrameAvg > trDuration + trDuration / 16 && trLate > -trDuration * 10) {
+			bPlayASAP = true;
+		}
+		if (trLate < -9000000) {
+			bPlayASAP = false;
+		}
+
+		ScheduleDecision Result;
+		if (bPlayASAP) {
+			m_nNormal = 0;
+			m_trWaitAvg = (m_trWaitAvg * (AVGPERIOD - 1)) / AVGPERIOD;
+			m_trFrameAvg = (trFrame + m_trFrameAvg * (AVGPERIOD - 1)) / AVGPERIOD;
+			m_trLastDraw = trRealStream;
+			if (m_trEarliness > trLate) {
+				m_trEarliness = trLate;
+			}
+			Result = Schedule_Send;
+		}
+		else {
+			++m_nNormal;
+			m_trFrameAvg = trDuration;
+
+			int64_t trE = m_trEarliness;
+			if (trE < -m_trFrameAvg) {
+				trE = -m_trFrameAvg;
+			}
+			*ptrStart += trE;
+
+			int64_t Delay = -trLate;
+			Result = Delay <= 0 ? Schedule_Send : Schedule_Wait;
+			m_trWaitAvg = trWaitAvg;
+			m_trLastDraw = (Result == Schedule_Wait) ? *ptrStart : trRealStream;
+		}
+		return Result;
+	}
+
+	m_trWaitAvg = trWaitAvg;
+	m_nNormal = -1;
+	return Schedule_Drop;
+}
+
+//######################################
+// MakeQuality
+// CBaseVideoRenderer::SendQuality, measured against the biased start time
+//######################################
+void CDisplayPolicy::MakeQuality (int64_t rtLate, int64_t rtNow, QUALITY_MSG *pQuality) {
+	int64_t trLate = rtLate + 80000;
+
+	pQuality->TimeStamp = rtNow;
+	pQuality->Type = (m_trFrameAvg >= 0 && m_trFrameAvg <= 2 * m_trRenderAvg) ? 1 : 0;
+	pQuality->Proportion = 1000;
+
+	if (m_trFrameAvg < 0) {
+		// leave it alone - we don't know enough
+	}
+	else if (trLate > 0) {
+		pQuality->Proportion = 1000 - (long)(trLate / (POLICY_UNITS / 1000));
+		if (pQuality->Proportion < 500) {
+			pQuality->Proportion = 500;
+		}
+	}
+	else if (m_trWaitAvg > 20000 && trLate < -20000) {
+		if (m_trWaitAvg >= m_trFrameAvg) {
+			pQuality->Proportion = 2000;
+		}
+		else if (m_trFrameAvg + 20000 > m_trWaitAvg) {
+			pQuality->Proportion = (long)(1000 * (m_trFrameAvg / (m_trFrameAvg + 20000 - m_trWaitAvg)));
+		}
+		else {
+			pQuality->Proportion = 2000;
+		}
+		if (pQuality->Proportion > 2000) {
+			pQuality->Proportion = 2000;
+		}
+	}
+
+	pQuality->Late = trLate + m_trRenderAvg / 2;
+}
+
+//######################################
+// OnSent
+// What CBaseVideoRenderer::OnRenderEnd does with the render time
+//######################################
+void CDisplayPolicy::OnSent (int64_t /* rtNow */, int64_t rtCost) {
+	if (rtCost < m_trRenderAvg * 2 || rtCost < 2 * m_trRenderLast) {
+		m_trRenderAvg = (rtCost + (AVGPERIOD - 1) * m_trRenderAvg) / AVGPERIOD;
+	}
+	m_trRenderLast = rtCost;
+}
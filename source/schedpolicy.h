@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+
+//######################################
+// Scheduling policies deciding whether a sample is sent now, sent when it
+// is due or dropped. All times are stream times in 100 ns units, the same
+// as REFERENCE_TIME. Nothing here depends on DirectShow or a real clock, so
+// the renderer and the simulator in schedsim.h run the same code
+//######################################
+
+#define POLICY_UNITS       10000000        // 100 ns units per second
+#define POLICY_MAX_GAP     POLICY_UNITS    // Never go longer than this without sending
+
+// What IQualityControl::Notify would be told, Type is a QualityMessageType
+struct QUALITY_MSG
+{
+	int Type;                   // 0 = Famine, 1 = Flood
+	long Proportion;            // Rate upstream should aim for, 1000 = as is
+	int64_t Late;
+	int64_t TimeStamp;
+};
+
+enum ScheduleDecision {
+	Schedule_Send,              // Send it now
+	Schedule_Wait,              // Send it at the (possibly adjusted) start time
+	Schedule_Drop               // Don't send it at all
+};
+
+class CSchedulePolicy
+{
+public:
+	virtual ~CSchedulePolicy() {}
+
+	virtual const char *Name() const = 0;
+
+	// Forget everything, called whenever streaming starts
+	virtual void Reset() = 0;
+
+	// Called with the stream time now and the sample times, which the policy
+	// may move. bDiscontinuity is set if upstream skipped samples before it
+	virtual ScheduleDecision Decide(int64_t rtNow, int64_t *prtStart, int64_t *prtEnd, bool bDiscontinuity) = 0;
+
+	// Called after a sample was sent, rtNow is when the send started and
+	// rtCost how long the send call took
+	virtual void OnSent(int64_t rtNow, int64_t rtCost) = 0;
+
+	// The quality message sent upstream for a sample rtLate late at rtNow,
+	// which happens just before Decide
+	virtual void MakeQuality(int64_t rtLate, int64_t rtNow, QUALITY_MSG *pQuality) = 0;
+};
+
+//######################################
+// Policy for a network sink. There is no screen refresh to wait for, so a
+// sample is due exactly at its start time. With clock_video NDI sends at
+// most one frame per frame duration and the send call blocks until there
+// is room, so the policy keeps track of when NDI will be ready for the next
+// frame. A late sample is dropped if, after waiting for that and paying the
+// average send cost, it would leave more than the lateness budget late.
+// With clock_video the send call's duration is mostly that very wait, so
+// only NDI's backlog is counted then, not the measured cost on top of it.
+// Quality messages report the same backpressure upstream, so the decoder
+// can skip frames before paying for them instead of us dropping them after
+//######################################
+class CNetworkSinkPolicy : public CSchedulePolicy
+{
+public:
+	CNetworkSinkPolicy();
+
+	void SetLatenessBudget(int64_t rtBudget) { m_rtBudget = rtBudget; }
+	void SetClocked(bool bClocked) { m_bClocked = bClocked; }
+
+	// Frames NDI still holds or is pacing out at rtNow
+	int QueueOccupancy(int64_t rtNow) const;
+	int64_t SendCost() const { return m_rtCostAvg; }
+	int64_t LateOut(int64_t rtNow, int64_t rtStart) const;
+
+	const char *Name() const { return "network"; }
+	void Reset();
+	ScheduleDecision Decide(int64_t rtNow, int64_t *prtStart, int64_t *prtEnd, bool bDiscontinuity);
+	void OnSent(int64_t rtNow, int64_t rtCost);
+	void MakeQuality(int64_t rtLate, int64_t rtNow, QUALITY_MSG *pQuality);
+
+private:
+	int64_t OwnCost() const;
+
+	int64_t m_rtBudget;         // Lateness accepted when a frame leaves
+	bool m_bClocked;            // NDI paces frames (clock_video)
+	int64_t m_rtCostAvg;        // Moving average of the send call duration
+	int64_t m_rtDuration;       // Last known sample duration
+	int64_t m_rtNdiFree;        // When NDI will take the next frame without blocking
+	int64_t m_rtLastSent;
+	bool m_bSent;               // Anything sent since Reset
+	long m_lDropRate;           // Moving average of drops, per mille
+};
+
+//######################################
+// Model of CBaseVideoRenderer::ShouldDrawSampleNow and the averages it is
+// fed from OnRenderEnd, tuned for a display: samples are biased 8 ms early
+// for the screen refresh, played early while catching up and dropped using
+// render and wait time averages. Kept for comparison in the simulator, the
+// renderer uses the real thing when this policy is selected
+//######################################
+class CDisplayPolicy : public CSchedulePolicy
+{
+public:
+	CDisplayPolicy();
+
+	const char *Name() const { return "display"; }
+	void Reset();
+	ScheduleDecision Decide(int64_t rtNow, int64_t *prtStart, int64_t *prtEnd, bool bDiscontinuity);
+	void OnSent(int64_t rtNow, int64_t rtCost);
+	void MakeQuality(int64_t rtLate, int64_t rtNow, QUALITY_MSG *pQuality);
+
+private:
+	int64_t m_trLastDraw;
+	int64_t m_trRenderAvg;
+	int64_t m_trRenderLast;
+	int64_t m_trFrameAvg;
+	int64_t m_trDuration;
+	int64_t m_trWaitAvg;
+	int64_t m_trEarliness;
+	int m_nNormal;
+};
@@ -0,0 +1,125 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "schedsim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//######################################
+// SimulateSchedule
+//######################################
+void SimulateSchedule (const SIM_SAMPLE *pTrace, int cSamples, const SIM_PARAMS *pParams,
+	CSchedulePolicy *pPolicy, SIM_RESULT *pResult)
+{
+	memset(pResult, 0, sizeof(*pResult));
+	pResult->lProportionMin = 1000;
+	pResult->lProportionMax = 1000;
+	pPolicy->Reset();
+
+	int64_t rtNow = 0;
+	int64_t rtNdiFree = 0;      // When NDI takes the next frame without blocking
+	int64_t rtLastDuration = 0;
+
+	for (int i = 0; i < cSamples; i++) {
+		const SIM_SAMPLE *pSample = &pTrace[i];
+		if (pSample->rtArrival > rtNow) rtNow = pSample->rtArrival;
+
+		int64_t rtStart = pSample->rtStart;
+		int64_t rtEnd = pSample->rtEnd;
+		if (rtEnd > rtStart) rtLastDuration = rtEnd - rtStart;
+
+		QUALITY_MSG Quality;
+		pPolicy->MakeQuality(rtNow - rtStart, rtNow, &Quality);
+		if (pParams->pQualityLog && pResult->cQuality < pParams->cQualityLog) {
+			pParams->pQualityLog[pResult->cQuality] = Quality;
+		}
+		pResult->cQuality++;
+		if (Quality.Proportion < pResult->lProportionMin) pResult->lProportionMin = Quality.Proportion;
+		if (Quality.Proportion > pResult->lProportionMax) pResult->lProportionMax = Quality.Proportion;
+
+		ScheduleDecision Decision = pPolicy->Decide(rtNow, &rtStart, &rtEnd, false);
+		pResult->cSamples++;
+
+		if (Decision == Schedule_Drop) {
+			pResult->cDropped++;
+			continue;
+		}
+		if (Decision == Schedule_Wait && rtStart > rtNow) {
+			rtNow = rtStart;
+		}
+
+		int64_t rtLate = rtNow - pSample->rtStart;
+		if (rtLate > 0) {
+			pResult->rtLateSum += rtLate;
+			if (rtLate > pResult->rtLateMax) pResult->rtLateMax = rtLate;
+		}
+		else if (-rtLate > pResult->rtEarlyMax) {
+			pResult->rtEarlyMax = -rtLate;
+		}
+
+		int64_t iBucket = (rtLate - SIM_LATE_MIN) / SIM_LATE_BUCKET;
+		if (rtLate < SIM_LATE_MIN) iBucket = 0;
+		if (iBucket >= SIM_LATE_BUCKETS) iBucket = SIM_LATE_BUCKETS - 1;
+		pResult->cLate[iBucket]++;
+
+		// A clocked sender blocks until the previous frame's slot has passed
+		int64_t rtCost = pSample->rtSendCost;
+		if (pParams->bClockVideo) {
+			if (rtNdiFree > rtNow) rtCost += rtNdiFree - rtNow;
+			rtNdiFree = (rtNdiFree > rtNow ? rtNdiFree : rtNow) + rtLastDuration;
+		}
+
+		pPolicy->OnSent(rtNow, rtCost);
+		rtNow += rtCost;
+		pResult->cSent++;
+	}
+
+	pResult->rtEnd = rtNow;
+}
+
+//######################################
+// LoadSimTrace
+//######################################
+SIM_SAMPLE *LoadSimTrace (const char *pPath, int *pcSamples) {
+	*pcSamples = 0;
+
+	FILE *f = fopen(pPath, "r");
+	if (!f) return NULL;
+
+	SIM_SAMPLE *pTrace = NULL;
+	int cAlloc = 0;
+	char szLine[256];
+
+	while (fgets(szLine, sizeof(szLine), f)) {
+		if (szLine[0] == '#') continue;
+		for (char *p = szLine; *p; p++) {
+			if (*p == ',') *p = ' ';
+		}
+
+		long long llStart, llEnd, llArrival, llCost;
+		if (sscanf(szLine, "%lld %lld %lld %lld", &llStart, &llEnd, &llArrival, &llCost) != 4) continue;
+
+		if (*pcSamples == cAlloc) {
+			cAlloc = cAlloc ? cAlloc * 2 : 256;
+			SIM_SAMPLE *pGrown = (SIM_SAMPLE *)realloc(pTrace, cAlloc * sizeof(SIM_SAMPLE));
+			if (!pGrown) {
+				free(pTrace);
+				fclose(f);
+				*pcSamples = 0;
+				return NULL;
+			}
+			pTrace = pGrown;
+		}
+
+		SIM_SAMPLE *pSample = &pTrace[(*pcSamples)++];
+		pSample->rtStart = llStart;
+		pSample->rtEnd = llEnd;
+		pSample->rtArrival = llArrival;
+		pSample->rtSendCost = llCost;
+	}
+
+	fclose(f);
+	return pTrace;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "schedpolicy.h"
+
+//######################################
+// Deterministic replay of a sample trace against a scheduling policy
+//
+// Time is virtual: the renderer thread jumps straight to whatever it would
+// wait for, so a trace runs as fast as the policy code allows and always
+// gives the same result. Upstream delivers a sample at rtArrival or, as
+// Receive blocks, once the previous one has been dealt with
+//######################################
+
+struct SIM_SAMPLE
+{
+	int64_t rtStart;            // Sample times
+	int64_t rtEnd;
+	int64_t rtArrival;          // Stream time upstream has it ready
+	int64_t rtSendCost;         // Duration of the send call, not counting NDI pacing
+};
+
+struct SIM_PARAMS
+{
+	bool bClockVideo;           // Model NDI's clock_video pacing on top of rtSendCost
+	QUALITY_MSG *pQualityLog;   // Optional, receives the quality messages in order
+	int cQualityLog;            // Room in pQualityLog
+};
+
+// Lateness histogram of sent samples: 5 ms buckets from -50 ms, the first
+// and last bucket also hold everything below and above
+#define SIM_LATE_BUCKET     50000
+#define SIM_LATE_MIN        -500000
+#define SIM_LATE_BUCKETS    42
+
+struct SIM_RESULT
+{
+	int cSamples;
+	int cSent;
+	int cDropped;
+	int64_t rtLateSum;          // Lateness of sent samples when their send started
+	int64_t rtLateMax;
+	int64_t rtEarlyMax;         // Most a sample was sent ahead of its start time
+	int64_t rtEnd;              // Virtual time when the last sample was dealt with
+	int cLate[SIM_LATE_BUCKETS];
+
+	int cQuality;               // Quality messages, also those pQualityLog had no room for
+	long lProportionMin;
+	long lProportionMax;
+};
+
+void SimulateSchedule(const SIM_SAMPLE *pTrace, int cSamples, const SIM_PARAMS *pParams,
+	CSchedulePolicy *pPolicy, SIM_RESULT *pResult);
+
+//######################################
+// Traces are text files with one sample per line: start, end, arrival and
+// send cost in 100 ns units, separated by commas or blanks. Lines starting
+// with # are comments. Returns a malloc'ed array or NULL
+//######################################
+SIM_SAMPLE *LoadSimTrace(const char *pPath, int *pcSamples);
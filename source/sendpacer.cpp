@@ -0,0 +1,142 @@
+#include "sendpacer.h"
+#include <string.h>
+
+//######################################
+// CSendPacer
+//######################################
+CSendPacer::CSendPacer () :
+	m_cChannels(0),
+	m_rtTolerance(0),
+	m_llTick(0),
+	m_cGroup(0),
+	m_cWoken(0),
+	m_rtWokenFirst(0),
+	m_rtWokenLast(0)
+{
+	for (int i = 0; i < PACER_MAX_CHANNELS; i++) {
+		m_Channels[i].bUsed = false;
+		m_Channels[i].rtDue = PACER_NEVER;
+		m_Channels[i].llTick = 0;
+	}
+	ResetStats();
+}
+
+void CSendPacer::ResetStats () {
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+//######################################
+// Register
+//######################################
+int CSendPacer::Register () {
+	for (int i = 0; i < PACER_MAX_CHANNELS; i++) {
+		if (m_Channels[i].bUsed) continue;
+		m_Channels[i].bUsed = true;
+		m_Channels[i].rtDue = PACER_NEVER;
+		m_Channels[i].llTick = 0;
+		m_cChannels++;
+		return i;
+	}
+	return -1;
+}
+
+//######################################
+// Unregister
+//######################################
+void CSendPacer::Unregister (int iChannel) {
+	if (iChannel < 0 || iChannel >= PACER_MAX_CHANNELS || !m_Channels[iChannel].bUsed) return;
+	m_Channels[iChannel].bUsed = false;
+	m_Channels[iChannel].rtDue = PACER_NEVER;
+	m_cChannels--;
+}
+
+//######################################
+// Post
+//######################################
+void CSendPacer::Post (int iChannel, int64_t rtDue) {
+	if (iChannel < 0 || iChannel >= PACER_MAX_CHANNELS || !m_Channels[iChannel].bUsed) return;
+	m_Channels[iChannel].rtDue = rtDue;
+	m_Stats.llPosted++;
+}
+
+//######################################
+// Cancel
+//######################################
+bool CSendPacer::Cancel (int iChannel) {
+	if (iChannel < 0 || iChannel >= PACER_MAX_CHANNELS || m_Channels[iChannel].rtDue == PACER_NEVER) return false;
+	m_Channels[iChannel].rtDue = PACER_NEVER;
+	m_Stats.llCancelled++;
+	return true;
+}
+
+//######################################
+// NextTick
+// The earliest due time. Waking any earlier only releases frames sooner
+// than they need to go, the tolerance is for joining a tick, not making one
+//######################################
+int64_t CSendPacer::NextTick () const {
+	int64_t rtNext = PACER_NEVER;
+	for (int i = 0; i < PACER_MAX_CHANNELS; i++) {
+		if (m_Channels[i].rtDue < rtNext) rtNext = m_Channels[i].rtDue;
+	}
+	return rtNext;
+}
+
+//######################################
+// Release
+//######################################
+int CSendPacer::Release (int64_t rtNow, int *piChannels) {
+	int64_t rtFirst = NextTick();
+	if (rtFirst == PACER_NEVER || rtFirst > rtNow + m_rtTolerance) {
+		m_Stats.llIdleTicks++;
+		return 0;
+	}
+
+	m_llTick++;
+	m_cGroup = 0;
+	m_cWoken = 0;
+
+	int64_t rtLimit = rtNow + m_rtTolerance;
+	for (int i = 0; i < PACER_MAX_CHANNELS; i++) {
+		CHANNEL *pChannel = &m_Channels[i];
+		if (pChannel->rtDue > rtLimit) continue;
+
+		if (pChannel->rtDue > rtNow) {
+			int64_t rtEarly = pChannel->rtDue - rtNow;
+			m_Stats.rtEarlySum += rtEarly;
+			if (rtEarly > m_Stats.rtEarlyMax) m_Stats.rtEarlyMax = rtEarly;
+		}
+		pChannel->rtDue = PACER_NEVER;
+		pChannel->llTick = m_llTick;
+		piChannels[m_cGroup++] = i;
+	}
+
+	m_Stats.llTicks++;
+	m_Stats.llReleased += m_cGroup;
+	if (m_cGroup > 1) {
+		m_Stats.llGrouped++;
+		m_Stats.llChannelsGrouped += m_cGroup;
+	}
+	if (rtNow - rtFirst > m_Stats.rtLateMax) m_Stats.rtLateMax = rtNow - rtFirst;
+	return m_cGroup;
+}
+
+//######################################
+// OnWoken
+// The skew of a group is known once its last channel ran. A channel that
+// only gets to run after the next tick isn't counted, by then its group
+// has long been spread further than any tolerance
+//######################################
+void CSendPacer::OnWoken (int iChannel, int64_t rtWoken) {
+	if (iChannel < 0 || iChannel >= PACER_MAX_CHANNELS || m_Channels[iChannel].llTick != m_llTick) return;
+	if (m_cWoken >= m_cGroup) return;
+
+	if (m_cWoken == 0 || rtWoken < m_rtWokenFirst) m_rtWokenFirst = rtWoken;
+	if (m_cWoken == 0 || rtWoken > m_rtWokenLast) m_rtWokenLast = rtWoken;
+	if (++m_cWoken < m_cGroup || m_cGroup < 2) return;
+
+	int64_t rtSkew = m_rtWokenLast - m_rtWokenFirst;
+	m_Stats.llSkewed++;
+	m_Stats.rtSkewSum += rtSkew;
+	if (rtSkew > m_Stats.rtSkewMax) m_Stats.rtSkewMax = rtSkew;
+}
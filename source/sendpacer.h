@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+
+//######################################
+// One send schedule for all renderer instances of a process
+//
+// Left alone, every instance's streaming thread sleeps until its own next
+// sample is due, so 16 channels mean 16 timer wakeups per frame period and
+// sends scattered all over it. Instead channels post when their next frame
+// is due and one pacer thread wakes for the earliest of them. That tick
+// releases every channel due within the tolerance after it, in one pass,
+// so channels close in phase send as one burst off one timer wakeup and
+// stay within the tolerance of each other. Frames leave early by at most
+// the tolerance, never late on the pacer's account. Times are in 100 ns
+// units of any monotonic clock shared by the channels. Nothing here locks
+// or depends on Windows: the pacer thread in pacerthread.h serializes the
+// calls, tools/pacersim.cpp drives the same code with a virtual clock
+//######################################
+
+#define PACER_UNITS         10000000        // 100 ns units per second
+#define PACER_MAX_CHANNELS  64
+#define PACER_NEVER         INT64_MAX       // NextTick with nothing posted
+
+struct PACER_STATS
+{
+	int64_t llTicks;            // Wakeups that released at least one channel
+	int64_t llIdleTicks;        // Wakeups that released nothing, after a cancel or an earlier post
+	int64_t llPosted;
+	int64_t llReleased;
+	int64_t llCancelled;        // Posts taken back before their tick, stop or flush
+	int64_t llGrouped;          // Ticks that released more than one channel
+	int64_t llChannelsGrouped;  // Channels released by those
+	int64_t llSkewed;           // Groups whose channels all woke before the next tick
+	int64_t rtSkewSum;          // Spread of those channels' wake times
+	int64_t rtSkewMax;
+	int64_t rtEarlySum;         // Releases ahead of the channel's due time
+	int64_t rtEarlyMax;
+	int64_t rtLateMax;          // Tick after the earliest due time, the pacer's own wake latency
+};
+
+class CSendPacer
+{
+public:
+	CSendPacer();
+
+	void SetTolerance(int64_t rtTolerance) { m_rtTolerance = rtTolerance > 0 ? rtTolerance : 0; }
+	int64_t Tolerance() const { return m_rtTolerance; }
+
+	// Channel numbers are 0 to PACER_MAX_CHANNELS - 1, Register returns -1
+	// when all are taken. Unregistering drops anything still posted
+	int Register();
+	void Unregister(int iChannel);
+	int Channels() const { return m_cChannels; }
+
+	// The channel's next frame is due at rtDue, replaces an earlier post
+	void Post(int iChannel, int64_t rtDue);
+
+	// Takes a post back, false if it was released already
+	bool Cancel(int iChannel);
+
+	// When the pacer should wake next, PACER_NEVER if nothing is posted
+	int64_t NextTick() const;
+
+	// The pacer woke at rtNow. Releases every channel due by rtNow plus the
+	// tolerance, their numbers go to piChannels in channel order. Returns
+	// how many there were, 0 if the earliest post is further away
+	int Release(int64_t rtNow, int *piChannels);
+
+	// A released channel's thread ran at rtWoken, for the group's skew
+	void OnWoken(int iChannel, int64_t rtWoken);
+
+	const PACER_STATS *Stats() const { return &m_Stats; }
+	void ResetStats();
+
+private:
+	struct CHANNEL
+	{
+		bool bUsed;
+		int64_t rtDue;          // PACER_NEVER unless posted
+		int64_t llTick;         // Tick that released it last
+	};
+
+	CHANNEL m_Channels[PACER_MAX_CHANNELS];
+	int m_cChannels;
+	int64_t m_rtTolerance;
+
+	// The last group, until all of its channels have woken
+	int64_t m_llTick;
+	int m_cGroup;
+	int m_cWoken;
+	int64_t m_rtWokenFirst;
+	int64_t m_rtWokenLast;
+
+	PACER_STATS m_Stats;
+};
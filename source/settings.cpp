@@ -0,0 +1,211 @@
+#include "settings.h"
+#include <stdlib.h>
+#include <string.h>
+
+//######################################
+// ReadSettingDWORD
+// Returns the named REG_DWORD below hKey or dwDefault if it isn't there
+//######################################
+DWORD ReadSettingDWORD (HKEY hKey, LPCTSTR pValueName, DWORD dwDefault) {
+	if (hKey == NULL) return dwDefault;
+
+	DWORD dwType = 0;
+	DWORD dwValue = 0;
+	DWORD cbValue = sizeof(dwValue);
+	LONG lResult = RegQueryValueEx(hKey, pValueName, NULL, &dwType, (LPBYTE)&dwValue, &cbValue);
+	if (lResult != ERROR_SUCCESS || dwType != REG_DWORD) return dwDefault;
+
+	return dwValue;
+}
+
+//######################################
+// ReadSettingString
+// Reads the named REG_SZ below hKey as UTF-8, FALSE if it isn't there,
+// is empty or doesn't fit. Every UTF-16 unit takes at least a byte in
+// UTF-8, so anything that fits cbUtf8 fits cbUtf8 - 1 WCHARs
+//######################################
+BOOL ReadSettingString (HKEY hKey, LPCWSTR pValueName, char *pUtf8, int cbUtf8) {
+	if (hKey == NULL || cbUtf8 < 2) return FALSE;
+
+	WCHAR *pwszValue = (WCHAR *)malloc(cbUtf8 * sizeof(WCHAR));
+	if (pwszValue == NULL) return FALSE;
+
+	DWORD dwType = 0;
+	DWORD cbValue = (cbUtf8 - 1) * sizeof(WCHAR);
+	LONG lResult = RegQueryValueExW(hKey, pValueName, NULL, &dwType, (LPBYTE)pwszValue, &cbValue);
+	BOOL bRead = (lResult == ERROR_SUCCESS && dwType == REG_SZ);
+	if (bRead) {
+		pwszValue[cbValue / sizeof(WCHAR)] = L'\0';
+		bRead = pwszValue[0] && WideCharToMultiByte(CP_UTF8, 0, pwszValue, -1, pUtf8, cbUtf8, NULL, NULL) > 0;
+	}
+
+	free(pwszValue);
+	return bRead;
+}
+
+//######################################
+// Constructor
+//######################################
+CRendererSettings::CRendererSettings () :
+	dwConvertRGB(CONVERT_RGB_OFF),
+	dwColorMatrix(709),
+	dwFullRange(0),
+	dwConvertThreads(0),
+	dwAllocatorBuffers(4),
+	dwAllocatorAlign(64),
+	dwAllocatorKeep(30),
+	dwAllocatorLargePages(0),
+	dwPublishStats(1),
+	dwSchedulePolicy(SCHEDULE_POLICY_NETWORK),
+	dwLatenessBudget(40),
+	dwLogQuality(1),
+	dwSlaveClock(0),
+	dwFastReceive(1),
+	dwSharedMemory(SHARED_MEMORY_OFF),
+	dwSharedMemorySlots(4),
+	dwTallyPolicy(0),
+	dwSendPacer(0),
+	dwPacerTolerance(4),
+	dwFramePoolLimit(0),
+	dwFramePoolKeep(30),
+	cSenders(1)
+{
+	szCaptureFile[0] = '\0';
+	ZeroMemory(Senders, sizeof(Senders));
+	strcpy_s(Senders[0].szName, sizeof(Senders[0].szName), DEFAULT_SENDER_NAME);
+	Senders[0].bClockVideo = TRUE;
+}
+
+//######################################
+// Load
+// Overwrites the defaults with whatever is found in the registry
+//######################################
+void CRendererSettings::Load () {
+	HKEY hKey = NULL;
+	if (RegOpenKeyEx(HKEY_CURRENT_USER, SETTINGS_KEY, 0, KEY_READ, &hKey) != ERROR_SUCCESS) {
+		return;
+	}
+
+	dwConvertRGB       = ReadSettingDWORD(hKey, TEXT("ConvertRGB"), dwConvertRGB);
+	dwColorMatrix      = ReadSettingDWORD(hKey, TEXT("ColorMatrix"), dwColorMatrix);
+	dwFullRange        = ReadSettingDWORD(hKey, TEXT("FullRange"), dwFullRange);
+	dwConvertThreads   = ReadSettingDWORD(hKey, TEXT("ConvertThreads"), dwConvertThreads);
+	dwAllocatorBuffers = ReadSettingDWORD(hKey, TEXT("AllocatorBuffers"), dwAllocatorBuffers);
+	dwAllocatorAlign   = ReadSettingDWORD(hKey, TEXT("AllocatorAlign"), dwAllocatorAlign);
+	dwAllocatorKeep    = ReadSettingDWORD(hKey, TEXT("AllocatorKeep"), dwAllocatorKeep);
+	dwAllocatorLargePages = ReadSettingDWORD(hKey, TEXT("AllocatorLargePages"), dwAllocatorLargePages);
+	dwPublishStats     = ReadSettingDWORD(hKey, TEXT("PublishStats"), dwPublishStats);
+	dwSchedulePolicy   = ReadSettingDWORD(hKey, TEXT("SchedulePolicy"), dwSchedulePolicy);
+	dwLatenessBudget   = ReadSettingDWORD(hKey, TEXT("LatenessBudget"), dwLatenessBudget);
+	dwLogQuality       = ReadSettingDWORD(hKey, TEXT("LogQuality"), dwLogQuality);
+	dwSlaveClock       = ReadSettingDWORD(hKey, TEXT("SlaveClock"), dwSlaveClock);
+	dwFastReceive      = ReadSettingDWORD(hKey, TEXT("FastReceive"), dwFastReceive);
+	dwSharedMemory     = ReadSettingDWORD(hKey, TEXT("SharedMemory"), dwSharedMemory);
+	dwSharedMemorySlots = ReadSettingDWORD(hKey, TEXT("SharedMemorySlots"), dwSharedMemorySlots);
+	dwTallyPolicy      = ReadSettingDWORD(hKey, TEXT("TallyPolicy"), dwTallyPolicy);
+	dwSendPacer        = ReadSettingDWORD(hKey, TEXT("SendPacer"), dwSendPacer);
+	dwPacerTolerance   = ReadSettingDWORD(hKey, TEXT("PacerTolerance"), dwPacerTolerance);
+	dwFramePoolLimit   = ReadSettingDWORD(hKey, TEXT("FramePoolLimit"), dwFramePoolLimit);
+	dwFramePoolKeep    = ReadSettingDWORD(hKey, TEXT("FramePoolKeep"), dwFramePoolKeep);
+
+	ReadSettingString(hKey, L"CaptureFile", szCaptureFile, sizeof(szCaptureFile));
+	LoadSenders(hKey);
+
+	RegCloseKey(hKey);
+
+	if (dwConvertRGB > CONVERT_RGB_AUTO) dwConvertRGB = CONVERT_RGB_OFF;
+	if (dwColorMatrix != 601) dwColorMatrix = 709;
+	if (dwAllocatorBuffers < 3) dwAllocatorBuffers = 3;
+	if (dwAllocatorBuffers > 8) dwAllocatorBuffers = 8;
+	if (dwAllocatorAlign < 16 || dwAllocatorAlign > 2 * 1024 * 1024 || (dwAllocatorAlign & (dwAllocatorAlign - 1))) dwAllocatorAlign = 64;
+	if (dwAllocatorKeep > 3600) dwAllocatorKeep = 3600;
+	if (dwSchedulePolicy > SCHEDULE_POLICY_NETWORK) dwSchedulePolicy = SCHEDULE_POLICY_NETWORK;
+	if (dwLatenessBudget > 1000) dwLatenessBudget = 1000;
+	if (dwSharedMemory > SHARED_MEMORY_ONLY) dwSharedMemory = SHARED_MEMORY_OFF;
+	if (dwSharedMemorySlots < 2) dwSharedMemorySlots = 2;
+	if (dwSharedMemorySlots > 16) dwSharedMemorySlots = 16;
+	dwTallyPolicy &= TALLY_HALF_RATE | TALLY_HALF_SIZE | TALLY_SKIP_REPEATS;
+	if (dwPacerTolerance > 20) dwPacerTolerance = 20;
+	if (dwFramePoolKeep > 3600) dwFramePoolKeep = 3600;
+}
+
+//######################################
+// LoadSenders
+// Replaces the default sender if at least one subkey has a name. Only the
+// first sender found is clocked unless the others ask for it. Regions are
+// fitted to the frame once it is known
+//######################################
+void CRendererSettings::LoadSenders (HKEY hKey) {
+	HKEY hSenders = NULL;
+	if (RegOpenKeyEx(hKey, SENDERS_SUBKEY, 0, KEY_READ, &hSenders) != ERROR_SUCCESS) {
+		return;
+	}
+
+	SENDER_DESC Found[MAX_SENDERS];
+	int cFound = 0;
+	for (int i = 0; i < MAX_SENDERS; i++) {
+		TCHAR szSubkey[4];
+		wsprintf(szSubkey, TEXT("%d"), i);
+		HKEY hSender = NULL;
+		if (RegOpenKeyEx(hSenders, szSubkey, 0, KEY_READ, &hSender) != ERROR_SUCCESS) continue;
+
+		SENDER_DESC *pDesc = &Found[cFound];
+		ZeroMemory(pDesc, sizeof(*pDesc));
+		if (ReadSettingString(hSender, L"Name", pDesc->szName, sizeof(pDesc->szName))) {
+			ReadSettingString(hSender, L"Groups", pDesc->szGroups, sizeof(pDesc->szGroups));
+			pDesc->bClockVideo = ReadSettingDWORD(hSender, TEXT("ClockVideo"), cFound == 0) != 0;
+			pDesc->lRegionX = (LONG)min(ReadSettingDWORD(hSender, TEXT("RegionX"), 0), (DWORD)MAXLONG);
+			pDesc->lRegionY = (LONG)min(ReadSettingDWORD(hSender, TEXT("RegionY"), 0), (DWORD)MAXLONG);
+			pDesc->lRegionWidth = (LONG)min(ReadSettingDWORD(hSender, TEXT("RegionWidth"), 0), (DWORD)MAXLONG);
+			pDesc->lRegionHeight = (LONG)min(ReadSettingDWORD(hSender, TEXT("RegionHeight"), 0), (DWORD)MAXLONG);
+			cFound++;
+		}
+		RegCloseKey(hSender);
+	}
+	RegCloseKey(hSenders);
+
+	if (cFound) {
+		CopyMemory(Senders, Found, cFound * sizeof(SENDER_DESC));
+		cSenders = cFound;
+	}
+}
+
+//######################################
+// Constructor
+//######################################
+CTestSourceSettings::CTestSourceSettings () :
+	dwWidth(1920),
+	dwHeight(1080),
+	dwRateN(60),
+	dwRateD(1),
+	dwFormat(TEST_FORMAT_ANY)
+{
+}
+
+//######################################
+// Load
+// Sizes are rounded down to even, rates above 120 frames per second and
+// unknown formats fall back to the defaults
+//######################################
+void CTestSourceSettings::Load () {
+	HKEY hKey = NULL;
+	if (RegOpenKeyEx(HKEY_CURRENT_USER, SETTINGS_KEY TEXT("\\") TEST_PATTERN_SUBKEY, 0, KEY_READ, &hKey) != ERROR_SUCCESS) {
+		return;
+	}
+
+	dwWidth  = ReadSettingDWORD(hKey, TEXT("Width"), dwWidth);
+	dwHeight = ReadSettingDWORD(hKey, TEXT("Height"), dwHeight);
+	dwRateN  = ReadSettingDWORD(hKey, TEXT("RateN"), dwRateN);
+	dwRateD  = ReadSettingDWORD(hKey, TEXT("RateD"), dwRateD);
+	dwFormat = ReadSettingDWORD(hKey, TEXT("Format"), dwFormat);
+
+	RegCloseKey(hKey);
+
+	dwWidth = min(max(dwWidth, (DWORD)128), (DWORD)7680) & ~1;
+	dwHeight = min(max(dwHeight, (DWORD)72), (DWORD)4320) & ~1;
+	if (dwRateN == 0 || dwRateD == 0 || (ULONGLONG)dwRateN > 120ULL * dwRateD) {
+		dwRateN = 60;
+		dwRateD = 1;
+	}
+	if (dwFormat > TEST_FORMAT_ARGB32) dwFormat = TEST_FORMAT_ANY;
+}
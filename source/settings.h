@@ -0,0 +1,120 @@
+#pragma once
+
+#include <windows.h>
+
+//######################################
+// Registry location of the renderer settings. All values are optional
+// REG_DWORDs unless noted as REG_SZ, anything missing falls back to the
+// defaults listed below
+//######################################
+#define SETTINGS_KEY TEXT("Software\\NDIRenderer")
+
+// One subkey per NDI sender, "0" to "7", each with a REG_SZ Name, an
+// optional REG_SZ Groups and optional REG_DWORDs ClockVideo, RegionX,
+// RegionY, RegionWidth and RegionHeight. Without any the renderer sends as
+// DEFAULT_SENDER_NAME
+#define SENDERS_SUBKEY TEXT("Senders")
+#define MAX_SENDERS 8
+#define DEFAULT_SENDER_NAME "NDIRenderer"
+
+// Values for SchedulePolicy
+#define SCHEDULE_POLICY_DISPLAY 0  // CBaseVideoRenderer's heuristics for a display
+#define SCHEDULE_POLICY_NETWORK 1  // CNetworkSinkPolicy
+
+// Values for ConvertRGB
+#define CONVERT_RGB_OFF    0    // send BGRX/BGRA and let the NDI SDK convert
+#define CONVERT_RGB_ON     1    // convert to UYVY/UYVA in the renderer
+#define CONVERT_RGB_AUTO   2    // time both paths on the first frames, keep the cheaper one
+
+// Values for SharedMemory
+#define SHARED_MEMORY_OFF  0
+#define SHARED_MEMORY_ON   1    // write frames to shared memory as well as to NDI
+#define SHARED_MEMORY_ONLY 2    // write frames to shared memory, no NDI senders
+
+// Bits of TallyPolicy, what a sender that isn't on program gives up
+#define TALLY_HALF_RATE    0x01 // every other frame
+#define TALLY_HALF_SIZE    0x02 // half the width and height
+#define TALLY_SKIP_REPEATS 0x04 // repaints of the frame sent last
+
+// Settings of the test pattern source filter, REG_DWORDs Width, Height,
+// RateN, RateD and Format
+#define TEST_PATTERN_SUBKEY TEXT("TestPattern")
+
+// Values for the test pattern's Format
+#define TEST_FORMAT_ANY    0    // offer every format, the renderer picks
+#define TEST_FORMAT_NV12   1
+#define TEST_FORMAT_UYVY   2
+#define TEST_FORMAT_RGB32  3
+#define TEST_FORMAT_ARGB32 4
+
+//######################################
+// An NDI sender the renderer feeds, names and groups in UTF-8
+//######################################
+struct SENDER_DESC
+{
+	char szName[256];
+	char szGroups[256];         // Comma separated, empty for NDI's default groups
+	BOOL bClockVideo;           // NDI paces sends to the frame rate (default only for the first sender)
+	LONG lRegionX;              // Part of the frame sent, in pixels of the frame as sent (default 0)
+	LONG lRegionY;
+	LONG lRegionWidth;          // 0 = up to the right edge (default)
+	LONG lRegionHeight;         // 0 = up to the bottom edge (default)
+};
+
+//######################################
+// Per-instance copy of the renderer settings, loaded when the filter is
+// created so changes in the registry apply to the next graph
+//######################################
+struct CRendererSettings
+{
+	DWORD dwConvertRGB;         // CONVERT_RGB_* (default CONVERT_RGB_OFF)
+	DWORD dwColorMatrix;        // 601 or 709 (default 709)
+	DWORD dwFullRange;          // 0 = limited 16-235 (default), 1 = full 0-255
+	DWORD dwConvertThreads;     // Worker threads for conversion, 0 = one per core
+	DWORD dwAllocatorBuffers;   // Buffers asked for from upstream, 3-8 (default 4)
+	DWORD dwAllocatorAlign;     // Buffer alignment, power of two from 16 to 2 MB (default 64)
+	DWORD dwAllocatorKeep;      // s our allocator keeps its memory after a stop, 0 = base class allocator (default 30)
+	DWORD dwAllocatorLargePages; // 1 = back our allocator with large pages (default 0)
+	DWORD dwPublishStats;       // 1 = publish statistics to shared memory (default)
+	DWORD dwSchedulePolicy;     // SCHEDULE_POLICY_* (default SCHEDULE_POLICY_NETWORK)
+	DWORD dwLatenessBudget;     // ms a frame may leave late before it is dropped (default 40)
+	DWORD dwLogQuality;         // 1 = log quality messages sent upstream (default)
+	DWORD dwSlaveClock;         // 1 = offer a graph clock slaved to NDI's pacing (default 0)
+	DWORD dwFastReceive;        // 1 = wait for samples in Receive instead of through clock advises (default)
+	DWORD dwSharedMemory;       // SHARED_MEMORY_* (default SHARED_MEMORY_OFF)
+	DWORD dwSharedMemorySlots;  // Frames in the shared memory ring, 2-16 (default 4)
+	DWORD dwTallyPolicy;        // TALLY_* for senders off program, 0 = always full quality (default)
+	DWORD dwSendPacer;          // 1 = leave waits for due samples to the process wide pacer (default 0)
+	DWORD dwPacerTolerance;     // ms a sample may go early to join a pacer tick, 0-20 (default 4)
+	DWORD dwFramePoolLimit;     // MB all instances' copy buffers may take together, 0 = no limit (default)
+	DWORD dwFramePoolKeep;      // Seconds an unused copy buffer is kept for the next instance, 0-3600 (default 30)
+
+	char szCaptureFile[512];    // REG_SZ CaptureFile, UTF-8 path to capture every sample to, empty = none (default)
+
+	SENDER_DESC Senders[MAX_SENDERS]; // Every frame goes to all of them
+	int cSenders;
+
+	CRendererSettings();
+	void Load();
+
+private:
+	void LoadSenders(HKEY hKey);
+};
+
+//######################################
+// Test pattern source settings, loaded when the filter is created
+//######################################
+struct CTestSourceSettings
+{
+	DWORD dwWidth;              // Even, up to 7680 (default 1920)
+	DWORD dwHeight;             // Even, up to 4320 (default 1080)
+	DWORD dwRateN;              // Frame rate as a fraction, up to 120 (default 60/1)
+	DWORD dwRateD;
+	DWORD dwFormat;             // TEST_FORMAT_* (default TEST_FORMAT_ANY)
+
+	CTestSourceSettings();
+	void Load();
+};
+
+DWORD ReadSettingDWORD(HKEY hKey, LPCTSTR pValueName, DWORD dwDefault);
+BOOL ReadSettingString(HKEY hKey, LPCWSTR pValueName, char *pUtf8, int cbUtf8);
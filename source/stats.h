@@ -0,0 +1,42 @@
+#pragma once
+
+#include <windows.h>
+
+//######################################
+// Counters kept by each renderer instance
+//######################################
+struct CRendererStats
+{
+	// Allocator negotiation, requested by our input pin and granted by
+	// whoever ended up providing the allocator
+	LONG lBuffersRequested;
+	LONG lBuffersGranted;
+	LONG lAlignRequested;
+	LONG lAlignGranted;
+	LONG lBufferSize;
+	LONG cUnalignedSamples;     // Samples whose data missed lAlignRequested
+	BOOL bZeroCopy;             // Samples are sent without copying them first
+	BOOL bWarmAllocator;        // Upstream uses our CWarmAllocator
+
+	// Sending
+	LONGLONG llFramesSent;
+	LONGLONG llFramesDropped;      // By quality control, before the current run
+	LONGLONG llFramesDuplicated;   // Same sample sent again (repaints)
+	LONGLONG llBytesCopied;        // Copied or converted before sending
+	LONGLONG llFramesNoBuffer;     // Not sent, the frame pool was at its limit
+
+	// Copying, converting, cutting and halving, see PrerenderSample
+	LONGLONG llPreparedAhead;      // Frames processed while waiting for their due time
+	LONGLONG llPreparedAtDue;      // Frames processed at their due time
+	LONGLONG llPreparedDiscarded;  // Processed but never sent (flushes, stops, drops)
+	LONGLONG llPrepareTime;        // us spent processing
+	LONGLONG llDueTimed;           // Sent frames with a time and a clock
+	LONGLONG llDueLateSum;         // us from their due time to the send call, 0 if early
+	LONGLONG llDueLateMax;
+
+	// How Receive got samples out, see CVideoRenderer::Receive
+	LONGLONG llReceiveDue;         // Due on arrival, no wait at all
+	LONGLONG llReceiveWaited;      // Due after waiting in Receive
+	LONGLONG llReceiveWaits;       // Timed waits done for those
+	LONGLONG llReceiveBase;        // Left to the base class
+};
@@ -0,0 +1,324 @@
+#include "statsblock.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+//######################################
+// Helpers
+// Full barriers are plenty here, the writer pays for two per frame
+//######################################
+#ifdef _WIN32
+
+static inline void Barrier () {
+	MemoryBarrier();
+}
+
+static inline uint32_t CompareExchange (volatile uint32_t *p, uint32_t dwExchange, uint32_t dwComparand) {
+	return (uint32_t)InterlockedCompareExchange((volatile LONG *)p, (LONG)dwExchange, (LONG)dwComparand);
+}
+
+static inline uint32_t CurrentProcessId () {
+	return (uint32_t)GetCurrentProcessId();
+}
+
+static bool IsProcessAlive (uint32_t dwProcessId) {
+	HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, dwProcessId);
+	if (!hProcess) return GetLastError() == ERROR_ACCESS_DENIED;
+	bool bAlive = WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+	CloseHandle(hProcess);
+	return bAlive;
+}
+
+#else
+
+static inline void Barrier () {
+	__sync_synchronize();
+}
+
+static inline uint32_t CompareExchange (volatile uint32_t *p, uint32_t dwExchange, uint32_t dwComparand) {
+	return __sync_val_compare_and_swap(p, dwComparand, dwExchange);
+}
+
+static inline uint32_t CurrentProcessId () {
+	return (uint32_t)getpid();
+}
+
+static bool IsProcessAlive (uint32_t dwProcessId) {
+	return kill((pid_t)dwProcessId, 0) == 0 || errno == EPERM;
+}
+
+#endif
+
+//######################################
+// GetStatsTime
+//######################################
+uint64_t GetStatsTime () {
+#ifdef _WIN32
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	uint64_t qw = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	return (qw - 116444736000000000ULL) / 10000;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+//######################################
+// ReadStatsSlot
+// Standard sequence lock read: an even sequence that is unchanged after
+// the copy means the copy is consistent
+//######################################
+bool ReadStatsSlot (const STATS_SLOT *pSlot, STATS_SNAPSHOT *pSnapshot) {
+	for (int nTries = 0; nTries < 100; nTries++) {
+		if (pSlot->dwOwner == 0) return false;
+
+		uint32_t dwBefore = pSlot->dwSequence;
+		if (dwBefore & 1) continue;
+		Barrier();
+
+		memcpy(pSnapshot, (const void *)&pSlot->Data, sizeof(*pSnapshot));
+
+		Barrier();
+		if (pSlot->dwSequence == dwBefore) return true;
+	}
+	return false;
+}
+
+//######################################
+// CStatsSegment
+//######################################
+CStatsSegment::CStatsSegment () :
+#ifdef _WIN32
+	m_hMapping(0),
+#endif
+	m_pSegment(0)
+{
+}
+
+CStatsSegment::~CStatsSegment () {
+	Close();
+}
+
+//######################################
+// Open
+// Maps the segment, creating it if bCreate is set. Whoever gets there first
+// fills in the header, the others only check it
+//######################################
+bool CStatsSegment::Open (bool bCreate) {
+	if (m_pSegment) return true;
+
+	const size_t cbSegment = sizeof(STATS_SEGMENT);
+	void *pView = 0;
+
+#ifdef _WIN32
+	HANDLE hMapping;
+	if (bCreate) {
+		hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)cbSegment, STATS_SEGMENT_NAME);
+	}
+	else {
+		hMapping = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, STATS_SEGMENT_NAME);
+	}
+	if (!hMapping) return false;
+
+	pView = MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, cbSegment);
+	if (!pView) {
+		CloseHandle(hMapping);
+		return false;
+	}
+	m_hMapping = hMapping;
+#else
+	int fd = shm_open(STATS_SEGMENT_NAME, bCreate ? (O_RDWR | O_CREAT) : O_RDWR, 0666);
+	if (fd < 0) return false;
+
+	// ftruncate only ever grows a new, zero filled segment to the same size
+	struct stat st;
+	if (fstat(fd, &st) != 0 || ((size_t)st.st_size < cbSegment && (!bCreate || ftruncate(fd, cbSegment) != 0))) {
+		close(fd);
+		return false;
+	}
+
+	pView = mmap(0, cbSegment, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pView == MAP_FAILED) return false;
+#endif
+
+	m_pSegment = (STATS_SEGMENT *)pView;
+
+	STATS_HEADER *pHeader = &m_pSegment->Header;
+	if (pHeader->dwMagic != STATS_MAGIC && bCreate) {
+		pHeader->dwVersion = STATS_VERSION;
+		pHeader->cbSlot = sizeof(STATS_SLOT);
+		pHeader->cSlots = STATS_MAX_SLOTS;
+		Barrier();
+		pHeader->dwMagic = STATS_MAGIC;
+	}
+
+	// Versions only add fields, the layout is what has to match
+	if (pHeader->dwMagic != STATS_MAGIC || pHeader->cbSlot != sizeof(STATS_SLOT) || pHeader->cSlots != STATS_MAX_SLOTS) {
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+//######################################
+// Close
+//######################################
+void CStatsSegment::Close () {
+#ifdef _WIN32
+	if (m_pSegment) UnmapViewOfFile(m_pSegment);
+	if (m_hMapping) CloseHandle((HANDLE)m_hMapping);
+	m_hMapping = 0;
+#else
+	if (m_pSegment) munmap(m_pSegment, sizeof(STATS_SEGMENT));
+#endif
+	m_pSegment = 0;
+}
+
+//######################################
+// CStatsPublisher
+//######################################
+CStatsPublisher::CStatsPublisher () :
+	m_pSlot(0)
+{
+}
+
+CStatsPublisher::~CStatsPublisher () {
+	Close();
+}
+
+//######################################
+// Open
+// Claims a free slot, or one whose owner died without giving it back
+//######################################
+bool CStatsPublisher::Open (uint32_t dwInstance) {
+	if (m_pSlot) return true;
+	if (!m_Segment.Open(true)) return false;
+
+	STATS_SEGMENT *pSegment = m_Segment.Get();
+	uint32_t dwProcessId = CurrentProcessId();
+
+	for (int i = 0; i < STATS_MAX_SLOTS && !m_pSlot; i++) {
+		STATS_SLOT *pSlot = &pSegment->Slots[i];
+		uint32_t dwOwner = pSlot->dwOwner;
+
+		if (dwOwner == 0 || (dwOwner != dwProcessId && !IsProcessAlive(dwOwner))) {
+			if (CompareExchange(&pSlot->dwOwner, dwProcessId, dwOwner) == dwOwner) {
+				m_pSlot = pSlot;
+			}
+		}
+	}
+	if (!m_pSlot) {
+		m_Segment.Close();
+		return false;
+	}
+
+	// Readers see the owner before the reset, so it is written like Publish.
+	// A dead owner may have left the sequence odd, and one of a later
+	// version fields past our Data
+	uint32_t dwSequence = m_pSlot->dwSequence | 1;
+	m_pSlot->dwSequence = dwSequence;
+	Barrier();
+
+	m_pSlot->dwInstance = dwInstance;
+	m_pSlot->dwVersion = STATS_VERSION;
+	memset((void *)&m_pSlot->Data, 0, sizeof(m_pSlot->Data));
+	memset(m_pSlot->dwReserved, 0, sizeof(m_pSlot->dwReserved));
+
+	Barrier();
+	m_pSlot->dwSequence = dwSequence + 1;
+	return true;
+}
+
+//######################################
+// Close
+// Gives the slot back, readers see it free from then on
+//######################################
+void CStatsPublisher::Close () {
+	if (m_pSlot) {
+		Barrier();
+		m_pSlot->dwOwner = 0;
+		m_pSlot = 0;
+	}
+	m_Segment.Close();
+}
+
+//######################################
+// Publish
+// Sequence lock write, the only writer of a slot is its owner
+//######################################
+void CStatsPublisher::Publish (const STATS_SNAPSHOT *pSnapshot) {
+	if (!m_pSlot) return;
+
+	uint32_t dwSequence = m_pSlot->dwSequence;
+	m_pSlot->dwSequence = dwSequence + 1;
+	Barrier();
+
+	memcpy((void *)&m_pSlot->Data, pSnapshot, sizeof(*pSnapshot));
+
+	Barrier();
+	m_pSlot->dwSequence = dwSequence + 2;
+}
+
+//######################################
+// CLatencyHistogram
+//######################################
+static inline int BucketIndex (uint32_t v) {
+	if (v < 4) return (int)v;
+	int msb = 31;
+	while (!(v & (1u << msb))) msb--;
+	return 4 * (msb - 1) + (int)((v >> (msb - 2)) & 3);
+}
+
+static inline uint32_t BucketUpperBound (int i) {
+	if (i < 4) return (uint32_t)i;
+	int msb = i / 4 + 1;
+	uint32_t lower = (uint32_t)(4 + (i & 3)) << (msb - 2);
+	return lower + ((1u << (msb - 2)) - 1);
+}
+
+void CLatencyHistogram::Reset () {
+	memset(m_cBuckets, 0, sizeof(m_cBuckets));
+	m_cValues = 0;
+	m_dwMax = 0;
+}
+
+void CLatencyHistogram::Add (uint32_t dwMicroseconds) {
+	m_cBuckets[BucketIndex(dwMicroseconds)]++;
+	m_cValues++;
+	if (dwMicroseconds > m_dwMax) m_dwMax = dwMicroseconds;
+}
+
+//######################################
+// Percentile
+// Upper bound of the bucket the percentile falls in, capped at the maximum
+//######################################
+uint32_t CLatencyHistogram::Percentile (uint32_t dwPercent) const {
+	if (m_cValues == 0) return 0;
+
+	uint64_t cTarget = ((uint64_t)m_cValues * dwPercent + 99) / 100;
+	if (cTarget == 0) cTarget = 1;
+
+	uint64_t cSeen = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		cSeen += m_cBuckets[i];
+		if (cSeen >= cTarget) {
+			uint32_t dwBound = BucketUpperBound(i);
+			return dwBound < m_dwMax ? dwBound : m_dwMax;
+		}
+	}
+	return m_dwMax;
+}
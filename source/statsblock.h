@@ -0,0 +1,175 @@
+#pragma once
+
+#include <stdint.h>
+
+//######################################
+// Statistics published to shared memory for external monitors
+//
+// All renderer instances on a machine (per session on Windows) share one
+// named segment of STATS_MAX_SLOTS fixed size slots. Each instance claims a
+// slot and rewrites it after every frame under a sequence lock, so a monitor
+// maps the segment once and polls every channel without locks, IPC calls or
+// any help from the renderer. Only fixed width types are used and the
+// layout only ever grows into the reserved space, bumping STATS_VERSION.
+// Builds of any version share the segment, only cbSlot and cSlots have to
+// match. Fields added after a slot's dwVersion read 0
+//######################################
+
+#ifdef _WIN32
+#define STATS_SEGMENT_NAME "Local\\NDIRendererStats"
+#else
+#define STATS_SEGMENT_NAME "/NDIRendererStats"
+#endif
+
+#define STATS_MAGIC        0x5344494E      // 'NIDS'
+#define STATS_VERSION      5
+#define STATS_MAX_SLOTS    256
+#define STATS_WINDOW_MS    500             // Latency percentiles and connections are refreshed this often
+
+// Values for STATS_SNAPSHOT::dwTally
+#define STATS_TALLY_PROGRAM 0x01
+#define STATS_TALLY_PREVIEW 0x02
+
+//######################################
+// What a renderer instance reports
+//######################################
+struct STATS_SNAPSHOT
+{
+	uint64_t qwFramesIn;            // Samples that reached the renderer
+	uint64_t qwFramesSent;          // Frames handed to NDI
+	uint64_t qwFramesDropped;       // Samples dropped by quality control
+	uint64_t qwFramesDuplicated;    // Samples sent again (repaints)
+	uint64_t qwBytesCopied;         // Bytes copied or converted before sending
+	uint64_t qwUpdateTime;          // Milliseconds since 1970 (UTC) of the last update
+	uint32_t dwQueueDepth;          // Frames NDI may still be reading
+	uint32_t dwConnections;         // NDI receivers connected to the sender
+	uint32_t dwLatencyP50;          // Send call duration percentiles in us,
+	uint32_t dwLatencyP90;          // over the last STATS_WINDOW_MS
+	uint32_t dwLatencyP99;
+	uint32_t dwLatencyMax;
+	uint32_t dwFourCC;              // NDI FourCC sent, 0 while not connected
+	uint32_t dwWidth;
+	uint32_t dwHeight;
+	uint32_t dwFrameRateN;          // Frame rate as a fraction, 0/0 if unknown
+	uint32_t dwFrameRateD;
+	uint32_t dwTally;               // STATS_TALLY_* of any sender
+	char szName[64];                // NDI source name, zero terminated
+	uint64_t qwTallyReduced;        // Sends skipped or halved by the tally policy
+	uint64_t qwTallyBytesSaved;     // Frame data not handed to NDI for it
+	uint64_t qwTallyCpuSaved;       // Send time saved for it in us, estimated
+	uint32_t dwTallyChanges;        // Tally transitions over all senders
+	uint32_t dwPacerWakeups;        // Per second, of the process's send pacer, 0 without SendPacer
+	uint32_t dwPacerSkew;           // us between the first and last channel of a pacer tick, average
+	uint32_t dwPrepareP50;          // Copy/conversion/cut time percentiles in us,
+	uint32_t dwPrepareP99;          // over the last STATS_WINDOW_MS
+	uint32_t dwDueLatencyP50;       // Due time to send call percentiles in us, 0 for
+	uint32_t dwDueLatencyP99;       // early sends, over the last STATS_WINDOW_MS
+	uint32_t dwDueLatencyMax;
+};
+
+//######################################
+// One slot per renderer instance, 256 bytes so slots never share a cache
+// line. dwSequence is odd while the owner is writing
+//######################################
+struct STATS_SLOT
+{
+	volatile uint32_t dwOwner;      // Process id of the owner, 0 = free
+	volatile uint32_t dwSequence;
+	uint32_t dwInstance;            // Renderer instance within the owner process
+	uint32_t dwVersion;             // STATS_VERSION of the owner, 0 before version 5
+	STATS_SNAPSHOT Data;
+	uint32_t dwReserved[6];
+};
+
+struct STATS_HEADER
+{
+	volatile uint32_t dwMagic;      // STATS_MAGIC once the fields below are valid
+	uint32_t dwVersion;             // STATS_VERSION of whoever created the segment
+	uint32_t cbSlot;                // sizeof(STATS_SLOT)
+	uint32_t cSlots;                // STATS_MAX_SLOTS
+	uint32_t dwReserved[12];
+};
+
+struct STATS_SEGMENT
+{
+	STATS_HEADER Header;
+	STATS_SLOT Slots[STATS_MAX_SLOTS];
+};
+
+static_assert(sizeof(STATS_SNAPSHOT) == 216, "STATS_SNAPSHOT layout changed");
+static_assert(sizeof(STATS_SLOT) == 256, "STATS_SLOT layout changed");
+static_assert(sizeof(STATS_HEADER) == 64, "STATS_HEADER layout changed");
+
+//######################################
+// Copies a consistent snapshot out of a slot. Returns false if the slot is
+// free or the owner kept writing while we tried
+//######################################
+bool ReadStatsSlot(const STATS_SLOT *pSlot, STATS_SNAPSHOT *pSnapshot);
+
+//######################################
+// Milliseconds since 1970 (UTC), for qwUpdateTime
+//######################################
+uint64_t GetStatsTime();
+
+//######################################
+// A mapping of the shared segment, created on first use
+//######################################
+class CStatsSegment
+{
+public:
+	CStatsSegment();
+	~CStatsSegment();
+
+	bool Open(bool bCreate);
+	void Close();
+	STATS_SEGMENT *Get() { return m_pSegment; }
+
+private:
+#ifdef _WIN32
+	void *m_hMapping;
+#endif
+	STATS_SEGMENT *m_pSegment;
+};
+
+//######################################
+// Writer side, one per renderer instance
+//######################################
+class CStatsPublisher
+{
+public:
+	CStatsPublisher();
+	~CStatsPublisher();
+
+	bool Open(uint32_t dwInstance);
+	void Close();
+	bool IsOpen() { return m_pSlot != 0; }
+
+	void Publish(const STATS_SNAPSHOT *pSnapshot);
+
+private:
+	CStatsSegment m_Segment;
+	STATS_SLOT *m_pSlot;
+};
+
+//######################################
+// Log scale histogram of durations in us, four buckets per power of two so
+// percentiles come out within 19%
+//######################################
+#define LATENCY_BUCKETS 128
+
+class CLatencyHistogram
+{
+public:
+	CLatencyHistogram() { Reset(); }
+
+	void Reset();
+	void Add(uint32_t dwMicroseconds);
+	uint32_t Percentile(uint32_t dwPercent) const;
+	uint32_t Max() const { return m_dwMax; }
+	uint32_t Count() const { return m_cValues; }
+
+private:
+	uint32_t m_cBuckets[LATENCY_BUCKETS];
+	uint32_t m_cValues;
+	uint32_t m_dwMax;
+};
@@ -0,0 +1,361 @@
+#include "testpattern.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TESTPATTERN_SSE2
+#endif
+
+//######################################
+// Helpers
+//######################################
+struct PATTERN_RGB { int r, g, b; };
+
+// 75% bars: white, yellow, cyan, green, magenta, red, blue, black
+static const PATTERN_RGB g_Bars[8] = {
+	{ 191, 191, 191 }, { 191, 191, 0 }, { 0, 191, 191 }, { 0, 191, 0 },
+	{ 191, 0, 191 }, { 191, 0, 0 }, { 0, 0, 191 }, { 0, 0, 0 }
+};
+
+static inline uint8_t Round255 (double d) {
+	return (uint8_t)(d < 0 ? 0 : (d > 255 ? 255 : d + 0.5));
+}
+
+// BT.709 limited range, the renderer's default matrix
+static inline uint8_t LumaOf (PATTERN_RGB c) {
+	return Round255(16 + 0.1826 * c.r + 0.6142 * c.g + 0.0620 * c.b);
+}
+
+static inline uint8_t CbOf (PATTERN_RGB c) {
+	return Round255(128 - 0.1006 * c.r - 0.3386 * c.g + 0.4392 * c.b);
+}
+
+static inline uint8_t CrOf (PATTERN_RGB c) {
+	return Round255(128 + 0.4392 * c.r - 0.3989 * c.g - 0.0403 * c.b);
+}
+
+static inline PATTERN_RGB Average (PATTERN_RGB a, PATTERN_RGB b) {
+	PATTERN_RGB c = { (a.r + b.r + 1) / 2, (a.g + b.g + 1) / 2, (a.b + b.b + 1) / 2 };
+	return c;
+}
+
+static PATTERN_RGB BarAt (int x, int width) {
+	// Bar edges on even pixels so chroma pairs never straddle two bars
+	int i = 7;
+	while (i > 0 && x < ((i * width / 8) & ~1)) i--;
+	return g_Bars[i];
+}
+
+// Fully saturated hue circle across the width
+static PATTERN_RGB RampAt (int x, int width) {
+	int h = (int)((int64_t)x * 1536 / width);
+	int f = h & 255;
+	PATTERN_RGB c;
+	switch (h >> 8) {
+		case 0:  c.r = 255;     c.g = f;       c.b = 0;       break;
+		case 1:  c.r = 255 - f; c.g = 255;     c.b = 0;       break;
+		case 2:  c.r = 0;       c.g = 255;     c.b = f;       break;
+		case 3:  c.r = 0;       c.g = 255 - f; c.b = 255;     break;
+		case 4:  c.r = f;       c.g = 0;       c.b = 255;     break;
+		default: c.r = 255;     c.g = 0;       c.b = 255 - f; break;
+	}
+	return c;
+}
+
+static inline uint8_t RampAlpha (int x, int width) {
+	return (uint8_t)(x * 255 / (width - 1));
+}
+
+//######################################
+// CopyRow
+// Streamed stores write around the cache, a frame the size of an 8K one
+// would only evict what the renderer needs anyway
+//######################################
+static inline void CopyRow (uint8_t *pDst, const uint8_t *pSrc, size_t cb, bool bStream) {
+#ifdef TESTPATTERN_SSE2
+	if (bStream) {
+		size_t cbHead = (16 - ((uintptr_t)pDst & 15)) & 15;
+		if (cbHead > cb) cbHead = cb;
+		memcpy(pDst, pSrc, cbHead);
+		size_t x = cbHead;
+		for (; x + 64 <= cb; x += 64) {
+			__m128i p0 = _mm_loadu_si128((const __m128i *)(pSrc + x));
+			__m128i p1 = _mm_loadu_si128((const __m128i *)(pSrc + x + 16));
+			__m128i p2 = _mm_loadu_si128((const __m128i *)(pSrc + x + 32));
+			__m128i p3 = _mm_loadu_si128((const __m128i *)(pSrc + x + 48));
+			_mm_stream_si128((__m128i *)(pDst + x), p0);
+			_mm_stream_si128((__m128i *)(pDst + x + 16), p1);
+			_mm_stream_si128((__m128i *)(pDst + x + 32), p2);
+			_mm_stream_si128((__m128i *)(pDst + x + 48), p3);
+		}
+		for (; x + 16 <= cb; x += 16) {
+			_mm_stream_si128((__m128i *)(pDst + x), _mm_loadu_si128((const __m128i *)(pSrc + x)));
+		}
+		if (x < cb) memcpy(pDst + x, pSrc + x, cb - x);
+		return;
+	}
+#else
+	(void)bStream;
+#endif
+	memcpy(pDst, pSrc, cb);
+}
+
+//######################################
+// Constructor
+//######################################
+CTestPattern::CTestPattern () :
+	m_Format(TestPattern_UYVY),
+	m_width(0),
+	m_height(0),
+	m_cell(0),
+	m_step(0),
+	m_split(0),
+	m_bStream(false),
+	m_pRows(NULL),
+	m_pBars(NULL),
+	m_pRamp(NULL),
+	m_pBarsUV(NULL),
+	m_pRampUV(NULL)
+{
+}
+
+//######################################
+// Destructor
+//######################################
+CTestPattern::~CTestPattern () {
+	Free();
+}
+
+//######################################
+// Free
+//######################################
+void CTestPattern::Free () {
+	free(m_pRows);
+	m_pRows = m_pBars = m_pRamp = m_pBarsUV = m_pRampUV = NULL;
+	m_width = m_height = 0;
+}
+
+//######################################
+// PixelBytes
+// Of the first plane
+//######################################
+int CTestPattern::PixelBytes () const {
+	switch (m_Format) {
+		case TestPattern_NV12: return 1;
+		case TestPattern_UYVY: return 2;
+		default:               return 4;
+	}
+}
+
+int CTestPattern::RowBytes () const {
+	return m_width * PixelBytes();
+}
+
+size_t CTestPattern::FrameBytes (ptrdiff_t lStride) const {
+	size_t cbStride = (size_t)(lStride < 0 ? -lStride : lStride);
+	size_t cbFrame = cbStride * m_height;
+	return m_Format == TestPattern_NV12 ? cbFrame + cbFrame / 2 : cbFrame;
+}
+
+//######################################
+// Init
+// Builds two frame widths of each pattern row, so that a row scrolled by
+// any offset is one contiguous copy
+//######################################
+bool CTestPattern::Init (TestPatternFormat Format, int width, int height) {
+	Free();
+	if ((width & 1) || (height & 1) || width < 2 * TESTPATTERN_CELLS || height < 8) return false;
+
+	m_Format = Format;
+	m_width = width;
+	m_height = height;
+
+	// Counter cells a 24th of the height, one cell of margin all round
+	m_cell = height / 24;
+	if (m_cell > width / (TESTPATTERN_CELLS + 2)) m_cell = width / (TESTPATTERN_CELLS + 2);
+	m_cell &= ~1;
+	if (m_cell < 2) m_cell = 2;
+
+	// Across the frame in about four seconds at 60 frames per second
+	m_step = (width / 240) & ~1;
+	if (m_step < 2) m_step = 2;
+
+	m_split = (height * 2 / 3) & ~1;
+	if (m_split < 2 * m_cell) m_split = 2 * m_cell;
+	m_bStream = FrameBytes(RowBytes()) > TESTPATTERN_STREAM_BYTES;
+
+	const int pb = PixelBytes();
+	const size_t cbRow = (size_t)2 * width * pb;
+	const size_t cbRowUV = Format == TestPattern_NV12 ? (size_t)2 * width : 0;
+	m_pRows = (uint8_t *)malloc(2 * cbRow + 2 * cbRowUV);
+	if (!m_pRows) {
+		m_width = m_height = 0;
+		return false;
+	}
+	m_pBars = m_pRows;
+	m_pRamp = m_pBars + cbRow;
+	if (cbRowUV) {
+		m_pBarsUV = m_pRamp + cbRow;
+		m_pRampUV = m_pBarsUV + cbRowUV;
+	}
+
+	for (int i = 0; i < 2 * width; i += 2) {
+		int x = i % width;
+		PATTERN_RGB Bar[2] = { BarAt(x, width), BarAt(x + 1, width) };
+		PATTERN_RGB Ramp[2] = { RampAt(x, width), RampAt(x + 1, width) };
+
+		switch (Format) {
+			case TestPattern_NV12: {
+				PATTERN_RGB BarPair = Average(Bar[0], Bar[1]);
+				PATTERN_RGB RampPair = Average(Ramp[0], Ramp[1]);
+				m_pBars[i] = LumaOf(Bar[0]);
+				m_pBars[i + 1] = LumaOf(Bar[1]);
+				m_pRamp[i] = LumaOf(Ramp[0]);
+				m_pRamp[i + 1] = LumaOf(Ramp[1]);
+				m_pBarsUV[i] = CbOf(BarPair);
+				m_pBarsUV[i + 1] = CrOf(BarPair);
+				m_pRampUV[i] = CbOf(RampPair);
+				m_pRampUV[i + 1] = CrOf(RampPair);
+				break;
+			}
+			case TestPattern_UYVY: {
+				PATTERN_RGB BarPair = Average(Bar[0], Bar[1]);
+				PATTERN_RGB RampPair = Average(Ramp[0], Ramp[1]);
+				uint8_t *pBar = m_pBars + i * 2;
+				uint8_t *pRamp = m_pRamp + i * 2;
+				pBar[0] = CbOf(BarPair);
+				pBar[1] = LumaOf(Bar[0]);
+				pBar[2] = CrOf(BarPair);
+				pBar[3] = LumaOf(Bar[1]);
+				pRamp[0] = CbOf(RampPair);
+				pRamp[1] = LumaOf(Ramp[0]);
+				pRamp[2] = CrOf(RampPair);
+				pRamp[3] = LumaOf(Ramp[1]);
+				break;
+			}
+			default: {
+				for (int j = 0; j < 2; j++) {
+					uint8_t *pBar = m_pBars + (i + j) * 4;
+					uint8_t *pRamp = m_pRamp + (i + j) * 4;
+					pBar[0] = (uint8_t)Bar[j].b;
+					pBar[1] = (uint8_t)Bar[j].g;
+					pBar[2] = (uint8_t)Bar[j].r;
+					pBar[3] = 255;
+					pRamp[0] = (uint8_t)Ramp[j].b;
+					pRamp[1] = (uint8_t)Ramp[j].g;
+					pRamp[2] = (uint8_t)Ramp[j].r;
+					pRamp[3] = Format == TestPattern_BGRA ? RampAlpha(x + j, width) : 255;
+				}
+				break;
+			}
+		}
+	}
+
+	return true;
+}
+
+//######################################
+// Draw
+//######################################
+void CTestPattern::Draw (uint64_t qwFrame, uint8_t *pTop, ptrdiff_t lStride) const {
+	if (!m_pRows) return;
+
+	const int pb = PixelBytes();
+	const size_t cbRow = (size_t)m_width * pb;
+	const int scroll = (int)((qwFrame * m_step) % m_width);
+
+	// Bars scroll left as a whole, the ramp moves diagonally
+	for (int y = 0; y < m_height; y++) {
+		uint8_t *pRow = pTop + y * lStride;
+		if (y < m_split) {
+			CopyRow(pRow, m_pBars + (size_t)scroll * pb, cbRow, m_bStream);
+		}
+		else {
+			int x = ((scroll + y) % m_width) & ~1;
+			CopyRow(pRow, m_pRamp + (size_t)x * pb, cbRow, m_bStream);
+		}
+	}
+
+	if (m_Format == TestPattern_NV12) {
+		uint8_t *pUV = pTop + m_height * lStride;
+		for (int y = 0; y < m_height / 2; y++) {
+			uint8_t *pRow = pUV + y * lStride;
+			if (2 * y < m_split) {
+				CopyRow(pRow, m_pBarsUV + scroll, m_width, m_bStream);
+			}
+			else {
+				int x = ((scroll + 2 * y) % m_width) & ~1;
+				CopyRow(pRow, m_pRampUV + x, m_width, m_bStream);
+			}
+		}
+	}
+
+#ifdef TESTPATTERN_SSE2
+	if (m_bStream) _mm_sfence();
+#endif
+
+	DrawCounter((uint32_t)qwFrame, pTop, lStride);
+}
+
+//######################################
+// DrawCounter
+// Cells of m_cell pixels square, one cell down and in from the top left.
+// Black is 16 and white 235 in YUV, 0 and 255 in RGB, chroma neutral
+//######################################
+void CTestPattern::DrawCounter (uint32_t dwCounter, uint8_t *pTop, ptrdiff_t lStride) const {
+	for (int iCell = 0; iCell < TESTPATTERN_CELLS; iCell++) {
+		bool bWhite = iCell == 0 || (iCell >= 2 && ((dwCounter >> (TESTPATTERN_CELLS - 1 - iCell)) & 1));
+		int x0 = m_cell * (iCell + 1);
+
+		for (int y = m_cell; y < 2 * m_cell; y++) {
+			uint8_t *pRow = pTop + y * lStride;
+			switch (m_Format) {
+				case TestPattern_NV12:
+					memset(pRow + x0, bWhite ? 235 : 16, m_cell);
+					if (!(y & 1)) memset(pTop + m_height * lStride + (y / 2) * lStride + x0, 128, m_cell);
+					break;
+				case TestPattern_UYVY:
+					for (int x = x0; x < x0 + m_cell; x++) {
+						pRow[x * 2] = 128;
+						pRow[x * 2 + 1] = bWhite ? 235 : 16;
+					}
+					break;
+				default:
+					for (int x = x0; x < x0 + m_cell; x++) {
+						uint8_t v = bWhite ? 255 : 0;
+						pRow[x * 4] = pRow[x * 4 + 1] = pRow[x * 4 + 2] = v;
+						pRow[x * 4 + 3] = 255;
+					}
+					break;
+			}
+		}
+	}
+}
+
+//######################################
+// ReadCounter
+// Samples the luma (or green) in the middle of each cell
+//######################################
+bool CTestPattern::ReadCounter (const uint8_t *pTop, ptrdiff_t lStride, uint32_t *pdwCounter) const {
+	if (!m_pRows) return false;
+
+	const uint8_t *pRow = pTop + (m_cell + m_cell / 2) * lStride;
+	uint32_t dwCounter = 0;
+	for (int iCell = 0; iCell < TESTPATTERN_CELLS; iCell++) {
+		int x = m_cell * (iCell + 1) + m_cell / 2;
+		uint8_t v;
+		switch (m_Format) {
+			case TestPattern_NV12: v = pRow[x]; break;
+			case TestPattern_UYVY: v = pRow[x * 2 + 1]; break;
+			default:               v = pRow[x * 4 + 1]; break;
+		}
+		bool bWhite = v >= 128;
+
+		if (iCell == 0 && !bWhite) return false;
+		if (iCell == 1 && bWhite) return false;
+		if (iCell >= 2) dwCounter = (dwCounter << 1) | (bWhite ? 1 : 0);
+	}
+	*pdwCounter = dwCounter;
+	return true;
+}
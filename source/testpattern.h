@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//######################################
+// Moving test patterns with an embedded frame counter, in every format
+// the renderer takes
+//
+// The top two thirds of a frame are colour bars scrolling left, the bottom
+// third a rainbow ramp moving diagonally, so every row changes from frame
+// to frame and an encoder has real work to do. A row of TESTPATTERN_BITS
+// cells near the top left carries the frame counter in black and white
+// blocks large enough to survive scaling and conversion. Each row is a
+// window into a row built once per format, so a frame costs little more
+// than the stores, which go around the cache for large frames. There is no
+// dependency on Windows, the same code drives the source filter and the
+// benchmarks
+//######################################
+
+#define TESTPATTERN_BITS           32                  // Counter bits, most significant first
+#define TESTPATTERN_CELLS          (TESTPATTERN_BITS + 2) // A white marker and a black guard cell before them
+#define TESTPATTERN_STREAM_BYTES   (4 * 1024 * 1024)   // Frames larger than this bypass the cache
+
+enum TestPatternFormat {
+	TestPattern_NV12,           // Y plane, then interleaved UV at half height
+	TestPattern_UYVY,
+	TestPattern_BGRX,
+	TestPattern_BGRA            // Alpha follows the ramp in the bottom third
+};
+
+class CTestPattern
+{
+public:
+	CTestPattern();
+	~CTestPattern();
+
+	// Width and height even and at least TESTPATTERN_CELLS * 2 by 8
+	bool Init(TestPatternFormat Format, int width, int height);
+	void Free();
+
+	int Width() const { return m_width; }
+	int Height() const { return m_height; }
+	int RowBytes() const;                       // Bytes per row of the first plane, the smallest stride
+	size_t FrameBytes(ptrdiff_t lStride) const; // All planes at lStride
+
+	// Draws frame qwFrame. pTop is the first row as shown, lStride may be
+	// negative for bottom-up RGB. NV12's UV plane follows the Y plane at
+	// pTop + height * lStride
+	void Draw(uint64_t qwFrame, uint8_t *pTop, ptrdiff_t lStride) const;
+
+	// The counter of a frame drawn with the same format and size, false if
+	// the marker cells aren't where they should be
+	bool ReadCounter(const uint8_t *pTop, ptrdiff_t lStride, uint32_t *pdwCounter) const;
+
+private:
+	int PixelBytes() const;
+	void DrawCounter(uint32_t dwCounter, uint8_t *pTop, ptrdiff_t lStride) const;
+
+	TestPatternFormat m_Format;
+	int m_width;
+	int m_height;
+	int m_cell;                 // Counter cell size in pixels, even
+	int m_step;                 // Pixels moved per frame, even
+	int m_split;                // First row of the ramp
+	bool m_bStream;             // Non-temporal stores
+	uint8_t *m_pRows;           // One allocation for the rows below
+	uint8_t *m_pBars;           // Two frame widths of bars, first plane
+	uint8_t *m_pRamp;           // Two frame widths of ramp, first plane
+	uint8_t *m_pBarsUV;         // NV12 only, two frame widths
+	uint8_t *m_pRampUV;
+};
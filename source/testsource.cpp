@@ -0,0 +1,265 @@
+#include "testsource.h"
+
+//######################################
+// Formats offered, in the renderer's order of preference
+//######################################
+struct TEST_FORMAT {
+	const GUID *pSubtype;
+	DWORD dwCompression;
+	WORD wBitCount;
+	TestPatternFormat Pattern;
+};
+
+static const TEST_FORMAT g_TestFormats[] = {
+	{ &MEDIASUBTYPE_NV12,   MAKEFOURCC('N','V','1','2'), 12, TestPattern_NV12 },
+	{ &MEDIASUBTYPE_UYVY,   MAKEFOURCC('U','Y','V','Y'), 16, TestPattern_UYVY },
+	{ &MEDIASUBTYPE_RGB32,  BI_RGB,                      32, TestPattern_BGRX },
+	{ &MEDIASUBTYPE_ARGB32, BI_RGB,                      32, TestPattern_BGRA }
+};
+static const int g_cTestFormats = sizeof(g_TestFormats) / sizeof(g_TestFormats[0]);
+
+static const TEST_FORMAT *FindTestFormat (const GUID *pSubtype) {
+	for (int i = 0; i < g_cTestFormats; i++) {
+		if (*g_TestFormats[i].pSubtype == *pSubtype) return &g_TestFormats[i];
+	}
+	return NULL;
+}
+
+//######################################
+// Setup data
+//######################################
+
+const AMOVIESETUP_MEDIATYPE sudTestPatternTypes[] = {
+	{ &MEDIATYPE_Video, &MEDIASUBTYPE_NV12 },
+	{ &MEDIATYPE_Video, &MEDIASUBTYPE_UYVY },
+	{ &MEDIATYPE_Video, &MEDIASUBTYPE_RGB32 },
+	{ &MEDIATYPE_Video, &MEDIASUBTYPE_ARGB32 }
+};
+
+const AMOVIESETUP_PIN sudTestPatternPins = {
+	L"Output",                  // Name of the pin
+	FALSE,                      // Is pin rendered
+	TRUE,                       // Is an output pin
+	FALSE,                      // Ok for no pins
+	FALSE,                      // Allowed many
+	&CLSID_NULL,                // Connects to filter
+	NULL,                       // Connects to pin
+	4,                          // Number of pin types
+	sudTestPatternTypes         // Details for pins
+};
+
+const AMOVIESETUP_FILTER sudTestPattern = {
+	&CLSID_NDITestPattern,      // Filter CLSID
+	L"NDIRenderer Test Pattern", // Filter name
+	MERIT_DO_NOT_USE,           // Filter merit
+	1,                          // Number pins
+	&sudTestPatternPins         // Pin details
+};
+
+//######################################
+// CreateInstance
+//######################################
+CUnknown * WINAPI CTestPatternSource::CreateInstance (LPUNKNOWN pUnk, HRESULT *phr) {
+	CTestPatternSource *pFilter = new CTestPatternSource(pUnk, phr);
+	if (pFilter == NULL && phr) *phr = E_OUTOFMEMORY;
+	return pFilter;
+}
+
+//######################################
+// Constructor
+// The pin adds itself to the filter, which deletes it again
+//######################################
+CTestPatternSource::CTestPatternSource (LPUNKNOWN pUnk, HRESULT *phr) :
+	CSource(NAME("NDIRenderer Test Pattern"), pUnk, CLSID_NDITestPattern, phr)
+{
+	m_Settings.Load();
+
+	CTestPatternStream *pStream = new CTestPatternStream(phr, this);
+	if (pStream == NULL && phr) *phr = E_OUTOFMEMORY;
+}
+
+//######################################
+// Constructor
+//######################################
+CTestPatternStream::CTestPatternStream (HRESULT *phr, CTestPatternSource *pFilter) :
+	CSourceStream(NAME("Test Pattern Pin"), phr, pFilter, L"Output"),
+	m_pSettings(&pFilter->m_Settings),
+	m_lStride(0),
+	m_bBottomUp(FALSE),
+	m_llFrame(0)
+{
+}
+
+//######################################
+// GetMediaType
+// Every format in turn at the configured size and rate, or only the one
+// the Format setting asks for
+//######################################
+HRESULT CTestPatternStream::GetMediaType (int iPosition, CMediaType *pmt) {
+	CheckPointer(pmt, E_POINTER);
+	CAutoLock cLock(m_pFilter->pStateLock());
+
+	if (iPosition < 0) return E_INVALIDARG;
+	const TEST_FORMAT *pFormat;
+	if (m_pSettings->dwFormat != TEST_FORMAT_ANY) {
+		if (iPosition > 0) return VFW_S_NO_MORE_ITEMS;
+		pFormat = &g_TestFormats[m_pSettings->dwFormat - TEST_FORMAT_NV12];
+	}
+	else {
+		if (iPosition >= g_cTestFormats) return VFW_S_NO_MORE_ITEMS;
+		pFormat = &g_TestFormats[iPosition];
+	}
+
+	VIDEOINFOHEADER *pVideoInfo = (VIDEOINFOHEADER *)pmt->AllocFormatBuffer(sizeof(VIDEOINFOHEADER));
+	if (pVideoInfo == NULL) return E_OUTOFMEMORY;
+	ZeroMemory(pVideoInfo, sizeof(VIDEOINFOHEADER));
+
+	pVideoInfo->AvgTimePerFrame = (REFERENCE_TIME)(UNITS * (LONGLONG)m_pSettings->dwRateD / m_pSettings->dwRateN);
+	pVideoInfo->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	pVideoInfo->bmiHeader.biWidth = m_pSettings->dwWidth;
+	pVideoInfo->bmiHeader.biHeight = m_pSettings->dwHeight;
+	pVideoInfo->bmiHeader.biPlanes = 1;
+	pVideoInfo->bmiHeader.biBitCount = pFormat->wBitCount;
+	pVideoInfo->bmiHeader.biCompression = pFormat->dwCompression;
+	pVideoInfo->bmiHeader.biSizeImage = GetBitmapSize(&pVideoInfo->bmiHeader);
+
+	pmt->SetType(&MEDIATYPE_Video);
+	pmt->SetSubtype(pFormat->pSubtype);
+	pmt->SetFormatType(&FORMAT_VideoInfo);
+	pmt->SetTemporalCompression(FALSE);
+	pmt->SetSampleSize(pVideoInfo->bmiHeader.biSizeImage);
+
+	return NOERROR;
+}
+
+//######################################
+// CheckMediaType
+// Our size and any stride at least as wide, RGB either way up
+//######################################
+HRESULT CTestPatternStream::CheckMediaType (const CMediaType *pmt) {
+	CheckPointer(pmt, E_POINTER);
+
+	if (*pmt->Type() != MEDIATYPE_Video || *pmt->FormatType() != FORMAT_VideoInfo) return E_INVALIDARG;
+	if (pmt->FormatLength() < sizeof(VIDEOINFOHEADER) || pmt->Format() == NULL) return E_INVALIDARG;
+
+	const TEST_FORMAT *pFormat = FindTestFormat(pmt->Subtype());
+	if (pFormat == NULL) return E_INVALIDARG;
+	if (m_pSettings->dwFormat != TEST_FORMAT_ANY && pFormat != &g_TestFormats[m_pSettings->dwFormat - TEST_FORMAT_NV12]) {
+		return E_INVALIDARG;
+	}
+
+	const BITMAPINFOHEADER *pHeader = &((const VIDEOINFOHEADER *)pmt->Format())->bmiHeader;
+	if (pHeader->biWidth < (LONG)m_pSettings->dwWidth || abs(pHeader->biHeight) != (LONG)m_pSettings->dwHeight) {
+		return E_INVALIDARG;
+	}
+	if (pHeader->biBitCount != pFormat->wBitCount) return E_INVALIDARG;
+
+	return NOERROR;
+}
+
+//######################################
+// SetMediaType
+//######################################
+HRESULT CTestPatternStream::SetMediaType (const CMediaType *pmt) {
+	CAutoLock cLock(m_pFilter->pStateLock());
+
+	HRESULT hr = CSourceStream::SetMediaType(pmt);
+	if (FAILED(hr)) return hr;
+
+	return UseFormat(pmt);
+}
+
+//######################################
+// UseFormat
+// Prepares the pattern for a type CheckMediaType accepted. The stride is
+// biWidth pixels of the first plane, as for every uncompressed format
+//######################################
+HRESULT CTestPatternStream::UseFormat (const CMediaType *pmt) {
+	const TEST_FORMAT *pFormat = FindTestFormat(pmt->Subtype());
+	const VIDEOINFOHEADER *pVideoInfo = (const VIDEOINFOHEADER *)pmt->Format();
+	if (pFormat == NULL || pVideoInfo == NULL) return E_INVALIDARG;
+
+	if (!m_Pattern.Init(pFormat->Pattern, m_pSettings->dwWidth, m_pSettings->dwHeight)) return E_OUTOFMEMORY;
+
+	LONG lPixelBytes = pFormat->Pattern == TestPattern_NV12 ? 1 : pFormat->wBitCount / 8;
+	m_lStride = pVideoInfo->bmiHeader.biWidth * lPixelBytes;
+	m_bBottomUp = pFormat->dwCompression == BI_RGB && pVideoInfo->bmiHeader.biHeight > 0;
+
+	return NOERROR;
+}
+
+//######################################
+// DecideBufferSize
+//######################################
+HRESULT CTestPatternStream::DecideBufferSize (IMemAllocator *pAlloc, ALLOCATOR_PROPERTIES *pProps) {
+	CheckPointer(pAlloc, E_POINTER);
+	CheckPointer(pProps, E_POINTER);
+	CAutoLock cLock(m_pFilter->pStateLock());
+
+	const VIDEOINFOHEADER *pVideoInfo = (const VIDEOINFOHEADER *)m_mt.Format();
+	if (pVideoInfo == NULL) return E_UNEXPECTED;
+
+	if (pProps->cBuffers < TEST_SOURCE_BUFFERS) pProps->cBuffers = TEST_SOURCE_BUFFERS;
+	pProps->cbBuffer = max(pProps->cbBuffer, (long)pVideoInfo->bmiHeader.biSizeImage);
+	if (pProps->cbAlign < 1) pProps->cbAlign = 1;
+
+	ALLOCATOR_PROPERTIES Actual;
+	HRESULT hr = pAlloc->SetProperties(pProps, &Actual);
+	if (FAILED(hr)) return hr;
+
+	if (Actual.cbBuffer < (long)pVideoInfo->bmiHeader.biSizeImage) return E_FAIL;
+
+	return NOERROR;
+}
+
+//######################################
+// OnThreadCreate
+// Every run starts again from frame 0
+//######################################
+HRESULT CTestPatternStream::OnThreadCreate () {
+	CAutoLock cLock(m_pFilter->pStateLock());
+	m_llFrame = 0;
+	return NOERROR;
+}
+
+//######################################
+// FillBuffer
+// Takes over a type the renderer attached to the sample, then draws the
+// next frame into it
+//######################################
+HRESULT CTestPatternStream::FillBuffer (IMediaSample *pSample) {
+	CheckPointer(pSample, E_POINTER);
+
+	AM_MEDIA_TYPE *pmtNew = NULL;
+	if (pSample->GetMediaType(&pmtNew) == S_OK && pmtNew) {
+		CMediaType mtNew(*pmtNew);
+		DeleteMediaType(pmtNew);
+		if (CheckMediaType(&mtNew) != NOERROR) return E_FAIL;
+
+		CAutoLock cLock(m_pFilter->pStateLock());
+		m_mt = mtNew;
+		HRESULT hr = UseFormat(&mtNew);
+		if (FAILED(hr)) return hr;
+	}
+
+	BYTE *pData = NULL;
+	HRESULT hr = pSample->GetPointer(&pData);
+	if (FAILED(hr)) return hr;
+
+	size_t cbFrame = m_Pattern.FrameBytes(m_lStride);
+	if ((size_t)pSample->GetSize() < cbFrame) return E_FAIL;
+
+	if (m_bBottomUp) m_Pattern.Draw(m_llFrame, pData + (size_t)(m_Pattern.Height() - 1) * m_lStride, -m_lStride);
+	else m_Pattern.Draw(m_llFrame, pData, m_lStride);
+
+	// Times from the frame number, so they don't drift at fractional rates
+	REFERENCE_TIME rtStart = m_llFrame * UNITS * m_pSettings->dwRateD / m_pSettings->dwRateN;
+	REFERENCE_TIME rtStop = (m_llFrame + 1) * UNITS * m_pSettings->dwRateD / m_pSettings->dwRateN;
+	pSample->SetTime(&rtStart, &rtStop);
+	pSample->SetSyncPoint(TRUE);
+	pSample->SetDiscontinuity(m_llFrame == 0);
+	pSample->SetActualDataLength((long)cbFrame);
+
+	m_llFrame++;
+	return NOERROR;
+}
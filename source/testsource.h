@@ -0,0 +1,67 @@
+#pragma once
+
+#include <streams.h>
+
+#include "settings.h"
+#include "testpattern.h"
+
+//######################################
+// GUIDs
+//######################################
+
+// {EDE175B5-2206-424F-8C1C-C0933C71560C}
+DEFINE_GUID(CLSID_NDITestPattern,
+	0xede175b5, 0x2206, 0x424f, 0x8c, 0x1c, 0xc0, 0x93, 0x3c, 0x71, 0x56, 0x0c);
+
+#define TEST_SOURCE_BUFFERS 4   // Samples asked for at least, so the renderer can hold one
+
+extern const AMOVIESETUP_FILTER sudTestPattern;
+
+class CTestPatternSource;
+
+//######################################
+// Output pin, draws a CTestPattern into every sample on the base class's
+// streaming thread. Samples are stamped at the configured rate from 0, so
+// with a clock the renderer paces the source and without one the graph
+// runs as fast as the renderer takes frames
+//######################################
+class CTestPatternStream : public CSourceStream
+{
+public:
+	CTestPatternStream(HRESULT *phr, CTestPatternSource *pFilter);
+
+	HRESULT GetMediaType(int iPosition, CMediaType *pmt);
+	HRESULT CheckMediaType(const CMediaType *pmt);
+	HRESULT SetMediaType(const CMediaType *pmt);
+	HRESULT DecideBufferSize(IMemAllocator *pAlloc, ALLOCATOR_PROPERTIES *pProps);
+
+	HRESULT FillBuffer(IMediaSample *pSample);
+	HRESULT OnThreadCreate();
+
+	// Quality messages are ignored, the point is to see what gets dropped
+	STDMETHODIMP Notify(IBaseFilter *pSelf, Quality q) { return NOERROR; }
+
+private:
+	HRESULT UseFormat(const CMediaType *pmt);
+
+	CTestSourceSettings *m_pSettings;
+	CTestPattern m_Pattern;
+	LONG m_lStride;                 // Bytes per row of the first plane
+	BOOL m_bBottomUp;               // RGB with a positive biHeight
+	LONGLONG m_llFrame;             // Next frame, drawn into the counter
+};
+
+//######################################
+// Source filter with one CTestPatternStream, for load testing the renderer
+// without decoders in the way
+//######################################
+class CTestPatternSource : public CSource
+{
+public:
+	static CUnknown * WINAPI CreateInstance(LPUNKNOWN pUnk, HRESULT *phr);
+
+	CTestSourceSettings m_Settings;
+
+private:
+	CTestPatternSource(LPUNKNOWN pUnk, HRESULT *phr);
+};
@@ -0,0 +1,228 @@
+#include "warmalloc.h"
+
+//######################################
+// Defines
+//######################################
+
+// A trim timer that fires this close to the idle timeout trims anyway
+#define TRIM_SLACK 50
+
+//######################################
+// Constructor
+//######################################
+CWarmAllocator::CWarmAllocator (LPCTSTR pName, DWORD dwIdleTimeout, LONG lMinAlign, BOOL bLargePages, HRESULT *phr) :
+	CBaseAllocator(pName, NULL, phr, TRUE, TRUE),
+	m_lMinAlign(lMinAlign),
+	m_bLargePages(bLargePages),
+	m_dwIdleTimeout(dwIdleTimeout),
+	m_dwIdleSince(0),
+	m_hTrimTimer(NULL)
+{
+	SYSTEM_INFO SysInfo;
+	GetSystemInfo(&SysInfo);
+	m_dwPageSize = SysInfo.dwPageSize;
+	ZeroMemory(&m_Block, sizeof(m_Block));
+
+	// Without a queue the memory is simply kept until we are deleted
+	m_hTimerQueue = CreateTimerQueue();
+
+	ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+//######################################
+// Destructor
+// The queue goes first, waiting for a trim that may be running
+//######################################
+CWarmAllocator::~CWarmAllocator () {
+	Decommit();
+	if (m_hTimerQueue) {
+		DeleteTimerQueueEx(m_hTimerQueue, INVALID_HANDLE_VALUE);
+	}
+	ReallyFree();
+}
+
+//######################################
+// SetProperties
+// Same checks and rounding as CMemAllocator, but alignment may go beyond
+// the allocation granularity, is raised to our minimum, and asking for
+// what we already have doesn't count as a change
+//######################################
+STDMETHODIMP CWarmAllocator::SetProperties (ALLOCATOR_PROPERTIES *pRequest, ALLOCATOR_PROPERTIES *pActual) {
+	CheckPointer(pRequest, E_POINTER);
+	CheckPointer(pActual, E_POINTER);
+	CAutoLock cObjectLock(this);
+
+	ZeroMemory(pActual, sizeof(ALLOCATOR_PROPERTIES));
+
+	if (pRequest->cbAlign <= 0 || (-pRequest->cbAlign & pRequest->cbAlign) != pRequest->cbAlign
+		|| pRequest->cbAlign > SAMPLE_BLOCK_MAX_ALIGN) {
+		return VFW_E_BADALIGN;
+	}
+	LONG lAlign = max(pRequest->cbAlign, m_lMinAlign);
+	if (m_bCommitted) {
+		return VFW_E_ALREADY_COMMITTED;
+	}
+	if (m_lFree.GetCount() < m_lAllocated) {
+		return VFW_E_BUFFERS_OUTSTANDING;
+	}
+
+	// Rounded up like CMemAllocator, but without overflowing
+	LONGLONG llSize = (LONGLONG)pRequest->cbBuffer + pRequest->cbPrefix;
+	if (llSize % lAlign) llSize += lAlign - llSize % lAlign;
+	llSize -= pRequest->cbPrefix;
+	if (llSize > MAXLONG) {
+		return E_OUTOFMEMORY;
+	}
+	LONG lSize = (LONG)llSize;
+
+	if (lSize != m_lSize || pRequest->cBuffers != m_lCount
+		|| lAlign != m_lAlignment || pRequest->cbPrefix != m_lPrefix) {
+		m_lSize = lSize;
+		m_lCount = pRequest->cBuffers;
+		m_lAlignment = lAlign;
+		m_lPrefix = pRequest->cbPrefix;
+		m_bChanged = TRUE;
+	}
+
+	pActual->cbBuffer = m_lSize;
+	pActual->cBuffers = m_lCount;
+	pActual->cbAlign = m_lAlignment;
+	pActual->cbPrefix = m_lPrefix;
+	return NOERROR;
+}
+
+//######################################
+// Alloc
+// Called by Commit with all samples free. Unchanged properties keep the
+// samples, changed ones are carved out of the block we still have if they
+// fit, are aligned in it and use at least half of it. Sizes are size_t,
+// so on 64-bit the total is only limited by memory
+//######################################
+HRESULT CWarmAllocator::Alloc () {
+	CAutoLock cObjectLock(this);
+
+	HRESULT hr = CBaseAllocator::Alloc();
+	if (FAILED(hr)) return hr;
+
+	m_Stats.cCommits++;
+	if (hr == S_FALSE) {
+		ASSERT(m_Block.pData);
+		m_Stats.cReused++;
+		return NOERROR;
+	}
+
+	size_t cbStride, cbNeeded;
+	if (!SampleBlockLayout(m_lCount, m_lSize, m_lPrefix, m_lAlignment, &cbStride, &cbNeeded) || cbNeeded == 0) {
+		return E_OUTOFMEMORY;
+	}
+
+	if (m_Block.pData && cbNeeded <= m_Block.cbData && cbNeeded >= m_Block.cbData / 2
+		&& ((ULONG_PTR)m_Block.pData & (m_lAlignment - 1)) == 0) {
+		FreeSamples();
+		m_Stats.cReused++;
+		m_Stats.llFaultsAvoided += (cbNeeded + m_dwPageSize - 1) / m_dwPageSize;
+	}
+	else {
+		ReallyFree();
+		if (!SampleBlockAlloc(&m_Block, cbNeeded, m_lAlignment, m_bLargePages != FALSE)) {
+			return E_OUTOFMEMORY;
+		}
+	}
+
+	LPBYTE pNext = m_Block.pData;
+	for (; m_lAllocated < m_lCount; m_lAllocated++, pNext += cbStride) {
+		CMediaSample *pSample = new CMediaSample(NAME("Warm memory media sample"), this, &hr, pNext + m_lPrefix, m_lSize);
+		if (pSample == NULL) {
+			return E_OUTOFMEMORY;
+		}
+		m_lFree.Add(pSample);
+	}
+
+	m_bChanged = FALSE;
+	return NOERROR;
+}
+
+//######################################
+// Free
+// Decommit completed, object locked by the caller. The memory stays, the
+// trim timer gives it back if nobody commits again in time
+//######################################
+void CWarmAllocator::Free () {
+	m_dwIdleSince = GetTickCount();
+	if (m_Block.pData && m_hTimerQueue && m_hTrimTimer == NULL) {
+		if (!CreateTimerQueueTimer(&m_hTrimTimer, m_hTimerQueue, TrimCallback, this,
+			m_dwIdleTimeout, 0, WT_EXECUTEONLYONCE)) {
+			m_hTrimTimer = NULL;
+		}
+	}
+}
+
+//######################################
+// TrimCallback
+// Runs on a thread pool thread
+//######################################
+VOID CALLBACK CWarmAllocator::TrimCallback (PVOID pContext, BOOLEAN bTimerFired) {
+	static_cast<CWarmAllocator *>(pContext)->Trim();
+}
+
+//######################################
+// Trim
+// There is only ever one timer, so this is the one in m_hTrimTimer. If a
+// commit came in between it does nothing, if that was decommitted again
+// since it waits for the rest of the timeout
+//######################################
+void CWarmAllocator::Trim () {
+	CAutoLock cObjectLock(this);
+
+	// Can't wait for ourselves, this only releases the handle
+	DeleteTimerQueueTimer(m_hTimerQueue, m_hTrimTimer, NULL);
+	m_hTrimTimer = NULL;
+
+	if (m_bCommitted || m_bDecommitInProgress || m_Block.pData == NULL) return;
+
+	DWORD dwIdle = GetTickCount() - m_dwIdleSince;
+	if (dwIdle + TRIM_SLACK < m_dwIdleTimeout) {
+		if (!CreateTimerQueueTimer(&m_hTrimTimer, m_hTimerQueue, TrimCallback, this,
+			m_dwIdleTimeout - dwIdle, 0, WT_EXECUTEONLYONCE)) {
+			m_hTrimTimer = NULL;
+		}
+		return;
+	}
+
+	ReallyFree();
+	m_Stats.cTrims++;
+}
+
+//######################################
+// FreeSamples
+// Deletes the samples but keeps their memory, all of them must be free
+//######################################
+void CWarmAllocator::FreeSamples () {
+	ASSERT(m_lAllocated == m_lFree.GetCount());
+
+	CMediaSample *pSample;
+	while ((pSample = m_lFree.RemoveHead()) != NULL) {
+		delete pSample;
+	}
+	m_lAllocated = 0;
+}
+
+//######################################
+// ReallyFree
+// Samples and memory, the next commit allocates from scratch
+//######################################
+void CWarmAllocator::ReallyFree () {
+	FreeSamples();
+	SampleBlockFree(&m_Block);
+	m_bChanged = TRUE;
+}
+
+//######################################
+// GetWarmStats
+//######################################
+void CWarmAllocator::GetWarmStats (WARM_ALLOCATOR_STATS *pStats) {
+	CAutoLock cObjectLock(this);
+	*pStats = m_Stats;
+	pStats->cbCommitted = (LONGLONG)m_Block.cbData;
+	pStats->bLargePages = m_Block.bLargePages;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <streams.h>
+
+#include "sampleblock.h"
+
+//######################################
+// Counters of a CWarmAllocator, since it was created
+//######################################
+struct WARM_ALLOCATOR_STATS
+{
+	LONG cCommits;              // Commits that needed samples
+	LONG cReused;               // Of those, served from memory that was still committed
+	LONG cTrims;                // Memory given back after the idle timeout
+	LONGLONG llFaultsAvoided;   // Pages that would have been committed and zeroed afresh
+	LONGLONG cbCommitted;       // Bytes committed right now
+	BOOL bLargePages;           // Those are large pages
+};
+
+//######################################
+// Sample allocator that keeps its memory across decommits
+//
+// CMemAllocator keeps its block while the properties are left alone, but
+// drops it for any SetProperties call, even one asking for the same again,
+// which upstream filters make on every reconnect and some on every seek.
+// This one only reallocates when the samples no longer fit the committed
+// block, carves new samples out of it otherwise, and gives the memory back
+// once it has stayed decommitted for the idle timeout.
+//
+// The block comes from SampleBlockAlloc, so it isn't limited to 2 GB on
+// 64-bit, can use large pages, and every buffer starts at least lMinAlign
+// aligned, whatever alignment upstream asked for
+//######################################
+class CWarmAllocator : public CBaseAllocator
+{
+public:
+	CWarmAllocator(LPCTSTR pName, DWORD dwIdleTimeout, LONG lMinAlign, BOOL bLargePages, HRESULT *phr);
+	~CWarmAllocator();
+
+	STDMETHODIMP SetProperties(ALLOCATOR_PROPERTIES *pRequest, ALLOCATOR_PROPERTIES *pActual);
+
+	void GetWarmStats(WARM_ALLOCATOR_STATS *pStats);
+
+protected:
+	HRESULT Alloc();
+	void Free();
+
+private:
+	static VOID CALLBACK TrimCallback(PVOID pContext, BOOLEAN bTimerFired);
+	void Trim();
+	void FreeSamples();
+	void ReallyFree();
+
+	SAMPLE_BLOCK m_Block;       // One block for all samples
+	DWORD m_dwPageSize;
+	LONG m_lMinAlign;           // Power of two up to SAMPLE_BLOCK_MAX_ALIGN
+	BOOL m_bLargePages;         // Ask for large pages
+
+	// Trimming, a one-shot timer on our own queue so the destructor can
+	// wait for a callback that is already running
+	DWORD m_dwIdleTimeout;      // ms
+	DWORD m_dwIdleSince;        // Tick count of the last decommit
+	HANDLE m_hTimerQueue;
+	HANDLE m_hTrimTimer;        // Pending or running, NULL if none
+
+	WARM_ALLOCATOR_STATS m_Stats;
+};
@@ -0,0 +1,139 @@
+#include "workers.h"
+
+#define MAX_WORKERS 16
+
+//######################################
+// Constructor
+//######################################
+CWorkerPool::CWorkerPool () :
+	m_phThreads(NULL),
+	m_nThreads(0),
+	m_hWake(NULL),
+	m_hDone(NULL),
+	m_bExit(FALSE),
+	m_pfnJob(NULL),
+	m_pContext(NULL),
+	m_nJobs(0),
+	m_lNextJob(0),
+	m_lActive(0)
+{
+}
+
+//######################################
+// Destructor
+//######################################
+CWorkerPool::~CWorkerPool () {
+	Stop();
+}
+
+//######################################
+// Start
+// The calling thread always takes part in Run(), so one core is left to it
+//######################################
+HRESULT CWorkerPool::Start (int nThreads) {
+	Stop();
+
+	if (nThreads <= 0) {
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		nThreads = (int)si.dwNumberOfProcessors - 1;
+	}
+	if (nThreads > MAX_WORKERS) nThreads = MAX_WORKERS;
+	if (nThreads <= 0) return S_FALSE;
+
+	m_hWake = CreateSemaphore(NULL, 0, nThreads, NULL);
+	m_hDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+	m_phThreads = new HANDLE[nThreads];
+	if (!m_hWake || !m_hDone || !m_phThreads) {
+		Stop();
+		return E_OUTOFMEMORY;
+	}
+
+	m_bExit = FALSE;
+	for (int i = 0; i < nThreads; i++) {
+		m_phThreads[i] = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+		if (!m_phThreads[i]) break;
+		m_nThreads++;
+	}
+
+	return NOERROR;
+}
+
+//######################################
+// Stop
+//######################################
+void CWorkerPool::Stop () {
+	if (m_nThreads) {
+		m_bExit = TRUE;
+		ReleaseSemaphore(m_hWake, m_nThreads, NULL);
+		WaitForMultipleObjects(m_nThreads, m_phThreads, TRUE, INFINITE);
+		for (int i = 0; i < m_nThreads; i++) CloseHandle(m_phThreads[i]);
+		m_nThreads = 0;
+	}
+
+	delete[] m_phThreads;
+	m_phThreads = NULL;
+
+	if (m_hWake) {
+		CloseHandle(m_hWake);
+		m_hWake = NULL;
+	}
+	if (m_hDone) {
+		CloseHandle(m_hDone);
+		m_hDone = NULL;
+	}
+}
+
+//######################################
+// Run
+// Only as many workers as there are spare jobs get woken
+//######################################
+void CWorkerPool::Run (PWORKERJOB pfnJob, void *pContext, int nJobs) {
+	if (nJobs <= 0) return;
+
+	m_pfnJob = pfnJob;
+	m_pContext = pContext;
+	m_nJobs = nJobs;
+	m_lNextJob = 0;
+
+	LONG lWake = nJobs - 1;
+	if (lWake > m_nThreads) lWake = m_nThreads;
+	m_lActive = lWake;
+
+	if (lWake) ReleaseSemaphore(m_hWake, lWake, NULL);
+
+	DoJobs();
+
+	if (lWake) WaitForSingleObject(m_hDone, INFINITE);
+}
+
+//######################################
+// DoJobs
+//######################################
+void CWorkerPool::DoJobs () {
+	for (;;) {
+		LONG iJob = InterlockedIncrement(&m_lNextJob) - 1;
+		if (iJob >= m_nJobs) break;
+		m_pfnJob(m_pContext, (int)iJob, m_nJobs);
+	}
+}
+
+//######################################
+// ThreadProc
+//######################################
+DWORD WINAPI CWorkerPool::ThreadProc (LPVOID pParam) {
+	CWorkerPool *pPool = (CWorkerPool *)pParam;
+
+	for (;;) {
+		WaitForSingleObject(pPool->m_hWake, INFINITE);
+		if (pPool->m_bExit) break;
+
+		pPool->DoJobs();
+
+		if (InterlockedDecrement(&pPool->m_lActive) == 0) {
+			SetEvent(pPool->m_hDone);
+		}
+	}
+
+	return 0;
+}
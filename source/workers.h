@@ -0,0 +1,39 @@
+#pragma once
+
+#include <windows.h>
+
+typedef void (*PWORKERJOB)(void *pContext, int iJob, int nJobs);
+
+//######################################
+// Small pool of worker threads used to split per-frame work (conversion,
+// copies) into stripes. Run() hands out jobs to the workers and to the
+// calling thread and only returns once every job has completed
+//######################################
+class CWorkerPool
+{
+public:
+	CWorkerPool();
+	~CWorkerPool();
+
+	HRESULT Start(int nThreads);        // 0 = one per logical processor
+	void Stop();
+	int JobCount() const { return m_nThreads + 1; }
+
+	void Run(PWORKERJOB pfnJob, void *pContext, int nJobs);
+
+private:
+	static DWORD WINAPI ThreadProc(LPVOID pParam);
+	void DoJobs();
+
+	HANDLE *m_phThreads;
+	int m_nThreads;
+	HANDLE m_hWake;                     // Semaphore, one count per worker woken
+	HANDLE m_hDone;                     // Set by the last worker to finish
+	volatile BOOL m_bExit;
+
+	PWORKERJOB m_pfnJob;
+	void *m_pContext;
+	int m_nJobs;
+	volatile LONG m_lNextJob;
+	volatile LONG m_lActive;
+};
@@ -0,0 +1,220 @@
+//######################################
+// advbench
+// Benchmarks the advise heap behind CAMSchedule against the sorted list it
+// replaced, with 10 to 10,000 outstanding advises, and checks both fire the
+// same advises in the same order. Needs no Windows:
+//
+//   g++ -O2 -Ibaseclasses/source tools/advbench.cpp baseclasses/source/advheap.cpp -o advbench
+//   cl /O2 /Ibaseclasses\source tools\advbench.cpp baseclasses\source\advheap.cpp
+//
+//   advbench [-n steps]
+//
+// Each step moves time on, fires whatever is due, re-arms the fired one-shot
+// advises at a random time ahead, and cancels and re-adds a random advise,
+// which is what renderers sharing one clock do all the time
+//######################################
+
+#include "advheap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PERIODIC_SHARE  10          // Percent of the advises that are periodic
+#define MAX_AHEAD       400000      // One-shot advises are due up to 40 ms ahead
+#define STEP            10000       // Time moves 1 ms per step
+
+//######################################
+// The old CAMSchedule list: sorted by time, a new packet goes in front of
+// equal times, a periodic packet that fired goes behind them
+//######################################
+class CAdviseList
+{
+public:
+	CAdviseList() : m_pHead(NULL), m_dwNextCookie(0), m_cCount(0) {}
+	~CAdviseList() {
+		while (m_pHead) {
+			PACKET *p = m_pHead;
+			m_pHead = p->pNext;
+			delete p;
+		}
+	}
+
+	uintptr_t Add(int64_t rtTime, int64_t rtPeriod, void *hNotify, bool bPeriodic) {
+		PACKET *p = new PACKET;
+		p->rtTime = rtTime;
+		p->rtPeriod = rtPeriod;
+		p->hNotify = hNotify;
+		p->bPeriodic = bPeriodic;
+		p->dwCookie = ++m_dwNextCookie;
+		Insert(p, false);
+		m_cCount++;
+		return p->dwCookie;
+	}
+
+	bool Remove(uintptr_t dwCookie) {
+		for (PACKET **pp = &m_pHead; *pp; pp = &(*pp)->pNext) {
+			if ((*pp)->dwCookie == dwCookie) {
+				PACKET *p = *pp;
+				*pp = p->pNext;
+				delete p;
+				m_cCount--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool PopDue(int64_t rtNow, void **phNotify) {
+		PACKET *p = m_pHead;
+		if (!p || p->rtTime > rtNow) return false;
+		*phNotify = p->hNotify;
+		m_pHead = p->pNext;
+		if (p->bPeriodic) {
+			p->rtTime += p->rtPeriod;
+			Insert(p, true);
+		}
+		else {
+			delete p;
+			m_cCount--;
+		}
+		return true;
+	}
+
+	uint32_t Count() const { return m_cCount; }
+
+private:
+	struct PACKET
+	{
+		PACKET *pNext;
+		int64_t rtTime;
+		int64_t rtPeriod;
+		void *hNotify;
+		bool bPeriodic;
+		uintptr_t dwCookie;
+	};
+
+	void Insert(PACKET *p, bool bBehindEqual) {
+		PACKET **pp = &m_pHead;
+		while (*pp && ((*pp)->rtTime < p->rtTime || (bBehindEqual && (*pp)->rtTime == p->rtTime))) pp = &(*pp)->pNext;
+		p->pNext = *pp;
+		*pp = p;
+	}
+
+	PACKET *m_pHead;
+	uintptr_t m_dwNextCookie;
+	uint32_t m_cCount;
+};
+
+//######################################
+// Both schedules behind one interface for the workload
+//######################################
+struct SCHEDULE
+{
+	CAdviseHeap *pHeap;
+	CAdviseList *pList;
+
+	uintptr_t Add(int64_t rtTime, int64_t rtPeriod, void *hNotify, bool bPeriodic) {
+		bool bFirst;
+		return pHeap ? pHeap->Add(rtTime, rtPeriod, hNotify, bPeriodic, &bFirst) : pList->Add(rtTime, rtPeriod, hNotify, bPeriodic);
+	}
+	bool Remove(uintptr_t dwCookie) {
+		return pHeap ? pHeap->Remove(dwCookie) : pList->Remove(dwCookie);
+	}
+	bool PopDue(int64_t rtNow, void **phNotify) {
+		bool bPeriodic;
+		uintptr_t dwCookie;
+		return pHeap ? pHeap->PopDue(rtNow, phNotify, &bPeriodic, &dwCookie) : pList->PopDue(rtNow, phNotify);
+	}
+};
+
+static uint32_t g_uRandom;
+
+static uint32_t Random () {
+	g_uRandom = g_uRandom * 1664525 + 1013904223;
+	return g_uRandom >> 8;
+}
+
+//######################################
+// Runs the workload, returns a checksum of the fire order. Handles are the
+// advise numbers, so the checksum is the same for both if they agree
+//######################################
+static uint64_t Run (SCHEDULE *pSchedule, int nAdvises, int nSteps, double *pdSeconds, long long *pllOps) {
+	uintptr_t *pCookies = (uintptr_t *)malloc(nAdvises * sizeof(uintptr_t));
+	bool *pbPeriodic = (bool *)malloc(nAdvises * sizeof(bool));
+	uint64_t qwSum = 0;
+	long long llOps = 0;
+	int64_t rtNow = 0;
+
+	g_uRandom = 12345;
+	for (int i = 0; i < nAdvises; i++) {
+		pbPeriodic[i] = (int)(Random() % 100) < PERIODIC_SHARE;
+		int64_t rtPeriod = pbPeriodic[i] ? 100000 + 10000 * (Random() % 40) : 0;
+		pCookies[i] = pSchedule->Add(Random() % MAX_AHEAD, rtPeriod, (void *)(uintptr_t)(i + 1), pbPeriodic[i]);
+	}
+
+	clock_t tStart = clock();
+	for (int s = 0; s < nSteps; s++) {
+		rtNow += STEP;
+
+		void *hNotify;
+		while (pSchedule->PopDue(rtNow, &hNotify)) {
+			int i = (int)((uintptr_t)hNotify - 1);
+			qwSum = qwSum * 31 + (uint64_t)(i + 1);
+			llOps++;
+			if (!pbPeriodic[i]) {
+				pCookies[i] = pSchedule->Add(rtNow + 1 + Random() % MAX_AHEAD, 0, hNotify, false);
+				llOps++;
+			}
+		}
+
+		// Cancel and re-arm one, periodic ones come back as one-shots
+		int i = (int)(Random() % nAdvises);
+		if (pSchedule->Remove(pCookies[i])) {
+			pbPeriodic[i] = false;
+			pCookies[i] = pSchedule->Add(rtNow + 1 + Random() % MAX_AHEAD, 0, (void *)(uintptr_t)(i + 1), false);
+			llOps += 2;
+		}
+	}
+	*pdSeconds = (double)(clock() - tStart) / CLOCKS_PER_SEC;
+	*pllOps = llOps;
+
+	for (int i = 0; i < nAdvises; i++) pSchedule->Remove(pCookies[i]);
+	free(pCookies);
+	free(pbPeriodic);
+	return qwSum;
+}
+
+int main (int argc, char **argv) {
+	int nSteps = 200;
+	if (argc == 3 && !strcmp(argv[1], "-n")) nSteps = atoi(argv[2]);
+	if ((argc != 1 && argc != 3) || nSteps <= 0) {
+		fprintf(stderr, "usage: advbench [-n steps]\n");
+		return 2;
+	}
+
+	static const int s_nAdvises[] = { 10, 100, 1000, 10000 };
+	int iResult = 0;
+
+	printf("advises  steps    heap ns/op    list ns/op    order\n");
+	for (size_t n = 0; n < sizeof(s_nAdvises) / sizeof(s_nAdvises[0]); n++) {
+		CAdviseHeap Heap;
+		CAdviseList List;
+		SCHEDULE HeapSchedule = { &Heap, NULL };
+		SCHEDULE ListSchedule = { NULL, &List };
+
+		double dHeap, dList;
+		long long llHeapOps, llListOps;
+		uint64_t qwHeap = Run(&HeapSchedule, s_nAdvises[n], nSteps, &dHeap, &llHeapOps);
+		uint64_t qwList = Run(&ListSchedule, s_nAdvises[n], nSteps, &dList, &llListOps);
+
+		bool bSame = (qwHeap == qwList && llHeapOps == llListOps && Heap.Count() == 0 && List.Count() == 0);
+		if (!bSame) iResult = 1;
+
+		printf("%7d  %5d  %12.1f  %12.1f    %s\n", s_nAdvises[n], nSteps,
+			llHeapOps ? dHeap * 1e9 / llHeapOps : 0.0, llListOps ? dList * 1e9 / llListOps : 0.0,
+			bSame ? "same" : "DIFFERENT");
+	}
+
+	return iResult;
+}
@@ -0,0 +1,207 @@
+//######################################
+// allocbench
+// Exercises the sample block behind the renderer's allocator: lays out and
+// maps a queue of 8K 16-bit frames beyond the 2 GB CMemAllocator refuses,
+// then compares normal pages with huge pages on a queue of UHD frames for
+// first touch (page faults), copying whole frames and walking them column
+// wise like a flip or a tile would. dTLB misses are read from perf events
+// where the kernel lets us:
+//
+//   g++ -O2 -Isource tools/allocbench.cpp source/sampleblock.cpp -o allocbench
+//
+//   allocbench [-f frames] [-r repeats]
+//
+//   -f  UHD frames in the queue (default 8)
+//   -r  passes over the queue per test (default 4)
+//######################################
+
+#include "sampleblock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define UHD_WIDTH       3840
+#define UHD_HEIGHT      2160
+#define UHD_BYTES       4               // BGRA
+#define BIG_WIDTH       7680
+#define BIG_HEIGHT      4320
+#define BIG_BYTES       8               // 16 bits per channel RGBA
+#define BIG_FRAMES      16
+#define COLUMN_STEP     64              // One cache line per row per column pass
+
+static double Now () {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//######################################
+// dTLB read misses of this thread, -1 where perf events aren't available
+//######################################
+struct TLB_COUNTER
+{
+	int hEvent;
+
+	TLB_COUNTER() : hEvent(-1) {
+#ifdef __linux__
+		struct perf_event_attr Attr;
+		memset(&Attr, 0, sizeof(Attr));
+		Attr.size = sizeof(Attr);
+		Attr.type = PERF_TYPE_HW_CACHE;
+		Attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		Attr.disabled = 1;
+		Attr.exclude_kernel = 1;
+		Attr.exclude_hv = 1;
+		hEvent = (int)syscall(SYS_perf_event_open, &Attr, 0, -1, -1, 0);
+#endif
+	}
+	~TLB_COUNTER() {
+#ifdef __linux__
+		if (hEvent >= 0) close(hEvent);
+#endif
+	}
+	void Start() {
+#ifdef __linux__
+		if (hEvent >= 0) {
+			ioctl(hEvent, PERF_EVENT_IOC_RESET, 0);
+			ioctl(hEvent, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+	long long Stop() {
+		long long llCount = -1;
+#ifdef __linux__
+		if (hEvent >= 0) {
+			ioctl(hEvent, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(hEvent, &llCount, sizeof(llCount)) != sizeof(llCount)) llCount = -1;
+		}
+#endif
+		return llCount;
+	}
+};
+
+struct RESULT
+{
+	double dTouch;                  // s to fault in the queue
+	double dCopy;                   // GB/s copying frame to frame
+	double dColumn;                 // ns per row step of the column walk
+	long long llCopyMisses;
+	long long llColumnMisses;
+	bool bLarge;
+};
+
+static volatile uint64_t g_qwSink;
+
+static bool Run (int nFrames, int nRepeats, bool bLarge, RESULT *pResult) {
+	size_t cbStride, cbTotal;
+	if (!SampleBlockLayout(nFrames, (int64_t)UHD_WIDTH * UHD_HEIGHT * UHD_BYTES, 0, 64, &cbStride, &cbTotal)) return false;
+
+	SAMPLE_BLOCK Block;
+	if (!SampleBlockAlloc(&Block, cbTotal, 64, bLarge)) return false;
+	pResult->bLarge = Block.bLargePages;
+
+	TLB_COUNTER Tlb;
+
+	double dStart = Now();
+	memset(Block.pData, 0x10, cbTotal);
+	pResult->dTouch = Now() - dStart;
+
+	// Each frame into the next, as a queue of copies
+	Tlb.Start();
+	dStart = Now();
+	for (int r = 0; r < nRepeats; r++) {
+		for (int i = 0; i + 1 < nFrames; i++) {
+			memcpy(Block.pData + (i + 1) * cbStride, Block.pData + i * cbStride, cbStride);
+		}
+	}
+	double dSeconds = Now() - dStart;
+	pResult->llCopyMisses = Tlb.Stop();
+	pResult->dCopy = (double)cbStride * (nFrames - 1) * nRepeats / dSeconds / 1e9;
+
+	// Down every column of cache lines, every row step lands on another page
+	const size_t cbLine = UHD_WIDTH * UHD_BYTES;
+	uint64_t qwSum = 0;
+	long long llSteps = 0;
+	Tlb.Start();
+	dStart = Now();
+	for (int r = 0; r < nRepeats; r++) {
+		for (int i = 0; i < nFrames; i++) {
+			const uint8_t *pFrame = Block.pData + i * cbStride;
+			for (size_t x = 0; x < cbLine; x += COLUMN_STEP * 16) {
+				for (int y = 0; y < UHD_HEIGHT; y++) qwSum += pFrame[y * cbLine + x];
+				llSteps += UHD_HEIGHT;
+			}
+		}
+	}
+	dSeconds = Now() - dStart;
+	pResult->llColumnMisses = Tlb.Stop();
+	pResult->dColumn = dSeconds * 1e9 / llSteps;
+	g_qwSink = qwSum;
+
+	SampleBlockFree(&Block);
+	return true;
+}
+
+static void PrintMisses (long long llMisses) {
+	if (llMisses < 0) printf("%14s", "n/a");
+	else printf("%14lld", llMisses);
+}
+
+int main (int argc, char **argv) {
+	int nFrames = 8;
+	int nRepeats = 4;
+	for (int iArg = 1; iArg < argc; iArg++) {
+		if (!strcmp(argv[iArg], "-f") && iArg + 1 < argc) nFrames = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-r") && iArg + 1 < argc) nRepeats = atoi(argv[++iArg]);
+		else {
+			fprintf(stderr, "usage: allocbench [-f frames] [-r repeats]\n");
+			return 2;
+		}
+	}
+	if (nFrames < 2 || nRepeats < 1) {
+		fprintf(stderr, "allocbench: bad arguments\n");
+		return 2;
+	}
+
+	// Beyond MAXLONG: only mapped, never touched
+	size_t cbStride, cbTotal;
+	int iResult = 0;
+	if (!SampleBlockLayout(BIG_FRAMES, (int64_t)BIG_WIDTH * BIG_HEIGHT * BIG_BYTES, 0, 4096, &cbStride, &cbTotal)) {
+		printf("%d 8K RGBA64 frames: layout doesn't fit this build's size_t\n", BIG_FRAMES);
+	}
+	else {
+		SAMPLE_BLOCK Block;
+		bool bMapped = SampleBlockAlloc(&Block, cbTotal, 4096, false);
+		printf("%d 8K RGBA64 frames: %.2f GB in one block, %s\n", BIG_FRAMES, cbTotal / 1073741824.0,
+			bMapped ? "mapped" : "NOT MAPPED");
+		if (!bMapped) iResult = 1;
+		SampleBlockFree(&Block);
+	}
+
+	printf("large page size %zu KB\n", SampleBlockLargePageSize() / 1024);
+	printf("%d UHD BGRA frames, %d passes\n", nFrames, nRepeats);
+	printf("pages     touch s   copy GB/s   copy dTLB miss   column ns   column dTLB miss\n");
+	for (int i = 0; i < 2; i++) {
+		RESULT Result;
+		if (!Run(nFrames, nRepeats, i == 1, &Result)) {
+			printf("%-8s  allocation failed\n", i ? "large" : "normal");
+			iResult = 1;
+			continue;
+		}
+		printf("%-8s  %7.3f  %10.2f  ", i == 0 ? "normal" : Result.bLarge ? "large" : "(normal)", Result.dTouch, Result.dCopy);
+		PrintMisses(Result.llCopyMisses);
+		printf("  %10.2f    ", Result.dColumn);
+		PrintMisses(Result.llColumnMisses);
+		printf("\n");
+	}
+
+	return iResult;
+}
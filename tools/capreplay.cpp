@@ -0,0 +1,267 @@
+//######################################
+// capreplay
+// Feeds a capture written by the renderer's CaptureFile tap back through
+// the renderer's network scheduling policy and a mock sender that does
+// what the renderer does with a frame short of NDI: copies it into the
+// half of a double buffer NDI isn't reading. At recorded speed samples
+// arrive when they arrived in production and the policy runs on the real
+// clock. Flat out, the clock is virtual and jumps over every wait, so only
+// the per frame work is timed. The decision hash covers which samples
+// were sent or dropped and the input hash the data, so two builds can be
+// compared on exactly the same input:
+//
+//   g++ -O2 -Isource tools/capreplay.cpp source/capture.cpp source/schedpolicy.cpp -o capreplay
+//
+//   capreplay [-m recorded|max] [-b budget_ms] [-u] capture
+//   capreplay -g capture [-n frames] [-w width] [-h height] [-r fps]
+//
+//   -m  replay speed (default recorded)
+//   -b  lateness budget in ms (default 40)
+//   -u  don't model NDI's clock_video pacing
+//   -g  write a synthetic UYVY capture with jittered arrivals instead
+//######################################
+
+#include "capture.h"
+#include "schedpolicy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+// MEDIASUBTYPE_UYVY as laid out in memory
+static const uint8_t g_SubtypeUYVY[16] = {
+	'U', 'Y', 'V', 'Y', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+};
+
+static int64_t Now () {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * POLICY_UNITS + ts.tv_nsec / 100;
+}
+
+static void SleepUntil (int64_t rtWhen) {
+	int64_t rtWait = rtWhen - Now();
+	if (rtWait > 0) usleep((useconds_t)(rtWait / 10));
+}
+
+static uint64_t Fnv (uint64_t qwHash, const void *p, size_t cb) {
+	const uint8_t *pb = (const uint8_t *)p;
+	for (size_t i = 0; i < cb; i++) qwHash = (qwHash ^ pb[i]) * 0x100000001B3ULL;
+	return qwHash;
+}
+
+//######################################
+// What the renderer does with a frame in async mode short of NDI: the
+// frame goes into the half of the double buffer that isn't being read
+//######################################
+class CMockSender
+{
+public:
+	CMockSender() : m_iHalf(0) {}
+
+	int64_t Send(const uint8_t *pData, size_t cbData) {
+		int64_t rtStart = Now();
+		if (m_Halves[m_iHalf].size() < cbData) m_Halves[m_iHalf].resize(cbData);
+		if (cbData) memcpy(&m_Halves[m_iHalf][0], pData, cbData);
+		m_iHalf ^= 1;
+		return Now() - rtStart;
+	}
+
+private:
+	std::vector<uint8_t> m_Halves[2];
+	int m_iHalf;
+};
+
+//######################################
+// Generate
+// A steady source at fps whose samples arrive 2 to 12 ms ahead of time,
+// with the occasional decoder stall of 60 ms
+//######################################
+static int Generate (const char *pPath, int nFrames, int nWidth, int nHeight, int nRate) {
+	CCaptureWriter Writer;
+	if (!Writer.Open(pPath)) {
+		fprintf(stderr, "capreplay: can't create %s\n", pPath);
+		return 1;
+	}
+
+	const size_t cbFrame = (size_t)nWidth * nHeight * 2;
+	std::vector<uint8_t> Frame(cbFrame);
+	const int64_t rtDuration = POLICY_UNITS / nRate;
+	uint32_t dwRandom = 12345;
+	int64_t rtPrevious = 0;
+
+	for (int n = 0; n < nFrames; n++) {
+		memset(&Frame[0], n & 0xFF, cbFrame);
+
+		// A stalled sample holds up the ones behind it, which then arrive in a burst
+		dwRandom = dwRandom * 1103515245 + 12345;
+		int64_t rtArrival = n * rtDuration - 20000 - (int64_t)((dwRandom >> 8) % 100000);
+		if ((dwRandom >> 16) % 100 == 0) rtArrival += 600000;
+		rtPrevious = std::max(rtPrevious, rtArrival);
+
+		CAPTURE_RECORD Record;
+		memset(&Record, 0, sizeof(Record));
+		Record.dwFlags = CAPTURE_TIME_VALID | CAPTURE_STOP_VALID | (n == 0 ? CAPTURE_DISCONTINUITY : 0);
+		Record.rtStart = n * rtDuration;
+		Record.rtStop = Record.rtStart + rtDuration;
+		Record.rtArrival = std::max((int64_t)0, rtPrevious);
+		Record.qwArrivalTime = (uint64_t)Record.rtArrival / 10;
+		Record.cbData = cbFrame;
+		memcpy(Record.Format.Subtype, g_SubtypeUYVY, sizeof(g_SubtypeUYVY));
+		Record.Format.lWidth = nWidth;
+		Record.Format.lHeight = nHeight;
+		Record.Format.dwBitCount = 16;
+		Record.Format.dwCompression = 0x59565955;
+		Record.Format.llAvgTimePerFrame = rtDuration;
+
+		if (!Writer.Append(&Record, &Frame[0])) {
+			fprintf(stderr, "capreplay: writing %s failed\n", pPath);
+			return 1;
+		}
+	}
+
+	printf("%s: %d %dx%d UYVY frames at %d fps, %.1f MB\n", pPath, nFrames, nWidth, nHeight, nRate, Writer.Length() / 1e6);
+	Writer.Close();
+	return 0;
+}
+
+int main (int argc, char **argv) {
+	bool bRecorded = true;
+	int iBudget = 40;
+	bool bClockVideo = true;
+	const char *pGenerate = NULL;
+	int nFrames = 600, nWidth = 1920, nHeight = 1080, nRate = 60;
+	const char *pPath = NULL;
+
+	for (int iArg = 1; iArg < argc; iArg++) {
+		if (!strcmp(argv[iArg], "-m") && iArg + 1 < argc) bRecorded = strcmp(argv[++iArg], "max") != 0;
+		else if (!strcmp(argv[iArg], "-b") && iArg + 1 < argc) iBudget = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-u")) bClockVideo = false;
+		else if (!strcmp(argv[iArg], "-g") && iArg + 1 < argc) pGenerate = argv[++iArg];
+		else if (!strcmp(argv[iArg], "-n") && iArg + 1 < argc) nFrames = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-w") && iArg + 1 < argc) nWidth = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-h") && iArg + 1 < argc) nHeight = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-r") && iArg + 1 < argc) nRate = atoi(argv[++iArg]);
+		else if (argv[iArg][0] != '-' && !pPath) pPath = argv[iArg];
+		else {
+			pPath = NULL;
+			pGenerate = NULL;
+			break;
+		}
+	}
+
+	if (pGenerate) {
+		if (nFrames < 1 || nWidth < 2 || nHeight < 1 || nRate < 1) {
+			fprintf(stderr, "capreplay: bad arguments\n");
+			return 2;
+		}
+		return Generate(pGenerate, nFrames, nWidth, nHeight, nRate);
+	}
+	if (!pPath) {
+		fprintf(stderr, "usage: capreplay [-m recorded|max] [-b budget_ms] [-u] capture\n"
+			"       capreplay -g capture [-n frames] [-w width] [-h height] [-r fps]\n");
+		return 2;
+	}
+
+	CCaptureReader Reader;
+	if (!Reader.Open(pPath)) {
+		fprintf(stderr, "capreplay: %s is not a capture\n", pPath);
+		return 1;
+	}
+
+	CNetworkSinkPolicy Policy;
+	Policy.SetLatenessBudget((int64_t)iBudget * 10000);
+	Policy.SetClocked(bClockVideo);
+	Policy.Reset();
+	CMockSender Sender;
+
+	// Stream time 0 is the replay start, whatever the capture's first arrival
+	const CAPTURE_RECORD *pFirst = Reader.Next(NULL);
+	const int64_t rtFirstArrival = pFirst && pFirst->rtArrival >= 0 ? pFirst->rtArrival : 0;
+	const uint64_t qwFirstArrival = pFirst ? pFirst->qwArrivalTime : 0;
+	const int64_t rtBase = Now();
+	int64_t rtVirtual = 0;
+
+	long cRecords = 0, cSent = 0, cDropped = 0, cWaited = 0;
+	int64_t rtLateSum = 0, rtLateMax = 0;
+	uint64_t qwDecisions = 0xCBF29CE484222325ULL, qwInput = 0xCBF29CE484222325ULL;
+	uint64_t cbSent = 0;
+	int64_t rtWork = 0;
+	std::vector<int64_t> Costs;
+
+	for (const CAPTURE_RECORD *pRecord = pFirst; pRecord; pRecord = Reader.Next(pRecord)) {
+		cRecords++;
+
+		// Arrival in replay stream time, from the stream clock if there was one
+		int64_t rtArrival = pRecord->rtArrival >= 0 ? pRecord->rtArrival - rtFirstArrival
+			: (int64_t)(pRecord->qwArrivalTime - qwFirstArrival) * 10;
+		int64_t rtNow;
+		if (bRecorded) {
+			SleepUntil(rtBase + rtArrival);
+			rtNow = Now() - rtBase;
+		}
+		else {
+			rtVirtual = std::max(rtVirtual, rtArrival);
+			rtNow = rtVirtual;
+		}
+
+		ScheduleDecision Decision = Schedule_Send;
+		int64_t rtStart = pRecord->rtStart - rtFirstArrival;
+		int64_t rtStop = pRecord->rtStop - rtFirstArrival;
+		if (pRecord->dwFlags & CAPTURE_TIME_VALID) {
+			if (!(pRecord->dwFlags & CAPTURE_STOP_VALID)) rtStop = rtStart + 1;
+			Decision = Policy.Decide(rtNow, &rtStart, &rtStop, (pRecord->dwFlags & CAPTURE_DISCONTINUITY) != 0);
+		}
+
+		qwDecisions = Fnv(qwDecisions, &pRecord->qwSequence, sizeof(pRecord->qwSequence));
+		qwDecisions = Fnv(qwDecisions, &Decision, sizeof(Decision));
+		if (Decision == Schedule_Drop) {
+			cDropped++;
+			continue;
+		}
+
+		if (Decision == Schedule_Wait && rtStart > rtNow) {
+			cWaited++;
+			if (bRecorded) {
+				SleepUntil(rtBase + rtStart);
+				rtNow = Now() - rtBase;
+			}
+			else {
+				rtNow = rtStart;
+			}
+		}
+
+		int64_t rtLate = (pRecord->dwFlags & CAPTURE_TIME_VALID) ? rtNow - rtStart : 0;
+		rtLateSum += rtLate;
+		rtLateMax = std::max(rtLateMax, rtLate);
+
+		const uint8_t *pData = CCaptureReader::Data(pRecord);
+		int64_t rtCost = Sender.Send(pData, (size_t)pRecord->cbData);
+		Policy.OnSent(rtNow, rtCost);
+		if (!bRecorded) rtVirtual = rtNow + rtCost;
+
+		Costs.push_back(rtCost);
+		rtWork += rtCost;
+		cbSent += pRecord->cbData;
+		cSent++;
+		qwInput = Fnv(qwInput, pData, std::min((size_t)pRecord->cbData, (size_t)4096));
+	}
+	double dSeconds = (Now() - rtBase) / (double)POLICY_UNITS;
+
+	std::sort(Costs.begin(), Costs.end());
+	int64_t rtP50 = Costs.empty() ? 0 : Costs[Costs.size() / 2];
+	int64_t rtP99 = Costs.empty() ? 0 : Costs[std::min(Costs.size() - 1, Costs.size() * 99 / 100)];
+
+	printf("%s%s, %s speed, %s pacing, budget %d ms\n", pPath, Reader.WasClosed() ? "" : " (not closed)",
+		bRecorded ? "recorded" : "max", bClockVideo ? "clock_video" : "no", iBudget);
+	printf("  samples %ld, sent %ld, dropped %ld, waited for %ld\n", cRecords, cSent, cDropped, cWaited);
+	printf("  late: mean %.2f ms, max %.2f ms\n", cSent ? rtLateSum / 10000.0 / cSent : 0.0, rtLateMax / 10000.0);
+	printf("  mock send: p50 %.3f ms, p99 %.3f ms, %.2f GB/s\n", rtP50 / 10000.0, rtP99 / 10000.0,
+		rtWork ? cbSent / (rtWork / (double)POLICY_UNITS) / 1e9 : 0.0);
+	printf("  replayed in %.3f s, decision hash %016llx, input hash %016llx\n", dSeconds,
+		(unsigned long long)qwDecisions, (unsigned long long)qwInput);
+	return 0;
+}
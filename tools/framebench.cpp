@@ -0,0 +1,213 @@
+//######################################
+// framebench
+// Runs the shared memory frame output between processes the way the
+// renderer and a local consumer would: the parent writes frames through
+// CFrameWriter, forked readers follow them through CFrameReader and read
+// every frame, either in place or copied out first. Each frame is filled
+// with its frame number, so a reader that finds other data in a frame
+// IsCurrent vouches for has caught the protocol failing. Reports write
+// cost, how long after the write readers had each frame, and frames read,
+// torn (overwritten while in use) and missed:
+//
+//   g++ -O2 -Isource tools/framebench.cpp source/frameshm.cpp -o framebench
+//
+//   framebench [-w width] [-h height] [-n frames] [-s slots] [-r fps] [-c readers] [-m inplace|copy]
+//
+//   -w, -h  UYVY frame size (default 3840x2160)
+//   -n      frames written (default 600)
+//   -s      slots in the ring (default 4)
+//   -r      frames per second, 0 = as fast as possible (default 60)
+//   -c      reader processes (default 1)
+//   -m      read frames in place (default) or copy them out first
+//######################################
+
+#include "frameshm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#define BENCH_SOURCE    "framebench"
+#define FOURCC_UYVY     0x59565955
+
+static double Now () {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//######################################
+// Every byte of frame n is n & 0xFF
+//######################################
+static bool CheckFrame (const uint8_t *pData, uint64_t cbData, uint64_t qwFrame) {
+	uint64_t qwPattern = (qwFrame & 0xFF) * 0x0101010101010101ULL;
+	const uint64_t *p = (const uint64_t *)pData;
+	bool bMatch = true;
+	for (uint64_t i = 0; i < cbData / 8; i++) bMatch &= (p[i] == qwPattern);
+	return bMatch;
+}
+
+static uint32_t Percentile (std::vector<uint32_t> &Values, int iPercent) {
+	if (Values.empty()) return 0;
+	size_t i = Values.size() * iPercent / 100;
+	if (i >= Values.size()) i = Values.size() - 1;
+	std::nth_element(Values.begin(), Values.begin() + i, Values.end());
+	return Values[i];
+}
+
+//######################################
+// Reader process, follows every frame until the writer has gone and no
+// newer frame is left. Returns 1 if it saw corrupt data
+//######################################
+static int Reader (int iReader, bool bCopy) {
+	CFrameReader Frames;
+	double dStart = Now();
+	while (!Frames.Open(BENCH_SOURCE)) {
+		if (Now() - dStart > 5) {
+			printf("reader %d: segment not found\n", iReader);
+			return 1;
+		}
+		usleep(1000);
+	}
+
+	std::vector<uint8_t> Copy;
+	std::vector<uint32_t> Latency;
+	uint64_t qwNext = 1;
+	long cRead = 0, cTorn = 0, cMissed = 0, cCorrupt = 0;
+	double dBusy = 0;
+	uint64_t cbRead = 0;
+
+	for (;;) {
+		FRAMES_VIEW View;
+		if (!Frames.Get(qwNext, &View)) {
+			// Not written yet, or overwritten already: catch up with the newest
+			FRAMES_VIEW Latest;
+			if (Frames.Latest(&Latest) && Latest.Info.qwFrame > qwNext) {
+				cMissed += (long)(Latest.Info.qwFrame - qwNext);
+				qwNext = Latest.Info.qwFrame;
+				continue;
+			}
+			if (Frames.IsClosed()) break;
+			usleep(100);
+			continue;
+		}
+
+		Latency.push_back((uint32_t)(GetFramesClock() - View.Info.qwWriteTime));
+
+		double dRead = Now();
+		const uint8_t *pData = View.pData;
+		if (bCopy) {
+			Copy.resize((size_t)View.Info.cbData);
+			memcpy(&Copy[0], View.pData, (size_t)View.Info.cbData);
+			pData = &Copy[0];
+		}
+		bool bMatch = CheckFrame(pData, View.Info.cbData, View.Info.qwFrame);
+		bool bCurrent = Frames.IsCurrent(&View);
+		dBusy += Now() - dRead;
+
+		if (!bCurrent) cTorn++;
+		else if (!bMatch) cCorrupt++;
+		else {
+			cRead++;
+			cbRead += View.Info.cbData;
+		}
+		qwNext++;
+	}
+
+	printf("reader %d (%s): %ld read, %ld torn, %ld missed, %ld corrupt, %.2f GB/s while reading, available after p50 %u us p99 %u us max %u us\n",
+		iReader, bCopy ? "copy" : "in place", cRead, cTorn, cMissed, cCorrupt,
+		dBusy > 0 ? cbRead / dBusy / 1e9 : 0.0,
+		Percentile(Latency, 50), Percentile(Latency, 99), Percentile(Latency, 100));
+	return cCorrupt ? 1 : 0;
+}
+
+int main (int argc, char **argv) {
+	int nWidth = 3840;
+	int nHeight = 2160;
+	int nFrames = 600;
+	int nSlots = 4;
+	int nRate = 60;
+	int nReaders = 1;
+	bool bCopy = false;
+	for (int iArg = 1; iArg < argc; iArg++) {
+		if (!strcmp(argv[iArg], "-w") && iArg + 1 < argc) nWidth = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-h") && iArg + 1 < argc) nHeight = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-n") && iArg + 1 < argc) nFrames = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-s") && iArg + 1 < argc) nSlots = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-r") && iArg + 1 < argc) nRate = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-c") && iArg + 1 < argc) nReaders = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-m") && iArg + 1 < argc) bCopy = !strcmp(argv[++iArg], "copy");
+		else {
+			fprintf(stderr, "usage: framebench [-w width] [-h height] [-n frames] [-s slots] [-r fps] [-c readers] [-m inplace|copy]\n");
+			return 2;
+		}
+	}
+	if (nWidth < 2 || nHeight < 1 || nFrames < 1 || nSlots < 2 || nRate < 0 || nReaders < 1) {
+		fprintf(stderr, "framebench: bad arguments\n");
+		return 2;
+	}
+
+	const uint64_t cbFrame = (uint64_t)nWidth * nHeight * 2;
+	CFrameWriter Writer;
+	if (!Writer.Open(BENCH_SOURCE, (uint32_t)nSlots, cbFrame)) {
+		fprintf(stderr, "framebench: can't create the segment\n");
+		return 1;
+	}
+
+	fflush(stdout);
+	for (int i = 0; i < nReaders; i++) {
+		// exit() leaves the writer alone, it isn't the child's to close
+		if (fork() == 0) exit(Reader(i, bCopy));
+	}
+
+	// Let the readers map the segment before the first frame
+	usleep(200000);
+
+	printf("%d %dx%d UYVY frames (%.1f MB), %d slots, %s, %d reader%s\n", nFrames, nWidth, nHeight, cbFrame / 1e6,
+		nSlots, nRate ? "paced" : "flat out", nReaders, nReaders > 1 ? "s" : "");
+
+	double dStart = Now();
+	double dWriting = 0;
+	for (int n = 1; n <= nFrames; n++) {
+		if (nRate) {
+			double dDue = dStart + (double)(n - 1) / nRate;
+			double dWait = dDue - Now();
+			if (dWait > 0) usleep((useconds_t)(dWait * 1e6));
+		}
+
+		double dWrite = Now();
+		uint8_t *pData = Writer.BeginFrame();
+		memset(pData, n & 0xFF, (size_t)cbFrame);
+
+		FRAMES_INFO Info;
+		memset(&Info, 0, sizeof(Info));
+		Info.llTimestamp = (int64_t)(n - 1) * 10000000 / (nRate ? nRate : 60);
+		Info.cbData = cbFrame;
+		Info.dwFourCC = FOURCC_UYVY;
+		Info.dwWidth = nWidth;
+		Info.dwHeight = nHeight;
+		Info.dwStride = nWidth * 2;
+		Info.dwFrameRateN = nRate ? nRate : 60;
+		Info.dwFrameRateD = 1;
+		Writer.EndFrame(&Info);
+		dWriting += Now() - dWrite;
+	}
+	double dSeconds = Now() - dStart;
+
+	printf("writer: %.1f frames/s, %.2f ms per frame written (%.2f GB/s)\n", nFrames / dSeconds,
+		dWriting * 1000 / nFrames, cbFrame * nFrames / dWriting / 1e9);
+	fflush(stdout);
+	Writer.Close();
+
+	int iResult = 0;
+	for (int i = 0; i < nReaders; i++) {
+		int iStatus = 0;
+		wait(&iStatus);
+		if (!WIFEXITED(iStatus) || WEXITSTATUS(iStatus) != 0) iResult = 1;
+	}
+	return iResult;
+}
@@ -0,0 +1,504 @@
+//######################################
+// freelistbench
+// Stress test and benchmark of the allocator's free list: CBaseAllocator's
+// GetBuffer, ReleaseBuffer, Commit and Decommit are rebuilt here on POSIX
+// threads, once around the locked CSampleList and once around the
+// CLockFreeStack of ALLOCATOR_LOCKFREE builds, following the same waiting
+// and decommit protocol as amfilter.cpp:
+//
+//   g++ -O2 -std=c++11 -pthread -Ibaseclasses/source tools/freelistbench.cpp -o freelistbench
+//
+//   freelistbench [-t seconds]
+//
+//   -t  seconds per run (default 1)
+//
+// Worker threads get a sample, hold it for a moment and release it, on
+// pools smaller and larger than the number of workers. The benchmark runs
+// leave the allocator committed and report gets per second and the mean
+// time spent in GetBuffer and ReleaseBuffer, which is what PERFLOG_GETBUFFER
+// and PERFLOG_RELBUFFER bracket in DXMPERF builds. The stress runs also
+// decommit and commit again all the time. A run fails if a sample was
+// handed out twice, handed out after Free, if Free ran with samples out,
+// if commit references don't balance, or if nobody got a sample for three
+// seconds (a lost wakeup)
+//######################################
+
+#include "freelist.h"
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS     8
+#define HOLD_SPINS      50              // Work done on a sample before releasing it
+#define HANG_SECONDS    3
+
+static double Now () {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long long Ticks () {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//######################################
+// Samples and the two free lists
+//######################################
+struct SAMPLE
+{
+	SAMPLE *pNext;
+	volatile int iOwner;            // Worker holding it plus one, 0 while free
+};
+
+struct SAMPLE_LINK
+{
+	static SAMPLE *&Next(SAMPLE *pSample) { return pSample->pNext; }
+};
+
+// CBaseAllocator::CSampleList
+class CLockedList
+{
+public:
+	CLockedList() : m_pHead(NULL), m_nOnList(0) {}
+	int GetCount() const { return __atomic_load_n(&m_nOnList, __ATOMIC_SEQ_CST); }
+	void Add(SAMPLE *pSample) {
+		pSample->pNext = m_pHead;
+		m_pHead = pSample;
+		__atomic_store_n(&m_nOnList, m_nOnList + 1, __ATOMIC_SEQ_CST);
+	}
+	SAMPLE *RemoveHead() {
+		SAMPLE *pSample = m_pHead;
+		if (pSample) {
+			m_pHead = pSample->pNext;
+			__atomic_store_n(&m_nOnList, m_nOnList - 1, __ATOMIC_SEQ_CST);
+		}
+		return pSample;
+	}
+
+private:
+	SAMPLE *m_pHead;
+	int m_nOnList;
+};
+
+// The ALLOCATOR_LOCKFREE CSampleList
+class CLockFreeList
+{
+public:
+	int GetCount() const { return m_Stack.GetCount(); }
+	void Add(SAMPLE *pSample) { m_Stack.Push(pSample); }
+	SAMPLE *RemoveHead() { return m_Stack.Pop(); }
+
+private:
+	CLockFreeStack<SAMPLE, SAMPLE_LINK> m_Stack;
+};
+
+//######################################
+// CBaseAllocator's buffer handling, bLockFree selects the protocol
+//######################################
+enum { GB_OK, GB_NOT_COMMITTED };
+
+template <class LIST, bool bLockFree> class CModelAllocator
+{
+public:
+	CModelAllocator(int nSamples) :
+		m_lWaiting(0), m_lGetting(0), m_bCommitted(0), m_bDecommitInProgress(0), m_bFreed(1),
+		m_lRefs(0), m_cCommits(0), m_cFrees(0), m_cBadFrees(0), m_nSamples(nSamples)
+	{
+		pthread_mutex_init(&m_Lock, NULL);
+		sem_init(&m_Sem, 0, 0);
+		m_pSamples = new SAMPLE[nSamples];
+		for (int i = 0; i < nSamples; i++) {
+			m_pSamples[i].iOwner = 0;
+			m_lFree.Add(&m_pSamples[i]);
+		}
+	}
+	~CModelAllocator() {
+		delete [] m_pSamples;
+		sem_destroy(&m_Sem);
+		pthread_mutex_destroy(&m_Lock);
+	}
+
+	void Commit() {
+		pthread_mutex_lock(&m_Lock);
+		if (!m_bCommitted) {
+			Store(&m_bFreed, 0);
+			Store(&m_bCommitted, 1);
+			if (m_bDecommitInProgress) {
+				Store(&m_bDecommitInProgress, 0);
+			}
+			else {
+				m_cCommits++;
+				__atomic_add_fetch(&m_lRefs, 1, __ATOMIC_SEQ_CST);
+			}
+		}
+		pthread_mutex_unlock(&m_Lock);
+	}
+
+	void Decommit() {
+		bool bRelease = false;
+		pthread_mutex_lock(&m_Lock);
+		if (m_bCommitted || m_bDecommitInProgress) {
+			Store(&m_bCommitted, 0);
+			if (bLockFree) {
+				__atomic_thread_fence(__ATOMIC_SEQ_CST);
+				while (Load(&m_lGetting) != 0) sched_yield();
+			}
+			if (m_lFree.GetCount() < m_nSamples) {
+				Store(&m_bDecommitInProgress, 1);
+				if (bLockFree) {
+					__atomic_thread_fence(__ATOMIC_SEQ_CST);
+					if (m_lFree.GetCount() == m_nSamples) {
+						Store(&m_bDecommitInProgress, 0);
+						Free();
+						bRelease = true;
+					}
+				}
+			}
+			else {
+				Store(&m_bDecommitInProgress, 0);
+				Free();
+				bRelease = true;
+			}
+			NotifySample();
+		}
+		pthread_mutex_unlock(&m_Lock);
+		if (bRelease) __atomic_sub_fetch(&m_lRefs, 1, __ATOMIC_SEQ_CST);
+	}
+
+	int GetBuffer(SAMPLE **ppSample) {
+		return bLockFree ? GetLockFree(ppSample) : GetLocked(ppSample);
+	}
+
+	void ReleaseBuffer(SAMPLE *pSample) {
+		if (bLockFree) ReleaseLockFree(pSample);
+		else ReleaseLocked(pSample);
+	}
+
+	bool Freed() const { return Load(&m_bFreed) != 0; }
+	long Refs() const { return Load(&m_lRefs); }
+	int FreeCount() const { return m_lFree.GetCount(); }
+	long Commits() const { return m_cCommits; }
+	long Frees() const { return m_cFrees; }
+	long BadFrees() const { return m_cBadFrees; }
+
+private:
+	template <class V> static V Load(const volatile V *p) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+	template <class V> static void Store(volatile V *p, V v) { __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+
+	// Locked by the caller, every sample must be back
+	void Free() {
+		if (m_lFree.GetCount() != m_nSamples) m_cBadFrees++;
+		for (int i = 0; i < m_nSamples; i++) {
+			if (m_pSamples[i].iOwner) m_cBadFrees++;
+		}
+		Store(&m_bFreed, 1);
+		m_cFrees++;
+	}
+
+	void NotifySample() {
+		if (m_lWaiting != 0) {
+			for (long i = 0; i < m_lWaiting; i++) sem_post(&m_Sem);
+			Store(&m_lWaiting, 0L);
+		}
+	}
+
+	// CBaseAllocator::GetBuffer
+	int GetLocked(SAMPLE **ppSample) {
+		for (;;) {
+			pthread_mutex_lock(&m_Lock);
+			if (!m_bCommitted) {
+				pthread_mutex_unlock(&m_Lock);
+				return GB_NOT_COMMITTED;
+			}
+			SAMPLE *pSample = m_lFree.RemoveHead();
+			if (pSample == NULL) m_lWaiting++;
+			pthread_mutex_unlock(&m_Lock);
+
+			if (pSample) {
+				*ppSample = pSample;
+				return GB_OK;
+			}
+			while (sem_wait(&m_Sem)) {}
+		}
+	}
+
+	// CBaseAllocator::ReleaseBuffer
+	void ReleaseLocked(SAMPLE *pSample) {
+		bool bRelease = false;
+		pthread_mutex_lock(&m_Lock);
+		m_lFree.Add(pSample);
+		NotifySample();
+		if (m_bDecommitInProgress && m_lFree.GetCount() == m_nSamples) {
+			Free();
+			Store(&m_bDecommitInProgress, 0);
+			bRelease = true;
+		}
+		pthread_mutex_unlock(&m_Lock);
+		if (bRelease) __atomic_sub_fetch(&m_lRefs, 1, __ATOMIC_SEQ_CST);
+	}
+
+	// ALLOCATOR_LOCKFREE CBaseAllocator::GetBuffer
+	int GetLockFree(SAMPLE **ppSample) {
+		for (;;) {
+			__atomic_add_fetch(&m_lGetting, 1, __ATOMIC_SEQ_CST);
+			int bCommitted = Load(&m_bCommitted);
+			SAMPLE *pSample = bCommitted ? m_lFree.RemoveHead() : NULL;
+			__atomic_sub_fetch(&m_lGetting, 1, __ATOMIC_SEQ_CST);
+
+			if (pSample) {
+				*ppSample = pSample;
+				return GB_OK;
+			}
+			if (!bCommitted) return GB_NOT_COMMITTED;
+
+			pthread_mutex_lock(&m_Lock);
+			if (!m_bCommitted) {
+				pthread_mutex_unlock(&m_Lock);
+				return GB_NOT_COMMITTED;
+			}
+			__atomic_add_fetch(&m_lWaiting, 1, __ATOMIC_SEQ_CST);
+			pSample = m_lFree.RemoveHead();
+			if (pSample) __atomic_sub_fetch(&m_lWaiting, 1, __ATOMIC_SEQ_CST);
+			pthread_mutex_unlock(&m_Lock);
+
+			if (pSample) {
+				*ppSample = pSample;
+				return GB_OK;
+			}
+			while (sem_wait(&m_Sem)) {}
+		}
+	}
+
+	// ALLOCATOR_LOCKFREE CBaseAllocator::ReleaseBuffer
+	void ReleaseLockFree(SAMPLE *pSample) {
+		bool bRelease = false;
+		m_lFree.Add(pSample);
+		if (Load(&m_lWaiting) != 0 || Load(&m_bDecommitInProgress)) {
+			pthread_mutex_lock(&m_Lock);
+			NotifySample();
+			if (m_bDecommitInProgress && m_lFree.GetCount() == m_nSamples) {
+				Free();
+				Store(&m_bDecommitInProgress, 0);
+				bRelease = true;
+			}
+			pthread_mutex_unlock(&m_Lock);
+		}
+		if (bRelease) __atomic_sub_fetch(&m_lRefs, 1, __ATOMIC_SEQ_CST);
+	}
+
+	pthread_mutex_t m_Lock;
+	sem_t m_Sem;
+	volatile long m_lWaiting;
+	volatile long m_lGetting;
+	volatile int m_bCommitted;
+	volatile int m_bDecommitInProgress;
+	volatile int m_bFreed;          // Free ran and no commit since
+	volatile long m_lRefs;          // The reference Commit takes
+	long m_cCommits;
+	long m_cFrees;
+	long m_cBadFrees;
+	int m_nSamples;
+	SAMPLE *m_pSamples;
+	LIST m_lFree;
+};
+
+//######################################
+// Workload
+//######################################
+struct COUNTERS
+{
+	long long llGets;
+	long long llGetTicks;
+	long long llReleaseTicks;
+	long long llNotCommitted;
+	long long llDoubled;            // Handed out while another worker had it
+	long long llAfterFree;          // Handed out after Free
+};
+
+template <class ALLOCATOR> struct WORKER
+{
+	ALLOCATOR *pAllocator;
+	int iWorker;
+	bool bTimed;
+	volatile int *pbStop;
+	COUNTERS Counters;
+};
+
+template <class ALLOCATOR> static void *WorkerThread (void *pContext) {
+	WORKER<ALLOCATOR> *pWorker = (WORKER<ALLOCATOR> *)pContext;
+	COUNTERS *pCounters = &pWorker->Counters;
+	volatile unsigned uSink = 0;
+
+	while (!__atomic_load_n(pWorker->pbStop, __ATOMIC_SEQ_CST)) {
+		SAMPLE *pSample;
+		long long llStart = pWorker->bTimed ? Ticks() : 0;
+		int iResult = pWorker->pAllocator->GetBuffer(&pSample);
+		if (pWorker->bTimed) pCounters->llGetTicks += Ticks() - llStart;
+
+		if (iResult == GB_NOT_COMMITTED) {
+			pCounters->llNotCommitted++;
+			sched_yield();
+			continue;
+		}
+		if (__atomic_exchange_n(&pSample->iOwner, pWorker->iWorker + 1, __ATOMIC_SEQ_CST) != 0) pCounters->llDoubled++;
+		if (pWorker->pAllocator->Freed()) pCounters->llAfterFree++;
+
+		for (int i = 0; i < HOLD_SPINS; i++) uSink = uSink + i;
+
+		__atomic_store_n(&pSample->iOwner, 0, __ATOMIC_SEQ_CST);
+		if (pWorker->bTimed) llStart = Ticks();
+		pWorker->pAllocator->ReleaseBuffer(pSample);
+		if (pWorker->bTimed) pCounters->llReleaseTicks += Ticks() - llStart;
+
+		__atomic_store_n(&pCounters->llGets, pCounters->llGets + 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+struct RESULT
+{
+	double dGetsPerSecond;
+	double dGetNs;
+	double dReleaseNs;
+	long cCommits;
+	bool bFailed;
+};
+
+template <class ALLOCATOR> static RESULT Run (int nThreads, int nSamples, double dSeconds, bool bChurn) {
+	RESULT Result;
+	memset(&Result, 0, sizeof(Result));
+
+	ALLOCATOR Allocator(nSamples);
+	Allocator.Commit();
+
+	volatile int bStop = 0;
+	WORKER<ALLOCATOR> Workers[MAX_THREADS];
+	pthread_t hThreads[MAX_THREADS];
+	for (int i = 0; i < nThreads; i++) {
+		memset(&Workers[i].Counters, 0, sizeof(COUNTERS));
+		Workers[i].pAllocator = &Allocator;
+		Workers[i].iWorker = i;
+		Workers[i].bTimed = !bChurn;
+		Workers[i].pbStop = &bStop;
+		pthread_create(&hThreads[i], NULL, WorkerThread<ALLOCATOR>, &Workers[i]);
+	}
+
+	// Decommit and commit again between gets, watching that gets go on
+	double dStart = Now();
+	double dLastProgress = dStart;
+	long long llLastGets = -1;
+	for (;;) {
+		double dNow = Now();
+		if (dNow - dStart >= dSeconds) break;
+
+		long long llGets = 0;
+		for (int i = 0; i < nThreads; i++) llGets += __atomic_load_n(&Workers[i].Counters.llGets, __ATOMIC_RELAXED);
+		if (llGets != llLastGets) {
+			llLastGets = llGets;
+			dLastProgress = dNow;
+		}
+		else if (dNow - dLastProgress > HANG_SECONDS) {
+			printf("no sample for %d s, a waiter missed its wakeup\n", HANG_SECONDS);
+			fflush(stdout);
+			_exit(1);
+		}
+
+		if (bChurn) {
+			Allocator.Decommit();
+			sched_yield();
+			Allocator.Commit();
+			usleep(100);
+		}
+		else {
+			usleep(10000);
+		}
+	}
+
+	// Waiters are woken by the decommit and see they should stop
+	__atomic_store_n(&bStop, 1, __ATOMIC_SEQ_CST);
+	Allocator.Decommit();
+	for (int i = 0; i < nThreads; i++) pthread_join(hThreads[i], NULL);
+	double dElapsed = Now() - dStart;
+
+	COUNTERS Total;
+	memset(&Total, 0, sizeof(Total));
+	for (int i = 0; i < nThreads; i++) {
+		Total.llGets += Workers[i].Counters.llGets;
+		Total.llGetTicks += Workers[i].Counters.llGetTicks;
+		Total.llReleaseTicks += Workers[i].Counters.llReleaseTicks;
+		Total.llDoubled += Workers[i].Counters.llDoubled;
+		Total.llAfterFree += Workers[i].Counters.llAfterFree;
+	}
+
+	Result.dGetsPerSecond = Total.llGets / dElapsed;
+	if (Total.llGets) {
+		Result.dGetNs = (double)Total.llGetTicks / Total.llGets;
+		Result.dReleaseNs = (double)Total.llReleaseTicks / Total.llGets;
+	}
+	Result.cCommits = Allocator.Commits();
+	Result.bFailed = Total.llDoubled || Total.llAfterFree || Allocator.BadFrees()
+		|| Allocator.Refs() != 0 || Allocator.FreeCount() != nSamples
+		|| Allocator.Frees() != Allocator.Commits();
+	if (Result.bFailed) {
+		printf("  doubled %lld, after free %lld, bad frees %ld, refs %ld, free %d of %d, commits %ld, frees %ld\n",
+			Total.llDoubled, Total.llAfterFree, Allocator.BadFrees(), Allocator.Refs(),
+			Allocator.FreeCount(), nSamples, Allocator.Commits(), Allocator.Frees());
+	}
+	return Result;
+}
+
+int main (int argc, char **argv) {
+	double dSeconds = 1;
+	if (argc == 3 && !strcmp(argv[1], "-t")) dSeconds = atof(argv[2]);
+	if ((argc != 1 && argc != 3) || dSeconds <= 0) {
+		fprintf(stderr, "usage: freelistbench [-t seconds]\n");
+		return 2;
+	}
+
+	typedef CModelAllocator<CLockedList, false> LOCKED;
+	typedef CModelAllocator<CLockFreeList, true> LOCKFREE;
+
+	static const int s_nThreads[] = { 1, 4, 8 };
+	static const int s_nSamples[] = { 2, 16 };
+	int iResult = 0;
+
+	printf("benchmark, always committed\n");
+	printf("threads  samples   locked M/s  get ns  rel ns   lock-free M/s  get ns  rel ns\n");
+	for (size_t t = 0; t < sizeof(s_nThreads) / sizeof(s_nThreads[0]); t++) {
+		for (size_t s = 0; s < sizeof(s_nSamples) / sizeof(s_nSamples[0]); s++) {
+			RESULT Locked = Run<LOCKED>(s_nThreads[t], s_nSamples[s], dSeconds, false);
+			RESULT LockFree = Run<LOCKFREE>(s_nThreads[t], s_nSamples[s], dSeconds, false);
+			bool bFailed = Locked.bFailed || LockFree.bFailed;
+			if (bFailed) iResult = 1;
+			printf("%7d  %7d  %11.2f  %6.0f  %6.0f  %14.2f  %6.0f  %6.0f%s\n", s_nThreads[t], s_nSamples[s],
+				Locked.dGetsPerSecond / 1e6, Locked.dGetNs, Locked.dReleaseNs,
+				LockFree.dGetsPerSecond / 1e6, LockFree.dGetNs, LockFree.dReleaseNs,
+				bFailed ? "    FAILED" : "");
+		}
+	}
+
+	printf("stress, decommitting and committing while getting\n");
+	printf("threads  samples   locked M/s  commits   lock-free M/s  commits\n");
+	for (size_t t = 0; t < sizeof(s_nThreads) / sizeof(s_nThreads[0]); t++) {
+		for (size_t s = 0; s < sizeof(s_nSamples) / sizeof(s_nSamples[0]); s++) {
+			RESULT Locked = Run<LOCKED>(s_nThreads[t], s_nSamples[s], dSeconds, true);
+			RESULT LockFree = Run<LOCKFREE>(s_nThreads[t], s_nSamples[s], dSeconds, true);
+			bool bFailed = Locked.bFailed || LockFree.bFailed;
+			if (bFailed) iResult = 1;
+			printf("%7d  %7d  %11.2f  %7ld  %14.2f  %7ld%s\n", s_nThreads[t], s_nSamples[s],
+				Locked.dGetsPerSecond / 1e6, Locked.cCommits,
+				LockFree.dGetsPerSecond / 1e6, LockFree.cCommits,
+				bFailed ? "    FAILED" : "");
+		}
+	}
+
+	return iResult;
+}
@@ -0,0 +1,309 @@
+//######################################
+// pacersim
+// Runs many renderer channels in one process on a virtual clock, first
+// each waiting for its own samples the way Receive does without SendPacer,
+// then through CSendPacer the way the pacer thread drives it. Compares
+// timer and thread wakeups per second, how many sends go out together, the
+// skew between channels that could share a tick and how early or late
+// samples leave. Needs no DirectShow, NDI or threads:
+//
+//   g++ -O2 -Isource tools/pacersim.cpp source/sendpacer.cpp -o pacersim
+//   cl /O2 /Isource tools\pacersim.cpp source\sendpacer.cpp
+//
+//   pacersim [-n channels] [-f fps[,fps...]] [-p phase_ms] [-t tolerance_ms] [-s seconds] [-g timer_us] [-j jitter_us]
+//
+//   -n  channels (default 16)
+//   -f  frame rates, given to the channels in turn (default 60)
+//   -p  channels start at random phases within this (default 16)
+//   -t  PacerTolerance (default 4)
+//   -s  length of the run (default 60)
+//   -g  timer granularity, timed waits end on multiples of it (default 1000)
+//   -j  scheduling jitter added to every wakeup (default 200)
+//
+// Upstream is always ahead, so every channel has its next sample waiting
+// as soon as it sent the last one. Timed waits are in whole ms, rounded as
+// Receive and the pacer thread round them, and end on the next timer tick
+//######################################
+
+#include "sendpacer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+#define SEND_COST           1000    // 0.1 ms per send
+#define SET_EVENT_COST      20      // 2 us per event the pacer sets
+#define EARLY_TOLERANCE     10000   // RECEIVE_EARLY_TOLERANCE
+#define BURST_GAP           2000    // Sends closer than 0.2 ms count as one burst
+#define MS                  (PACER_UNITS / 1000)
+
+struct CHANNEL_SETUP
+{
+	int64_t rtPeriod;
+	int64_t rtPhase;
+};
+
+struct SEND
+{
+	int64_t rtDue;
+	int64_t rtSent;
+	int iChannel;
+};
+
+struct SIM_RESULT
+{
+	int64_t llTimerWakeups;         // Timed waits that ran out
+	int64_t llThreadWakeups;        // Any thread woken, timers and events
+	std::vector<SEND> Sends;
+	int64_t llSkewed;               // Groups of more than one channel
+	int64_t rtSkewSum;
+	int64_t rtSkewMax;
+};
+
+static uint32_t g_uRandom = 1;
+static int64_t g_rtGranularity = MS;
+static int64_t g_rtJitter = 2000;
+
+static int64_t Random (int64_t rtMax) {
+	g_uRandom = g_uRandom * 1664525 + 1013904223;
+	return rtMax > 0 ? (int64_t)((g_uRandom >> 8) % (uint32_t)rtMax) : 0;
+}
+
+// When a wait of dwMs started at rtNow ends
+static int64_t TimerFires (int64_t rtNow, int64_t llMs) {
+	int64_t rtEnd = rtNow + llMs * MS;
+	return (rtEnd + g_rtGranularity - 1) / g_rtGranularity * g_rtGranularity + Random(g_rtJitter);
+}
+
+//######################################
+// Every channel on its own: wait the whole ms left, rounded down, send
+// once within EARLY_TOLERANCE, wait again otherwise
+//######################################
+static void RunAlone (const std::vector<CHANNEL_SETUP> &Channels, int64_t rtLength, SIM_RESULT *pResult) {
+	for (size_t i = 0; i < Channels.size(); i++) {
+		int64_t rtNow = 0;
+		for (int64_t k = 0; ; k++) {
+			int64_t rtDue = Channels[i].rtPhase + k * Channels[i].rtPeriod;
+			if (rtDue >= rtLength) break;
+			while (rtDue > rtNow + EARLY_TOLERANCE) {
+				rtNow = TimerFires(rtNow, (rtDue - rtNow) / MS);
+				pResult->llTimerWakeups++;
+				pResult->llThreadWakeups++;
+			}
+			SEND Send = { rtDue, rtNow, (int)i };
+			pResult->Sends.push_back(Send);
+			rtNow += SEND_COST;
+		}
+	}
+}
+
+//######################################
+// Through CSendPacer. Events are the pacer's wakeups and the channels'
+// posts and wakeups, in time order
+//######################################
+enum EventType { Event_PacerWake, Event_ChannelPost, Event_ChannelWake };
+
+struct EVENT
+{
+	int64_t rtTime;
+	EventType Type;
+	int iIndex;                     // Channel, or the pacer's wait generation
+	bool operator<(const EVENT &Other) const { return rtTime > Other.rtTime; }
+};
+
+static void RunPaced (const std::vector<CHANNEL_SETUP> &Channels, int64_t rtLength, int64_t rtTolerance, SIM_RESULT *pResult) {
+	CSendPacer Pacer;
+	Pacer.SetTolerance(rtTolerance);
+
+	std::priority_queue<EVENT> Events;
+	std::vector<int> Map(Channels.size());
+	std::vector<int64_t> Frame(Channels.size(), 0);
+	for (size_t i = 0; i < Channels.size(); i++) {
+		Map[i] = Pacer.Register();
+		EVENT Post = { 0, Event_ChannelPost, (int)i };
+		Events.push(Post);
+	}
+
+	int iGeneration = 0;
+	bool bWaiting = false;          // A timed pacer wait is outstanding
+	int iReleased[PACER_MAX_CHANNELS];
+
+	while (!Events.empty()) {
+		EVENT Event = Events.top();
+		Events.pop();
+		int64_t rtNow = Event.rtTime;
+
+		if (Event.Type == Event_ChannelPost) {
+			int i = Event.iIndex;
+			int64_t rtDue = Channels[i].rtPhase + Frame[i] * Channels[i].rtPeriod;
+			if (rtDue >= rtLength) continue;
+			if (rtDue <= rtNow + EARLY_TOLERANCE) {
+				SEND Send = { rtDue, rtNow, i };
+				pResult->Sends.push_back(Send);
+				Frame[i]++;
+				EVENT Next = { rtNow + SEND_COST, Event_ChannelPost, i };
+				Events.push(Next);
+				continue;
+			}
+			bool bEarlier = rtDue < Pacer.NextTick();
+			Pacer.Post(Map[i], rtDue);
+			if (bEarlier) {
+				// hWake, whatever timed wait the pacer was in is over
+				EVENT Wake = { rtNow + Random(g_rtJitter), Event_PacerWake, ++iGeneration };
+				Events.push(Wake);
+				bWaiting = false;
+			}
+		}
+		else if (Event.Type == Event_PacerWake) {
+			if (Event.iIndex != iGeneration) continue;
+			pResult->llThreadWakeups++;
+			if (bWaiting) pResult->llTimerWakeups++;
+			bWaiting = false;
+
+			int cReleased = Pacer.Release(rtNow, iReleased);
+			for (int r = 0; r < cReleased; r++) {
+				for (size_t i = 0; i < Channels.size(); i++) {
+					if (Map[i] != iReleased[r]) continue;
+					EVENT Wake = { rtNow + (r + 1) * SET_EVENT_COST + Random(g_rtJitter), Event_ChannelWake, (int)i };
+					Events.push(Wake);
+				}
+			}
+
+			int64_t rtNext = Pacer.NextTick();
+			if (rtNext != PACER_NEVER) {
+				int64_t rtWait = rtNext - rtNow;
+				int64_t llMs = rtTolerance >= MS ? rtWait / MS : (rtWait + MS - 1) / MS;
+				EVENT Wake = { llMs > 0 ? TimerFires(rtNow, llMs) : rtNow, Event_PacerWake, ++iGeneration };
+				Events.push(Wake);
+				bWaiting = llMs > 0;
+			}
+		}
+		else {
+			int i = Event.iIndex;
+			pResult->llThreadWakeups++;
+			Pacer.OnWoken(Map[i], rtNow);
+			SEND Send = { Channels[i].rtPhase + Frame[i] * Channels[i].rtPeriod, rtNow, i };
+			pResult->Sends.push_back(Send);
+			Frame[i]++;
+			EVENT Next = { rtNow + SEND_COST, Event_ChannelPost, i };
+			Events.push(Next);
+		}
+	}
+
+	const PACER_STATS *pStats = Pacer.Stats();
+	pResult->llSkewed = pStats->llSkewed;
+	pResult->rtSkewSum = pStats->rtSkewSum;
+	pResult->rtSkewMax = pStats->rtSkewMax;
+}
+
+//######################################
+// Skew without the pacer: group the sends as a tick would have, the first
+// due time and everything due within the tolerance after it
+//######################################
+static bool ByDue (const SEND &a, const SEND &b) { return a.rtDue < b.rtDue; }
+static bool BySent (const SEND &a, const SEND &b) { return a.rtSent < b.rtSent; }
+
+static void GroupSkew (SIM_RESULT *pResult, int64_t rtTolerance) {
+	std::vector<SEND> Sends = pResult->Sends;
+	std::sort(Sends.begin(), Sends.end(), ByDue);
+	for (size_t i = 0; i < Sends.size(); ) {
+		size_t j = i + 1;
+		int64_t rtFirst = Sends[i].rtSent, rtLast = Sends[i].rtSent;
+		while (j < Sends.size() && Sends[j].rtDue <= Sends[i].rtDue + rtTolerance) {
+			rtFirst = std::min(rtFirst, Sends[j].rtSent);
+			rtLast = std::max(rtLast, Sends[j].rtSent);
+			j++;
+		}
+		if (j - i > 1) {
+			pResult->llSkewed++;
+			pResult->rtSkewSum += rtLast - rtFirst;
+			pResult->rtSkewMax = std::max(pResult->rtSkewMax, rtLast - rtFirst);
+		}
+		i = j;
+	}
+}
+
+static void PrintResult (const char *pName, SIM_RESULT *pResult, double dSeconds) {
+	std::vector<SEND> &Sends = pResult->Sends;
+	std::sort(Sends.begin(), Sends.end(), BySent);
+
+	int64_t llBursts = 0, rtEarlyMax = 0, rtLateMax = 0, rtOffsetSum = 0;
+	for (size_t i = 0; i < Sends.size(); i++) {
+		if (i == 0 || Sends[i].rtSent - Sends[i - 1].rtSent > BURST_GAP) llBursts++;
+		int64_t rtOffset = Sends[i].rtSent - Sends[i].rtDue;
+		rtEarlyMax = std::max(rtEarlyMax, -rtOffset);
+		rtLateMax = std::max(rtLateMax, rtOffset);
+		rtOffsetSum += rtOffset < 0 ? -rtOffset : rtOffset;
+	}
+
+	printf("%-12s %7.1f timer wakeups/s, %7.1f thread wakeups/s, %.2f sends per burst, skew avg %.0f max %.0f us, off due avg %.0f us, early max %.0f late max %.0f us\n",
+		pName, pResult->llTimerWakeups / dSeconds, pResult->llThreadWakeups / dSeconds,
+		llBursts ? (double)Sends.size() / llBursts : 0.0,
+		pResult->llSkewed ? pResult->rtSkewSum / 10.0 / pResult->llSkewed : 0.0, pResult->rtSkewMax / 10.0,
+		Sends.empty() ? 0.0 : rtOffsetSum / 10.0 / Sends.size(), rtEarlyMax / 10.0, rtLateMax / 10.0);
+}
+
+int main (int argc, char **argv) {
+	int nChannels = 16;
+	const char *pRates = "60";
+	int iPhase = 16;
+	int iTolerance = 4;
+	int iSeconds = 60;
+	int iGranularity = 1000;
+	int iJitter = 200;
+
+	for (int iArg = 1; iArg < argc; iArg++) {
+		if (!strcmp(argv[iArg], "-n") && iArg + 1 < argc) nChannels = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-f") && iArg + 1 < argc) pRates = argv[++iArg];
+		else if (!strcmp(argv[iArg], "-p") && iArg + 1 < argc) iPhase = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-t") && iArg + 1 < argc) iTolerance = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-s") && iArg + 1 < argc) iSeconds = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-g") && iArg + 1 < argc) iGranularity = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-j") && iArg + 1 < argc) iJitter = atoi(argv[++iArg]);
+		else {
+			fprintf(stderr, "usage: pacersim [-n channels] [-f fps[,fps...]] [-p phase_ms] [-t tolerance_ms] [-s seconds] [-g timer_us] [-j jitter_us]\n");
+			return 2;
+		}
+	}
+
+	std::vector<int> Rates;
+	for (const char *p = pRates; *p; ) {
+		Rates.push_back(atoi(p));
+		while (*p && *p != ',') p++;
+		if (*p) p++;
+	}
+	bool bBad = nChannels < 1 || nChannels > PACER_MAX_CHANNELS || iPhase < 0 || iTolerance < 0
+		|| iSeconds < 1 || iGranularity < 1 || iJitter < 0 || Rates.empty();
+	for (size_t i = 0; i < Rates.size(); i++) bBad |= Rates[i] < 1;
+	if (bBad) {
+		fprintf(stderr, "pacersim: bad arguments\n");
+		return 2;
+	}
+
+	g_rtGranularity = (int64_t)iGranularity * 10;
+	g_rtJitter = (int64_t)iJitter * 10;
+	int64_t rtLength = (int64_t)iSeconds * PACER_UNITS;
+	int64_t rtTolerance = (int64_t)iTolerance * MS;
+
+	std::vector<CHANNEL_SETUP> Channels(nChannels);
+	for (int i = 0; i < nChannels; i++) {
+		Channels[i].rtPeriod = PACER_UNITS / Rates[i % Rates.size()];
+		Channels[i].rtPhase = Random((int64_t)iPhase * MS);
+	}
+
+	printf("%d channels at %s fps, phases within %d ms, tolerance %d ms, %d s, timer %d us, jitter %d us\n",
+		nChannels, pRates, iPhase, iTolerance, iSeconds, iGranularity, iJitter);
+
+	SIM_RESULT Alone, Paced;
+	Alone.llTimerWakeups = Alone.llThreadWakeups = Alone.llSkewed = Alone.rtSkewSum = Alone.rtSkewMax = 0;
+	Paced = Alone;
+	RunAlone(Channels, rtLength, &Alone);
+	GroupSkew(&Alone, rtTolerance);
+	RunPaced(Channels, rtLength, rtTolerance, &Paced);
+
+	PrintResult("own waits", &Alone, iSeconds);
+	PrintResult("send pacer", &Paced, iSeconds);
+	return 0;
+}
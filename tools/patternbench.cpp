@@ -0,0 +1,172 @@
+//######################################
+// patternbench
+// Drives the test pattern source's generator the way the source filter
+// and the renderer would, without DirectShow or NDI: every frame is drawn
+// with CTestPattern, scheduled by the renderer's network policy and handed
+// to a mock sender that copies it into a double buffer and, with -c, takes
+// as long as a real send would. The sender reads back the embedded frame
+// counter, so drops show up as gaps and damaged frames as bad counters.
+// Reports draw cost, frames sent and dropped and the counter check, per
+// format, which shows where the renderer side saturates for a given size
+// and rate:
+//
+//   g++ -O2 -Isource tools/patternbench.cpp source/testpattern.cpp source/schedpolicy.cpp -o patternbench
+//
+//   patternbench [-f all|nv12|uyvy|bgrx|bgra] [-w width] [-h height] [-n frames] [-r fps] [-c send_ms]
+//
+//   -f      format (default all of them in turn)
+//   -w, -h  frame size (default 7680x4320)
+//   -n      frames per format (default 240)
+//   -r      frames per second, 0 = as fast as possible (default 120)
+//   -c      time a send takes on top of the copy, in ms (default 0)
+//######################################
+
+#include "testpattern.h"
+#include "schedpolicy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+static const char *g_FormatNames[] = { "NV12", "UYVY", "BGRX", "BGRA" };
+
+static int64_t Now () {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * POLICY_UNITS + ts.tv_nsec / 100;
+}
+
+static void SleepUntil (int64_t rtWhen) {
+	int64_t rtWait = rtWhen - Now();
+	if (rtWait > 0) usleep((useconds_t)(rtWait / 10));
+}
+
+//######################################
+// Frame memory as the source's allocator would hand it out
+//######################################
+static uint8_t *AllocFrame (size_t cb) {
+	void *p = NULL;
+	if (posix_memalign(&p, 64, cb)) return NULL;
+	memset(p, 0, cb);
+	return (uint8_t *)p;
+}
+
+//######################################
+// One format, returns false if the counter check failed
+//######################################
+static bool Run (TestPatternFormat Format, int nWidth, int nHeight, int nFrames, int nRate, int iSendCost) {
+	CTestPattern Pattern;
+	if (!Pattern.Init(Format, nWidth, nHeight)) {
+		fprintf(stderr, "patternbench: can't draw %s at %dx%d\n", g_FormatNames[Format], nWidth, nHeight);
+		return false;
+	}
+
+	const ptrdiff_t lStride = Pattern.RowBytes();
+	const size_t cbFrame = Pattern.FrameBytes(lStride);
+	uint8_t *pFrame = AllocFrame(cbFrame);
+	uint8_t *pHalves[2] = { AllocFrame(cbFrame), AllocFrame(cbFrame) };
+	if (!pFrame || !pHalves[0] || !pHalves[1]) {
+		fprintf(stderr, "patternbench: out of memory\n");
+		return false;
+	}
+
+	CNetworkSinkPolicy Policy;
+	Policy.SetClocked(nRate != 0);
+	Policy.Reset();
+
+	const int64_t rtFrame = POLICY_UNITS / (nRate ? nRate : 60);
+	const int64_t rtSendCost = (int64_t)iSendCost * 10000;
+	int64_t rtDrawing = 0, rtDrawMax = 0;
+	long cSent = 0, cDropped = 0, cBadCounter = 0, cGaps = 0;
+	int64_t llLastSent = -1;
+	int iHalf = 0;
+
+	const int64_t rtBase = Now();
+	for (int n = 0; n < nFrames; n++) {
+		// The source blocks on the allocator until the renderer lets a
+		// sample go, so frames are drawn no earlier than a frame ahead
+		int64_t rtStart = n * rtFrame;
+		if (nRate) SleepUntil(rtBase + rtStart - rtFrame);
+
+		int64_t rtDraw = Now();
+		Pattern.Draw(n, pFrame, lStride);
+		rtDraw = Now() - rtDraw;
+		rtDrawing += rtDraw;
+		if (rtDraw > rtDrawMax) rtDrawMax = rtDraw;
+
+		int64_t rtNow = Now() - rtBase;
+		int64_t rtStop = rtStart + rtFrame;
+		ScheduleDecision Decision = nRate ? Policy.Decide(rtNow, &rtStart, &rtStop, n == 0) : Schedule_Send;
+		if (Decision == Schedule_Drop) {
+			cDropped++;
+			continue;
+		}
+		if (Decision == Schedule_Wait) SleepUntil(rtBase + rtStart);
+
+		// The mock send, copy into the half NDI isn't reading and pretend
+		// the rest of the send takes iSendCost
+		int64_t rtSend = Now();
+		memcpy(pHalves[iHalf], pFrame, cbFrame);
+		uint32_t dwCounter = 0;
+		if (!Pattern.ReadCounter(pHalves[iHalf], lStride, &dwCounter) || dwCounter != (uint32_t)n) cBadCounter++;
+		else if (llLastSent >= 0 && dwCounter != llLastSent + 1) cGaps++;
+		llLastSent = dwCounter;
+		iHalf ^= 1;
+		while (Now() - rtSend < rtSendCost) {}
+		Policy.OnSent(Now() - rtBase, Now() - rtSend);
+		cSent++;
+	}
+	double dSeconds = (Now() - rtBase) / (double)POLICY_UNITS;
+
+	printf("%s %dx%d, %.1f MB: draw avg %.2f ms max %.2f ms (%.2f GB/s), %.1f frames/s, sent %ld, dropped %ld, %ld gaps, %ld bad counters\n",
+		g_FormatNames[Format], nWidth, nHeight, cbFrame / 1e6,
+		rtDrawing / 10000.0 / nFrames, rtDrawMax / 10000.0,
+		rtDrawing ? cbFrame * (double)nFrames / (rtDrawing / (double)POLICY_UNITS) / 1e9 : 0.0,
+		cSent / dSeconds, cSent, cDropped, cGaps, cBadCounter);
+
+	free(pFrame);
+	free(pHalves[0]);
+	free(pHalves[1]);
+	return cBadCounter == 0;
+}
+
+int main (int argc, char **argv) {
+	int iFormat = -1;
+	int nWidth = 7680;
+	int nHeight = 4320;
+	int nFrames = 240;
+	int nRate = 120;
+	int iSendCost = 0;
+	for (int iArg = 1; iArg < argc; iArg++) {
+		if (!strcmp(argv[iArg], "-f") && iArg + 1 < argc) {
+			const char *pName = argv[++iArg];
+			iFormat = -2;
+			if (!strcmp(pName, "all")) iFormat = -1;
+			for (int i = 0; i < 4; i++) if (!strcasecmp(pName, g_FormatNames[i])) iFormat = i;
+		}
+		else if (!strcmp(argv[iArg], "-w") && iArg + 1 < argc) nWidth = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-h") && iArg + 1 < argc) nHeight = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-n") && iArg + 1 < argc) nFrames = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-r") && iArg + 1 < argc) nRate = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-c") && iArg + 1 < argc) iSendCost = atoi(argv[++iArg]);
+		else iFormat = -2;
+		if (iFormat == -2) {
+			fprintf(stderr, "usage: patternbench [-f all|nv12|uyvy|bgrx|bgra] [-w width] [-h height] [-n frames] [-r fps] [-c send_ms]\n");
+			return 2;
+		}
+	}
+	if (nFrames < 1 || nRate < 0 || iSendCost < 0) {
+		fprintf(stderr, "patternbench: bad arguments\n");
+		return 2;
+	}
+
+	printf("%d frames per format, %s, mock send %d ms\n", nFrames, nRate ? "paced" : "flat out", iSendCost);
+	bool bPassed = true;
+	for (int i = 0; i < 4; i++) {
+		if (iFormat >= 0 && iFormat != i) continue;
+		bPassed &= Run((TestPatternFormat)i, nWidth, nHeight, nFrames, nRate, iSendCost);
+	}
+	return bPassed ? 0 : 1;
+}
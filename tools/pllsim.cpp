@@ -0,0 +1,161 @@
+//######################################
+// pllsim
+// Runs synthetic drift profiles between the graph clock and NDI's pacing
+// through CPacingPll and compares the slaved clock with a free running one.
+// Needs no DirectShow, NDI or hardware:
+//
+//   g++ -O2 -Isource tools/pllsim.cpp source/clockpll.cpp -o pllsim
+//   cl /O2 /Isource tools\pllsim.cpp source\clockpll.cpp
+//
+//   pllsim [-t seconds] [-j jitter_us] [-f fps]
+//
+//   -t  length of each run (default 3600)
+//   -j  scheduling jitter added to every wakeup and send (default 200)
+//   -f  frame rate (default 25)
+//
+// NDI is modelled as letting one frame through per frame duration of its
+// own clock: a send before the next slot blocks until it, a send after it
+// goes straight through and restarts the pacing from there
+//######################################
+
+#include "clockpll.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEND_COST   1000            // 0.1 ms
+
+struct DRIFT_PROFILE
+{
+	const char *pName;
+	double dFrom;                   // NDI clock drift in ppm at the start...
+	double dTo;                     // ...and at the end, linear in between
+	bool bStep;                     // Jump from dFrom to dTo half way instead
+};
+
+static const DRIFT_PROFILE g_Profiles[] = {
+	{ "constant +100 ppm",    100,  100, false },
+	{ "constant -100 ppm",   -100, -100, false },
+	{ "constant -300 ppm",   -300, -300, false },
+	{ "ramp 0 to +60 ppm",      0,   60, false },
+	{ "step +50 to -50 ppm",   50,  -50, true  },
+};
+
+struct PLL_RESULT
+{
+	int cFrames;
+	int cUnblocked;                 // Sends that found NDI's slot already passed
+	int64_t rtBlockSum;
+	int64_t rtBlockMax;
+	int64_t rtLateMax;              // Furthest a send fell behind its due time
+	int iLockedAt;                  // Frame after which the loop stayed locked, -1 never
+};
+
+static uint32_t g_uRandom = 1;
+
+static int64_t Jitter (int64_t rtMax) {
+	g_uRandom = g_uRandom * 1664525 + 1013904223;
+	return rtMax > 0 ? (int64_t)((g_uRandom >> 8) % (uint32_t)rtMax) : 0;
+}
+
+static void Run (const DRIFT_PROFILE *pProfile, int64_t rtLength, int64_t rtPeriod, int64_t rtJitter,
+	bool bSlaved, PLL_RESULT *pResult)
+{
+	memset(pResult, 0, sizeof(*pResult));
+	pResult->iLockedAt = -1;
+	g_uRandom = 1;
+
+	CPacingPll Pll;
+	int64_t rtNdiNext = 0;
+	int64_t rtReturn = 0;
+
+	for (int i = 0; ; i++) {
+		int64_t rtDue = (int64_t)i * rtPeriod;
+		if (rtDue >= rtLength) break;
+
+		// System time our clock reaches rtDue, the clock is linear since its last update
+		int64_t rtWake = rtDue;
+		if (bSlaved) {
+			int64_t rtBase = rtReturn;
+			int64_t rtAhead = rtDue - Pll.Time(rtBase);
+			rtWake = rtBase + (rtAhead > 0 ? (int64_t)(rtAhead / Pll.Rate()) + 1 : 0);
+		}
+		int64_t rtSend = (rtWake > rtReturn ? rtWake : rtReturn) + Jitter(rtJitter);
+
+		double dFraction = (double)rtSend / rtLength;
+		double dPpm = pProfile->bStep ? (dFraction < 0.5 ? pProfile->dFrom : pProfile->dTo)
+			: pProfile->dFrom + (pProfile->dTo - pProfile->dFrom) * dFraction;
+		int64_t rtNdiPeriod = rtPeriod + (int64_t)(rtPeriod * dPpm / 1e6);
+
+		if (rtSend < rtNdiNext) {
+			rtReturn = rtNdiNext + SEND_COST;
+			rtNdiNext += rtNdiPeriod;
+		}
+		else {
+			rtReturn = rtSend + SEND_COST;
+			rtNdiNext = rtSend + rtNdiPeriod;
+			pResult->cUnblocked++;
+		}
+		rtReturn += Jitter(rtJitter / 4);
+
+		int64_t rtBlocked = rtReturn - rtSend;
+		if (bSlaved) Pll.Update(rtReturn, rtBlocked, rtPeriod);
+
+		// Late against the schedule on our own clock
+		int64_t rtLate = rtSend - rtWake;
+		if (rtLate > pResult->rtLateMax) pResult->rtLateMax = rtLate;
+		pResult->rtBlockSum += rtBlocked;
+		if (rtBlocked > pResult->rtBlockMax) pResult->rtBlockMax = rtBlocked;
+		pResult->cFrames++;
+
+		if (!Pll.IsLocked()) pResult->iLockedAt = -1;
+		else if (pResult->iLockedAt < 0) pResult->iLockedAt = i;
+	}
+
+	if (bSlaved) {
+		printf("    loop: drift estimate %+.1f ppm, last error %.2f ms, ", Pll.Frequency() * 1e6, Pll.PhaseError() / 10000.0);
+		if (pResult->iLockedAt >= 0) printf("locked after %.1f s\n", pResult->iLockedAt * rtPeriod / (double)PLL_UNITS);
+		else printf("not locked\n");
+	}
+}
+
+static void PrintResult (const char *pName, const PLL_RESULT *r) {
+	printf("    %-12s sends %d, unblocked %d (%.2f%%), block mean %.2f ms max %.2f ms, late max %.2f ms\n",
+		pName, r->cFrames, r->cUnblocked, r->cFrames ? 100.0 * r->cUnblocked / r->cFrames : 0.0,
+		r->cFrames ? r->rtBlockSum / 10000.0 / r->cFrames : 0.0, r->rtBlockMax / 10000.0, r->rtLateMax / 10000.0);
+}
+
+int main (int argc, char **argv) {
+	int iSeconds = 3600;
+	int iJitter = 200;
+	int iFps = 25;
+
+	for (int iArg = 1; iArg < argc; iArg++) {
+		if (!strcmp(argv[iArg], "-t") && iArg + 1 < argc) iSeconds = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-j") && iArg + 1 < argc) iJitter = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-f") && iArg + 1 < argc) iFps = atoi(argv[++iArg]);
+		else {
+			fprintf(stderr, "usage: pllsim [-t seconds] [-j jitter_us] [-f fps]\n");
+			return 2;
+		}
+	}
+	if (iSeconds <= 0 || iFps <= 0 || iJitter < 0) {
+		fprintf(stderr, "pllsim: bad arguments\n");
+		return 2;
+	}
+
+	int64_t rtLength = (int64_t)iSeconds * PLL_UNITS;
+	int64_t rtPeriod = PLL_UNITS / iFps;
+	int64_t rtJitter = (int64_t)iJitter * 10;
+
+	for (size_t i = 0; i < sizeof(g_Profiles) / sizeof(g_Profiles[0]); i++) {
+		PLL_RESULT Free, Slaved;
+		printf("%s, %d s at %d fps, %d us jitter\n", g_Profiles[i].pName, iSeconds, iFps, iJitter);
+		Run(&g_Profiles[i], rtLength, rtPeriod, rtJitter, false, &Free);
+		Run(&g_Profiles[i], rtLength, rtPeriod, rtJitter, true, &Slaved);
+		PrintResult("free running", &Free);
+		PrintResult("slaved", &Slaved);
+	}
+
+	return 0;
+}
@@ -0,0 +1,229 @@
+//######################################
+// poolbench
+// Runs the process wide frame pool the way a multi-channel host uses it:
+// channels of mixed formats start and stop at random on a virtual clock,
+// borrowing their copy buffer when they start and returning it when they
+// stop. Reports what the pool allocated against what per-instance buffers
+// kept for good would have taken, how often buffers were reused, trimmed
+// and refused under the limit, and checks the accounts add up. Then times
+// the first frame copied after a cue into a fresh allocation and into a
+// buffer from the pool, with the page faults each took:
+//
+//   g++ -O2 -Isource tools/poolbench.cpp source/framepool.cpp source/sampleblock.cpp -o poolbench
+//
+//   poolbench [-n channels] [-s seconds] [-l limit_mb] [-k keep_s] [-c cues]
+//
+//   -n  channels (default 16)
+//   -s  virtual seconds to run (default 3600)
+//   -l  pool limit in MB, 0 = none (default 0)
+//   -k  seconds idle buffers are kept (default 30)
+//   -c  cues timed for the page fault test (default 20)
+//######################################
+
+#include "framepool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <vector>
+
+struct FORMAT
+{
+	const char *pName;
+	int width;
+	int height;
+	int iBits;
+	bool bConvert;              // RGB sent as UYVY, needs the buffer even with zero copy
+};
+
+static const FORMAT g_Formats[] = {
+	{ "1080p UYVY",  1920, 1080, 16, false },
+	{ "1080p NV12",  1920, 1080, 12, false },
+	{ "1080p BGRA",  1920, 1080, 32, true  },
+	{ "2160p UYVY",  3840, 2160, 16, false },
+	{ "720p BGRX",   1280,  720, 32, true  },
+	{ "2160p BGRA",  3840, 2160, 32, true  },
+};
+static const int g_cFormats = sizeof(g_Formats) / sizeof(g_Formats[0]);
+
+struct CHANNEL
+{
+	const FORMAT *pFormat;
+	size_t cbBuffer;            // Two frames, as in async mode
+	uint8_t *pBuffer;
+	bool bRunning;
+	bool bEverRan;
+	FRAME_POOL_ACCOUNT Account;
+};
+
+static uint32_t g_uRandom = 1;
+
+static uint32_t Random (uint32_t uMax) {
+	g_uRandom = g_uRandom * 1664525 + 1013904223;
+	return (g_uRandom >> 8) % uMax;
+}
+
+static double Now () {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long MinorFaults () {
+	struct rusage Usage;
+	getrusage(RUSAGE_SELF, &Usage);
+	return Usage.ru_minflt;
+}
+
+//######################################
+// Accounts against the pool's totals
+//######################################
+static bool Check (const CFramePool *pPool, const std::vector<CHANNEL> &Channels) {
+	const FRAME_POOL_STATS *pStats = pPool->Stats();
+	uint64_t cbLent = 0;
+	for (size_t i = 0; i < Channels.size(); i++) {
+		cbLent += Channels[i].Account.cbLent;
+		if ((Channels[i].pBuffer != NULL) != (Channels[i].Account.cbLent != 0)) return false;
+	}
+	if (cbLent != pStats->cbLent || pStats->cbLent > pStats->cbAllocated) return false;
+	if (pStats->cbLimit && pStats->cbAllocated > pStats->cbLimit) return false;
+	return true;
+}
+
+//######################################
+// Channels start and stop at random, a few minutes at a time
+//######################################
+static bool RunChurn (int nChannels, int iSeconds, uint64_t cbLimit, uint64_t qwKeepMs) {
+	CFramePool Pool;
+	Pool.SetLimit(cbLimit);
+	Pool.SetKeep(qwKeepMs);
+
+	std::vector<CHANNEL> Channels(nChannels);
+	for (int i = 0; i < nChannels; i++) {
+		memset(&Channels[i], 0, sizeof(CHANNEL));
+		Channels[i].pFormat = &g_Formats[i % g_cFormats];
+		Channels[i].cbBuffer = 2 * (size_t)Channels[i].pFormat->width * Channels[i].pFormat->height * Channels[i].pFormat->iBits / 8;
+	}
+
+	uint64_t cbKeptForGood = 0;         // Per-instance buffers from their first start on
+	uint64_t cbKeptPeak = 0;
+	uint64_t cbNeededPeak = 0;          // What the running channels needed at once
+	uint64_t llStarts = 0;
+	bool bConsistent = true;
+
+	for (uint64_t qwNow = 0; qwNow < (uint64_t)iSeconds * 1000; qwNow += 1000) {
+		// Every second each channel may change state, on average every 3 minutes
+		for (int i = 0; i < nChannels; i++) {
+			CHANNEL *pChannel = &Channels[i];
+			if (Random(180) != 0) continue;
+
+			if (pChannel->bRunning) {
+				if (pChannel->pBuffer) Pool.Return(pChannel->pBuffer, qwNow, &pChannel->Account);
+				pChannel->pBuffer = NULL;
+				pChannel->bRunning = false;
+			}
+			else {
+				pChannel->pBuffer = Pool.Borrow(pChannel->cbBuffer, qwNow, &pChannel->Account);
+				pChannel->bRunning = true;
+				llStarts++;
+				if (!pChannel->bEverRan) cbKeptForGood += CFramePool::ClassSize(pChannel->cbBuffer);
+				pChannel->bEverRan = true;
+			}
+		}
+		Pool.Trim(qwNow, false);
+
+		uint64_t cbNeeded = 0;
+		for (int i = 0; i < nChannels; i++) {
+			if (Channels[i].bRunning) cbNeeded += CFramePool::ClassSize(Channels[i].cbBuffer);
+		}
+		if (cbNeeded > cbNeededPeak) cbNeededPeak = cbNeeded;
+		if (cbKeptForGood > cbKeptPeak) cbKeptPeak = cbKeptForGood;
+		bConsistent &= Check(&Pool, Channels);
+	}
+
+	const FRAME_POOL_STATS *pStats = Pool.Stats();
+	printf("%d channels, %d s, limit %llu MB, keep %llu s: %llu starts\n", nChannels, iSeconds,
+		(unsigned long long)(cbLimit >> 20), (unsigned long long)(qwKeepMs / 1000), (unsigned long long)llStarts);
+	printf("  kept per instance %llu MB, needed at once at most %llu MB, pool peak %llu MB, at the end %llu MB (%llu lent)\n",
+		(unsigned long long)(cbKeptPeak >> 20), (unsigned long long)(cbNeededPeak >> 20),
+		(unsigned long long)(pStats->cbPeak >> 20), (unsigned long long)(pStats->cbAllocated >> 20),
+		(unsigned long long)(pStats->cbLent >> 20));
+	printf("  %llu buffers allocated, %llu reused, %llu trimmed, %llu refused, %llu pages faulted in on allocation, accounts %s\n",
+		(unsigned long long)pStats->llAllocated, (unsigned long long)pStats->llReused, (unsigned long long)pStats->llTrimmed,
+		(unsigned long long)pStats->llRefused, (unsigned long long)pStats->llPagesFaulted, bConsistent ? "consistent" : "INCONSISTENT");
+
+	for (int i = 0; i < nChannels; i++) {
+		if (Channels[i].pBuffer) Pool.Return(Channels[i].pBuffer, (uint64_t)iSeconds * 1000, &Channels[i].Account);
+	}
+	return bConsistent;
+}
+
+//######################################
+// First frame after a cue, copied into a new allocation as the renderer
+// did before and into a buffer the pool kept from the last run
+//######################################
+static void RunCues (int nCues) {
+	const FORMAT *pFormat = &g_Formats[3];
+	size_t cbFrame = (size_t)pFormat->width * pFormat->height * pFormat->iBits / 8;
+	uint8_t *pSource = (uint8_t *)malloc(cbFrame);
+	memset(pSource, 0x80, cbFrame);
+
+	CFramePool Pool;
+	Pool.SetKeep(30000);
+	FRAME_POOL_ACCOUNT Account;
+	memset(&Account, 0, sizeof(Account));
+
+	double dFresh = 0, dPooled = 0;
+	long cFreshFaults = 0, cPooledFaults = 0;
+	for (int n = 0; n < nCues; n++) {
+		long cFaults = MinorFaults();
+		double dStart = Now();
+		uint8_t *pFresh = (uint8_t *)malloc(2 * cbFrame);
+		memcpy(pFresh, pSource, cbFrame);
+		dFresh += Now() - dStart;
+		cFreshFaults += MinorFaults() - cFaults;
+		free(pFresh);
+
+		// The pool borrows in Active, before the first frame
+		uint8_t *pPooled = Pool.Borrow(2 * cbFrame, n, &Account);
+		cFaults = MinorFaults();
+		dStart = Now();
+		memcpy(pPooled, pSource, cbFrame);
+		dPooled += Now() - dStart;
+		cPooledFaults += MinorFaults() - cFaults;
+		Pool.Return(pPooled, n, &Account);
+	}
+
+	printf("first %s frame after a cue, %d cues: fresh buffer %.2f ms and %ld page faults, pooled %.2f ms and %ld page faults\n",
+		pFormat->pName, nCues, dFresh * 1000 / nCues, cFreshFaults / nCues, dPooled * 1000 / nCues, cPooledFaults / nCues);
+	free(pSource);
+}
+
+int main (int argc, char **argv) {
+	int nChannels = 16;
+	int iSeconds = 3600;
+	int iLimit = 0;
+	int iKeep = 30;
+	int nCues = 20;
+
+	for (int iArg = 1; iArg < argc; iArg++) {
+		if (!strcmp(argv[iArg], "-n") && iArg + 1 < argc) nChannels = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-s") && iArg + 1 < argc) iSeconds = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-l") && iArg + 1 < argc) iLimit = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-k") && iArg + 1 < argc) iKeep = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-c") && iArg + 1 < argc) nCues = atoi(argv[++iArg]);
+		else {
+			fprintf(stderr, "usage: poolbench [-n channels] [-s seconds] [-l limit_mb] [-k keep_s] [-c cues]\n");
+			return 2;
+		}
+	}
+	if (nChannels < 1 || iSeconds < 1 || iLimit < 0 || iKeep < 0 || nCues < 1) {
+		fprintf(stderr, "poolbench: bad arguments\n");
+		return 2;
+	}
+
+	bool bPassed = RunChurn(nChannels, iSeconds, (uint64_t)iLimit << 20, (uint64_t)iKeep * 1000);
+	RunCues(nCues);
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+//######################################
+// queuebench
+// Compares CRingQueue with CQueue's semaphore and critical section design
+// under contention, one producer and one consumer and four of each, on a
+// queue of the default two objects and on a longer one. Needs POSIX threads:
+//
+//   g++ -O2 -std=c++11 -pthread -Ibaseclasses/source tools/queuebench.cpp -o queuebench
+//
+//   queuebench [-n objects]
+//
+// CQueue itself needs Windows, so it is rebuilt here one to one on POSIX
+// semaphores and a mutex. Every object is a distinct number, the consumers
+// sum what they got, and a run only counts if nothing was lost or doubled
+//######################################
+
+#include "ringq.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//######################################
+// CQueue from wxutil.h on POSIX primitives
+//######################################
+template <class T> class CSemaphoreQueue
+{
+public:
+	CSemaphoreQueue(int n) : m_nMax(n), m_iNextPut(0), m_iNextGet(0) {
+		pthread_mutex_init(&m_Lock, NULL);
+		sem_init(&m_SemPut, 0, n);
+		sem_init(&m_SemGet, 0, 0);
+		m_pObjects = new T[n];
+	}
+	~CSemaphoreQueue() {
+		delete [] m_pObjects;
+		sem_destroy(&m_SemGet);
+		sem_destroy(&m_SemPut);
+		pthread_mutex_destroy(&m_Lock);
+	}
+
+	T GetQueueObject() {
+		while (sem_wait(&m_SemGet)) {}
+		pthread_mutex_lock(&m_Lock);
+		T Object = m_pObjects[m_iNextGet++ % m_nMax];
+		pthread_mutex_unlock(&m_Lock);
+		sem_post(&m_SemPut);
+		return Object;
+	}
+
+	void PutQueueObject(T Object) {
+		while (sem_wait(&m_SemPut)) {}
+		pthread_mutex_lock(&m_Lock);
+		m_pObjects[m_iNextPut++ % m_nMax] = Object;
+		pthread_mutex_unlock(&m_Lock);
+		sem_post(&m_SemGet);
+	}
+
+private:
+	sem_t m_SemPut;
+	sem_t m_SemGet;
+	pthread_mutex_t m_Lock;
+	int m_nMax;
+	int m_iNextPut;
+	int m_iNextGet;
+	T *m_pObjects;
+};
+
+//######################################
+// Workload
+//######################################
+template <class QUEUE> struct WORKER
+{
+	QUEUE *pQueue;
+	long long llFirst;              // Producers put llFirst .. llFirst + llCount - 1
+	long long llCount;              // Consumers get llCount objects
+	long long llSum;
+};
+
+template <class QUEUE> static void *Produce (void *pArg) {
+	WORKER<QUEUE> *w = (WORKER<QUEUE> *)pArg;
+	for (long long i = 0; i < w->llCount; i++) w->pQueue->PutQueueObject((void *)(intptr_t)(w->llFirst + i));
+	return NULL;
+}
+
+template <class QUEUE> static void *Consume (void *pArg) {
+	WORKER<QUEUE> *w = (WORKER<QUEUE> *)pArg;
+	long long llSum = 0;
+	for (long long i = 0; i < w->llCount; i++) llSum += (intptr_t)w->pQueue->GetQueueObject();
+	w->llSum = llSum;
+	return NULL;
+}
+
+static double Now () {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns millions of objects per second, negative if the sum is off
+template <class QUEUE> static double Run (int nSize, int nThreads, long long llObjects) {
+	QUEUE Queue(nSize);
+	WORKER<QUEUE> Producers[8], Consumers[8];
+	pthread_t hProducers[8], hConsumers[8];
+	long long llPerThread = llObjects / nThreads;
+
+	double dStart = Now();
+	for (int i = 0; i < nThreads; i++) {
+		Consumers[i].pQueue = &Queue;
+		Consumers[i].llCount = llPerThread;
+		pthread_create(&hConsumers[i], NULL, Consume<QUEUE>, &Consumers[i]);
+	}
+	for (int i = 0; i < nThreads; i++) {
+		Producers[i].pQueue = &Queue;
+		Producers[i].llFirst = 1 + i * llPerThread;
+		Producers[i].llCount = llPerThread;
+		pthread_create(&hProducers[i], NULL, Produce<QUEUE>, &Producers[i]);
+	}
+	long long llSum = 0;
+	for (int i = 0; i < nThreads; i++) pthread_join(hProducers[i], NULL);
+	for (int i = 0; i < nThreads; i++) {
+		pthread_join(hConsumers[i], NULL);
+		llSum += Consumers[i].llSum;
+	}
+	double dSeconds = Now() - dStart;
+
+	long long llTotal = llPerThread * nThreads;
+	if (llSum != llTotal * (llTotal + 1) / 2) return -1;
+	return llTotal / dSeconds / 1e6;
+}
+
+int main (int argc, char **argv) {
+	long long llObjects = 1000000;
+	if (argc == 3 && !strcmp(argv[1], "-n")) llObjects = atoll(argv[2]);
+	if ((argc != 1 && argc != 3) || llObjects <= 0) {
+		fprintf(stderr, "usage: queuebench [-n objects]\n");
+		return 2;
+	}
+
+	static const int s_nSizes[] = { DEFAULT_QUEUESIZE, 64 };
+	static const int s_nThreads[] = { 1, 4 };
+	int iResult = 0;
+
+	printf("threads  size    semaphore M/s    ring M/s\n");
+	for (size_t t = 0; t < sizeof(s_nThreads) / sizeof(s_nThreads[0]); t++) {
+		for (size_t s = 0; s < sizeof(s_nSizes) / sizeof(s_nSizes[0]); s++) {
+			double dSemaphore = Run<CSemaphoreQueue<void *> >(s_nSizes[s], s_nThreads[t], llObjects);
+			double dRing = Run<CRingQueue<void *> >(s_nSizes[s], s_nThreads[t], llObjects);
+			if (dSemaphore < 0 || dRing < 0) iResult = 1;
+
+			printf("%3dP/%dC  %4d  %15.2f  %10.2f%s\n", s_nThreads[t], s_nThreads[t], s_nSizes[s],
+				dSemaphore, dRing, (dSemaphore < 0 || dRing < 0) ? "    LOST OBJECTS" : "");
+		}
+	}
+
+	return iResult;
+}
@@ -0,0 +1,129 @@
+//######################################
+// schedsim
+// Replays sample traces against the renderer's scheduling policies on a
+// virtual clock and reports drops, lateness and quality messages. Needs no
+// DirectShow, NDI or hardware:
+//
+//   g++ -O2 -Isource tools/schedsim.cpp source/schedsim.cpp source/schedpolicy.cpp -o schedsim
+//   cl /O2 /Isource tools\schedsim.cpp source\schedsim.cpp source\schedpolicy.cpp
+//
+//   schedsim [-p display|network|both] [-b budget_ms] [-u] [-q] trace...
+//
+//   -p  policy to run (default both)
+//   -b  lateness budget of the network policy in ms (default 40)
+//   -u  don't model NDI's clock_video pacing
+//   -q  print every quality message
+//
+// Reference traces are in release/assets/*.trace
+//######################################
+
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "schedsim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_QUALITY_LOG 100000
+
+static void PrintResult (const char *pTrace, CSchedulePolicy *pPolicy, const SIM_RESULT *r, double dSeconds) {
+	double dStream = r->rtEnd / (double)POLICY_UNITS;
+
+	printf("%s, %s policy\n", pTrace, pPolicy->Name());
+	printf("  samples %d, sent %d, dropped %d (%.2f%%)\n",
+		r->cSamples, r->cSent, r->cDropped, r->cSamples ? 100.0 * r->cDropped / r->cSamples : 0.0);
+	printf("  late: mean %.2f ms, max %.2f ms, earliest %.2f ms ahead\n",
+		r->cSent ? r->rtLateSum / 10000.0 / r->cSent : 0.0, r->rtLateMax / 10000.0, r->rtEarlyMax / 10000.0);
+	printf("  quality messages %d, proportion %ld..%ld\n", r->cQuality, r->lProportionMin, r->lProportionMax);
+	if (dSeconds > 0) {
+		printf("  %.1f s of stream in %.3f ms, %.0fx real time\n", dStream, dSeconds * 1000, dStream / dSeconds);
+	}
+
+	printf("  lateness histogram (ms, sent samples)\n");
+	for (int i = 0; i < SIM_LATE_BUCKETS; i++) {
+		if (!r->cLate[i]) continue;
+		int iFrom = (SIM_LATE_MIN + i * SIM_LATE_BUCKET) / 10000;
+		const char *pFrom = (i == 0) ? "<" : " ";
+		const char *pTo = (i == SIM_LATE_BUCKETS - 1) ? "+" : " ";
+		printf("   %s%5d%s %6d\n", pFrom, i == 0 ? iFrom + SIM_LATE_BUCKET / 10000 : iFrom, pTo, r->cLate[i]);
+	}
+}
+
+int main (int argc, char **argv) {
+	const char *pPolicyName = "both";
+	int iBudget = 40;
+	bool bClockVideo = true;
+	bool bPrintQuality = false;
+	int iArg = 1;
+
+	for (; iArg < argc && argv[iArg][0] == '-'; iArg++) {
+		if (!strcmp(argv[iArg], "-p") && iArg + 1 < argc) pPolicyName = argv[++iArg];
+		else if (!strcmp(argv[iArg], "-b") && iArg + 1 < argc) iBudget = atoi(argv[++iArg]);
+		else if (!strcmp(argv[iArg], "-u")) bClockVideo = false;
+		else if (!strcmp(argv[iArg], "-q")) bPrintQuality = true;
+		else break;
+	}
+	if (iArg >= argc) {
+		fprintf(stderr, "usage: schedsim [-p display|network|both] [-b budget_ms] [-u] [-q] trace...\n");
+		return 2;
+	}
+
+	CNetworkSinkPolicy Network;
+	Network.SetLatenessBudget((int64_t)iBudget * 10000);
+	Network.SetClocked(bClockVideo);
+	CDisplayPolicy Display;
+
+	CSchedulePolicy *pPolicies[2];
+	int cPolicies = 0;
+	if (strcmp(pPolicyName, "network")) pPolicies[cPolicies++] = &Display;
+	if (strcmp(pPolicyName, "display")) pPolicies[cPolicies++] = &Network;
+
+	QUALITY_MSG *pQualityLog = bPrintQuality ? (QUALITY_MSG *)malloc(MAX_QUALITY_LOG * sizeof(QUALITY_MSG)) : NULL;
+
+	int iResult = 0;
+	for (; iArg < argc; iArg++) {
+		int cSamples;
+		SIM_SAMPLE *pTrace = LoadSimTrace(argv[iArg], &cSamples);
+		if (!pTrace) {
+			fprintf(stderr, "%s: can't read trace\n", argv[iArg]);
+			iResult = 1;
+			continue;
+		}
+
+		for (int i = 0; i < cPolicies; i++) {
+			SIM_PARAMS Params;
+			Params.bClockVideo = bClockVideo;
+			Params.pQualityLog = pQualityLog;
+			Params.cQualityLog = pQualityLog ? MAX_QUALITY_LOG : 0;
+
+			// Repeat short traces so the timing means something
+			SIM_RESULT Result;
+			int nRuns = 0;
+			clock_t tStart = clock();
+			do {
+				SimulateSchedule(pTrace, cSamples, &Params, pPolicies[i], &Result);
+				nRuns++;
+			} while (clock() - tStart < CLOCKS_PER_SEC / 10);
+			double dSeconds = (double)(clock() - tStart) / CLOCKS_PER_SEC / nRuns;
+
+			PrintResult(argv[iArg], pPolicies[i], &Result, dSeconds);
+
+			if (pQualityLog) {
+				printf("  quality messages (time ms, type, proportion, late ms)\n");
+				int cLogged = Result.cQuality < MAX_QUALITY_LOG ? Result.cQuality : MAX_QUALITY_LOG;
+				for (int q = 0; q < cLogged; q++) {
+					printf("   %10.2f %-6s %5ld %8.2f\n", pQualityLog[q].TimeStamp / 10000.0,
+						pQualityLog[q].Type ? "Flood" : "Famine", pQualityLog[q].Proportion, pQualityLog[q].Late / 10000.0);
+				}
+			}
+		}
+
+		free(pTrace);
+	}
+
+	free(pQualityLog);
+	return iResult;
+}